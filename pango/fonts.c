@@ -60,8 +60,11 @@ struct _PangoFontDescription
   guint static_family : 1;
   guint static_variations : 1;
   guint size_is_absolute : 1;
+  guint interned : 1;
 
   int size;
+
+  guint hash;			/* only valid if interned */
 };
 
 G_DEFINE_BOXED_TYPE (PangoFontDescription, pango_font_description,
@@ -82,8 +85,11 @@ static const PangoFontDescription pfd_defaults = {
   0,			/* static_family */
   0,			/* static_variations*/
   0,    		/* size_is_absolute */
+  0,			/* interned */
 
   0,			/* size */
+
+  0,			/* hash */
 };
 
 /**
@@ -808,6 +814,7 @@ pango_font_description_copy  (const PangoFontDescription  *desc)
 
   result->variations = g_strdup (result->variations);
   result->static_variations = FALSE;
+  result->interned = FALSE;
 
   return result;
 }
@@ -844,6 +851,8 @@ pango_font_description_copy_static (const PangoFontDescription *desc)
   if (result->variations)
     result->static_variations = TRUE;
 
+  result->interned = FALSE;
+
   return result;
 }
 
@@ -868,6 +877,15 @@ pango_font_description_equal (const PangoFontDescription  *desc1,
   g_return_val_if_fail (desc1 != NULL, FALSE);
   g_return_val_if_fail (desc2 != NULL, FALSE);
 
+  if (desc1 == desc2)
+    return TRUE;
+
+  /* Interned descriptions have their hash precomputed,
+   * see intern_from_string()
+   */
+  if (desc1->interned && desc2->interned && desc1->hash != desc2->hash)
+    return FALSE;
+
   return desc1->style == desc2->style &&
 	 desc1->variant == desc2->variant &&
 	 desc1->weight == desc2->weight &&
@@ -915,6 +933,9 @@ pango_font_description_hash (const PangoFontDescription *desc)
 
   g_return_val_if_fail (desc != NULL, 0);
 
+  if (desc->interned)
+    return desc->hash;
+
   if (desc->family_name)
     hash = case_insensitive_hash (desc->family_name);
   if (desc->variations)
@@ -934,12 +955,13 @@ pango_font_description_hash (const PangoFontDescription *desc)
  * pango_font_description_free:
  * @desc: (nullable): a #PangoFontDescription, may be %NULL
  *
- * Frees a font description.
+ * Frees a font description. Font descriptions returned by
+ * pango_font_description_from_string_interned() are left alone.
  **/
 void
 pango_font_description_free  (PangoFontDescription  *desc)
 {
-  if (desc == NULL)
+  if (desc == NULL || desc->interned)
     return;
 
   if (desc->family_name && !desc->static_family)
@@ -1357,6 +1379,135 @@ pango_font_description_from_string (const char *str)
   return desc;
 }
 
+/* Interned font descriptions are parsed once and live until
+ * the process exits. Equal descriptions (including the mask and
+ * the case of the family name) are shared.
+ *
+ * Strings from markup are only added while the cache is small,
+ * and only if they are short, since they may come from untrusted
+ * input.
+ */
+#define MAX_INTERNED_FOR_LOOKUP 1024
+#define MAX_INTERNED_LENGTH_FOR_LOOKUP 64
+
+G_LOCK_DEFINE_STATIC (interned);
+static GHashTable *interned_strings; /* string -> description */
+static GHashTable *interned_descs;   /* description -> itself */
+
+static guint
+interned_desc_hash (gconstpointer key)
+{
+  const PangoFontDescription *desc = key;
+
+  return pango_font_description_hash (desc) ^ desc->mask;
+}
+
+static gboolean
+interned_desc_equal (gconstpointer a,
+                     gconstpointer b)
+{
+  const PangoFontDescription *desc1 = a;
+  const PangoFontDescription *desc2 = b;
+
+  /* pango_font_description_equal() ignores the case of the
+   * family name, but we must give back the spelling we got
+   */
+  return desc1->mask == desc2->mask &&
+         g_strcmp0 (desc1->family_name, desc2->family_name) == 0 &&
+         pango_font_description_equal (desc1, desc2);
+}
+
+static const PangoFontDescription *
+intern_from_string (const char *str,
+                    gboolean    bounded)
+{
+  PangoFontDescription *desc;
+
+  G_LOCK (interned);
+
+  if (G_UNLIKELY (!interned_strings))
+    {
+      interned_strings = g_hash_table_new (g_str_hash, g_str_equal);
+      interned_descs = g_hash_table_new (interned_desc_hash, interned_desc_equal);
+    }
+
+  desc = g_hash_table_lookup (interned_strings, str);
+  if (!desc &&
+      (!bounded ||
+       (g_hash_table_size (interned_strings) < MAX_INTERNED_FOR_LOOKUP &&
+        strlen (str) <= MAX_INTERNED_LENGTH_FOR_LOOKUP)))
+    {
+      PangoFontDescription *parsed;
+
+      parsed = pango_font_description_from_string (str);
+
+      desc = g_hash_table_lookup (interned_descs, parsed);
+      if (desc)
+        pango_font_description_free (parsed);
+      else
+        {
+          desc = parsed;
+          desc->hash = pango_font_description_hash (desc);
+          desc->interned = TRUE;
+          g_hash_table_add (interned_descs, desc);
+        }
+
+      g_hash_table_insert (interned_strings, g_strdup (str), desc);
+    }
+
+  G_UNLOCK (interned);
+
+  return desc;
+}
+
+/**
+ * pango_font_description_from_string_interned:
+ * @str: string representation of a font description.
+ *
+ * Like pango_font_description_from_string(), but each distinct
+ * string is only parsed once, and the result is shared between
+ * all callers. Strings that describe the same font, with the
+ * family name spelled the same way, share the same result as well.
+ *
+ * This is meant for the small set of font descriptions that
+ * applications and themes use over and over. The results are never
+ * freed, so don't use it for strings that come from untrusted input.
+ *
+ * Comparing and hashing the returned font description with
+ * pango_font_description_equal() and pango_font_description_hash()
+ * is cheap, and pango_attr_font_desc_new() only makes a shallow
+ * copy of it.
+ *
+ * Return value: (transfer none): a shared #PangoFontDescription.
+ *   It must not be modified or freed. Use pango_font_description_copy()
+ *   to get a description that can be modified.
+ *
+ * Since: 1.50
+ **/
+const PangoFontDescription *
+pango_font_description_from_string_interned (const char *str)
+{
+  g_return_val_if_fail (str != NULL, NULL);
+
+  return intern_from_string (str, FALSE);
+}
+
+/* Like pango_font_description_from_string_interned(), but returns
+ * %NULL instead of growing the cache past a fixed size or adding
+ * long strings to it, so that it can be used for strings from markup.
+ */
+const PangoFontDescription *
+_pango_font_description_lookup_interned (const char *str)
+{
+  return intern_from_string (str, TRUE);
+}
+
+gboolean
+_pango_font_description_is_interned (const PangoFontDescription *desc)
+{
+  return desc->interned;
+}
+
 static void
 append_field (GString *str, const char *what, const FieldMap *map, int n_elements, int val)
 {
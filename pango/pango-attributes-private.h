@@ -32,16 +32,63 @@ struct _PangoAttrIterator
   guint end_index;
 };
 
+typedef struct _PangoAttrArena PangoAttrArena;
+
+/* @attributes is sorted by start index. Attributes that are
+ * inserted out of order go to @pending first, and are merged
+ * into @attributes before the list is next looked at.
+ *
+ * @max_ends holds an upper bound for the end index of each
+ * block of ATTR_BLOCK_SIZE attributes in @attributes, so that
+ * attributes that end before a position can be skipped a block
+ * at a time. It is built on demand, and dropped when the
+ * indices change wholesale.
+ *
+ * Lists that are no longer modified may be read from several
+ * threads, so readers don't sort @pending or build @max_ends
+ * themselves, but through attr_list_prepare(), which does it
+ * once under a lock and then sets @ready. Changing @pending or
+ * dropping @max_ends clears @ready.
+ *
+ * @arena holds the memory of attributes that were added with a
+ * #PangoAttrListBuilder. Destroying those attributes does nothing,
+ * the memory goes away with the last list that uses the arena.
+ *
+ * A list with @is_view set borrows its attributes from another
+ * list, see _pango_attr_list_init_views(), and does not destroy
+ * them.
+ */
 struct _PangoAttrList
 {
   guint ref_count;
   GPtrArray *attributes;
+  GArray *pending;
+  int pending_seq;
+  GArray *max_ends;
+  int ready;
+  PangoAttrArena *arena;
+  gboolean is_view;
 };
 
+/* Custom attribute types all share the last bit */
+#define PANGO_ATTR_TYPE_BIT(type) (G_GUINT64_CONSTANT (1) << MIN ((guint) (type), 63))
+
 void     _pango_attr_list_init         (PangoAttrList     *list);
 void     _pango_attr_list_destroy      (PangoAttrList     *list);
 gboolean _pango_attr_list_has_attributes (const PangoAttrList *list);
 
+void     _pango_attr_list_init_views   (PangoAttrList     *list,
+                                        PangoAttribute   **extra,
+                                        guint              n_extra,
+                                        const guint64     *masks,
+                                        PangoAttrList     *views,
+                                        guint              n_views);
+
+void     _pango_attr_list_get_overlapping (PangoAttrList *list,
+                                           guint          start_index,
+                                           guint          end_index,
+                                           GPtrArray     *attrs);
+
 void     _pango_attr_list_get_iterator (PangoAttrList     *list,
                                         PangoAttrIterator *iterator);
 
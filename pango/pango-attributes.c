@@ -35,6 +35,7 @@
 
 #include "pango-attributes.h"
 #include "pango-attributes-private.h"
+#include "pango-font-private.h"
 #include "pango-impl-utils.h"
 
 static PangoAttribute *pango_attr_color_new         (const PangoAttrClass *klass,
@@ -712,7 +713,14 @@ pango_attr_font_desc_new (const PangoFontDescription *desc)
 
   PangoAttrFontDesc *result = g_slice_new (PangoAttrFontDesc);
   pango_attribute_init (&result->attr, &klass);
-  result->desc = pango_font_description_copy (desc);
+  /* The attribute owns a description that it may modify, but
+   * the strings of interned descriptions are never freed, so
+   * they don't need to be copied
+   */
+  if (_pango_font_description_is_interned (desc))
+    result->desc = pango_font_description_copy_static (desc);
+  else
+    result->desc = pango_font_description_copy (desc);
 
   return (PangoAttribute *)result;
 }
@@ -1306,11 +1314,295 @@ G_DEFINE_BOXED_TYPE (PangoAttrList, pango_attr_list,
                      pango_attr_list_copy,
                      pango_attr_list_unref);
 
+#define ATTR_BLOCK_SHIFT 5
+#define ATTR_BLOCK_SIZE (1 << ATTR_BLOCK_SHIFT)
+
+typedef struct {
+  PangoAttribute *attr;
+  int seq;
+} PendingAttr;
+
+/* Chunks start small, since many lists only have a few attributes,
+ * and double in size up to the maximum
+ */
+#define ATTR_ARENA_MIN_CHUNK_SIZE 512
+#define ATTR_ARENA_MAX_CHUNK_SIZE 65536
+#define N_ARENA_TYPES (PANGO_ATTR_OVERLINE_COLOR + 1)
+
+/* Attributes in an arena have a class that wraps the class
+ * of the same attribute type, except that destroying them
+ * does nothing, and copies are regular attributes.
+ */
+typedef struct {
+  PangoAttrClass klass;
+  const PangoAttrClass *base;
+  gboolean color;
+} ArenaAttrClass;
+
+struct _PangoAttrArena
+{
+  int ref_count;
+  GSList *chunks;
+  gsize chunk_size; /* of the first chunk */
+  gsize used; /* in the first chunk */
+  ArenaAttrClass classes[N_ARENA_TYPES];
+};
+
+static PangoAttrArena *
+attr_arena_ref (PangoAttrArena *arena)
+{
+  g_atomic_int_inc (&arena->ref_count);
+
+  return arena;
+}
+
+static void
+attr_arena_unref (PangoAttrArena *arena)
+{
+  if (!g_atomic_int_dec_and_test (&arena->ref_count))
+    return;
+
+  g_slist_free_full (arena->chunks, g_free);
+  g_free (arena);
+}
+
 void
 _pango_attr_list_init (PangoAttrList *list)
 {
   list->ref_count = 1;
   list->attributes = NULL;
+  list->pending = NULL;
+  list->pending_seq = 0;
+  list->max_ends = NULL;
+  list->ready = FALSE;
+  list->arena = NULL;
+  list->is_view = FALSE;
+}
+
+static void
+attr_list_drop_index (PangoAttrList *list)
+{
+  g_atomic_int_set (&list->ready, FALSE);
+
+  if (list->max_ends)
+    {
+      g_array_free (list->max_ends, TRUE);
+      list->max_ends = NULL;
+    }
+}
+
+static void
+attr_list_build_index (PangoAttrList *list)
+{
+  guint i;
+
+  list->max_ends = g_array_new (FALSE, TRUE, sizeof (guint));
+  g_array_set_size (list->max_ends, (list->attributes->len + ATTR_BLOCK_SIZE - 1) >> ATTR_BLOCK_SHIFT);
+
+  for (i = 0; i < list->attributes->len; i++)
+    {
+      PangoAttribute *attr = g_ptr_array_index (list->attributes, i);
+      guint *max_end = &g_array_index (list->max_ends, guint, i >> ATTR_BLOCK_SHIFT);
+
+      *max_end = MAX (*max_end, attr->end_index);
+    }
+}
+
+/* Records that the attribute at position @i may end at @end_index */
+static inline void
+attr_list_index_add (PangoAttrList *list,
+                     guint          i,
+                     guint          end_index)
+{
+  guint *max_end;
+
+  if (!list->max_ends)
+    return;
+
+  if ((i >> ATTR_BLOCK_SHIFT) >= list->max_ends->len)
+    g_array_set_size (list->max_ends, (i >> ATTR_BLOCK_SHIFT) + 1);
+
+  max_end = &g_array_index (list->max_ends, guint, i >> ATTR_BLOCK_SHIFT);
+  *max_end = MAX (*max_end, end_index);
+}
+
+static void
+attr_list_insert_at (PangoAttrList  *list,
+                     guint           i,
+                     PangoAttribute *attr)
+{
+  guint k;
+
+  g_ptr_array_insert (list->attributes, i, attr);
+
+  if (!list->max_ends)
+    return;
+
+  /* Each later block gains the last attribute of the one before */
+  for (k = (i >> ATTR_BLOCK_SHIFT) + 1; (k << ATTR_BLOCK_SHIFT) < list->attributes->len; k++)
+    {
+      PangoAttribute *moved = g_ptr_array_index (list->attributes, k << ATTR_BLOCK_SHIFT);
+
+      attr_list_index_add (list, k << ATTR_BLOCK_SHIFT, moved->end_index);
+    }
+
+  attr_list_index_add (list, i, attr->end_index);
+}
+
+static void
+attr_list_remove_at (PangoAttrList *list,
+                     guint          i)
+{
+  guint k;
+
+  g_ptr_array_remove_index (list->attributes, i);
+
+  if (!list->max_ends)
+    return;
+
+  /* Each block from here on gains the first attribute of the next */
+  for (k = i >> ATTR_BLOCK_SHIFT; ((k + 1) << ATTR_BLOCK_SHIFT) <= list->attributes->len; k++)
+    {
+      PangoAttribute *moved = g_ptr_array_index (list->attributes, ((k + 1) << ATTR_BLOCK_SHIFT) - 1);
+
+      attr_list_index_add (list, ((k + 1) << ATTR_BLOCK_SHIFT) - 1, moved->end_index);
+    }
+}
+
+/* Returns the position for an attribute starting at @start_index:
+ * after all attributes that start at or before it, or, if @before
+ * is %TRUE, before all attributes that start at it.
+ */
+static guint
+attr_list_bisect (PangoAttrList *list,
+                  guint          start_index,
+                  gboolean       before)
+{
+  guint lo = 0, hi = list->attributes->len;
+
+  while (lo < hi)
+    {
+      guint mid = lo + (hi - lo) / 2;
+      PangoAttribute *attr = g_ptr_array_index (list->attributes, mid);
+
+      if (attr->start_index < start_index ||
+          (!before && attr->start_index == start_index))
+        lo = mid + 1;
+      else
+        hi = mid;
+    }
+
+  return lo;
+}
+
+static void
+attr_list_insert_sorted (PangoAttrList  *list,
+                         PangoAttribute *attr,
+                         gboolean        before)
+{
+  if (G_UNLIKELY (!list->attributes))
+    list->attributes = g_ptr_array_new ();
+
+  attr_list_insert_at (list, attr_list_bisect (list, attr->start_index, before), attr);
+}
+
+static int
+pending_attr_compare (gconstpointer a,
+                      gconstpointer b)
+{
+  const PendingAttr *pa = a;
+  const PendingAttr *pb = b;
+
+  if (pa->attr->start_index != pb->attr->start_index)
+    return pa->attr->start_index < pb->attr->start_index ? -1 : 1;
+
+  return pa->seq < pb->seq ? -1 : (pa->seq > pb->seq ? 1 : 0);
+}
+
+/* Merges the pending attributes into the sorted array.
+ *
+ * Pending attributes that were inserted with insert_before()
+ * have negative sequence numbers that decrease with each
+ * insertion, the others have increasing positive ones. Sorting
+ * by start index and sequence number, and putting all sorted
+ * attributes after the negative and before the positive ones
+ * with the same start index, gives the same order as if every
+ * attribute had been inserted in place right away.
+ */
+static void
+attr_list_sort (PangoAttrList *list)
+{
+  GPtrArray *merged;
+  PendingAttr *pending;
+  guint i, j, n_sorted, n_pending;
+
+  if (G_LIKELY (!list->pending || list->pending->len == 0))
+    return;
+
+  if (G_UNLIKELY (!list->attributes))
+    list->attributes = g_ptr_array_new ();
+
+  g_array_sort (list->pending, pending_attr_compare);
+
+  pending = (PendingAttr *) list->pending->data;
+  n_pending = list->pending->len;
+  n_sorted = list->attributes->len;
+
+  merged = g_ptr_array_sized_new (n_sorted + n_pending);
+
+  for (i = 0, j = 0; i < n_sorted || j < n_pending; )
+    {
+      PangoAttribute *attr = i < n_sorted ? g_ptr_array_index (list->attributes, i) : NULL;
+
+      if (j < n_pending &&
+          (attr == NULL ||
+           pending[j].attr->start_index < attr->start_index ||
+           (pending[j].attr->start_index == attr->start_index && pending[j].seq < 0)))
+        g_ptr_array_add (merged, pending[j++].attr);
+      else
+        {
+          g_ptr_array_add (merged, attr);
+          i++;
+        }
+    }
+
+  g_ptr_array_free (list->attributes, TRUE);
+  list->attributes = merged;
+
+  g_array_set_size (list->pending, 0);
+  list->pending_seq = 0;
+
+  attr_list_drop_index (list);
+}
+
+G_LOCK_DEFINE_STATIC (attr_list_prepare);
+
+/* Sorts @list and builds its index for functions that only read
+ * it. Those may run in several threads at once, so this is done
+ * under a lock, and only once until @list is modified again.
+ */
+static void
+attr_list_prepare (PangoAttrList *list)
+{
+  if (G_LIKELY (g_atomic_int_get (&list->ready)))
+    return;
+
+  G_LOCK (attr_list_prepare);
+
+  if (!list->ready)
+    {
+      attr_list_sort (list);
+
+      /* Writers only keep an index up to date that exists */
+      if (!list->attributes)
+        list->attributes = g_ptr_array_new ();
+      if (!list->max_ends)
+        attr_list_build_index (list);
+
+      g_atomic_int_set (&list->ready, TRUE);
+    }
+
+  G_UNLOCK (attr_list_prepare);
 }
 
 /**
@@ -1357,17 +1649,130 @@ _pango_attr_list_destroy (PangoAttrList *list)
 {
   guint i, p;
 
-  if (!list->attributes)
-    return;
+  if (list->pending)
+    {
+      for (i = 0, p = list->pending->len; i < p; i++)
+        {
+          PangoAttribute *attr = g_array_index (list->pending, PendingAttr, i).attr;
 
-  for (i = 0, p = list->attributes->len; i < p; i++)
+          attr->klass->destroy (attr);
+        }
+
+      g_array_free (list->pending, TRUE);
+    }
+
+  attr_list_drop_index (list);
+
+  if (list->attributes)
     {
-      PangoAttribute *attr = g_ptr_array_index (list->attributes, i);
+      /* Views don't own their attributes */
+      if (!list->is_view)
+        for (i = 0, p = list->attributes->len; i < p; i++)
+          {
+            PangoAttribute *attr = g_ptr_array_index (list->attributes, i);
 
-      attr->klass->destroy (attr);
+            attr->klass->destroy (attr);
+          }
+
+      g_ptr_array_free (list->attributes, TRUE);
     }
 
-  g_ptr_array_free (list->attributes, TRUE);
+  if (list->arena)
+    attr_arena_unref (list->arena);
+}
+
+/* Splits @list into @n_views lists in one pass, without copying
+ * any attributes. Each view gets the attributes whose type bit
+ * (see PANGO_ATTR_TYPE_BIT()) is set in its mask, in the order
+ * of @list. The @extra attributes go in front of the others, so
+ * they must start at index 0. @list may be %NULL.
+ *
+ * The views borrow the attributes, so they are only good while
+ * @list and @extra are alive and unchanged. Free them with
+ * _pango_attr_list_destroy().
+ */
+void
+_pango_attr_list_init_views (PangoAttrList   *list,
+                             PangoAttribute **extra,
+                             guint            n_extra,
+                             const guint64   *masks,
+                             PangoAttrList   *views,
+                             guint            n_views)
+{
+  guint i, j, n_attrs;
+
+  for (j = 0; j < n_views; j++)
+    {
+      _pango_attr_list_init (&views[j]);
+      views[j].is_view = TRUE;
+    }
+
+  if (list)
+    attr_list_prepare (list);
+
+  n_attrs = list && list->attributes ? list->attributes->len : 0;
+
+  for (i = 0; i < n_extra + n_attrs; i++)
+    {
+      PangoAttribute *attr;
+      guint64 bit;
+
+      if (i < n_extra)
+        attr = extra[i];
+      else
+        attr = g_ptr_array_index (list->attributes, i - n_extra);
+
+      bit = PANGO_ATTR_TYPE_BIT (attr->klass->type);
+
+      for (j = 0; j < n_views; j++)
+        {
+          if ((masks[j] & bit) == 0)
+            continue;
+
+          if (G_UNLIKELY (!views[j].attributes))
+            views[j].attributes = g_ptr_array_new ();
+
+          g_ptr_array_add (views[j].attributes, attr);
+        }
+    }
+}
+
+/* Appends the attributes of @list that overlap the range from
+ * @start_index to @end_index to @attrs, in the order of @list.
+ * @list must be sorted, like the views above.
+ */
+void
+_pango_attr_list_get_overlapping (PangoAttrList *list,
+                                  guint          start_index,
+                                  guint          end_index,
+                                  GPtrArray     *attrs)
+{
+  guint i, n;
+
+  attr_list_prepare (list);
+
+  if (!list->attributes || list->attributes->len == 0)
+    return;
+
+  /* Everything from here on starts too late */
+  n = attr_list_bisect (list, end_index, TRUE);
+
+  for (i = 0; i < n; i++)
+    {
+      PangoAttribute *attr;
+
+      /* Skip blocks of attributes that end too early */
+      if ((i & (ATTR_BLOCK_SIZE - 1)) == 0 &&
+          g_array_index (list->max_ends, guint, i >> ATTR_BLOCK_SHIFT) <= start_index)
+        {
+          i += ATTR_BLOCK_SIZE - 1;
+          continue;
+        }
+
+      attr = g_ptr_array_index (list->attributes, i);
+      if (attr->end_index > start_index)
+        g_ptr_array_add (attrs, attr);
+    }
 }
 
 /**
@@ -1413,6 +1818,9 @@ pango_attr_list_copy (PangoAttrList *list)
     return NULL;
 
   new = pango_attr_list_new ();
+
+  attr_list_prepare (list);
+
   if (!list->attributes || list->attributes->len == 0)
     return new;
 
@@ -1428,41 +1836,38 @@ pango_attr_list_insert_internal (PangoAttrList  *list,
 {
   const guint start_index = attr->start_index;
   PangoAttribute *last_attr;
+  PendingAttr pending;
 
   if (G_UNLIKELY (!list->attributes))
     list->attributes = g_ptr_array_new ();
 
-  if (list->attributes->len == 0)
-    {
-      g_ptr_array_add (list->attributes, attr);
-      return;
-    }
-
-  g_assert (list->attributes->len > 0);
-
-  last_attr = g_ptr_array_index (list->attributes, list->attributes->len - 1);
-
-  if (last_attr->start_index < start_index ||
-      (!before && last_attr->start_index == start_index))
+  if (!list->pending || list->pending->len == 0)
     {
-      g_ptr_array_add (list->attributes, attr);
-    }
-  else
-    {
-      guint i, p;
+      if (list->attributes->len > 0)
+        last_attr = g_ptr_array_index (list->attributes, list->attributes->len - 1);
+      else
+        last_attr = NULL;
 
-      for (i = 0, p = list->attributes->len; i < p; i++)
+      if (last_attr == NULL ||
+          last_attr->start_index < start_index ||
+          (!before && last_attr->start_index == start_index))
         {
-          PangoAttribute *cur = g_ptr_array_index (list->attributes, i);
-
-          if (cur->start_index > start_index ||
-              (before && cur->start_index == start_index))
-            {
-              g_ptr_array_insert (list->attributes, i, attr);
-              break;
-            }
+          g_ptr_array_add (list->attributes, attr);
+          attr_list_index_add (list, list->attributes->len - 1, attr->end_index);
+          return;
         }
     }
+
+  /* Out of order, sort it in when the list is next used */
+  if (G_UNLIKELY (!list->pending))
+    list->pending = g_array_new (FALSE, FALSE, sizeof (PendingAttr));
+
+  g_atomic_int_set (&list->ready, FALSE);
+
+  list->pending_seq++;
+  pending.attr = attr;
+  pending.seq = before ? - list->pending_seq : list->pending_seq;
+  g_array_append_val (list->pending, pending);
 }
 
 /**
@@ -1525,7 +1930,7 @@ void
 pango_attr_list_change (PangoAttrList  *list,
                         PangoAttribute *attr)
 {
-  guint i, p;
+  guint i, attr_pos;
   guint start_index = attr->start_index;
   guint end_index = attr->end_index;
   gboolean inserted;
@@ -1538,20 +1943,40 @@ pango_attr_list_change (PangoAttrList  *list,
       return;
     }
 
+  attr_list_sort (list);
+
   if (!list->attributes || list->attributes->len == 0)
     {
       pango_attr_list_insert (list, attr);
       return;
     }
 
+  if (!list->max_ends)
+    attr_list_build_index (list);
+
   inserted = FALSE;
-  for (i = 0, p = list->attributes->len; i < p; i++)
+  attr_pos = 0;
+  for (i = 0; i < list->attributes->len; i++)
     {
-      PangoAttribute *tmp_attr = g_ptr_array_index (list->attributes, i);
+      PangoAttribute *tmp_attr;
+
+      /* Skip blocks of attributes that end before the new one */
+      if ((i & (ATTR_BLOCK_SIZE - 1)) == 0)
+        {
+          while (i < list->attributes->len &&
+                 g_array_index (list->max_ends, guint, i >> ATTR_BLOCK_SHIFT) < start_index)
+            i += ATTR_BLOCK_SIZE;
+
+          if (i >= list->attributes->len)
+            break;
+        }
+
+      tmp_attr = g_ptr_array_index (list->attributes, i);
 
       if (tmp_attr->start_index > start_index)
         {
-          g_ptr_array_insert (list->attributes, i, attr);
+          attr_list_insert_at (list, i, attr);
+          attr_pos = i;
           inserted = TRUE;
           break;
         }
@@ -1579,9 +2004,11 @@ pango_attr_list_change (PangoAttrList  *list,
             }
 
           tmp_attr->end_index = end_index;
+          attr_list_index_add (list, i, end_index);
           pango_attribute_destroy (attr);
 
           attr = tmp_attr;
+          attr_pos = i;
           inserted = TRUE;
           break;
         }
@@ -1594,13 +2021,13 @@ pango_attr_list_change (PangoAttrList  *list,
               PangoAttribute *end_attr = pango_attribute_copy (tmp_attr);
 
               end_attr->start_index = end_index;
-              pango_attr_list_insert (list, end_attr);
+              attr_list_insert_sorted (list, end_attr, FALSE);
             }
 
           if (tmp_attr->start_index == start_index)
             {
               pango_attribute_destroy (tmp_attr);
-              g_ptr_array_remove_index (list->attributes, i);
+              attr_list_remove_at (list, i);
               break;
             }
           else
@@ -1613,14 +2040,13 @@ pango_attr_list_change (PangoAttrList  *list,
   if (!inserted)
     {
       /* we didn't insert attr yet */
-      pango_attr_list_insert (list, attr);
+      attr_list_insert_sorted (list, attr, FALSE);
       return;
     }
 
   /* We now have the range inserted into the list one way or the
    * other. Fix up the remainder */
-  /* Attention: No i = 0 here. */
-  for (i = i + 1, p = list->attributes->len; i < p; i++)
+  for (i = attr_pos + 1; i < list->attributes->len; i++)
     {
       PangoAttribute *tmp_attr = g_ptr_array_index (list->attributes, i);
 
@@ -1635,10 +2061,10 @@ pango_attr_list_change (PangoAttrList  *list,
         {
           /* We can merge the new attribute with this attribute. */
           attr->end_index = MAX (end_index, tmp_attr->end_index);
+          attr_list_index_add (list, attr_pos, attr->end_index);
           pango_attribute_destroy (tmp_attr);
-          g_ptr_array_remove_index (list->attributes, i);
+          attr_list_remove_at (list, i);
           i--;
-          p--;
           continue;
         }
       else
@@ -1648,17 +2074,26 @@ pango_attr_list_change (PangoAttrList  *list,
            * it in the list to maintain the required non-decreasing
            * order of start indices
            */
-          int k, m;
+          guint k;
 
           tmp_attr->start_index = attr->end_index;
 
-          for (k = i + 1, m = list->attributes->len; k < m; k++)
+          for (k = i + 1; k < list->attributes->len; k++)
             {
               PangoAttribute *tmp_attr2 = g_ptr_array_index (list->attributes, k);
 
               if (tmp_attr2->start_index >= tmp_attr->start_index)
                 break;
+
+              g_ptr_array_index (list->attributes, k - 1) = tmp_attr2;
+              g_ptr_array_index (list->attributes, k) = tmp_attr;
+              attr_list_index_add (list, k - 1, tmp_attr2->end_index);
+              attr_list_index_add (list, k, tmp_attr->end_index);
             }
+
+          /* Look at the attribute that moved into this place */
+          if (k > i + 1)
+            i--;
         }
     }
 }
@@ -1695,50 +2130,56 @@ pango_attr_list_update (PangoAttrList *list,
                         int             remove,
                         int             add)
 {
-  guint i, p;
+  guint i, j, p;
 
   g_return_if_fail (pos >= 0);
   g_return_if_fail (remove >= 0);
   g_return_if_fail (add >= 0);
 
-  if (list->attributes)
-    for (i = 0, p = list->attributes->len; i < p; i++)
-      {
-        PangoAttribute *attr = g_ptr_array_index (list->attributes, i);
+  attr_list_sort (list);
+  attr_list_drop_index (list);
+
+  if (!list->attributes)
+    return;
+
+  for (i = 0, j = 0, p = list->attributes->len; i < p; i++)
+    {
+      PangoAttribute *attr = g_ptr_array_index (list->attributes, i);
+
+      if (attr->start_index >= pos &&
+        attr->end_index < pos + remove)
+        {
+          pango_attribute_destroy (attr);
+          continue;
+        }
+
+      if (attr->start_index >= pos &&
+          attr->start_index < pos + remove)
+        {
+          attr->start_index = pos + add;
+        }
+      else if (attr->start_index >= pos + remove)
+        {
+          attr->start_index += add - remove;
+        }
 
-        if (attr->start_index >= pos &&
+      if (attr->end_index >= pos &&
           attr->end_index < pos + remove)
-          {
-            pango_attribute_destroy (attr);
-            g_ptr_array_remove_index (list->attributes, i);
-            i--; /* Look at this index again */
-            p--;
-            continue;
-          }
+        {
+          attr->end_index = pos;
+        }
+      else if (attr->end_index >= pos + remove)
+        {
+          if (G_MAXUINT - attr->end_index < add - remove)
+            attr->end_index = G_MAXUINT;
+          else
+            attr->end_index += add - remove;
+        }
 
-        if (attr->start_index >= pos &&
-            attr->start_index < pos + remove)
-          {
-            attr->start_index = pos + add;
-          }
-        else if (attr->start_index >= pos + remove)
-          {
-            attr->start_index += add - remove;
-          }
+      g_ptr_array_index (list->attributes, j++) = attr;
+    }
 
-        if (attr->end_index >= pos &&
-            attr->end_index < pos + remove)
-          {
-            attr->end_index = pos;
-          }
-        else if (attr->end_index >= pos + remove)
-          {
-            if (G_MAXUINT - attr->end_index < add - remove)
-              attr->end_index = G_MAXUINT;
-            else
-              attr->end_index += add - remove;
-          }
-      }
+  g_ptr_array_set_size (list->attributes, j);
 }
 
 /**
@@ -1783,27 +2224,55 @@ pango_attr_list_splice (PangoAttrList *list,
  */
 #define CLAMP_ADD(a,b) (((a) + (b) < (a)) ? G_MAXUINT : (a) + (b))
 
-  if (list->attributes)
-    for (i = 0, p = list->attributes->len; i < p; i++)
-      {
-        PangoAttribute *attr = g_ptr_array_index (list->attributes, i);;
+  attr_list_sort (list);
+  attr_list_prepare (other);
 
-        if (attr->start_index <= upos)
-          {
-            if (attr->end_index > upos)
+  if (list->attributes && list->attributes->len > 0)
+    {
+      guint n_before;
+
+      if (!list->max_ends)
+        attr_list_build_index (list);
+
+      /* Of the attributes that start at or before @pos, only
+       * the ones that reach past it grow, so skip blocks that
+       * end before it. This keeps appending to a long list cheap.
+       */
+      n_before = attr_list_bisect (list, upos, FALSE);
+
+      for (i = 0; i < n_before; i++)
+        {
+          PangoAttribute *attr;
+
+          if ((i & (ATTR_BLOCK_SIZE - 1)) == 0 &&
+              g_array_index (list->max_ends, guint, i >> ATTR_BLOCK_SHIFT) <= upos)
+            {
+              i += ATTR_BLOCK_SIZE - 1;
+              continue;
+            }
+
+          attr = g_ptr_array_index (list->attributes, i);
+          if (attr->end_index > upos)
+            {
               attr->end_index = CLAMP_ADD (attr->end_index, ulen);
-          }
-        else
-          {
-            /* This could result in a zero length attribute if it
-             * gets squashed up against G_MAXUINT, but deleting such
-             * an element could (in theory) suprise the caller, so
-             * we don't delete it.
-             */
-            attr->start_index = CLAMP_ADD (attr->start_index, ulen);
-            attr->end_index = CLAMP_ADD (attr->end_index, ulen);
-         }
-      }
+              attr_list_index_add (list, i, attr->end_index);
+            }
+        }
+
+      for (i = n_before, p = list->attributes->len; i < p; i++)
+        {
+          PangoAttribute *attr = g_ptr_array_index (list->attributes, i);
+
+          /* This could result in a zero length attribute if it
+           * gets squashed up against G_MAXUINT, but deleting such
+           * an element could (in theory) suprise the caller, so
+           * we don't delete it.
+           */
+          attr->start_index = CLAMP_ADD (attr->start_index, ulen);
+          attr->end_index = CLAMP_ADD (attr->end_index, ulen);
+          attr_list_index_add (list, i, attr->end_index);
+        }
+    }
 
   if (!other->attributes || other->attributes->len == 0)
     return;
@@ -1843,6 +2312,8 @@ pango_attr_list_get_attributes (PangoAttrList *list)
 
   g_return_val_if_fail (list != NULL, NULL);
 
+  attr_list_prepare (list);
+
   if (!list->attributes || list->attributes->len == 0)
     return NULL;
 
@@ -1856,6 +2327,52 @@ pango_attr_list_get_attributes (PangoAttrList *list)
   return g_slist_reverse (result);
 }
 
+/**
+ * pango_attr_list_get_attributes_in_range:
+ * @list: a #PangoAttrList
+ * @start_index: start of the range, in bytes
+ * @end_index: end of the range, in bytes
+ *
+ * Gets a list of the attributes in @list that overlap the range
+ * from @start_index to @end_index, that is, the attributes that
+ * start before @end_index and end after @start_index, in the
+ * order of @list.
+ *
+ * This doesn't look at most of the attributes outside of the
+ * range, so it is cheap for small ranges of large lists.
+ *
+ * Return value: (element-type Pango.Attribute) (transfer full):
+ *   a list of the attributes in the range. To free this value,
+ *   call pango_attribute_destroy() on each value and g_slist_free()
+ *   on the list.
+ *
+ * Since: 1.50
+ */
+GSList *
+pango_attr_list_get_attributes_in_range (PangoAttrList *list,
+                                         guint          start_index,
+                                         guint          end_index)
+{
+  GPtrArray *attrs;
+  GSList *result = NULL;
+  guint i;
+
+  g_return_val_if_fail (list != NULL, NULL);
+
+  if (start_index >= end_index)
+    return NULL;
+
+  attrs = g_ptr_array_new ();
+  _pango_attr_list_get_overlapping (list, start_index, end_index, attrs);
+
+  for (i = attrs->len; i > 0; i--)
+    result = g_slist_prepend (result, pango_attribute_copy (g_ptr_array_index (attrs, i - 1)));
+
+  g_ptr_array_free (attrs, TRUE);
+
+  return result;
+}
+
 /**
  * pango_attr_list_equal:
  * @list: a #PangoAttrList
@@ -1883,6 +2400,9 @@ pango_attr_list_equal (PangoAttrList *list,
   if (list == NULL || other_list == NULL)
     return FALSE;
 
+  attr_list_prepare (list);
+  attr_list_prepare (other_list);
+
   if (list->attributes == NULL || other_list->attributes == NULL)
     return list->attributes == other_list->attributes;
 
@@ -1927,7 +2447,12 @@ pango_attr_list_equal (PangoAttrList *list,
 gboolean
 _pango_attr_list_has_attributes (const PangoAttrList *list)
 {
-  return list && list->attributes != NULL && list->attributes->len > 0;
+  if (!list)
+    return FALSE;
+
+  attr_list_prepare ((PangoAttrList *) list);
+
+  return list->attributes != NULL && list->attributes->len > 0;
 }
 
 G_DEFINE_BOXED_TYPE (PangoAttrIterator,
@@ -1939,6 +2464,8 @@ void
 _pango_attr_list_get_iterator (PangoAttrList     *list,
                                PangoAttrIterator *iterator)
 {
+  attr_list_prepare (list);
+
   iterator->attribute_stack = NULL;
   iterator->attrs = list->attributes;
   iterator->n_attrs = iterator->attrs ? iterator->attrs->len : 0;
@@ -2343,33 +2870,38 @@ pango_attr_list_filter (PangoAttrList       *list,
 
 {
   PangoAttrList *new = NULL;
-  guint i, p;
+  guint i, j, p;
 
   g_return_val_if_fail (list != NULL, NULL);
 
+  attr_list_sort (list);
+
   if (!list->attributes || list->attributes->len == 0)
     return NULL;
 
-  for (i = 0, p = list->attributes->len; i < p; i++)
+  for (i = 0, j = 0, p = list->attributes->len; i < p; i++)
     {
       PangoAttribute *tmp_attr = g_ptr_array_index (list->attributes, i);
 
       if ((*func) (tmp_attr, data))
         {
-          g_ptr_array_remove_index (list->attributes, i);
-          i--; /* Need to look at this index again */
-          p--;
-
           if (G_UNLIKELY (!new))
             {
               new = pango_attr_list_new ();
               new->attributes = g_ptr_array_new ();
+              if (list->arena)
+                new->arena = attr_arena_ref (list->arena);
             }
 
           g_ptr_array_add (new->attributes, tmp_attr);
         }
+      else
+        g_ptr_array_index (list->attributes, j++) = tmp_attr;
     }
 
+  g_ptr_array_set_size (list->attributes, j);
+  attr_list_drop_index (list);
+
   return new;
 }
 
@@ -2419,3 +2951,359 @@ pango_attr_iterator_get_attrs (PangoAttrIterator *iterator)
 
   return attrs;
 }
+
+/*
+ * Attribute list builder
+ */
+
+struct _PangoAttrListBuilder
+{
+  PangoAttrList *list;
+  PangoAttribute *last[N_ARENA_TYPES];
+};
+
+/* Only ever used for attribute structs, which
+ * are much smaller than the smallest chunk
+ */
+static gpointer
+attr_arena_alloc (PangoAttrArena *arena,
+                  gsize           size)
+{
+  gpointer mem;
+
+  size = (size + sizeof (gpointer) - 1) & ~(sizeof (gpointer) - 1);
+
+  g_assert (size <= ATTR_ARENA_MIN_CHUNK_SIZE);
+
+  if (!arena->chunks || arena->used + size > arena->chunk_size)
+    {
+      if (arena->chunks)
+        arena->chunk_size = MIN (arena->chunk_size * 2, ATTR_ARENA_MAX_CHUNK_SIZE);
+      else
+        arena->chunk_size = ATTR_ARENA_MIN_CHUNK_SIZE;
+
+      arena->chunks = g_slist_prepend (arena->chunks, g_malloc (arena->chunk_size));
+      arena->used = 0;
+    }
+
+  mem = (char *) arena->chunks->data + arena->used;
+  arena->used += size;
+
+  return mem;
+}
+
+static PangoAttribute *
+arena_attr_copy (const PangoAttribute *attr)
+{
+  const ArenaAttrClass *klass = (const ArenaAttrClass *) attr->klass;
+  PangoAttribute *copy;
+
+  copy = klass->base->copy (attr);
+  copy->klass = klass->base;
+
+  return copy;
+}
+
+static void
+arena_attr_destroy (PangoAttribute *attr G_GNUC_UNUSED)
+{
+}
+
+static gboolean
+arena_attr_equal (const PangoAttribute *attr1,
+                  const PangoAttribute *attr2)
+{
+  const ArenaAttrClass *klass = (const ArenaAttrClass *) attr1->klass;
+
+  return klass->base->equal (attr1, attr2);
+}
+
+/* Returns a new attribute of a type that the builder handles,
+ * to find the class for that type
+ */
+static PangoAttribute *
+builder_attr_new (PangoAttrType type,
+                  gboolean      color)
+{
+  if (color)
+    switch ((int) type)
+      {
+      case PANGO_ATTR_FOREGROUND: return pango_attr_foreground_new (0, 0, 0);
+      case PANGO_ATTR_BACKGROUND: return pango_attr_background_new (0, 0, 0);
+      case PANGO_ATTR_UNDERLINE_COLOR: return pango_attr_underline_color_new (0, 0, 0);
+      case PANGO_ATTR_STRIKETHROUGH_COLOR: return pango_attr_strikethrough_color_new (0, 0, 0);
+      case PANGO_ATTR_OVERLINE_COLOR: return pango_attr_overline_color_new (0, 0, 0);
+      default: return NULL;
+      }
+  else
+    switch ((int) type)
+      {
+      case PANGO_ATTR_STYLE: return pango_attr_style_new (PANGO_STYLE_NORMAL);
+      case PANGO_ATTR_WEIGHT: return pango_attr_weight_new (PANGO_WEIGHT_NORMAL);
+      case PANGO_ATTR_VARIANT: return pango_attr_variant_new (PANGO_VARIANT_NORMAL);
+      case PANGO_ATTR_STRETCH: return pango_attr_stretch_new (PANGO_STRETCH_NORMAL);
+      case PANGO_ATTR_UNDERLINE: return pango_attr_underline_new (PANGO_UNDERLINE_NONE);
+      case PANGO_ATTR_STRIKETHROUGH: return pango_attr_strikethrough_new (FALSE);
+      case PANGO_ATTR_RISE: return pango_attr_rise_new (0);
+      case PANGO_ATTR_FALLBACK: return pango_attr_fallback_new (TRUE);
+      case PANGO_ATTR_LETTER_SPACING: return pango_attr_letter_spacing_new (0);
+      case PANGO_ATTR_GRAVITY: return pango_attr_gravity_new (PANGO_GRAVITY_SOUTH);
+      case PANGO_ATTR_GRAVITY_HINT: return pango_attr_gravity_hint_new (PANGO_GRAVITY_HINT_NATURAL);
+      case PANGO_ATTR_FOREGROUND_ALPHA: return pango_attr_foreground_alpha_new (0);
+      case PANGO_ATTR_BACKGROUND_ALPHA: return pango_attr_background_alpha_new (0);
+      case PANGO_ATTR_ALLOW_BREAKS: return pango_attr_allow_breaks_new (TRUE);
+      case PANGO_ATTR_SHOW: return pango_attr_show_new (PANGO_SHOW_NONE);
+      case PANGO_ATTR_INSERT_HYPHENS: return pango_attr_insert_hyphens_new (TRUE);
+      case PANGO_ATTR_OVERLINE: return pango_attr_overline_new (PANGO_OVERLINE_NONE);
+      default: return NULL;
+      }
+}
+
+static const PangoAttrClass *
+builder_get_class (PangoAttrListBuilder *builder,
+                   PangoAttrType         type,
+                   gboolean              color)
+{
+  PangoAttrArena *arena;
+  ArenaAttrClass *klass;
+  PangoAttribute *attr;
+
+  if (G_UNLIKELY (!builder->list->arena))
+    {
+      builder->list->arena = g_new0 (PangoAttrArena, 1);
+      builder->list->arena->ref_count = 1;
+    }
+
+  arena = builder->list->arena;
+
+  if ((guint) type >= N_ARENA_TYPES)
+    return NULL;
+
+  klass = &arena->classes[type];
+  if (G_LIKELY (klass->base))
+    return klass->color == color ? &klass->klass : NULL;
+
+  attr = builder_attr_new (type, color);
+  if (!attr)
+    return NULL;
+
+  klass->base = attr->klass;
+  klass->color = color;
+  klass->klass.type = type;
+  klass->klass.copy = arena_attr_copy;
+  klass->klass.destroy = arena_attr_destroy;
+  klass->klass.equal = arena_attr_equal;
+
+  pango_attribute_destroy (attr);
+
+  return &klass->klass;
+}
+
+/**
+ * pango_attr_list_builder_new:
+ *
+ * Creates a new #PangoAttrListBuilder, for constructing an
+ * attribute list with many attributes quickly.
+ *
+ * Attributes that are added with pango_attr_list_builder_add_int()
+ * or pango_attr_list_builder_add_color() are allocated in large
+ * blocks of memory that belong to the list, and adjacent ranges
+ * with the same value are merged into one attribute. The attributes
+ * can be added in any order, they are sorted once when the list
+ * is first used.
+ *
+ * Return value: (transfer full): a new #PangoAttrListBuilder
+ *
+ * Since: 1.50
+ */
+PangoAttrListBuilder *
+pango_attr_list_builder_new (void)
+{
+  PangoAttrListBuilder *builder;
+
+  builder = g_slice_new0 (PangoAttrListBuilder);
+  builder->list = pango_attr_list_new ();
+
+  return builder;
+}
+
+/**
+ * pango_attr_list_builder_add_int:
+ * @builder: a #PangoAttrListBuilder
+ * @type: the type of the attribute, for a type that uses #PangoAttrInt,
+ *   such as %PANGO_ATTR_WEIGHT or %PANGO_ATTR_UNDERLINE. The font size
+ *   types are not supported.
+ * @value: the value of the attribute
+ * @start_index: the start index of the range
+ * @end_index: the end index of the range
+ *
+ * Adds an integer attribute to the list that @builder is
+ * constructing.
+ *
+ * Since: 1.50
+ */
+void
+pango_attr_list_builder_add_int (PangoAttrListBuilder *builder,
+                                 PangoAttrType         type,
+                                 int                   value,
+                                 guint                 start_index,
+                                 guint                 end_index)
+{
+  const PangoAttrClass *klass;
+  PangoAttrInt *attr;
+
+  g_return_if_fail (builder != NULL);
+
+  klass = builder_get_class (builder, type, FALSE);
+  g_return_if_fail (klass != NULL);
+
+  if (builder->last[type])
+    {
+      PangoAttrInt *last = (PangoAttrInt *) builder->last[type];
+
+      if (last->attr.end_index == start_index && last->value == value)
+        {
+          last->attr.end_index = end_index;
+          return;
+        }
+    }
+
+  attr = attr_arena_alloc (builder->list->arena, sizeof (PangoAttrInt));
+  attr->attr.klass = klass;
+  attr->attr.start_index = start_index;
+  attr->attr.end_index = end_index;
+  attr->value = value;
+
+  pango_attr_list_insert (builder->list, &attr->attr);
+  builder->last[type] = &attr->attr;
+}
+
+/**
+ * pango_attr_list_builder_add_color:
+ * @builder: a #PangoAttrListBuilder
+ * @type: the type of the attribute, for a type that uses #PangoAttrColor,
+ *   such as %PANGO_ATTR_FOREGROUND
+ * @red: the red value (ranging from 0 to 65535)
+ * @green: the green value
+ * @blue: the blue value
+ * @start_index: the start index of the range
+ * @end_index: the end index of the range
+ *
+ * Adds a color attribute to the list that @builder is
+ * constructing.
+ *
+ * Since: 1.50
+ */
+void
+pango_attr_list_builder_add_color (PangoAttrListBuilder *builder,
+                                   PangoAttrType         type,
+                                   guint16               red,
+                                   guint16               green,
+                                   guint16               blue,
+                                   guint                 start_index,
+                                   guint                 end_index)
+{
+  const PangoAttrClass *klass;
+  PangoAttrColor *attr;
+
+  g_return_if_fail (builder != NULL);
+
+  klass = builder_get_class (builder, type, TRUE);
+  g_return_if_fail (klass != NULL);
+
+  if (builder->last[type])
+    {
+      PangoAttrColor *last = (PangoAttrColor *) builder->last[type];
+
+      if (last->attr.end_index == start_index &&
+          last->color.red == red &&
+          last->color.green == green &&
+          last->color.blue == blue)
+        {
+          last->attr.end_index = end_index;
+          return;
+        }
+    }
+
+  attr = attr_arena_alloc (builder->list->arena, sizeof (PangoAttrColor));
+  attr->attr.klass = klass;
+  attr->attr.start_index = start_index;
+  attr->attr.end_index = end_index;
+  attr->color.red = red;
+  attr->color.green = green;
+  attr->color.blue = blue;
+
+  pango_attr_list_insert (builder->list, &attr->attr);
+  builder->last[type] = &attr->attr;
+}
+
+/**
+ * pango_attr_list_builder_add:
+ * @builder: a #PangoAttrListBuilder
+ * @attr: (transfer full): the attribute to add. Ownership of this
+ *   value is assumed by the list.
+ *
+ * Adds an attribute of any type to the list that @builder is
+ * constructing. This is like pango_attr_list_insert(), for
+ * attributes that pango_attr_list_builder_add_int() and
+ * pango_attr_list_builder_add_color() don't handle.
+ *
+ * Since: 1.50
+ */
+void
+pango_attr_list_builder_add (PangoAttrListBuilder *builder,
+                             PangoAttribute       *attr)
+{
+  g_return_if_fail (builder != NULL);
+  g_return_if_fail (attr != NULL);
+
+  /* Don't extend an earlier attribute of the same type across this one */
+  if ((guint) attr->klass->type < N_ARENA_TYPES)
+    builder->last[attr->klass->type] = NULL;
+
+  pango_attr_list_insert (builder->list, attr);
+}
+
+/**
+ * pango_attr_list_builder_finish:
+ * @builder: (transfer full): a #PangoAttrListBuilder
+ *
+ * Frees @builder and returns the list that it constructed.
+ *
+ * Attributes in the list can be used like any other, but
+ * they are not separately allocated: pango_attribute_copy()
+ * turns them into regular attributes.
+ *
+ * Return value: (transfer full): the new #PangoAttrList, which
+ *   should be freed with pango_attr_list_unref()
+ *
+ * Since: 1.50
+ */
+PangoAttrList *
+pango_attr_list_builder_finish (PangoAttrListBuilder *builder)
+{
+  PangoAttrList *list;
+
+  g_return_val_if_fail (builder != NULL, NULL);
+
+  list = builder->list;
+  g_slice_free (PangoAttrListBuilder, builder);
+
+  return list;
+}
+
+/**
+ * pango_attr_list_builder_free:
+ * @builder: (transfer full): a #PangoAttrListBuilder
+ *
+ * Frees @builder and the attributes that were added to it.
+ *
+ * Since: 1.50
+ */
+void
+pango_attr_list_builder_free (PangoAttrListBuilder *builder)
+{
+  g_return_if_fail (builder != NULL);
+
+  pango_attr_list_unref (pango_attr_list_builder_finish (builder));
+}
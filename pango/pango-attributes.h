@@ -122,6 +122,7 @@ typedef struct _PangoAttrFontFeatures PangoAttrFontFeatures;
  * for more than one paragraph of text.
  */
 typedef struct _PangoAttrList     PangoAttrList;
+typedef struct _PangoAttrListBuilder PangoAttrListBuilder;
 typedef struct _PangoAttrIterator PangoAttrIterator;
 
 /**
@@ -637,11 +638,39 @@ PangoAttrList *pango_attr_list_filter (PangoAttrList       *list,
 
 PANGO_AVAILABLE_IN_1_44
 GSList        *pango_attr_list_get_attributes    (PangoAttrList *list);
+PANGO_AVAILABLE_IN_1_50
+GSList        *pango_attr_list_get_attributes_in_range (PangoAttrList *list,
+                                                        guint          start_index,
+                                                        guint          end_index);
 
 PANGO_AVAILABLE_IN_1_46
 gboolean       pango_attr_list_equal             (PangoAttrList *list,
                                                   PangoAttrList *other_list);
 
+PANGO_AVAILABLE_IN_1_50
+PangoAttrListBuilder *pango_attr_list_builder_new       (void);
+PANGO_AVAILABLE_IN_1_50
+void                  pango_attr_list_builder_add_int   (PangoAttrListBuilder *builder,
+                                                         PangoAttrType         type,
+                                                         int                   value,
+                                                         guint                 start_index,
+                                                         guint                 end_index);
+PANGO_AVAILABLE_IN_1_50
+void                  pango_attr_list_builder_add_color (PangoAttrListBuilder *builder,
+                                                         PangoAttrType         type,
+                                                         guint16               red,
+                                                         guint16               green,
+                                                         guint16               blue,
+                                                         guint                 start_index,
+                                                         guint                 end_index);
+PANGO_AVAILABLE_IN_1_50
+void                  pango_attr_list_builder_add       (PangoAttrListBuilder *builder,
+                                                         PangoAttribute       *attr);
+PANGO_AVAILABLE_IN_1_50
+PangoAttrList *       pango_attr_list_builder_finish    (PangoAttrListBuilder *builder);
+PANGO_AVAILABLE_IN_1_50
+void                  pango_attr_list_builder_free      (PangoAttrListBuilder *builder);
+
 PANGO_AVAILABLE_IN_1_44
 GType              pango_attr_iterator_get_type  (void) G_GNUC_CONST;
 
@@ -688,6 +717,32 @@ gboolean              pango_markup_parser_finish (GMarkupParseContext   *context
                                                   gunichar              *accel_char,
                                                   GError               **error);
 
+/**
+ * PangoMarkupParagraphFunc:
+ * @text: the text of the paragraph, including its paragraph separator
+ * @length: the length of @text in bytes
+ * @attrs: the attributes of the paragraph, with indices relative to @text
+ * @user_data: user data passed to pango_markup_parser_new_streaming()
+ *
+ * Type of a function that is called with each paragraph of markup
+ * parsed by a parser from pango_markup_parser_new_streaming().
+ *
+ * @text and @attrs are only valid during the call. Use
+ * pango_attr_list_ref() to keep @attrs.
+ *
+ * Since: 1.50
+ */
+typedef void (*PangoMarkupParagraphFunc) (const char    *text,
+                                          int            length,
+                                          PangoAttrList *attrs,
+                                          gpointer       user_data);
+
+PANGO_AVAILABLE_IN_1_50
+GMarkupParseContext * pango_markup_parser_new_streaming (gunichar                  accel_marker,
+                                                         PangoMarkupParagraphFunc  func,
+                                                         gpointer                  user_data,
+                                                         GDestroyNotify            notify);
+
 G_END_DECLS
 
 #endif /* __PANGO_ATTRIBUTES_H__ */
@@ -43,6 +43,7 @@
 #include "pango-fontmap-private.h"
 #include "pango-script-private.h"
 #include "pango-emoji-private.h"
+#include "pango-layout-private.h"
 
 /**
  * SECTION:context
@@ -81,6 +82,9 @@ struct _PangoContext
   PangoFontMap *font_map;
 
   gboolean round_glyph_positions;
+
+  guint paragraph_cache_size;
+  PangoParagraphCache *paragraph_cache;
 };
 
 struct _PangoContextClass
@@ -138,6 +142,9 @@ pango_context_finalize (GObject *object)
   if (context->matrix)
     pango_matrix_free (context->matrix);
 
+  if (context->paragraph_cache)
+    _pango_paragraph_cache_free (context->paragraph_cache);
+
   G_OBJECT_CLASS (pango_context_parent_class)->finalize (object);
 }
 
@@ -619,30 +626,45 @@ advance_attr_iterator_to (PangoAttrIterator *iterator,
 }
 
 /***************************************************************************
- * We cache the results of character,fontset => font in a hash table
+ * We cache the results of character,fontset => font in a two-level table.
+ * The fonts found so far are kept in an array, and characters map to
+ * indices into it, 0 meaning that the character is not cached yet.
+ * Characters in the BMP are looked up in pages of 256 indices, allocated
+ * as needed, so the common lookup is a couple of loads; characters in
+ * other planes go to a hash table.
  ***************************************************************************/
 
-typedef struct {
-  GHashTable *hash;
-} FontCache;
+#define FONT_CACHE_PAGE_BITS 8
+#define FONT_CACHE_PAGE_SIZE (1 << FONT_CACHE_PAGE_BITS)
+#define FONT_CACHE_N_PAGES (0x10000 >> FONT_CACHE_PAGE_BITS)
 
 typedef struct {
-  PangoFont *font;
-} FontElement;
+  GPtrArray *fonts;	/* owns the fonts, may contain %NULL */
+  guint16 *pages[FONT_CACHE_N_PAGES];
+  GHashTable *astral;	/* gunichar => index */
+} FontCache;
 
 static void
 font_cache_destroy (FontCache *cache)
 {
-  g_hash_table_destroy (cache->hash);
-  g_slice_free (FontCache, cache);
-}
+  guint i;
 
-static void
-font_element_destroy (FontElement *element)
-{
-  if (element->font)
-    g_object_unref (element->font);
-  g_slice_free (FontElement, element);
+  for (i = 0; i < cache->fonts->len; i++)
+    {
+      PangoFont *font = g_ptr_array_index (cache->fonts, i);
+
+      if (font)
+        g_object_unref (font);
+    }
+  g_ptr_array_free (cache->fonts, TRUE);
+
+  for (i = 0; i < FONT_CACHE_N_PAGES; i++)
+    g_free (cache->pages[i]);
+
+  if (cache->astral)
+    g_hash_table_destroy (cache->astral);
+
+  g_slice_free (FontCache, cache);
 }
 
 static FontCache *
@@ -658,9 +680,8 @@ retry:
   cache = g_object_get_qdata (G_OBJECT (fontset), cache_quark);
   if (G_UNLIKELY (!cache))
     {
-      cache = g_slice_new (FontCache);
-      cache->hash = g_hash_table_new_full (g_direct_hash, NULL,
-					   NULL, (GDestroyNotify)font_element_destroy);
+      cache = g_slice_new0 (FontCache);
+      cache->fonts = g_ptr_array_new ();
       if (!g_object_replace_qdata (G_OBJECT (fontset), cache_quark, NULL,
                                    cache, (GDestroyNotify)font_cache_destroy,
                                    NULL))
@@ -673,22 +694,33 @@ retry:
   return cache;
 }
 
-static gboolean
+static inline gboolean
 font_cache_get (FontCache   *cache,
 		gunichar     wc,
 		PangoFont  **font)
 {
-  FontElement *element;
+  guint index;
 
-  element = g_hash_table_lookup (cache->hash, GUINT_TO_POINTER (wc));
-  if (element)
+  if (G_LIKELY (wc < 0x10000))
     {
-      *font = element->font;
+      const guint16 *page = cache->pages[wc >> FONT_CACHE_PAGE_BITS];
 
-      return TRUE;
+      if (G_UNLIKELY (!page))
+        return FALSE;
+
+      index = page[wc & (FONT_CACHE_PAGE_SIZE - 1)];
     }
+  else if (cache->astral)
+    index = GPOINTER_TO_UINT (g_hash_table_lookup (cache->astral, GUINT_TO_POINTER (wc)));
   else
     return FALSE;
+
+  if (index == 0)
+    return FALSE;
+
+  *font = g_ptr_array_index (cache->fonts, index - 1);
+
+  return TRUE;
 }
 
 static void
@@ -696,10 +728,39 @@ font_cache_insert (FontCache   *cache,
 		   gunichar           wc,
 		   PangoFont         *font)
 {
-  FontElement *element = g_slice_new (FontElement);
-  element->font = font ? g_object_ref (font) : NULL;
+  guint index;
+
+  for (index = 0; index < cache->fonts->len; index++)
+    if (g_ptr_array_index (cache->fonts, index) == font)
+      break;
+
+  if (index == cache->fonts->len)
+    {
+      /* Too many fonts to index, just don't cache */
+      if (G_UNLIKELY (index == G_MAXUINT16))
+        return;
+
+      g_ptr_array_add (cache->fonts, font ? g_object_ref (font) : NULL);
+    }
+
+  index++;
 
-  g_hash_table_insert (cache->hash, GUINT_TO_POINTER (wc), element);
+  if (G_LIKELY (wc < 0x10000))
+    {
+      guint16 **page = &cache->pages[wc >> FONT_CACHE_PAGE_BITS];
+
+      if (!*page)
+        *page = g_new0 (guint16, FONT_CACHE_PAGE_SIZE);
+
+      (*page)[wc & (FONT_CACHE_PAGE_SIZE - 1)] = index;
+    }
+  else
+    {
+      if (!cache->astral)
+        cache->astral = g_hash_table_new (g_direct_hash, NULL);
+
+      g_hash_table_insert (cache->astral, GUINT_TO_POINTER (wc), GUINT_TO_POINTER (index));
+    }
 }
 
 /**********************************************************************/
@@ -1912,3 +1973,97 @@ pango_context_get_round_glyph_positions (PangoContext *context)
 {
   return context->round_glyph_positions;
 }
+
+/**
+ * pango_context_set_paragraph_cache_size:
+ * @context: a #PangoContext
+ * @size: the maximum number of paragraphs to keep
+ *
+ * Sets the maximum number of laid out paragraphs that layouts
+ * using @context share.
+ *
+ * When a #PangoLayout lays out a paragraph that another layout
+ * with the same context has laid out before, with the same text,
+ * attributes, width, wrapping and ellipsization settings, it
+ * copies the lines of that paragraph instead of itemizing,
+ * breaking and shaping it again. This helps when the same strings
+ * are laid out over and over in new layouts, as widgets often do.
+ *
+ * Paragraphs are evicted in least-recently-used order, and all
+ * of them are dropped when @context changes. Paragraphs with tabs,
+ * and layouts with a positive height, are not cached.
+ *
+ * The default size is 0, which disables the cache.
+ *
+ * Since: 1.50
+ */
+void
+pango_context_set_paragraph_cache_size (PangoContext *context,
+                                        guint         size)
+{
+  g_return_if_fail (PANGO_IS_CONTEXT (context));
+
+  context->paragraph_cache_size = size;
+
+  if (context->paragraph_cache)
+    _pango_paragraph_cache_set_max_size (context->paragraph_cache, size);
+}
+
+/**
+ * pango_context_get_paragraph_cache_size:
+ * @context: a #PangoContext
+ *
+ * Returns the maximum number of laid out paragraphs that layouts
+ * using @context share. See pango_context_set_paragraph_cache_size().
+ *
+ * Returns: the maximum size of the paragraph cache
+ *
+ * Since: 1.50
+ */
+guint
+pango_context_get_paragraph_cache_size (PangoContext *context)
+{
+  g_return_val_if_fail (PANGO_IS_CONTEXT (context), 0);
+
+  return context->paragraph_cache_size;
+}
+
+/**
+ * pango_context_get_paragraph_cache_stats:
+ * @context: a #PangoContext
+ * @hits: (out) (optional): return location for the number of cache hits
+ * @misses: (out) (optional): return location for the number of cache misses
+ *
+ * Obtains the number of times that the lines of a paragraph were
+ * found in the paragraph cache of @context, and the number of times
+ * that they had to be computed, since the cache was enabled.
+ *
+ * Since: 1.50
+ */
+void
+pango_context_get_paragraph_cache_stats (PangoContext *context,
+                                         guint        *hits,
+                                         guint        *misses)
+{
+  g_return_if_fail (PANGO_IS_CONTEXT (context));
+
+  if (hits)
+    *hits = 0;
+  if (misses)
+    *misses = 0;
+
+  if (context->paragraph_cache)
+    _pango_paragraph_cache_get_stats (context->paragraph_cache, hits, misses);
+}
+
+PangoParagraphCache *
+_pango_context_get_paragraph_cache (PangoContext *context)
+{
+  if (context->paragraph_cache_size == 0)
+    return NULL;
+
+  if (G_UNLIKELY (!context->paragraph_cache))
+    context->paragraph_cache = _pango_paragraph_cache_new (context->paragraph_cache_size);
+
+  return context->paragraph_cache;
+}
@@ -119,6 +119,16 @@ void                      pango_context_set_round_glyph_positions (PangoContext
 PANGO_AVAILABLE_IN_1_44
 gboolean                  pango_context_get_round_glyph_positions (PangoContext *context);
 
+PANGO_AVAILABLE_IN_1_50
+void                      pango_context_set_paragraph_cache_size  (PangoContext *context,
+                                                                   guint         size);
+PANGO_AVAILABLE_IN_1_50
+guint                     pango_context_get_paragraph_cache_size  (PangoContext *context);
+PANGO_AVAILABLE_IN_1_50
+void                      pango_context_get_paragraph_cache_stats (PangoContext *context,
+                                                                   guint        *hits,
+                                                                   guint        *misses);
+
 
 /* Break a string of Unicode characters into segments with
  * consistent shaping/language engine and bidrectional level.
@@ -33,6 +33,9 @@ G_BEGIN_DECLS
 PANGO_AVAILABLE_IN_ALL
 PangoFontMetrics *pango_font_metrics_new (void);
 
+const PangoFontDescription *_pango_font_description_lookup_interned (const char                 *str);
+gboolean                    _pango_font_description_is_interned     (const PangoFontDescription *desc);
+
 G_END_DECLS
 
 #endif /* __PANGO_FONT_PRIVATE_H__ */
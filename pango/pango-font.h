@@ -311,6 +311,8 @@ gboolean pango_font_description_better_match (const PangoFontDescription *desc,
 
 PANGO_AVAILABLE_IN_ALL
 PangoFontDescription *pango_font_description_from_string (const char                  *str);
+PANGO_AVAILABLE_IN_1_50
+const PangoFontDescription *pango_font_description_from_string_interned (const char *str);
 PANGO_AVAILABLE_IN_ALL
 char *                pango_font_description_to_string   (const PangoFontDescription  *desc);
 PANGO_AVAILABLE_IN_ALL
@@ -227,6 +227,14 @@ void pango_shape_with_flags (const char          *item_text,
                              PangoGlyphString    *glyphs,
                              PangoShapeFlags      flags);
 
+PANGO_AVAILABLE_IN_1_50
+void pango_shape_cache_set_size  (int    size);
+PANGO_AVAILABLE_IN_1_50
+int  pango_shape_cache_get_size  (void);
+PANGO_AVAILABLE_IN_1_50
+void pango_shape_cache_get_stats (guint *hits,
+                                  guint *misses);
+
 PANGO_AVAILABLE_IN_ALL
 GList *pango_reorder_items (GList *logical_items);
 
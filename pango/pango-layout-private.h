@@ -26,6 +26,17 @@
 
 G_BEGIN_DECLS
 
+typedef struct _Extents Extents;
+struct _Extents
+{
+  /* Vertical position of the line's baseline in layout coords */
+  int baseline;
+
+  /* Line extents in layout coords */
+  PangoRectangle ink_rect;
+  PangoRectangle logical_rect;
+};
+
 struct _PangoLayout
 {
   GObject parent_instance;
@@ -61,7 +72,10 @@ struct _PangoLayout
   guint alignment : 2;
   guint single_paragraph : 1;
   guint auto_dir : 1;
+  guint lazy : 1;
+  guint parallel : 1;
   guint wrap : 2;		/* PangoWrapMode */
+  guint line_breaking : 1;	/* PangoLineBreaking */
   guint is_wrapped : 1;		/* Whether the layout has any wrapped lines */
   guint ellipsize : 2;		/* PangoEllipsizeMode */
   guint is_ellipsized : 1;	/* Whether the layout has any ellipsized lines */
@@ -79,19 +93,27 @@ struct _PangoLayout
   /* Not copied during _copy() */
 
   PangoLogAttr *log_attrs;	/* Logical attributes for layout's text */
+  int n_log_attrs;		/* Allocated size of @log_attrs */
   GSList *lines;
+  GSList *lines_tail;		/* Last link of @lines */
   guint line_count;		/* Number of lines in @lines. 0 if lines is %NULL */
-};
 
-typedef struct _Extents Extents;
-struct _Extents
-{
-  /* Vertical position of the line's baseline in layout coords */
-  int baseline;
+  /* Random access to @lines, see get_line_table() in pango-layout.c */
+  GPtrArray *line_table;	/* Links of the first lines of @lines */
+  Extents *line_table_extents;	/* Extents of the first lines, no ink rects */
+  guint n_line_table_extents;
 
-  /* Line extents in layout coords */
-  PangoRectangle ink_rect;
-  PangoRectangle logical_rect;
+  /* Shaped items of the paragraphs, kept once the layout has
+   * been rewrapped, see ShapedParagraph in pango-layout.c
+   */
+  GPtrArray *shaped_paragraphs;
+  guint retain_shaping : 1;
+
+  /* Where to continue if a lazy layout has not been laid out completely */
+  guint lines_incomplete : 1;
+  int lines_end_index;
+  int lines_end_offset;
+  PangoDirection lines_end_dir;
 };
 
 struct _PangoLayoutIter
@@ -107,8 +129,11 @@ struct _PangoLayoutIter
   PangoLayoutRun *run; /* FIXME nuke this, just keep the link */
   int index;
 
-  /* list of Extents for each line in layout coordinates */
-  Extents *line_extents;
+  /* Extents of the current line in layout coordinates. The
+   * extents of the next line are computed from them when moving
+   * there, so lines that are not visited are not measured.
+   */
+  Extents line_extents;
   int line_index;
 
   /* X position of the current run */
@@ -149,9 +174,27 @@ gboolean _pango_layout_line_ellipsize (PangoLayoutLine *line,
 
 void     _pango_layout_get_iter (PangoLayout     *layout,
                                  PangoLayoutIter *iter);
+void     _pango_layout_get_iter_at_line (PangoLayout     *layout,
+                                         int              line,
+                                         PangoLayoutIter *iter);
+int      _pango_layout_get_first_line_at_y (PangoLayout *layout,
+                                            int          y);
 
 void     _pango_layout_iter_destroy (PangoLayoutIter *iter);
 
+/* Paragraph cache, see pango_context_set_paragraph_cache_size() */
+typedef struct _PangoParagraphCache PangoParagraphCache;
+
+PangoParagraphCache *_pango_paragraph_cache_new          (guint                max_size);
+void                 _pango_paragraph_cache_free         (PangoParagraphCache *cache);
+void                 _pango_paragraph_cache_set_max_size (PangoParagraphCache *cache,
+                                                          guint                max_size);
+void                 _pango_paragraph_cache_get_stats    (PangoParagraphCache *cache,
+                                                          guint               *hits,
+                                                          guint               *misses);
+
+PangoParagraphCache *_pango_context_get_paragraph_cache  (PangoContext        *context);
+
 G_END_DECLS
 
 #endif /* __PANGO_LAYOUT_PRIVATE_H__ */
@@ -83,6 +83,7 @@
 
 typedef struct _ItemProperties ItemProperties;
 typedef struct _ParaBreakState ParaBreakState;
+typedef struct _ShapedParagraph ShapedParagraph;
 
 /* Note that rise, letter_spacing, shape are constant across items,
  * since we pass them into itemization.
@@ -128,6 +129,13 @@ struct _PangoLayoutLinePrivate
   PangoRectangle ink_rect;
   PangoRectangle logical_rect;
   int height;
+
+  /* Paragraph state, kept so that lines can be reused
+   * when only other paragraphs of the layout change
+   */
+  PangoDirection base_dir;
+  guint wrapped : 1;
+  guint ellipsized : 1;
 };
 
 struct _PangoLayoutClass
@@ -161,13 +169,21 @@ check_invalid (PangoLayoutIter *iter,
 
 static void check_context_changed  (PangoLayout *layout);
 static void layout_changed  (PangoLayout *layout);
+static void layout_width_changed  (PangoLayout *layout);
 
 static void pango_layout_clear_lines (PangoLayout *layout);
 static void pango_layout_check_lines (PangoLayout *layout);
-
-static PangoAttrList *pango_layout_get_effective_attributes (PangoLayout *layout);
+static void pango_layout_check_n_lines (PangoLayout *layout,
+                                        int          n_lines);
+static gboolean pango_layout_update_paragraphs (PangoLayout *layout,
+                                                const char  *old_text,
+                                                int          old_n_chars,
+                                                int          pos,
+                                                int          remove,
+                                                int          add);
 
 static PangoLayoutLine * pango_layout_line_new         (PangoLayout     *layout);
+static int               pango_layout_line_get_width   (PangoLayoutLine *line);
 static void              pango_layout_line_postprocess (PangoLayoutLine *line,
 							ParaBreakState  *state,
 							gboolean         wrapped);
@@ -178,6 +194,20 @@ static int *pango_layout_line_get_vis2log_map (PangoLayoutLine  *line,
 					       gboolean          strong);
 static void pango_layout_line_leaked (PangoLayoutLine *line);
 
+static void           clear_line_table         (PangoLayout *layout);
+static void           clear_line_table_extents (PangoLayout *layout);
+static GSList **      get_line_table           (PangoLayout *layout);
+static const Extents *get_line_table_extents   (PangoLayout *layout);
+static void           check_lines_to_index     (PangoLayout *layout,
+                                                int          index);
+static int            find_line_by_index       (PangoLayout *layout,
+                                                int          index);
+static int            find_line_by_y           (PangoLayout *layout,
+                                                int          y,
+                                                gboolean    *outside);
+
+#define LINE_TABLE_LINE(links, i) ((PangoLayoutLine *) (links)[i]->data)
+
 /* doesn't leak line */
 static PangoLayoutLine* _pango_layout_iter_get_line (PangoLayoutIter *iter);
 
@@ -210,14 +240,26 @@ pango_layout_init (PangoLayout *layout)
   layout->justify = FALSE;
   layout->auto_dir = TRUE;
 
+  layout->lazy = FALSE;
+  layout->parallel = FALSE;
+
   layout->log_attrs = NULL;
+  layout->n_log_attrs = 0;
   layout->lines = NULL;
+  layout->lines_tail = NULL;
   layout->line_count = 0;
+  layout->lines_incomplete = FALSE;
+  layout->line_table = NULL;
+  layout->line_table_extents = NULL;
+  layout->n_line_table_extents = 0;
+  layout->shaped_paragraphs = NULL;
+  layout->retain_shaping = FALSE;
 
   layout->tab_width = -1;
   layout->unknown_glyphs_count = -1;
 
   layout->wrap = PANGO_WRAP_WORD;
+  layout->line_breaking = PANGO_LINE_BREAKING_GREEDY;
   layout->is_wrapped = FALSE;
   layout->ellipsize = PANGO_ELLIPSIZE_NONE;
   layout->is_ellipsized = FALSE;
@@ -368,7 +410,7 @@ pango_layout_set_width (PangoLayout *layout,
       if (layout->line_count == 1 && width > layout->width)
         return;
 
-      layout_changed (layout);
+      layout_width_changed (layout);
     }
 }
 
@@ -503,6 +545,58 @@ pango_layout_get_wrap (PangoLayout *layout)
   return layout->wrap;
 }
 
+/**
+ * pango_layout_set_line_breaking:
+ * @layout: a #PangoLayout
+ * @line_breaking: how to choose line breaks
+ *
+ * Sets how @layout chooses where to break the lines of its
+ * paragraphs. Like the wrap mode, this only has effect if a
+ * width is set on the layout with pango_layout_set_width().
+ *
+ * With %PANGO_LINE_BREAKING_OPTIMAL, the breaks of a paragraph
+ * are chosen together, to minimize how much the lines have to
+ * be stretched (or, without justification, how ragged they
+ * are), with penalties for hyphenated lines. Paragraphs with
+ * tabs or line separators, and ellipsized paragraphs, are
+ * still broken greedily.
+ *
+ * Since: 1.50
+ */
+void
+pango_layout_set_line_breaking (PangoLayout       *layout,
+                                PangoLineBreaking  line_breaking)
+{
+  g_return_if_fail (PANGO_IS_LAYOUT (layout));
+
+  if (layout->line_breaking != line_breaking)
+    {
+      layout->line_breaking = line_breaking;
+
+      if (layout->width != -1)
+        layout_changed (layout);
+    }
+}
+
+/**
+ * pango_layout_get_line_breaking:
+ * @layout: a #PangoLayout
+ *
+ * Gets how @layout chooses line breaks.
+ * See pango_layout_set_line_breaking().
+ *
+ * Return value: the line breaking strategy
+ *
+ * Since: 1.50
+ */
+PangoLineBreaking
+pango_layout_get_line_breaking (PangoLayout *layout)
+{
+  g_return_val_if_fail (PANGO_IS_LAYOUT (layout), PANGO_LINE_BREAKING_GREEDY);
+
+  return layout->line_breaking;
+}
+
 /**
  * pango_layout_is_wrapped:
  * @layout: a #PangoLayout
@@ -1014,6 +1108,111 @@ pango_layout_get_single_paragraph_mode (PangoLayout *layout)
   return layout->single_paragraph;
 }
 
+/**
+ * pango_layout_set_lazy:
+ * @layout: a #PangoLayout
+ * @lazy: whether to lay out lines on demand
+ *
+ * Sets whether @layout computes its lines lazily.
+ *
+ * Normally, the first request for any information about the
+ * lines of a #PangoLayout lays out the complete text. A lazy
+ * layout only lays out as many paragraphs as needed to answer
+ * the request: pango_layout_get_line(), pango_layout_get_iter()
+ * and functions based on iterators, like pango_layout_xy_to_index(),
+ * only lay out paragraphs up to the position they need. Other
+ * functions, like pango_layout_get_extents() or
+ * pango_layout_get_line_count(), still lay out all of the text.
+ *
+ * This makes it possible to display the beginning of very large
+ * texts without laying them out completely. Use
+ * pango_layout_get_estimated_height() to size scrollbars.
+ *
+ * Lines are only computed lazily when a width is set on @layout
+ * and its height is not positive.
+ *
+ * Since: 1.50
+ */
+void
+pango_layout_set_lazy (PangoLayout *layout,
+                       gboolean     lazy)
+{
+  g_return_if_fail (PANGO_IS_LAYOUT (layout));
+
+  lazy = lazy != FALSE;
+
+  if (layout->lazy != lazy)
+    {
+      layout->lazy = lazy;
+      layout_changed (layout);
+    }
+}
+
+/**
+ * pango_layout_get_lazy:
+ * @layout: a #PangoLayout
+ *
+ * Returns whether @layout computes its lines lazily.
+ * See pango_layout_set_lazy().
+ *
+ * Return value: %TRUE if lines are computed on demand
+ *
+ * Since: 1.50
+ */
+gboolean
+pango_layout_get_lazy (PangoLayout *layout)
+{
+  g_return_val_if_fail (PANGO_IS_LAYOUT (layout), FALSE);
+
+  return layout->lazy;
+}
+
+/**
+ * pango_layout_set_parallel:
+ * @layout: a #PangoLayout
+ * @parallel: whether to use several threads for laying out
+ *
+ * Sets whether @layout may use other threads to speed up
+ * laying out long texts with many paragraphs.
+ *
+ * Parallel layout analyzes the break opportunities of all
+ * paragraphs on a pool of threads before the paragraphs are
+ * itemized, broken into lines and shaped in order. The resulting
+ * lines are the same as without it.
+ *
+ * Parallel layout is not used for lazy layouts, layouts with a
+ * positive height or in single paragraph mode.
+ *
+ * Since: 1.50
+ */
+void
+pango_layout_set_parallel (PangoLayout *layout,
+                           gboolean     parallel)
+{
+  g_return_if_fail (PANGO_IS_LAYOUT (layout));
+
+  layout->parallel = parallel != FALSE;
+}
+
+/**
+ * pango_layout_get_parallel:
+ * @layout: a #PangoLayout
+ *
+ * Returns whether @layout may use other threads for laying out.
+ * See pango_layout_set_parallel().
+ *
+ * Return value: %TRUE if parallel layout is enabled
+ *
+ * Since: 1.50
+ */
+gboolean
+pango_layout_get_parallel (PangoLayout *layout)
+{
+  g_return_val_if_fail (PANGO_IS_LAYOUT (layout), FALSE);
+
+  return layout->parallel;
+}
+
 /**
  * pango_layout_set_ellipsize:
  * @layout: a #PangoLayout
@@ -1096,6 +1295,37 @@ pango_layout_is_ellipsized (PangoLayout *layout)
   return layout->is_ellipsized;
 }
 
+/* Validates @text, and replaces invalid bytes with -1.
+ * Returns %FALSE if any replacement was made.
+ */
+static gboolean
+sanitize_text (char *text)
+{
+  char *start, *end;
+
+  start = text;
+  for (;;) {
+    gboolean valid;
+
+    valid = g_utf8_validate (start, -1, (const char **)&end);
+
+    if (!*end)
+      break;
+
+    /* Replace invalid bytes with -1.  The -1 will be converted to
+     * ((gunichar) -1) by glib, and that in turn yields a glyph value of
+     * ((PangoGlyph) -1) by PANGO_GET_UNKNOWN_GLYPH(-1),
+     * and that's PANGO_GLYPH_INVALID_INPUT.
+     */
+    if (!valid)
+      *end++ = -1;
+
+    start = end;
+  }
+
+  return start == text;
+}
+
 /**
  * pango_layout_set_text:
  * @layout: a #PangoLayout
@@ -1122,7 +1352,7 @@ pango_layout_set_text (PangoLayout *layout,
 		       const char  *text,
 		       int          length)
 {
-  char *old_text, *start, *end;
+  char *old_text;
 
   g_return_if_fail (layout != NULL);
   g_return_if_fail (length == 0 || text != NULL);
@@ -1147,28 +1377,7 @@ pango_layout_set_text (PangoLayout *layout,
       layout->text = g_malloc0 (1);
     }
 
-  /* validate it, and replace invalid bytes with -1 */
-  start = layout->text;
-  for (;;) {
-    gboolean valid;
-
-    valid = g_utf8_validate (start, -1, (const char **)&end);
-
-    if (!*end)
-      break;
-
-    /* Replace invalid bytes with -1.  The -1 will be converted to
-     * ((gunichar) -1) by glib, and that in turn yields a glyph value of
-     * ((PangoGlyph) -1) by PANGO_GET_UNKNOWN_GLYPH(-1),
-     * and that's PANGO_GLYPH_INVALID_INPUT.
-     */
-    if (!valid)
-      *end++ = -1;
-
-    start = end;
-  }
-
-  if (start != layout->text)
+  if (!sanitize_text (layout->text))
     /* TODO: Write out the beginning excerpt of text? */
     g_warning ("Invalid UTF-8 string passed to pango_layout_set_text()");
 
@@ -1180,6 +1389,195 @@ pango_layout_set_text (PangoLayout *layout,
   g_free (old_text);
 }
 
+/* Replaces @old_length bytes at @start with @text. The attributes
+ * are adjusted with pango_attr_list_update(), or, if @attrs is
+ * given, the attributes in @attrs are spliced in for the new text.
+ */
+static void
+layout_replace_text (PangoLayout   *layout,
+                     int            start,
+                     int            old_length,
+                     const char    *text,
+                     int            length,
+                     PangoAttrList *attrs)
+{
+  char *old_text;
+  char *inserted;
+  int old_n_chars;
+  int new_length;
+  gboolean have_lines;
+
+  if (G_UNLIKELY (!layout->text))
+    pango_layout_set_text (layout, NULL, 0);
+
+  g_return_if_fail ((layout->text[start] & 0xc0) != 0x80);
+  g_return_if_fail ((layout->text[start + old_length] & 0xc0) != 0x80);
+
+  if (length == 0)
+    inserted = g_strdup ("");
+  else if (length < 0)
+    inserted = g_strdup (text);
+  else
+    inserted = g_strndup (text, length);
+
+  if (!sanitize_text (inserted))
+    g_warning ("Invalid UTF-8 string passed to pango_layout_replace_text()");
+
+  new_length = strlen (inserted);
+
+  /* Drops the lines if the context has changed */
+  check_context_changed (layout);
+  have_lines = layout->lines != NULL && !layout->lines_incomplete;
+
+  old_text = layout->text;
+  old_n_chars = layout->n_chars;
+
+  layout->text = g_malloc (layout->length - old_length + new_length + 1);
+  memcpy (layout->text, old_text, start);
+  memcpy (layout->text + start, inserted, new_length);
+  memcpy (layout->text + start + new_length,
+          old_text + start + old_length,
+          layout->length - start - old_length + 1);
+
+  layout->length += new_length - old_length;
+  layout->n_chars += pango_utf8_strlen (inserted, new_length) -
+                     pango_utf8_strlen (old_text + start, old_length);
+
+  if (layout->attrs || attrs)
+    {
+      PangoAttrList *new_attrs;
+
+      /* Only adjust the list in place if nobody else holds it */
+      if (!layout->attrs)
+        new_attrs = pango_attr_list_new ();
+      else if (layout->attrs->ref_count == 1)
+        new_attrs = pango_attr_list_ref (layout->attrs);
+      else
+        new_attrs = pango_attr_list_copy (layout->attrs);
+
+      if (attrs)
+        {
+          pango_attr_list_update (new_attrs, start, old_length, 0);
+          pango_attr_list_splice (new_attrs, attrs, start, new_length);
+        }
+      else
+        pango_attr_list_update (new_attrs, start, old_length, new_length);
+
+      pango_attr_list_unref (layout->attrs);
+      layout->attrs = new_attrs;
+    }
+
+  /* Retained shaping refers to the old text */
+  g_clear_pointer (&layout->shaped_paragraphs, g_ptr_array_unref);
+
+  if (have_lines &&
+      pango_layout_update_paragraphs (layout, old_text, old_n_chars,
+                                      start, old_length, new_length))
+    {
+      layout->serial++;
+      if (layout->serial == 0)
+        layout->serial++;
+    }
+  else
+    layout_changed (layout);
+
+  g_free (old_text);
+  g_free (inserted);
+}
+
+/**
+ * pango_layout_replace_text:
+ * @layout: a #PangoLayout
+ * @start: byte index of the first byte to replace
+ * @old_length: number of bytes to remove, starting at @start
+ * @text: the text to insert at @start
+ * @length: length of @text in bytes, or -1 if @text is nul-terminated.
+ *          The text will also be truncated on encountering a
+ *          nul-termination even when @length is positive.
+ *
+ * Replaces @old_length bytes of the text of @layout, starting at
+ * @start, with @text. Both @start and @start + @old_length must
+ * be at character boundaries.
+ *
+ * The result is the same as setting the edited text with
+ * pango_layout_set_text(), but when the layout has already been
+ * laid out, the lines of paragraphs that are not affected by the
+ * change are kept, and only the changed paragraphs are itemized,
+ * broken into lines and shaped again. This makes small edits of
+ * large texts much cheaper.
+ *
+ * The attributes of @layout are adjusted to the edit with
+ * pango_attr_list_update(). If the attribute list is shared with
+ * others, a copy of it is adjusted and replaces it.
+ *
+ * As with any other change, iterators and lines obtained from
+ * @layout before the call should not be used anymore.
+ *
+ * Since: 1.50
+ */
+void
+pango_layout_replace_text (PangoLayout *layout,
+                           int          start,
+                           int          old_length,
+                           const char  *text,
+                           int          length)
+{
+  g_return_if_fail (PANGO_IS_LAYOUT (layout));
+  g_return_if_fail (length == 0 || text != NULL);
+  g_return_if_fail (start >= 0 && old_length >= 0);
+  g_return_if_fail (start + old_length <= layout->length);
+
+  layout_replace_text (layout, start, old_length, text, length, NULL);
+}
+
+/**
+ * pango_layout_insert_text:
+ * @layout: a #PangoLayout
+ * @start: byte index at which to insert @text
+ * @text: the text to insert
+ * @length: length of @text in bytes, or -1 if @text is nul-terminated.
+ * @attrs: (nullable): attributes for @text, with indices relative
+ *   to @text, or %NULL
+ *
+ * Inserts @text with the attributes @attrs at @start, which must
+ * be at a character boundary.
+ *
+ * Like pango_layout_replace_text(), this only lays out the changed
+ * paragraphs again. The attributes of @layout are adjusted as with
+ * pango_attr_list_splice(), so attributes that cover @start are
+ * stretched over the new text, and @attrs are changed in on top.
+ *
+ * Together with pango_markup_parser_new_streaming(), this can be
+ * used to lay out large markup a paragraph at a time, while it is
+ * being parsed.
+ *
+ * Since: 1.50
+ */
+void
+pango_layout_insert_text (PangoLayout   *layout,
+                          int            start,
+                          const char    *text,
+                          int            length,
+                          PangoAttrList *attrs)
+{
+  PangoAttrList no_attrs;
+
+  g_return_if_fail (PANGO_IS_LAYOUT (layout));
+  g_return_if_fail (length == 0 || text != NULL);
+  g_return_if_fail (start >= 0 && start <= layout->length);
+
+  if (attrs)
+    {
+      layout_replace_text (layout, start, 0, text, length, attrs);
+      return;
+    }
+
+  /* Still splice, so that attributes ending at @start don't grow */
+  _pango_attr_list_init (&no_attrs);
+  layout_replace_text (layout, start, 0, text, length, &no_attrs);
+  _pango_attr_list_destroy (&no_attrs);
+}
+
 /**
  * pango_layout_get_text:
  * @layout: a #PangoLayout
@@ -1374,6 +1772,37 @@ layout_changed (PangoLayout *layout)
   pango_layout_clear_lines (layout);
 }
 
+/* Like layout_changed(), but keeps what does not depend on the
+ * width. A layout that gets rewrapped is likely to be rewrapped
+ * again, so from now on it keeps the shaped items of its paragraphs
+ * around, and only has to break them into lines again.
+ */
+static void
+layout_width_changed (PangoLayout *layout)
+{
+  GPtrArray *shaped_paragraphs;
+  PangoLogAttr *log_attrs;
+  int n_log_attrs;
+
+  if (layout->lines)
+    layout->retain_shaping = TRUE;
+
+  shaped_paragraphs = g_steal_pointer (&layout->shaped_paragraphs);
+  log_attrs = g_steal_pointer (&layout->log_attrs);
+  n_log_attrs = layout->n_log_attrs;
+
+  layout_changed (layout);
+
+  if (shaped_paragraphs)
+    {
+      layout->shaped_paragraphs = shaped_paragraphs;
+      layout->log_attrs = log_attrs;
+      layout->n_log_attrs = n_log_attrs;
+    }
+  else
+    g_free (log_attrs);
+}
+
 /**
  * pango_layout_context_changed:
  * @layout: a #PangoLayout
@@ -1588,22 +2017,19 @@ PangoLayoutLine *
 pango_layout_get_line (PangoLayout *layout,
 		       int          line)
 {
-  GSList *list_item;
   g_return_val_if_fail (layout != NULL, NULL);
 
   if (line < 0)
     return NULL;
 
-  pango_layout_check_lines (layout);
-
-  list_item = g_slist_nth (layout->lines, line);
+  pango_layout_check_n_lines (layout, line + 1);
 
-  if (list_item)
+  if ((guint) line < layout->line_count)
     {
-      PangoLayoutLine *line = list_item->data;
+      PangoLayoutLine *layout_line = LINE_TABLE_LINE (get_line_table (layout), line);
 
-      pango_layout_line_leaked (line);
-      return line;
+      pango_layout_line_leaked (layout_line);
+      return layout_line;
     }
 
   return NULL;
@@ -1633,21 +2059,15 @@ PangoLayoutLine *
 pango_layout_get_line_readonly (PangoLayout *layout,
 				int          line)
 {
-  GSList *list_item;
   g_return_val_if_fail (layout != NULL, NULL);
 
   if (line < 0)
     return NULL;
 
-  pango_layout_check_lines (layout);
-
-  list_item = g_slist_nth (layout->lines, line);
+  pango_layout_check_n_lines (layout, line + 1);
 
-  if (list_item)
-    {
-      PangoLayoutLine *line = list_item->data;
-      return line;
-    }
+  if ((guint) line < layout->line_count)
+    return LINE_TABLE_LINE (get_line_table (layout), line);
 
   return NULL;
 }
@@ -1729,41 +2149,22 @@ pango_layout_index_to_line (PangoLayout      *layout,
 			    PangoLayoutLine **line_before,
 			    PangoLayoutLine **line_after)
 {
-  GSList *tmp_list;
-  GSList *line_list;
-  PangoLayoutLine *line = NULL;
-  PangoLayoutLine *prev_line = NULL;
-  int i = -1;
-
-  line_list = tmp_list = layout->lines;
-  while (tmp_list)
-    {
-      PangoLayoutLine *tmp_line = tmp_list->data;
-
-      if (tmp_line->start_index > index)
-	break; /* index was in paragraph delimiters */
-
-      prev_line = line;
-      line = tmp_line;
-      line_list = tmp_list;
-      i++;
-
-      if (line->start_index + line->length > index)
-	break;
+  GSList **links;
+  int i;
 
-      tmp_list = tmp_list->next;
-    }
+  links = get_line_table (layout);
+  i = find_line_by_index (layout, index);
 
   if (line_nr)
     *line_nr = i;
 
   if (line_before)
-    *line_before = prev_line;
+    *line_before = i > 0 ? LINE_TABLE_LINE (links, i - 1) : NULL;
 
   if (line_after)
-    *line_after = (line_list && line_list->next) ? line_list->next->data : NULL;
+    *line_after = (guint) (i + 1) < layout->line_count ? LINE_TABLE_LINE (links, i + 1) : NULL;
 
-  return line;
+  return i >= 0 ? LINE_TABLE_LINE (links, i) : NULL;
 }
 
 static PangoLayoutLine *
@@ -1771,33 +2172,18 @@ pango_layout_index_to_line_and_extents (PangoLayout     *layout,
 					int              index,
 					PangoRectangle  *line_rect)
 {
-  PangoLayoutIter iter;
-  PangoLayoutLine *line = NULL;
-
-  _pango_layout_get_iter (layout, &iter);
-
-  if (!ITER_IS_INVALID (&iter))
-    while (TRUE)
-      {
-	PangoLayoutLine *tmp_line = _pango_layout_iter_get_line (&iter);
-
-	if (tmp_line->start_index > index)
-	    break; /* index was in paragraph delimiters */
-
-	line = tmp_line;
-
-	pango_layout_iter_get_line_extents (&iter, NULL, line_rect);
+  int i;
 
-	if (line->start_index + line->length > index)
-	  break;
+  check_lines_to_index (layout, index);
 
-	if (!pango_layout_iter_next_line (&iter))
-	  break; /* Use end of last line */
-      }
+  i = find_line_by_index (layout, index);
+  if (i < 0)
+    return NULL;
 
-  _pango_layout_iter_destroy (&iter);
+  if (line_rect)
+    *line_rect = get_line_table_extents (layout)[i].logical_rect;
 
-  return line;
+  return LINE_TABLE_LINE (get_line_table (layout), i);
 }
 
 /**
@@ -2072,78 +2458,25 @@ pango_layout_xy_to_index (PangoLayout *layout,
 			  int         *index,
 			  gint        *trailing)
 {
-  PangoLayoutIter iter;
-  PangoLayoutLine *prev_line = NULL;
-  PangoLayoutLine *found = NULL;
-  int found_line_x = 0;
-  int prev_last = 0;
-  int prev_line_x = 0;
+  PangoLayoutLine *found;
+  const Extents *extents;
+  int i;
   gboolean retval = FALSE;
   gboolean outside = FALSE;
 
   g_return_val_if_fail (PANGO_IS_LAYOUT (layout), FALSE);
 
-  _pango_layout_get_iter (layout, &iter);
+  i = find_line_by_y (layout, y, &outside);
 
-  do
-    {
-      PangoRectangle line_logical;
-      int first_y, last_y;
+  found = LINE_TABLE_LINE (get_line_table (layout), i);
+  extents = get_line_table_extents (layout);
 
-      g_assert (!ITER_IS_INVALID (&iter));
+  retval = pango_layout_line_x_to_index (found,
+					 x - extents[i].logical_rect.x,
+					 index, trailing);
 
-      pango_layout_iter_get_line_extents (&iter, NULL, &line_logical);
-      pango_layout_iter_get_line_yrange (&iter, &first_y, &last_y);
-
-      if (y < first_y)
-	{
-	  if (prev_line && y < (prev_last + (first_y - prev_last) / 2))
-	    {
-	      found = prev_line;
-	      found_line_x = prev_line_x;
-	    }
-	  else
-	    {
-	      if (prev_line == NULL)
-		outside = TRUE; /* off the top */
-
-	      found = _pango_layout_iter_get_line (&iter);
-	      found_line_x = x - line_logical.x;
-	    }
-	}
-      else if (y >= first_y &&
-	       y < last_y)
-	{
-	  found = _pango_layout_iter_get_line (&iter);
-	  found_line_x = x - line_logical.x;
-	}
-
-      prev_line = _pango_layout_iter_get_line (&iter);
-      prev_last = last_y;
-      prev_line_x = x - line_logical.x;
-
-      if (found != NULL)
-	break;
-    }
-  while (pango_layout_iter_next_line (&iter));
-
-  _pango_layout_iter_destroy (&iter);
-
-  if (found == NULL)
-    {
-      /* Off the bottom of the layout */
-      outside = TRUE;
-
-      found = prev_line;
-      found_line_x = prev_line_x;
-    }
-
-  retval = pango_layout_line_x_to_index (found,
-					 found_line_x,
-					 index, trailing);
-
-  if (outside)
-    retval = FALSE;
+  if (outside)
+    retval = FALSE;
 
   return retval;
 }
@@ -2167,65 +2500,37 @@ pango_layout_index_to_pos (PangoLayout    *layout,
 			   PangoRectangle *pos)
 {
   PangoRectangle logical_rect;
-  PangoLayoutIter iter;
-  PangoLayoutLine *layout_line = NULL;
+  PangoLayoutLine *layout_line;
   int x_pos;
 
   g_return_if_fail (layout != NULL);
   g_return_if_fail (index >= 0);
   g_return_if_fail (pos != NULL);
 
-  _pango_layout_get_iter (layout, &iter);
-
-  if (!ITER_IS_INVALID (&iter))
-    {
-      while (TRUE)
-	{
-	  PangoLayoutLine *tmp_line = _pango_layout_iter_get_line (&iter);
-
-	  if (tmp_line->start_index > index)
-	    {
-	      /* index is in the paragraph delim&iters, move to
-	       * end of previous line
-	       *
-	       * This shouldn’t occur in the first loop &iteration as the first
-	       * line’s start_index should always be 0.
-	       */
-	      g_assert (layout_line != NULL);
-	      index = layout_line->start_index + layout_line->length;
-	      break;
-	    }
-
-	  layout_line = tmp_line;
+  layout_line = pango_layout_index_to_line_and_extents (layout, index, &logical_rect);
 
-	  pango_layout_iter_get_line_extents (&iter, NULL, &logical_rect);
-
-	  if (layout_line->start_index + layout_line->length > index)
-	    break;
+  /* The first line's start_index should always be 0 */
+  g_assert (layout_line != NULL);
 
-	  if (!pango_layout_iter_next_line (&iter))
-	    {
-	      index = layout_line->start_index + layout_line->length;
-	      break;
-	    }
-	}
+  /* If index is in the paragraph delimiters, or after the
+   * end of the last line, move to the end of the line
+   */
+  if (index > layout_line->start_index + layout_line->length)
+    index = layout_line->start_index + layout_line->length;
 
-      pos->y = logical_rect.y;
-      pos->height = logical_rect.height;
+  pos->y = logical_rect.y;
+  pos->height = logical_rect.height;
 
-      pango_layout_line_index_to_x (layout_line, index, 0, &x_pos);
-      pos->x = logical_rect.x + x_pos;
+  pango_layout_line_index_to_x (layout_line, index, 0, &x_pos);
+  pos->x = logical_rect.x + x_pos;
 
-      if (index < layout_line->start_index + layout_line->length)
-	{
-	  pango_layout_line_index_to_x (layout_line, index, 1, &x_pos);
-	  pos->width = (logical_rect.x + x_pos) - pos->x;
-	}
-      else
-	pos->width = 0;
+  if (index < layout_line->start_index + layout_line->length)
+    {
+      pango_layout_line_index_to_x (layout_line, index, 1, &x_pos);
+      pos->width = (logical_rect.x + x_pos) - pos->x;
     }
-
-  _pango_layout_iter_destroy (&iter);
+  else
+    pos->width = 0;
 }
 
 static void
@@ -2663,6 +2968,53 @@ get_line_extents_layout_coords (PangoLayout     *layout,
     *baseline = new_baseline;
 }
 
+/* Fills @ext with the extents of @line, placing it below the
+ * line with extents @prev, or at the top of the layout if @prev
+ * is %NULL. The ink rect is not set.
+ */
+static void
+get_line_extents_below (PangoLayout     *layout,
+                        PangoLayoutLine *line,
+                        int              layout_width,
+                        const Extents   *prev,
+                        Extents         *ext)
+{
+  int y_offset = 0;
+  int baseline = 0;
+
+  if (prev)
+    {
+      y_offset = prev->logical_rect.y + prev->logical_rect.height + layout->spacing;
+      baseline = prev->baseline;
+    }
+
+  get_line_extents_layout_coords (layout, line,
+                                  layout_width, y_offset,
+                                  &baseline,
+                                  NULL,
+                                  &ext->logical_rect);
+  ext->baseline = baseline;
+}
+
+/* Fills @line_extents with the extents of the lines starting at
+ * @line_list, placing them below the line with extents @prev,
+ * or at the top of the layout if @prev is %NULL
+ */
+static void
+get_lines_extents (PangoLayout   *layout,
+                   GSList        *line_list,
+                   int            layout_width,
+                   const Extents *prev,
+                   Extents       *line_extents)
+{
+  for (; line_list; line_list = line_list->next, line_extents++)
+    {
+      get_line_extents_below (layout, line_list->data, layout_width,
+                              prev, line_extents);
+      prev = line_extents;
+    }
+}
+
 /* if non-NULL line_extents returns a list of line extents
  * in layout coordinates
  */
@@ -2848,6 +3200,235 @@ pango_layout_get_extents_internal (PangoLayout    *layout,
     }
 }
 
+/* Random access to the lines
+ *
+ * Finding a line by number, byte index or y position in the list of
+ * lines takes time linear in the number of lines. So layouts keep
+ * an array of the links of the lines, and the extents of the lines,
+ * and find lines by bisecting those instead. Both are made when
+ * first needed, extended when a lazy layout gets more lines, and
+ * dropped whenever the lines change.
+ */
+
+static void
+clear_line_table (PangoLayout *layout)
+{
+  g_clear_pointer (&layout->line_table, g_ptr_array_unref);
+  clear_line_table_extents (layout);
+}
+
+static void
+clear_line_table_extents (PangoLayout *layout)
+{
+  g_free (layout->line_table_extents);
+  layout->line_table_extents = NULL;
+  layout->n_line_table_extents = 0;
+}
+
+/* Returns the links of the lines of @layout that are laid out.
+ * New lines of lazy layouts are appended after the last link,
+ * so the table only has to be extended.
+ */
+static GSList **
+get_line_table (PangoLayout *layout)
+{
+  GPtrArray *table;
+  GSList *l;
+
+  if (!layout->line_table)
+    layout->line_table = g_ptr_array_sized_new (layout->line_count);
+
+  table = layout->line_table;
+
+  if (table->len < layout->line_count)
+    {
+      if (table->len > 0)
+        l = ((GSList *) g_ptr_array_index (table, table->len - 1))->next;
+      else
+        l = layout->lines;
+
+      for (; l; l = l->next)
+        g_ptr_array_add (table, l);
+    }
+
+  return (GSList **) table->pdata;
+}
+
+/* Returns the extents of the lines of @layout that are laid out,
+ * as for iterators. Ink rects are not set.
+ */
+static const Extents *
+get_line_table_extents (PangoLayout *layout)
+{
+  guint n = layout->n_line_table_extents;
+  GSList **links;
+
+  if (n == layout->line_count)
+    return layout->line_table_extents;
+
+  links = get_line_table (layout);
+
+  if (layout->width == -1)
+    {
+      /* The lines depend on the width of the widest line.
+       * Such layouts are not lazy, so all lines are there.
+       */
+      clear_line_table_extents (layout);
+      pango_layout_get_extents_internal (layout, NULL, NULL,
+                                         &layout->line_table_extents);
+    }
+  else
+    {
+      layout->line_table_extents = g_renew (Extents, layout->line_table_extents,
+                                            layout->line_count);
+      get_lines_extents (layout, links[n], layout->width,
+                         n > 0 ? &layout->line_table_extents[n - 1] : NULL,
+                         &layout->line_table_extents[n]);
+    }
+
+  layout->n_line_table_extents = layout->line_count;
+
+  return layout->line_table_extents;
+}
+
+/* Makes sure that the line with @index is laid out */
+static void
+check_lines_to_index (PangoLayout *layout,
+                      int          index)
+{
+  pango_layout_check_n_lines (layout, 1);
+
+  while (layout->lines_incomplete && layout->lines_end_index <= index)
+    pango_layout_check_n_lines (layout, layout->line_count + 1);
+}
+
+/* Returns the number of the last line that starts at or before
+ * @index, or -1 if there is none. That is the line with @index,
+ * or the line before the paragraph delimiters that @index is in.
+ */
+static int
+find_line_by_index (PangoLayout *layout,
+                    int          index)
+{
+  GSList **links = get_line_table (layout);
+  guint lo = 0, hi = layout->line_count;
+
+  while (lo < hi)
+    {
+      guint mid = (lo + hi) / 2;
+
+      if (LINE_TABLE_LINE (links, mid)->start_index <= index)
+        lo = mid + 1;
+      else
+        hi = mid;
+    }
+
+  return (int) lo - 1;
+}
+
+/* The range of y positions that belongs to line @i, as in
+ * pango_layout_iter_get_line_yrange()
+ */
+static void
+get_line_table_yrange (PangoLayout   *layout,
+                       const Extents *extents,
+                       int            i,
+                       int           *y0,
+                       int           *y1)
+{
+  const PangoRectangle *rect = &extents[i].logical_rect;
+  int half_spacing = layout->spacing / 2;
+
+  if (y0)
+    {
+      if (i == 0)
+        *y0 = rect->y;
+      else
+        *y0 = rect->y - (layout->spacing - half_spacing);
+    }
+
+  if (y1)
+    {
+      if ((guint) i + 1 == layout->line_count && !layout->lines_incomplete)
+        *y1 = rect->y + rect->height;
+      else
+        *y1 = rect->y + rect->height + half_spacing;
+    }
+}
+
+/* Returns the number of the line that @y is closest to. If
+ * @y is between two lines, that is the nearer one. @outside
+ * is set if @y is above the first line or below the last one.
+ */
+static int
+find_line_by_y (PangoLayout *layout,
+                int          y,
+                gboolean    *outside)
+{
+  const Extents *extents;
+  int lo, hi;
+  int first_y, last_y, prev_last;
+
+  pango_layout_check_n_lines (layout, 1);
+
+  /* Lay out lazy layouts until they get to y */
+  while (layout->lines_incomplete)
+    {
+      extents = get_line_table_extents (layout);
+      get_line_table_yrange (layout, extents, layout->line_count - 1, NULL, &last_y);
+
+      if (y < last_y)
+        break;
+
+      pango_layout_check_n_lines (layout, layout->line_count + 1);
+    }
+
+  extents = get_line_table_extents (layout);
+
+  /* Find the first line that ends below y */
+  lo = 0;
+  hi = layout->line_count;
+  while (lo < hi)
+    {
+      int mid = (lo + hi) / 2;
+
+      get_line_table_yrange (layout, extents, mid, NULL, &last_y);
+
+      if (y < last_y)
+        hi = mid;
+      else
+        lo = mid + 1;
+    }
+
+  *outside = FALSE;
+
+  if ((guint) lo == layout->line_count)
+    {
+      /* Off the bottom of the layout */
+      *outside = TRUE;
+      return lo - 1;
+    }
+
+  get_line_table_yrange (layout, extents, lo, &first_y, NULL);
+
+  if (y >= first_y)
+    return lo;
+
+  if (lo == 0)
+    {
+      /* Off the top of the layout */
+      *outside = TRUE;
+      return 0;
+    }
+
+  get_line_table_yrange (layout, extents, lo - 1, NULL, &prev_last);
+
+  if (y < prev_last + (first_y - prev_last) / 2)
+    return lo - 1;
+
+  return lo;
+}
+
 /**
  * pango_layout_get_extents:
  * @layout:   a #PangoLayout
@@ -2959,6 +3540,52 @@ pango_layout_get_pixel_size (PangoLayout *layout,
     *height = logical_rect.height;
 }
 
+/**
+ * pango_layout_get_estimated_height:
+ * @layout: a #PangoLayout
+ *
+ * Returns an estimate for the logical height of @layout.
+ *
+ * If all of @layout has been laid out, this is the same as the
+ * height returned by pango_layout_get_size(). For lazy layouts
+ * that have only been laid out partially, the height of the lines
+ * laid out so far is extrapolated to the whole text, without
+ * laying out anything more. The estimate changes as more lines
+ * are laid out. See pango_layout_set_lazy().
+ *
+ * Return value: the estimated height, in Pango units
+ *
+ * Since: 1.50
+ */
+int
+pango_layout_get_estimated_height (PangoLayout *layout)
+{
+  GSList *line_list;
+  int y_offset = 0;
+  int baseline = 0;
+  PangoRectangle logical;
+
+  g_return_val_if_fail (PANGO_IS_LAYOUT (layout), 0);
+
+  pango_layout_check_n_lines (layout, 1);
+
+  if (!layout->lines_incomplete)
+    {
+      pango_layout_get_extents_internal (layout, NULL, &logical, NULL);
+      return logical.height;
+    }
+
+  for (line_list = layout->lines; line_list; line_list = line_list->next)
+    {
+      get_line_extents_layout_coords (layout, line_list->data,
+                                      layout->width, y_offset,
+                                      &baseline, NULL, &logical);
+      y_offset = logical.y + logical.height + layout->spacing;
+    }
+
+  return (gint64) (logical.y + logical.height) * layout->length / layout->lines_end_index;
+}
+
 /**
  * pango_layout_get_baseline:
  * @layout: a #PangoLayout
@@ -3003,13 +3630,19 @@ pango_layout_clear_lines (PangoLayout *layout)
       layout->lines = NULL;
       layout->line_count = 0;
 
-      /* This could be handled separately, since we don't need to
-       * recompute log_attrs on a width change, but this is easiest
-       */
-      g_free (layout->log_attrs);
-      layout->log_attrs = NULL;
+      layout->lines_tail = NULL;
+      layout->lines_incomplete = FALSE;
     }
 
+  /* See layout_width_changed() for keeping these */
+  g_free (layout->log_attrs);
+  layout->log_attrs = NULL;
+  layout->n_log_attrs = 0;
+
+  g_clear_pointer (&layout->shaped_paragraphs, g_ptr_array_unref);
+
+  clear_line_table (layout);
+
   layout->unknown_glyphs_count = -1;
   layout->logical_rect_cached = FALSE;
   layout->ink_rect_cached = FALSE;
@@ -3028,6 +3661,7 @@ pango_layout_line_leaked (PangoLayoutLine *line)
     {
       line->layout->logical_rect_cached = FALSE;
       line->layout->ink_rect_cached = FALSE;
+      clear_line_table_extents (line->layout);
     }
 }
 
@@ -3071,6 +3705,96 @@ uninsert_run (PangoLayoutLine *line)
   return item;
 }
 
+/* Attributes that affect font selection, and ones that need to
+ * be constant across runs
+ */
+#define ITEMIZE_ATTR_TYPES \
+  (PANGO_ATTR_TYPE_BIT (PANGO_ATTR_LANGUAGE) | \
+   PANGO_ATTR_TYPE_BIT (PANGO_ATTR_FAMILY) | \
+   PANGO_ATTR_TYPE_BIT (PANGO_ATTR_STYLE) | \
+   PANGO_ATTR_TYPE_BIT (PANGO_ATTR_WEIGHT) | \
+   PANGO_ATTR_TYPE_BIT (PANGO_ATTR_VARIANT) | \
+   PANGO_ATTR_TYPE_BIT (PANGO_ATTR_STRETCH) | \
+   PANGO_ATTR_TYPE_BIT (PANGO_ATTR_SIZE) | \
+   PANGO_ATTR_TYPE_BIT (PANGO_ATTR_FONT_DESC) | \
+   PANGO_ATTR_TYPE_BIT (PANGO_ATTR_SCALE) | \
+   PANGO_ATTR_TYPE_BIT (PANGO_ATTR_FALLBACK) | \
+   PANGO_ATTR_TYPE_BIT (PANGO_ATTR_ABSOLUTE_SIZE) | \
+   PANGO_ATTR_TYPE_BIT (PANGO_ATTR_GRAVITY) | \
+   PANGO_ATTR_TYPE_BIT (PANGO_ATTR_GRAVITY_HINT) | \
+   PANGO_ATTR_TYPE_BIT (PANGO_ATTR_LETTER_SPACING) | \
+   PANGO_ATTR_TYPE_BIT (PANGO_ATTR_SHAPE) | \
+   PANGO_ATTR_TYPE_BIT (PANGO_ATTR_RISE))
+
+/* Attributes that affect breaking or shaping */
+#define SHAPE_ATTR_TYPES \
+  (PANGO_ATTR_TYPE_BIT (PANGO_ATTR_ALLOW_BREAKS) | \
+   PANGO_ATTR_TYPE_BIT (PANGO_ATTR_INSERT_HYPHENS) | \
+   PANGO_ATTR_TYPE_BIT (PANGO_ATTR_FONT_FEATURES) | \
+   PANGO_ATTR_TYPE_BIT (PANGO_ATTR_SHOW))
+
+/* The effective attributes of a layout, split by what they are
+ * used for. The lists are views on layout->attrs, so the layout
+ * attributes must not change while they are in use.
+ */
+typedef struct {
+  PangoAttrList itemize;  /* ITEMIZE_ATTR_TYPES */
+  PangoAttrList shape;    /* SHAPE_ATTR_TYPES */
+  PangoAttrList runs;     /* everything else */
+  PangoAttribute *extra[2];
+  guint n_extra;
+} LayoutAttrs;
+
+static void
+layout_attrs_init (PangoLayout *layout,
+                   LayoutAttrs *attrs)
+{
+  const guint64 masks[3] = {
+    ITEMIZE_ATTR_TYPES,
+    SHAPE_ATTR_TYPES,
+    ~(ITEMIZE_ATTR_TYPES | SHAPE_ATTR_TYPES)
+  };
+  PangoAttrList views[3];
+
+  attrs->n_extra = 0;
+
+  if (layout->single_paragraph)
+    attrs->extra[attrs->n_extra++] = pango_attr_show_new (PANGO_SHOW_LINE_BREAKS);
+
+  if (layout->font_desc)
+    attrs->extra[attrs->n_extra++] = pango_attr_font_desc_new (layout->font_desc);
+
+  _pango_attr_list_init_views (layout->attrs,
+                               attrs->extra, attrs->n_extra,
+                               masks, views, G_N_ELEMENTS (views));
+
+  attrs->itemize = views[0];
+  attrs->shape = views[1];
+  attrs->runs = views[2];
+}
+
+static void
+layout_attrs_clear (LayoutAttrs *attrs)
+{
+  guint i;
+
+  _pango_attr_list_destroy (&attrs->itemize);
+  _pango_attr_list_destroy (&attrs->shape);
+  _pango_attr_list_destroy (&attrs->runs);
+
+  for (i = 0; i < attrs->n_extra; i++)
+    pango_attribute_destroy (attrs->extra[i]);
+}
+
+/* Returns %NULL for an empty view, which is what the
+ * itemizer and the apply_attributes_to_ functions expect
+ */
+static inline PangoAttrList *
+view_or_null (PangoAttrList *view)
+{
+  return _pango_attr_list_has_attributes (view) ? view : NULL;
+}
+
 static void
 ensure_tab_width (PangoLayout *layout)
 {
@@ -3083,7 +3807,7 @@ ensure_tab_width (PangoLayout *layout)
       PangoItem *item;
       GList *items;
       PangoAttribute *attr;
-      PangoAttrList *layout_attrs;
+      LayoutAttrs layout_attrs;
       PangoAttrList tmp_attrs;
       PangoFontDescription *font_desc = pango_font_description_copy_static (pango_context_get_font_description (layout->context));
       PangoLanguage *language = NULL;
@@ -3092,12 +3816,12 @@ ensure_tab_width (PangoLayout *layout)
       if (pango_context_get_round_glyph_positions (layout->context))
         shape_flags |= PANGO_SHAPE_ROUND_POSITIONS;
 
-      layout_attrs = pango_layout_get_effective_attributes (layout);
-      if (layout_attrs)
+      layout_attrs_init (layout, &layout_attrs);
+      if (_pango_attr_list_has_attributes (&layout_attrs.itemize))
         {
           PangoAttrIterator iter;
 
-          _pango_attr_list_get_iterator (layout_attrs, &iter);
+          _pango_attr_list_get_iterator (&layout_attrs.itemize, &iter);
           pango_attr_iterator_get_font (&iter, font_desc, &language, NULL);
           _pango_attr_iterator_destroy (&iter);
         }
@@ -3116,11 +3840,7 @@ ensure_tab_width (PangoLayout *layout)
 
       items = pango_itemize (layout->context, " ", 0, 1, &tmp_attrs, NULL);
 
-      if (layout_attrs != layout->attrs)
-        {
-          pango_attr_list_unref (layout_attrs);
-          layout_attrs = NULL;
-        }
+      layout_attrs_clear (&layout_attrs);
       _pango_attr_list_destroy (&tmp_attrs);
 
       item = items->data;
@@ -3381,10 +4101,15 @@ struct _ParaBreakState
   int start_offset;		/* Character offset of first item in state->items in layout->text */
   ItemProperties properties;	/* Properties for the first item in state->items */
   int *log_widths;		/* Logical widths for first item in state->items.. */
+  int *log_widths_sums;		/* Sums of log_widths before each position */
+  gboolean log_widths_increasing; /* Whether log_widths_sums only increases */
   int log_widths_offset;        /* Offset into log_widths to the point corresponding
 				 * to the remaining portion of the first item */
 
   int *need_hyphen;             /* Insert a hyphen if breaking here ? */
+  int *scratch;			/* Storage for the arrays above, reused for all
+				 * items of the paragraph */
+  int scratch_size;
   int line_start_index;		/* Start index (byte offset) of line in layout->text */
   int line_start_offset;	/* Character offset of line in layout->text */
 
@@ -3393,63 +4118,253 @@ struct _ParaBreakState
   int remaining_width;		/* Amount of space remaining on line; < 0 is infinite */
 
   int hyphen_width;             /* How much space a hyphen will take */
+
+  ShapedParagraph *shaped;	/* Retained shaping of the paragraph, or NULL */
+  int *line_ends;		/* Character offsets at which to end the lines of the
+				 * paragraph, or NULL to break them greedily */
+  int line_end;			/* Index of the end of the current line in line_ends */
 };
 
-static gboolean
-should_ellipsize_current_line (PangoLayout    *layout,
-			       ParaBreakState *state);
+/* When a layout gets rewrapped, nothing but the line breaking
+ * depends on the width. To not itemize and shape the text all over
+ * again, such layouts keep the items of their paragraphs in
+ * layout->shaped_paragraphs, sorted by start, together with the
+ * glyphs and logical widths of the items, as far as they were
+ * needed. Only the pieces of items that get split at the end of
+ * a line, and tabs, need to be shaped again.
+ */
+typedef struct
+{
+  PangoItem *item;
+  PangoGlyphString *glyphs;	/* NULL until the item is shaped */
+  int *log_widths;		/* NULL until the item is broken */
+} ShapedItem;
+
+struct _ShapedParagraph
+{
+  int start;			/* Byte offset in layout->text */
+  int length;			/* Length in bytes, including the delimiter */
+  int n_chars;			/* Length in characters, including the delimiter */
+  PangoDirection base_dir;
+  PangoLogAttr end_attr;	/* The paragraph's own log attr for its end */
+  int n_items;
+  ShapedItem *items;		/* In logical order */
+};
 
-static PangoGlyphString *
-shape_run (PangoLayoutLine *line,
-	   ParaBreakState  *state,
-	   PangoItem       *item)
+static ShapedParagraph *
+shaped_paragraph_new (PangoLayout    *layout,
+                      int             start,
+                      int             length,
+                      int             start_offset,
+                      PangoDirection  base_dir,
+                      GList          *items)
 {
-  PangoLayout *layout = line->layout;
-  PangoGlyphString *glyphs = pango_glyph_string_new ();
+  ShapedParagraph *shaped = g_slice_new (ShapedParagraph);
+  GList *l;
+  int i;
 
-  if (layout->text[item->offset] == '\t')
-    shape_tab (line, item, glyphs);
-  else
+  shaped->start = start;
+  shaped->length = length;
+  shaped->n_chars = pango_utf8_strlen (layout->text + start, length);
+  shaped->base_dir = base_dir;
+  shaped->end_attr = layout->log_attrs[start_offset + shaped->n_chars];
+  shaped->n_items = g_list_length (items);
+  shaped->items = g_new (ShapedItem, shaped->n_items);
+
+  for (l = items, i = 0; l; l = l->next, i++)
     {
-      PangoShapeFlags shape_flags = PANGO_SHAPE_NONE;
+      shaped->items[i].item = pango_item_copy (l->data);
+      shaped->items[i].glyphs = NULL;
+      shaped->items[i].log_widths = NULL;
+    }
 
-      if (pango_context_get_round_glyph_positions (layout->context))
-        shape_flags |= PANGO_SHAPE_ROUND_POSITIONS;
+  return shaped;
+}
 
-      if (state->properties.shape_set)
-	_pango_shape_shape (layout->text + item->offset, item->num_chars,
-			    state->properties.shape_ink_rect, state->properties.shape_logical_rect,
-			    glyphs);
-      else
-        pango_shape_with_flags (layout->text + item->offset, item->length,
-                                layout->text, layout->length,
-                                &item->analysis, glyphs,
-                                shape_flags);
+static void
+shaped_paragraph_free (gpointer data)
+{
+  ShapedParagraph *shaped = data;
+  int i;
 
-      if (state->properties.letter_spacing)
-	{
-	  PangoGlyphItem glyph_item;
-	  int space_left, space_right;
+  for (i = 0; i < shaped->n_items; i++)
+    {
+      pango_item_free (shaped->items[i].item);
+      if (shaped->items[i].glyphs)
+        pango_glyph_string_free (shaped->items[i].glyphs);
+      g_free (shaped->items[i].log_widths);
+    }
 
-	  glyph_item.item = item;
-	  glyph_item.glyphs = glyphs;
+  g_free (shaped->items);
+  g_slice_free (ShapedParagraph, shaped);
+}
 
-	  pango_glyph_item_letter_space (&glyph_item,
-					 layout->text,
-					 layout->log_attrs + state->start_offset,
-					 state->properties.letter_spacing);
+/* Finds the retained paragraph starting at @start. If there is
+ * none, @pos is set to where it would have to be inserted.
+ */
+static ShapedParagraph *
+find_shaped_paragraph (PangoLayout *layout,
+                       int          start,
+                       guint       *pos)
+{
+  guint lo = 0, hi = 0;
 
-	  distribute_letter_spacing (state->properties.letter_spacing, &space_left, &space_right);
+  if (layout->shaped_paragraphs)
+    hi = layout->shaped_paragraphs->len;
 
-	  glyphs->glyphs[0].geometry.width += space_left;
-	  glyphs->glyphs[0].geometry.x_offset += space_left;
-	  glyphs->glyphs[glyphs->num_glyphs - 1].geometry.width += space_right;
-	}
+  while (lo < hi)
+    {
+      guint mid = (lo + hi) / 2;
+      ShapedParagraph *shaped = g_ptr_array_index (layout->shaped_paragraphs, mid);
+
+      if (shaped->start < start)
+        lo = mid + 1;
+      else
+        hi = mid;
+    }
+
+  *pos = lo;
+
+  if (lo < (layout->shaped_paragraphs ? layout->shaped_paragraphs->len : 0))
+    {
+      ShapedParagraph *shaped = g_ptr_array_index (layout->shaped_paragraphs, lo);
+
+      if (shaped->start == start)
+        return shaped;
+    }
+
+  return NULL;
+}
+
+/* Finds the retained item for @item, if @item has not been split */
+static ShapedItem *
+find_shaped_item (ParaBreakState *state,
+                  PangoItem      *item)
+{
+  ShapedParagraph *shaped = state->shaped;
+  int lo, hi;
+
+  if (!shaped)
+    return NULL;
+
+  lo = 0;
+  hi = shaped->n_items;
+  while (lo < hi)
+    {
+      int mid = (lo + hi) / 2;
+
+      if (shaped->items[mid].item->offset < item->offset)
+        lo = mid + 1;
+      else
+        hi = mid;
+    }
+
+  if (lo < shaped->n_items &&
+      shaped->items[lo].item->offset == item->offset &&
+      shaped->items[lo].item->length == item->length)
+    return &shaped->items[lo];
+
+  return NULL;
+}
+
+static gboolean
+should_ellipsize_current_line (PangoLayout    *layout,
+			       ParaBreakState *state);
+
+/* Shapes an item that is not a tab; unlike tabs, these
+ * do not depend on where in the line they end up
+ */
+static PangoGlyphString *
+shape_item (PangoLayout    *layout,
+            ParaBreakState *state,
+            PangoItem      *item)
+{
+  PangoGlyphString *glyphs = pango_glyph_string_new ();
+  PangoShapeFlags shape_flags = PANGO_SHAPE_NONE;
+
+  if (pango_context_get_round_glyph_positions (layout->context))
+    shape_flags |= PANGO_SHAPE_ROUND_POSITIONS;
+
+  if (state->properties.shape_set)
+    _pango_shape_shape (layout->text + item->offset, item->num_chars,
+                        state->properties.shape_ink_rect, state->properties.shape_logical_rect,
+                        glyphs);
+  else
+    pango_shape_with_flags (layout->text + item->offset, item->length,
+                            layout->text, layout->length,
+                            &item->analysis, glyphs,
+                            shape_flags);
+
+  if (state->properties.letter_spacing)
+    {
+      PangoGlyphItem glyph_item;
+      int space_left, space_right;
+
+      glyph_item.item = item;
+      glyph_item.glyphs = glyphs;
+
+      pango_glyph_item_letter_space (&glyph_item,
+                                     layout->text,
+                                     layout->log_attrs + state->start_offset,
+                                     state->properties.letter_spacing);
+
+      distribute_letter_spacing (state->properties.letter_spacing, &space_left, &space_right);
+
+      glyphs->glyphs[0].geometry.width += space_left;
+      glyphs->glyphs[0].geometry.x_offset += space_left;
+      glyphs->glyphs[glyphs->num_glyphs - 1].geometry.width += space_right;
+    }
+
+  return glyphs;
+}
+
+static PangoGlyphString *
+shape_run (PangoLayoutLine *line,
+	   ParaBreakState  *state,
+	   PangoItem       *item)
+{
+  PangoLayout *layout = line->layout;
+  PangoGlyphString *glyphs;
+
+  if (layout->text[item->offset] == '\t')
+    {
+      glyphs = pango_glyph_string_new ();
+      shape_tab (line, item, glyphs);
     }
+  else
+    glyphs = shape_item (layout, state, item);
 
   return glyphs;
 }
 
+/* Like shape_run(), but shapes each retained item only once.
+ * Tabs depend on their position in the line and are always shaped.
+ */
+static PangoGlyphString *
+get_item_glyphs (PangoLayoutLine  *line,
+                 ParaBreakState   *state,
+                 PangoItem        *item,
+                 ShapedItem      **shaped_item)
+{
+  ShapedItem *shaped;
+
+  *shaped_item = NULL;
+
+  if (line->layout->text[item->offset] == '\t')
+    return shape_run (line, state, item);
+
+  shaped = find_shaped_item (state, item);
+  if (!shaped)
+    return shape_run (line, state, item);
+
+  if (!shaped->glyphs)
+    shaped->glyphs = shape_item (line->layout, state, item);
+
+  *shaped_item = shaped;
+
+  return pango_glyph_string_copy (shaped->glyphs);
+}
+
 static void
 insert_run (PangoLayoutLine *line,
 	    ParaBreakState  *state,
@@ -3470,9 +4385,7 @@ insert_run (PangoLayoutLine *line,
       if (state->log_widths_offset > 0)
 	pango_glyph_string_free (state->glyphs);
       state->glyphs = NULL;
-      g_free (state->log_widths);
       state->log_widths = NULL;
-      g_free (state->need_hyphen);
       state->need_hyphen = NULL;
     }
 
@@ -3480,6 +4393,81 @@ insert_run (PangoLayoutLine *line,
   line->length += run_item->length;
 }
 
+/* Returns storage for @size ints. The previous contents are
+ * not kept, so this must only be called when starting on an item.
+ */
+static int *
+get_scratch (ParaBreakState *state,
+             int             size)
+{
+  if (state->scratch_size < size)
+    {
+      state->scratch_size = MAX (size, 2 * state->scratch_size);
+      g_free (state->scratch);
+      state->scratch = g_new (int, state->scratch_size);
+    }
+
+  return state->scratch;
+}
+
+static void
+sum_log_widths (ParaBreakState *state,
+                int             num_chars)
+{
+  int i;
+
+  state->log_widths_sums[0] = 0;
+  state->log_widths_increasing = TRUE;
+
+  for (i = 0; i < num_chars; i++)
+    {
+      state->log_widths_sums[i + 1] = state->log_widths_sums[i] + state->log_widths[i];
+      if (state->log_widths[i] < 0)
+        state->log_widths_increasing = FALSE;
+    }
+}
+
+/* Returns the width of @num_chars chars of the first item,
+ * starting at @pos in what remains of it
+ */
+static inline int
+get_log_widths_sum (ParaBreakState *state,
+                    int             pos,
+                    int             num_chars)
+{
+  int start = state->log_widths_offset + pos;
+
+  return state->log_widths_sums[start + num_chars] - state->log_widths_sums[start];
+}
+
+/* Returns how many chars of what remains of the first item
+ * fit into @width, at most @num_chars, or -1 if none do
+ */
+static int
+find_fitting_chars (ParaBreakState *state,
+                    int             num_chars,
+                    int             width)
+{
+  int lo, hi;
+
+  if (width < 0)
+    return -1;
+
+  lo = 0;
+  hi = num_chars;
+  while (lo < hi)
+    {
+      int mid = (lo + hi + 1) / 2;
+
+      if (get_log_widths_sum (state, 0, mid) <= width)
+        lo = mid;
+      else
+        hi = mid - 1;
+    }
+
+  return lo;
+}
+
 static void
 get_need_hyphen (PangoItem  *item,
                  const char *text,
@@ -3693,8 +4681,8 @@ process_item (PangoLayout     *layout,
   int width;
   int extra_width;
   int length;
-  int i;
   gboolean processing_new_item = FALSE;
+  ShapedItem *shaped_item = NULL;
 
   /* Only one character has type G_UNICODE_LINE_SEPARATOR in Unicode 5.0;
    * update this if that changes. */
@@ -3703,7 +4691,7 @@ process_item (PangoLayout     *layout,
   if (!state->glyphs)
     {
       pango_layout_get_item_properties (item, &state->properties);
-      state->glyphs = shape_run (line, state, item);
+      state->glyphs = get_item_glyphs (line, state, item, &shaped_item);
 
       state->log_widths = NULL;
       state->need_hyphen = NULL;
@@ -3736,8 +4724,7 @@ process_item (PangoLayout     *layout,
     }
   else
     {
-      for (i = 0; i < item->num_chars; i++)
-	width += state->log_widths[state->log_widths_offset + i];
+      width = get_log_widths_sum (state, 0, item->num_chars);
     }
 
   if ((width <= state->remaining_width || (item->num_chars == 1 && !line->runs)) &&
@@ -3761,10 +4748,24 @@ process_item (PangoLayout     *layout,
       if (processing_new_item)
 	{
 	  PangoGlyphItem glyph_item = {item, state->glyphs};
-	  state->log_widths = g_new (int, item->num_chars);
-	  pango_glyph_item_get_logical_widths (&glyph_item, layout->text, state->log_widths);
-	  state->need_hyphen = g_new (int, item->num_chars);
+	  int *scratch = get_scratch (state, 3 * item->num_chars + 1);
+
+	  state->need_hyphen = scratch;
+	  state->log_widths_sums = scratch + item->num_chars;
+
+	  if (shaped_item && shaped_item->log_widths)
+	    state->log_widths = shaped_item->log_widths;
+	  else
+	    {
+	      if (shaped_item)
+	        state->log_widths = shaped_item->log_widths = g_new (int, item->num_chars);
+	      else
+	        state->log_widths = scratch + 2 * item->num_chars + 1;
+	      pango_glyph_item_get_logical_widths (&glyph_item, layout->text, state->log_widths);
+	    }
+
           get_need_hyphen (item, layout->text, state->need_hyphen);
+	  sum_log_widths (state, item->num_chars);
 	}
 
     retry_break:
@@ -3772,7 +4773,43 @@ process_item (PangoLayout     *layout,
       /* See how much of the item we can stuff in the line. */
       width = 0;
       extra_width = 0;
-      for (num_chars = 0; num_chars < item->num_chars; num_chars++)
+      num_chars = 0;
+
+      /* As long as there is room for the text and a hyphen, the
+       * search below can not stop. Start it at the last break
+       * before that point, in the state it would be in there.
+       */
+      if (state->log_widths_increasing && state->remaining_width >= 0)
+        {
+          int max_extra_width;
+          int fit, first, pos;
+
+          max_extra_width = state->hyphen_width >= 0 ? state->hyphen_width : find_hyphen_width (item);
+          fit = find_fitting_chars (state, item->num_chars, state->remaining_width - max_extra_width);
+
+          /* If there are no previous runs we have to take care to grab at least one char. */
+          first = line->runs ? 0 : 1;
+          for (pos = MIN (fit, item->num_chars - 1); pos >= first; pos--)
+            if (can_break_at (layout, state->start_offset + pos, retrying_with_char_breaks))
+              break;
+
+          if (pos >= first)
+            {
+              break_num_chars = pos;
+              break_width = get_log_widths_sum (state, 0, pos);
+              if (pos - 1 >= first &&
+                  can_break_at (layout, state->start_offset + pos - 1, retrying_with_char_breaks))
+                break_extra_width = find_break_extra_width (layout, state, pos - 1);
+              else
+                break_extra_width = 0;
+
+              extra_width = find_break_extra_width (layout, state, pos);
+              width = get_log_widths_sum (state, 0, pos + 1);
+              num_chars = pos + 1;
+            }
+        }
+
+      for (; num_chars < item->num_chars; num_chars++)
 	{
 	  if (width + extra_width > state->remaining_width && break_num_chars < item->num_chars)
             {
@@ -3863,9 +4900,7 @@ process_item (PangoLayout     *layout,
 	{
 	  pango_glyph_string_free (state->glyphs);
 	  state->glyphs = NULL;
-	  g_free (state->log_widths);
 	  state->log_widths = NULL;
-	  g_free (state->need_hyphen);
 	  state->need_hyphen = NULL;
 
 	  return BREAK_NONE_FIT;
@@ -3974,226 +5009,562 @@ add_line (PangoLayoutLine *line,
     }
 }
 
-static void
-process_line (PangoLayout    *layout,
-	      ParaBreakState *state)
+static int
+get_line_width (PangoLayout *layout,
+                gboolean     is_paragraph_start)
 {
-  PangoLayoutLine *line;
-
-  gboolean have_break = FALSE;      /* If we've seen a possible break yet */
-  int break_remaining_width = 0;    /* Remaining width before adding run with break */
-  int break_start_offset = 0;	    /* Start offset before adding run with break */
-  GSList *break_link = NULL;        /* Link holding run before break */
-  gboolean wrapped = FALSE;         /* If we had to wrap the line */
-
-  line = pango_layout_line_new (layout);
-  line->start_index = state->line_start_index;
-  line->is_paragraph_start = state->line_of_par == 1;
-  line_set_resolved_dir (line, state->base_dir);
+  int line_width = layout->width;
 
-  state->line_width = layout->width;
-  if (state->line_width >= 0 && layout->alignment != PANGO_ALIGN_CENTER)
+  if (line_width >= 0 && layout->alignment != PANGO_ALIGN_CENTER)
     {
-      if (line->is_paragraph_start && layout->indent >= 0)
-	state->line_width -= layout->indent;
-      else if (!line->is_paragraph_start && layout->indent < 0)
-	state->line_width += layout->indent;
+      if (is_paragraph_start && layout->indent >= 0)
+	line_width -= layout->indent;
+      else if (!is_paragraph_start && layout->indent < 0)
+	line_width += layout->indent;
 
-      if (state->line_width < 0)
-        state->line_width = 0;
+      if (line_width < 0)
+        line_width = 0;
     }
 
-  if (G_UNLIKELY (should_ellipsize_current_line (layout, state)))
-    state->remaining_width = -1;
-  else
-    state->remaining_width = state->line_width;
-  DEBUG ("starting to fill line", line, state);
+  return line_width;
+}
 
-  while (state->items)
-    {
-      PangoItem *item = state->items->data;
-      BreakResult result;
-      int old_num_chars;
-      int old_remaining_width;
-      gboolean first_item_in_line;
+/* Optimal line breaking
+ *
+ * With PANGO_LINE_BREAKING_OPTIMAL, the breaks of a paragraph are
+ * chosen before any lines are made, in the way of Knuth and Plass:
+ * among all the ways to break the paragraph, find the one with the
+ * least total demerits, where each line has demerits for how much
+ * it would need to be stretched to fill the width, and for ending
+ * in a hyphen. This is a shortest path search over the possible
+ * breaks, which keeps the breaks that can still start a line that
+ * fits (the active breaks) and, for every possible break, finds the
+ * best active break to come from.
+ *
+ * Lines can only be stretched in justified layouts. Otherwise, the
+ * demerits are for how ragged the lines are, as if each line could
+ * stretch by a third of the width.
+ *
+ * This works on the log attrs and on the logical widths of the
+ * shaped items, so the items are shaped up front. Lines are then
+ * made from the items by fill_line(), which splits items at the
+ * chosen breaks.
+ */
 
-      old_num_chars = item->num_chars;
-      old_remaining_width = state->remaining_width;
-      first_item_in_line = line->runs != NULL;
+#define LINE_PENALTY 10
+#define HYPHEN_PENALTY 50
+#define CHAR_BREAK_PENALTY 1000
+#define DOUBLE_HYPHEN_DEMERITS 3000
+#define INF_BADNESS 10000
 
-      result = process_item (layout, line, state, !have_break, FALSE);
+/* Keeps the search linear in the length of the paragraph
+ * when many breaks fit into a line
+ */
+#define MAX_ACTIVE_BREAKS 64
 
-      switch (result)
-	{
-	case BREAK_ALL_FIT:
-	  if (can_break_in (layout, state->start_offset, old_num_chars, first_item_in_line))
-	    {
-	      have_break = TRUE;
-	      break_remaining_width = old_remaining_width;
-	      break_start_offset = state->start_offset;
-	      break_link = line->runs->next;
-	    }
+typedef struct
+{
+  int position;			/* Character offset in the paragraph */
+  int prev;			/* Index of the break before, or -1 */
+  gboolean hyphenated;
+  double demerits;		/* Total up to here */
+} BreakNode;
 
-	  state->items = g_list_delete_link (state->items, state->items);
-	  state->start_offset += old_num_chars;
+typedef struct
+{
+  PangoLayout *layout;
+  int start_offset;		/* Character offset of the paragraph */
+  int n_chars;
+  int first_line_width;
+  int line_width;
+  gint64 *widths;		/* Sums of the logical widths before each position */
+  gint64 *spaces;		/* The same, for expandable spaces only */
+  int *hyphens;			/* Hyphen width for a break after each char, or -1 */
+} OptimalBreaks;
 
-	  break;
+static double
+get_badness (gint64 slack,
+             gint64 stretch)
+{
+  double r;
 
-	case BREAK_EMPTY_FIT:
-	  wrapped = TRUE;
-	  goto done;
+  if (slack <= 0)
+    return 0;
 
-	case BREAK_SOME_FIT:
-	  state->start_offset += old_num_chars - item->num_chars;
-	  wrapped = TRUE;
-	  goto done;
+  if (stretch <= 0)
+    return INF_BADNESS;
 
-	case BREAK_NONE_FIT:
-	  /* Back up over unused runs to run where there is a break */
-	  while (line->runs && line->runs != break_link)
-	    state->items = g_list_prepend (state->items, uninsert_run (line));
+  r = (double) slack / stretch;
 
-	  state->start_offset = break_start_offset;
-	  state->remaining_width = break_remaining_width;
+  return MIN (100 * r * r * r, INF_BADNESS);
+}
 
-	  /* Reshape run to break */
-	  item = state->items->data;
+/* Runs the search with the breaks of the wrap mode, or with all
+ * character breaks if @char_breaks is %TRUE. Returns %FALSE if
+ * some lines did not fit.
+ */
+static gboolean
+find_breaks (OptimalBreaks *data,
+             gboolean       char_breaks,
+             GArray        *nodes)
+{
+  PangoLayout *layout = data->layout;
+  int active[MAX_ACTIVE_BREAKS + 1];
+  int n_active;
+  int fallback = -1;
+  gboolean all_fit = TRUE;
+  int b, i;
+  BreakNode node;
+
+  g_array_set_size (nodes, 0);
+
+  node.position = 0;
+  node.prev = -1;
+  node.hyphenated = FALSE;
+  node.demerits = 0;
+  g_array_append_val (nodes, node);
+  active[0] = 0;
+  n_active = 1;
+
+  for (b = 1; b <= data->n_chars; b++)
+    {
+      gboolean last = b == data->n_chars;
+      gboolean hyphenated;
+      gint64 trailing_width, trailing_space;
+      int penalty;
+      int best = -1;
+      double best_demerits = 0;
+
+      if (!last && !can_break_at (layout, data->start_offset + b, char_breaks))
+        continue;
+
+      penalty = 0;
+      hyphenated = !last && data->hyphens[b - 1] >= 0;
+      if (hyphenated)
+        penalty = HYPHEN_PENALTY;
+      else if (char_breaks && !last &&
+               !layout->log_attrs[data->start_offset + b].is_line_break)
+        penalty = CHAR_BREAK_PENALTY;
+
+      /* A space at the end of the line does not take up room,
+       * the same as in process_item()
+       */
+      trailing_width = trailing_space = 0;
+      if (!last && layout->log_attrs[data->start_offset + b - 1].is_white)
+        {
+          trailing_width = data->widths[b] - data->widths[b - 1];
+          trailing_space = data->spaces[b] - data->spaces[b - 1];
+        }
 
-	  old_num_chars = item->num_chars;
-	  result = process_item (layout, line, state, TRUE, TRUE);
-	  g_assert (result == BREAK_SOME_FIT || result == BREAK_EMPTY_FIT);
+      for (i = 0; i < n_active; )
+        {
+          BreakNode *a = &g_array_index (nodes, BreakNode, active[i]);
+          int line_width = a->position == 0 ? data->first_line_width : data->line_width;
+          gint64 width, stretch;
+          double badness, demerits;
 
-	  state->start_offset += old_num_chars - item->num_chars;
+          width = data->widths[b] - data->widths[a->position] - trailing_width;
+          if (hyphenated)
+            width += data->hyphens[b - 1];
 
-	  wrapped = TRUE;
-	  goto done;
+          if (width > line_width)
+            {
+              /* Lines from here only get longer */
+              if (fallback < 0 ||
+                  a->position > g_array_index (nodes, BreakNode, fallback).position)
+                fallback = active[i];
 
-	case BREAK_LINE_SEPARATOR:
-	  state->items = g_list_delete_link (state->items, state->items);
-	  state->start_offset += old_num_chars;
-	  /* A line-separate is just a forced break.  Set wrapped, so we do
-	   * justification */
-	  wrapped = TRUE;
-	  goto done;
-	}
-    }
+              active[i] = active[--n_active];
+              continue;
+            }
 
- done:
-  pango_layout_line_postprocess (line, state, wrapped);
-  add_line (line, state);
-  state->line_of_par++;
-  state->line_start_index += line->length;
-  state->line_start_offset = state->start_offset;
-}
+          if (last)
+            badness = 0;
+          else
+            {
+              if (layout->justify)
+                stretch = data->spaces[b] - data->spaces[a->position] - trailing_space;
+              else
+                stretch = line_width / 3;
 
-static void
-get_items_log_attrs (const char   *text,
-                     int           start,
-                     int           length,
-		     GList        *items,
-		     PangoLogAttr *log_attrs,
-                     int           log_attrs_len)
-{
-  int offset = 0;
-  GList *l;
+              badness = get_badness (line_width - width, stretch);
+            }
 
-  pango_default_break (text + start, length, NULL, log_attrs, log_attrs_len);
+          demerits = (LINE_PENALTY + badness) * (LINE_PENALTY + badness) + penalty * penalty;
+          if (hyphenated && a->hyphenated)
+            demerits += DOUBLE_HYPHEN_DEMERITS;
+          demerits += a->demerits;
 
-  for (l = items; l; l = l->next)
-    {
-      PangoItem *item = l->data;
-      g_assert (item->offset <= start + length);
-      g_assert (item->length <= (start + length) - item->offset);
+          if (best < 0 || demerits < best_demerits)
+            {
+              best = active[i];
+              best_demerits = demerits;
+            }
 
-      pango_tailor_break (text + item->offset,
-                          item->length,
-                          &item->analysis,
-                          item->offset,
-                          log_attrs + offset,
-                          item->num_chars + 1);
+          i++;
+        }
 
-      offset += item->num_chars;
+      if (best < 0 && n_active > 0)
+        continue;
+
+      if (best < 0)
+        {
+          /* Nothing fits; put the shortest overfull line and go on */
+          best = fallback;
+          best_demerits = g_array_index (nodes, BreakNode, fallback).demerits;
+          all_fit = FALSE;
+        }
+
+      node.position = b;
+      node.prev = best;
+      node.hyphenated = hyphenated;
+      node.demerits = best_demerits;
+      g_array_append_val (nodes, node);
+
+      fallback = -1;
+      active[n_active++] = nodes->len - 1;
+
+      if (n_active > MAX_ACTIVE_BREAKS)
+        {
+          int worst = 0;
+
+          for (i = 1; i < n_active; i++)
+            if (g_array_index (nodes, BreakNode, active[i]).demerits >
+                g_array_index (nodes, BreakNode, active[worst]).demerits)
+              worst = i;
+
+          active[worst] = active[--n_active];
+        }
     }
+
+  return all_fit;
 }
 
-static PangoAttrList *
-pango_layout_get_effective_attributes (PangoLayout *layout)
-{
-  PangoAttrList *attrs;
+/* Returns the character offsets at which to end the lines of
+ * the paragraph in state->items, or %NULL if the paragraph has
+ * to be broken greedily. The items are shaped into state->shaped.
+ */
+static int *
+find_optimal_breaks (PangoLayout    *layout,
+                     ParaBreakState *state)
+{
+  OptimalBreaks data;
+  GArray *nodes;
+  int *line_ends;
+  int n_lines;
+  int offset;
+  GList *l;
+  int i;
 
-  if (layout->attrs)
-    attrs = pango_attr_list_copy (layout->attrs);
-  else
-    attrs = NULL;
+  data.layout = layout;
+  data.start_offset = state->start_offset;
+  data.n_chars = 0;
+  for (l = state->items; l; l = l->next)
+    {
+      PangoItem *item = l->data;
 
-  if (layout->font_desc)
+      /* Tabs depend on where they are in the line */
+      if (layout->text[item->offset] == '\t')
+        return NULL;
+
+      data.n_chars += item->num_chars;
+    }
+
+  for (i = 1; i < data.n_chars; i++)
+    if (layout->log_attrs[data.start_offset + i].is_mandatory_break)
+      return NULL;
+
+  data.first_line_width = get_line_width (layout, state->line_of_par == 1);
+  data.line_width = get_line_width (layout, FALSE);
+  data.widths = g_new (gint64, data.n_chars + 1);
+  data.spaces = g_new (gint64, data.n_chars + 1);
+  data.hyphens = g_new (int, data.n_chars);
+
+  data.widths[0] = data.spaces[0] = 0;
+  offset = 0;
+  for (l = state->items; l; l = l->next)
     {
-      PangoAttribute *attr = pango_attr_font_desc_new (layout->font_desc);
+      PangoItem *item = l->data;
+      ShapedItem *shaped_item = find_shaped_item (state, item);
+      int hyphen_width = -1;
+
+      g_assert (shaped_item != NULL);
+
+      /* Shape the item as process_item() would */
+      state->start_offset = data.start_offset + offset;
+      pango_layout_get_item_properties (item, &state->properties);
+
+      if (!shaped_item->glyphs)
+        shaped_item->glyphs = shape_item (layout, state, item);
+
+      if (!shaped_item->log_widths)
+        {
+          PangoGlyphItem glyph_item = { item, shaped_item->glyphs };
+
+          shaped_item->log_widths = g_new (int, item->num_chars);
+          pango_glyph_item_get_logical_widths (&glyph_item, layout->text, shaped_item->log_widths);
+        }
+
+      get_need_hyphen (item, layout->text, data.hyphens + offset);
+
+      for (i = 0; i < item->num_chars; i++)
+        {
+          int w = shaped_item->log_widths[i];
 
-      if (!attrs)
-        attrs = pango_attr_list_new ();
+          data.widths[offset + i + 1] = data.widths[offset + i] + w;
+          data.spaces[offset + i + 1] = data.spaces[offset + i];
+          if (layout->log_attrs[data.start_offset + offset + i].is_expandable_space)
+            data.spaces[offset + i + 1] += w;
+
+          if (data.hyphens[offset + i])
+            {
+              if (hyphen_width < 0)
+                hyphen_width = find_hyphen_width (item);
+              data.hyphens[offset + i] = hyphen_width;
+            }
+          else
+            data.hyphens[offset + i] = -1;
+        }
 
-      pango_attr_list_insert_before (attrs, attr);
+      offset += item->num_chars;
     }
 
-  if (layout->single_paragraph)
+  state->start_offset = data.start_offset;
+
+  nodes = g_array_new (FALSE, FALSE, sizeof (BreakNode));
+
+  /* Like PANGO_WRAP_WORD_CHAR in greedy breaking, only break
+   * words if there is no other way to make the lines fit
+   */
+  if (!find_breaks (&data, FALSE, nodes) && layout->wrap == PANGO_WRAP_WORD_CHAR)
+    find_breaks (&data, TRUE, nodes);
+
+  n_lines = 0;
+  for (i = nodes->len - 1; i > 0; i = g_array_index (nodes, BreakNode, i).prev)
+    n_lines++;
+
+  line_ends = g_new (int, MAX (n_lines, 1));
+  for (i = nodes->len - 1; i > 0; i = g_array_index (nodes, BreakNode, i).prev)
+    line_ends[--n_lines] = data.start_offset + g_array_index (nodes, BreakNode, i).position;
+
+  g_array_free (nodes, TRUE);
+  g_free (data.widths);
+  g_free (data.spaces);
+  g_free (data.hyphens);
+
+  return line_ends;
+}
+
+/* Puts the items up to @end_offset into @line, splitting
+ * the last one if necessary
+ */
+static void
+fill_line (PangoLayout     *layout,
+           PangoLayoutLine *line,
+           ParaBreakState  *state,
+           int              end_offset)
+{
+  while (state->items && state->start_offset < end_offset)
     {
-      PangoAttribute *attr = pango_attr_show_new (PANGO_SHOW_LINE_BREAKS);
+      PangoItem *item = state->items->data;
+      int num_chars = end_offset - state->start_offset;
+      int old_num_chars = item->num_chars;
+
+      if (!state->glyphs)
+        {
+          ShapedItem *shaped_item;
 
-      if (!attrs)
-        attrs = pango_attr_list_new ();
+          pango_layout_get_item_properties (item, &state->properties);
+          state->glyphs = get_item_glyphs (line, state, item, &shaped_item);
 
-      pango_attr_list_insert_before (attrs, attr);
+          state->log_widths = NULL;
+          state->need_hyphen = NULL;
+          state->log_widths_offset = 0;
+        }
+
+      if (num_chars > item->num_chars)
+        {
+          insert_run (line, state, item, TRUE);
+          state->items = g_list_delete_link (state->items, state->items);
+          state->start_offset += old_num_chars;
+          continue;
+        }
+
+      /* The line ends in this item */
+      if (!state->need_hyphen)
+        {
+          state->need_hyphen = get_scratch (state, item->num_chars);
+          get_need_hyphen (item, layout->text, state->need_hyphen);
+        }
+
+      if (num_chars == item->num_chars)
+        {
+          if (state->items->next && break_needs_hyphen (layout, state, num_chars))
+            item->analysis.flags |= PANGO_ANALYSIS_FLAG_NEED_HYPHEN;
+          insert_run (line, state, item, TRUE);
+          state->items = g_list_delete_link (state->items, state->items);
+        }
+      else
+        {
+          PangoItem *new_item;
+          int length;
+
+          length = g_utf8_offset_to_pointer (layout->text + item->offset, num_chars) - (layout->text + item->offset);
+          new_item = pango_item_split (item, length, num_chars);
+
+          if (break_needs_hyphen (layout, state, num_chars))
+            new_item->analysis.flags |= PANGO_ANALYSIS_FLAG_NEED_HYPHEN;
+          insert_run (line, state, new_item, FALSE);
+
+          state->log_widths_offset += num_chars;
+        }
+
+      state->start_offset += num_chars;
+      break;
     }
 
-  return attrs;
+  state->remaining_width = MAX (state->line_width - pango_layout_line_get_width (line), 0);
 }
 
-static gboolean
-affects_itemization (PangoAttribute *attr,
-                     gpointer        data)
-{
-  switch (attr->klass->type)
-    {
-    /* These affect font selection */
-    case PANGO_ATTR_LANGUAGE:
-    case PANGO_ATTR_FAMILY:
-    case PANGO_ATTR_STYLE:
-    case PANGO_ATTR_WEIGHT:
-    case PANGO_ATTR_VARIANT:
-    case PANGO_ATTR_STRETCH:
-    case PANGO_ATTR_SIZE:
-    case PANGO_ATTR_FONT_DESC:
-    case PANGO_ATTR_SCALE:
-    case PANGO_ATTR_FALLBACK:
-    case PANGO_ATTR_ABSOLUTE_SIZE:
-    case PANGO_ATTR_GRAVITY:
-    case PANGO_ATTR_GRAVITY_HINT:
-    /* These need to be constant across runs */
-    case PANGO_ATTR_LETTER_SPACING:
-    case PANGO_ATTR_SHAPE:
-    case PANGO_ATTR_RISE:
-      return TRUE;
-    default:
-      return FALSE;
+static void
+process_line (PangoLayout    *layout,
+	      ParaBreakState *state)
+{
+  PangoLayoutLine *line;
+
+  gboolean have_break = FALSE;      /* If we've seen a possible break yet */
+  int break_remaining_width = 0;    /* Remaining width before adding run with break */
+  int break_start_offset = 0;	    /* Start offset before adding run with break */
+  GSList *break_link = NULL;        /* Link holding run before break */
+  gboolean wrapped = FALSE;         /* If we had to wrap the line */
+
+  line = pango_layout_line_new (layout);
+  line->start_index = state->line_start_index;
+  line->is_paragraph_start = state->line_of_par == 1;
+  line_set_resolved_dir (line, state->base_dir);
+  ((PangoLayoutLinePrivate *)line)->base_dir = state->base_dir;
+
+  state->line_width = get_line_width (layout, line->is_paragraph_start);
+
+  if (G_UNLIKELY (should_ellipsize_current_line (layout, state)))
+    state->remaining_width = -1;
+  else
+    state->remaining_width = state->line_width;
+  DEBUG ("starting to fill line", line, state);
+
+  if (state->line_ends)
+    {
+      fill_line (layout, line, state, state->line_ends[state->line_end++]);
+      wrapped = state->items != NULL;
+      goto done;
+    }
+
+  while (state->items)
+    {
+      PangoItem *item = state->items->data;
+      BreakResult result;
+      int old_num_chars;
+      int old_remaining_width;
+      gboolean first_item_in_line;
+
+      old_num_chars = item->num_chars;
+      old_remaining_width = state->remaining_width;
+      first_item_in_line = line->runs != NULL;
+
+      result = process_item (layout, line, state, !have_break, FALSE);
+
+      switch (result)
+	{
+	case BREAK_ALL_FIT:
+	  if (can_break_in (layout, state->start_offset, old_num_chars, first_item_in_line))
+	    {
+	      have_break = TRUE;
+	      break_remaining_width = old_remaining_width;
+	      break_start_offset = state->start_offset;
+	      break_link = line->runs->next;
+	    }
+
+	  state->items = g_list_delete_link (state->items, state->items);
+	  state->start_offset += old_num_chars;
+
+	  break;
+
+	case BREAK_EMPTY_FIT:
+	  wrapped = TRUE;
+	  goto done;
+
+	case BREAK_SOME_FIT:
+	  state->start_offset += old_num_chars - item->num_chars;
+	  wrapped = TRUE;
+	  goto done;
+
+	case BREAK_NONE_FIT:
+	  /* Back up over unused runs to run where there is a break */
+	  while (line->runs && line->runs != break_link)
+	    state->items = g_list_prepend (state->items, uninsert_run (line));
+
+	  state->start_offset = break_start_offset;
+	  state->remaining_width = break_remaining_width;
+
+	  /* Reshape run to break */
+	  item = state->items->data;
+
+	  old_num_chars = item->num_chars;
+	  result = process_item (layout, line, state, TRUE, TRUE);
+	  g_assert (result == BREAK_SOME_FIT || result == BREAK_EMPTY_FIT);
+
+	  state->start_offset += old_num_chars - item->num_chars;
+
+	  wrapped = TRUE;
+	  goto done;
+
+	case BREAK_LINE_SEPARATOR:
+	  state->items = g_list_delete_link (state->items, state->items);
+	  state->start_offset += old_num_chars;
+	  /* A line-separate is just a forced break.  Set wrapped, so we do
+	   * justification */
+	  wrapped = TRUE;
+	  goto done;
+	}
     }
+
+ done:
+  pango_layout_line_postprocess (line, state, wrapped);
+  add_line (line, state);
+  state->line_of_par++;
+  state->line_start_index += line->length;
+  state->line_start_offset = state->start_offset;
 }
 
-static gboolean
-affects_break_or_shape (PangoAttribute *attr,
-                        gpointer        data)
+static void
+get_items_log_attrs (const char   *text,
+                     int           start,
+                     int           length,
+		     GList        *items,
+                     gboolean      default_break,
+		     PangoLogAttr *log_attrs,
+                     int           log_attrs_len)
 {
-  switch (attr->klass->type)
+  int offset = 0;
+  GList *l;
+
+  if (default_break)
+    pango_default_break (text + start, length, NULL, log_attrs, log_attrs_len);
+
+  for (l = items; l; l = l->next)
     {
-    /* Affects breaks */
-    case PANGO_ATTR_ALLOW_BREAKS:
-    /* Affects shaping */
-    case PANGO_ATTR_INSERT_HYPHENS:
-    case PANGO_ATTR_FONT_FEATURES:
-    case PANGO_ATTR_SHOW:
-      return TRUE;
-    default:
-      return FALSE;
+      PangoItem *item = l->data;
+      g_assert (item->offset <= start + length);
+      g_assert (item->length <= (start + length) - item->offset);
+
+      pango_tailor_break (text + item->offset,
+                          item->length,
+                          &item->analysis,
+                          item->offset,
+                          log_attrs + offset,
+                          item->num_chars + 1);
+
+      offset += item->num_chars;
     }
 }
 
@@ -4209,115 +5580,1282 @@ apply_attributes_to_items (GList         *items,
 
   _pango_attr_list_get_iterator (attrs, &iter);
 
-  for (l = items; l; l = l->next)
+  for (l = items; l; l = l->next)
+    {
+      PangoItem *item = l->data;
+      pango_item_apply_attrs (item, &iter);
+    }
+
+  _pango_attr_iterator_destroy (&iter);
+}
+
+static void
+apply_attributes_to_runs (PangoLayout   *layout,
+                          GSList        *lines,
+                          PangoAttrList *attrs)
+{
+  GSList *ll;
+
+  if (!attrs)
+    return;
+
+  for (ll = lines; ll; ll = ll->next)
+    {
+      PangoLayoutLine *line = ll->data;
+      GSList *old_runs = g_slist_reverse (line->runs);
+      GSList *rl;
+
+      line->runs = NULL;
+      for (rl = old_runs; rl; rl = rl->next)
+        {
+          PangoGlyphItem *glyph_item = rl->data;
+          GSList *new_runs;
+
+          new_runs = pango_glyph_item_apply_attrs (glyph_item,
+                                                   layout->text,
+                                                   attrs);
+
+          line->runs = g_slist_concat (new_runs, line->runs);
+        }
+
+      g_slist_free (old_runs);
+    }
+}
+
+static void
+find_paragraph (PangoLayout *layout,
+                const char  *start,
+                int         *delimiter_index,
+                int         *next_para_index)
+{
+  if (layout->single_paragraph)
+    {
+      *delimiter_index = (layout->text + layout->length) - start;
+      *next_para_index = *delimiter_index;
+    }
+  else
+    {
+      pango_find_paragraph_boundary (start,
+                                     (layout->text + layout->length) - start,
+                                     delimiter_index,
+                                     next_para_index);
+    }
+
+  g_assert (*next_para_index >= *delimiter_index);
+}
+
+static PangoDirection
+get_initial_base_dir (PangoLayout *layout)
+{
+  PangoDirection base_dir;
+
+  base_dir = pango_find_base_dir (layout->text, layout->length);
+  if (base_dir == PANGO_DIRECTION_NEUTRAL)
+    base_dir = pango_context_get_base_dir (layout->context);
+
+  return base_dir;
+}
+
+/* Paragraph cache
+ *
+ * Widgets tend to create new layouts for the same strings over
+ * and over, so a context can keep the lines of the paragraphs that
+ * its layouts laid out, see pango_context_set_paragraph_cache_size().
+ *
+ * The key covers everything the lines of a paragraph depend on:
+ * its text, its base direction, the attributes for itemization
+ * and shaping that overlap it, and the layout settings that are
+ * used for breaking lines. Everything else that matters comes from
+ * the context, so all entries are dropped when its serial changes.
+ * The attributes for the runs are applied to the lines afterwards,
+ * like for lines that are laid out normally, so they are not part
+ * of the key.
+ *
+ * Indices in the key are relative to the start of the paragraph,
+ * except for the ones that stand for the start and end of the text,
+ * so that lines can be reused for a paragraph at another position.
+ */
+
+/* Don't bother caching long paragraphs, they are unlikely to repeat */
+#define PARAGRAPH_CACHE_MAX_LENGTH 4096
+
+typedef struct {
+  int length;		/* of the text, including the delimiter */
+  int n_attrs;
+  int width;
+  int height;
+  int indent;
+  int base_dir;
+  int alignment;
+  int justify;
+  int wrap;
+  int line_breaking;
+  int ellipsize;
+  int single_paragraph;
+} ParagraphKeyHeader;
+
+typedef struct {
+  PangoAttribute *attr;
+  guint start;
+  guint end;
+  guint8 start_fixed;
+  guint8 end_fixed;
+} ParagraphKeyAttr;
+
+typedef struct {
+  ParagraphKeyHeader header;
+  const char *text;
+  ParagraphKeyAttr *attrs;
+  guint hash;
+} ParagraphKey;
+
+typedef struct {
+  ParagraphKey key;	/* owns its text and attributes */
+  GList link;
+  int offset;		/* of the paragraph that the lines were made for */
+  int n_chars;		/* including the delimiter */
+  PangoLogAttr *log_attrs;	/* n_chars + 1 */
+  GSList *lines;
+} ParagraphCacheEntry;
+
+struct _PangoParagraphCache
+{
+  GHashTable *entries;
+  GQueue lru;
+  guint max_size;
+  guint serial;
+  guint hits;
+  guint misses;
+};
+
+static inline guint
+paragraph_key_index (guint   index,
+                     guint   offset,
+                     guint8 *fixed)
+{
+  *fixed = index == PANGO_ATTR_INDEX_FROM_TEXT_BEGINNING ||
+           index == PANGO_ATTR_INDEX_TO_TEXT_END;
+
+  return *fixed ? index : index - offset;
+}
+
+static inline guint32
+hash_bytes (guint32       h,
+            gconstpointer data,
+            gsize         length)
+{
+  const guchar *p = data;
+  gsize i;
+
+  for (i = 0; i < length; i++)
+    h = (h << 5) + h + p[i];
+
+  return h;
+}
+
+static void
+paragraph_key_init (ParagraphKey  *key,
+                    PangoLayout   *layout,
+                    const char    *start,
+                    int            length,
+                    PangoDirection base_dir,
+                    PangoAttrList *itemize_attrs,
+                    PangoAttrList *shape_attrs)
+{
+  GPtrArray *overlapping;
+  guint offset = start - layout->text;
+  guint32 h;
+  guint i;
+
+  overlapping = g_ptr_array_new ();
+  if (itemize_attrs)
+    _pango_attr_list_get_overlapping (itemize_attrs, offset, offset + length, overlapping);
+  if (shape_attrs)
+    _pango_attr_list_get_overlapping (shape_attrs, offset, offset + length, overlapping);
+
+  memset (&key->header, 0, sizeof (ParagraphKeyHeader));
+  key->header.length = length;
+  key->header.n_attrs = overlapping->len;
+  key->header.width = layout->width;
+  key->header.height = layout->height;
+  key->header.indent = layout->indent;
+  key->header.base_dir = base_dir;
+  key->header.alignment = layout->alignment;
+  key->header.justify = layout->justify;
+  key->header.wrap = layout->wrap;
+  key->header.line_breaking = layout->line_breaking;
+  key->header.ellipsize = layout->ellipsize;
+  key->header.single_paragraph = layout->single_paragraph;
+
+  key->text = start;
+
+  h = hash_bytes (5381, &key->header, sizeof (ParagraphKeyHeader));
+  h = hash_bytes (h, start, length);
+
+  key->attrs = g_new (ParagraphKeyAttr, overlapping->len);
+  for (i = 0; i < overlapping->len; i++)
+    {
+      PangoAttribute *attr = g_ptr_array_index (overlapping, i);
+      ParagraphKeyAttr *key_attr = &key->attrs[i];
+      guint values[3];
+
+      key_attr->attr = attr;
+      key_attr->start = paragraph_key_index (attr->start_index, offset, &key_attr->start_fixed);
+      key_attr->end = paragraph_key_index (attr->end_index, offset, &key_attr->end_fixed);
+
+      values[0] = attr->klass->type;
+      values[1] = key_attr->start;
+      values[2] = key_attr->end;
+      h = hash_bytes (h, values, sizeof (values));
+    }
+
+  key->hash = h;
+
+  g_ptr_array_free (overlapping, TRUE);
+}
+
+static guint
+paragraph_key_hash (gconstpointer data)
+{
+  const ParagraphKey *key = data;
+
+  return key->hash;
+}
+
+static gboolean
+paragraph_key_equal (gconstpointer a,
+                     gconstpointer b)
+{
+  const ParagraphKey *key_a = a;
+  const ParagraphKey *key_b = b;
+  int i;
+
+  if (key_a->hash != key_b->hash ||
+      memcmp (&key_a->header, &key_b->header, sizeof (ParagraphKeyHeader)) != 0 ||
+      memcmp (key_a->text, key_b->text, key_a->header.length) != 0)
+    return FALSE;
+
+  for (i = 0; i < key_a->header.n_attrs; i++)
+    {
+      const ParagraphKeyAttr *attr_a = &key_a->attrs[i];
+      const ParagraphKeyAttr *attr_b = &key_b->attrs[i];
+
+      if (attr_a->start != attr_b->start ||
+          attr_a->end != attr_b->end ||
+          attr_a->start_fixed != attr_b->start_fixed ||
+          attr_a->end_fixed != attr_b->end_fixed ||
+          !pango_attribute_equal (attr_a->attr, attr_b->attr))
+        return FALSE;
+    }
+
+  return TRUE;
+}
+
+/* Copies @line for @layout, moving it by @delta bytes. The
+ * attributes of the runs are moved by @attr_delta, except for
+ * indices that stand for the start and end of the text.
+ */
+static PangoLayoutLine *
+paragraph_line_copy (PangoLayoutLine *line,
+                     PangoLayout     *layout,
+                     int              delta,
+                     int              attr_delta)
+{
+  PangoLayoutLinePrivate *private = (PangoLayoutLinePrivate *)line;
+  PangoLayoutLinePrivate *copy_private;
+  PangoLayoutLine *copy;
+  GSList *l, *al;
+
+  copy = pango_layout_line_new (layout);
+  copy->start_index = line->start_index + delta;
+  copy->length = line->length;
+  copy->is_paragraph_start = line->is_paragraph_start;
+  copy->resolved_dir = line->resolved_dir;
+
+  copy_private = (PangoLayoutLinePrivate *)copy;
+  copy_private->base_dir = private->base_dir;
+  copy_private->wrapped = private->wrapped;
+  copy_private->ellipsized = private->ellipsized;
+
+  for (l = line->runs; l; l = l->next)
+    {
+      PangoGlyphItem *run = pango_glyph_item_copy (l->data);
+
+      run->item->offset += delta;
+      for (al = run->item->analysis.extra_attrs; al; al = al->next)
+        {
+          PangoAttribute *attr = al->data;
+
+          if (attr->start_index != PANGO_ATTR_INDEX_FROM_TEXT_BEGINNING &&
+              attr->start_index != PANGO_ATTR_INDEX_TO_TEXT_END)
+            attr->start_index += attr_delta;
+          if (attr->end_index != PANGO_ATTR_INDEX_FROM_TEXT_BEGINNING &&
+              attr->end_index != PANGO_ATTR_INDEX_TO_TEXT_END)
+            attr->end_index += attr_delta;
+        }
+
+      copy->runs = g_slist_prepend (copy->runs, run);
+    }
+
+  copy->runs = g_slist_reverse (copy->runs);
+
+  return copy;
+}
+
+static void
+paragraph_cache_entry_free (ParagraphCacheEntry *entry)
+{
+  int i;
+
+  for (i = 0; i < entry->key.header.n_attrs; i++)
+    pango_attribute_destroy (entry->key.attrs[i].attr);
+  g_free (entry->key.attrs);
+  g_free ((char *) entry->key.text);
+  g_free (entry->log_attrs);
+  g_slist_free_full (entry->lines, (GDestroyNotify) pango_layout_line_unref);
+  g_slice_free (ParagraphCacheEntry, entry);
+}
+
+static void
+paragraph_cache_trim (PangoParagraphCache *cache,
+                      guint                max_size)
+{
+  while (cache->lru.length > max_size)
+    {
+      GList *link = g_queue_pop_tail_link (&cache->lru);
+      ParagraphCacheEntry *entry = link->data;
+
+      g_hash_table_remove (cache->entries, entry);
+      paragraph_cache_entry_free (entry);
+    }
+}
+
+PangoParagraphCache *
+_pango_paragraph_cache_new (guint max_size)
+{
+  PangoParagraphCache *cache = g_slice_new0 (PangoParagraphCache);
+
+  cache->entries = g_hash_table_new (paragraph_key_hash, paragraph_key_equal);
+  g_queue_init (&cache->lru);
+  cache->max_size = max_size;
+
+  return cache;
+}
+
+void
+_pango_paragraph_cache_free (PangoParagraphCache *cache)
+{
+  paragraph_cache_trim (cache, 0);
+  g_hash_table_unref (cache->entries);
+  g_slice_free (PangoParagraphCache, cache);
+}
+
+void
+_pango_paragraph_cache_set_max_size (PangoParagraphCache *cache,
+                                     guint                max_size)
+{
+  cache->max_size = max_size;
+  paragraph_cache_trim (cache, max_size);
+}
+
+void
+_pango_paragraph_cache_get_stats (PangoParagraphCache *cache,
+                                  guint               *hits,
+                                  guint               *misses)
+{
+  if (hits)
+    *hits = cache->hits;
+  if (misses)
+    *misses = cache->misses;
+}
+
+/* Returns the paragraph cache to use for a paragraph of @layout,
+ * or %NULL if the paragraph can't be cached
+ */
+static PangoParagraphCache *
+get_paragraph_cache (PangoLayout *layout,
+                     const char  *start,
+                     int          length)
+{
+  PangoParagraphCache *cache;
+  guint serial;
+
+  /* With a positive height, the lines of a paragraph depend on the
+   * lines before it, and tabs depend on the whole layout
+   */
+  if (layout->height >= 0 ||
+      length > PARAGRAPH_CACHE_MAX_LENGTH ||
+      memchr (start, '\t', length) != NULL)
+    return NULL;
+
+  cache = _pango_context_get_paragraph_cache (layout->context);
+  if (!cache)
+    return NULL;
+
+  serial = pango_context_get_serial (layout->context);
+  if (cache->serial != serial)
+    {
+      paragraph_cache_trim (cache, 0);
+      cache->serial = serial;
+    }
+
+  return cache;
+}
+
+/* Adds the lines for @key to @layout if they are in @cache */
+static gboolean
+paragraph_cache_lookup (PangoParagraphCache *cache,
+                        ParagraphKey        *key,
+                        PangoLayout         *layout,
+                        ParaBreakState      *state,
+                        int                  start_offset)
+{
+  ParagraphCacheEntry *entry;
+  int offset = key->text - layout->text;
+  GSList *l;
+
+  entry = g_hash_table_lookup (cache->entries, key);
+  if (!entry)
+    {
+      cache->misses++;
+      return FALSE;
+    }
+
+  cache->hits++;
+
+  g_queue_unlink (&cache->lru, &entry->link);
+  g_queue_push_head_link (&cache->lru, &entry->link);
+
+  for (l = entry->lines; l; l = l->next)
+    {
+      PangoLayoutLine *line;
+
+      line = paragraph_line_copy (l->data, layout, offset, offset - entry->offset);
+      add_line (line, state);
+
+      layout->is_wrapped |= ((PangoLayoutLinePrivate *)line)->wrapped;
+      layout->is_ellipsized |= ((PangoLayoutLinePrivate *)line)->ellipsized;
+    }
+
+  memcpy (layout->log_attrs + start_offset, entry->log_attrs,
+          (entry->n_chars + 1) * sizeof (PangoLogAttr));
+
+  return TRUE;
+}
+
+/* Adds the last @n_lines lines of @layout to @cache, with @key.
+ * Takes over the attributes array of @key.
+ */
+static void
+paragraph_cache_insert (PangoParagraphCache *cache,
+                        ParagraphKey        *key,
+                        PangoLayout         *layout,
+                        int                  start_offset,
+                        guint                n_lines)
+{
+  ParagraphCacheEntry *entry;
+  int offset = key->text - layout->text;
+  GSList *l;
+  int i;
+
+  entry = g_slice_new (ParagraphCacheEntry);
+  entry->key = *key;
+  entry->key.text = g_malloc (key->header.length);
+  memcpy ((char *) entry->key.text, key->text, key->header.length);
+  for (i = 0; i < key->header.n_attrs; i++)
+    entry->key.attrs[i].attr = pango_attribute_copy (key->attrs[i].attr);
+  entry->link.data = entry;
+  entry->link.prev = entry->link.next = NULL;
+  entry->offset = offset;
+  entry->n_chars = pango_utf8_strlen (key->text, key->header.length);
+  entry->log_attrs = g_memdup (layout->log_attrs + start_offset,
+                               (entry->n_chars + 1) * sizeof (PangoLogAttr));
+
+  /* The new lines are at the start of layout->lines, in reverse */
+  entry->lines = NULL;
+  for (l = layout->lines; n_lines > 0; l = l->next, n_lines--)
+    entry->lines = g_slist_prepend (entry->lines,
+                                    paragraph_line_copy (l->data, NULL, -offset, 0));
+
+  key->attrs = NULL;
+
+  g_hash_table_add (cache->entries, entry);
+  g_queue_push_head_link (&cache->lru, &entry->link);
+
+  paragraph_cache_trim (cache, cache->max_size);
+}
+
+/* Itemizes, breaks and shapes the paragraph starting at @start,
+ * prepending its lines to layout->lines. If @default_break is
+ * %FALSE, the default break analysis for the paragraph must
+ * already be in layout->log_attrs.
+ */
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wdeprecated-declarations"
+
+static void
+process_paragraph (PangoLayout       *layout,
+                   ParaBreakState    *state,
+                   const char        *start,
+                   int                delimiter_index,
+                   int                delim_len,
+                   int                start_offset,
+                   PangoDirection     base_dir,
+                   PangoAttrList     *itemize_attrs,
+                   PangoAttrIterator *iter,
+                   PangoAttrList     *shape_attrs,
+                   gboolean           default_break)
+{
+  const char *end = start + delimiter_index;
+  PangoParagraphCache *cache;
+  ParagraphKey key;
+  guint line_count = layout->line_count;
+  ShapedParagraph *shaped = NULL;
+  ShapedParagraph *unretained = NULL;
+  PangoLogAttr next_attr = { 0, };
+  guint pos = 0;
+
+  g_assert (end <= (layout->text + layout->length));
+  g_assert (start <= (layout->text + layout->length));
+  g_assert (delim_len < 4);	/* PS is 3 bytes */
+  g_assert (delim_len >= 0);
+
+  state->attrs = itemize_attrs;
+
+  cache = get_paragraph_cache (layout, start, delimiter_index + delim_len);
+  if (cache)
+    {
+      paragraph_key_init (&key, layout, start, delimiter_index + delim_len,
+                          base_dir, itemize_attrs, shape_attrs);
+
+      if (paragraph_cache_lookup (cache, &key, layout, state, start_offset))
+        {
+          g_free (key.attrs);
+          return;
+        }
+    }
+
+  if (layout->retain_shaping)
+    {
+      shaped = find_shaped_paragraph (layout, start - layout->text, &pos);
+      if (shaped &&
+          (shaped->length != delimiter_index + delim_len || shaped->base_dir != base_dir))
+        {
+          g_ptr_array_remove_index (layout->shaped_paragraphs, pos);
+          shaped = NULL;
+        }
+    }
+
+  if (shaped)
+    {
+      int i;
+
+      /* The log attrs are still there, but the boundary with the next
+       * paragraph has the entry of the next paragraph by now
+       */
+      next_attr = layout->log_attrs[start_offset + shaped->n_chars];
+      layout->log_attrs[start_offset + shaped->n_chars] = shaped->end_attr;
+
+      state->items = NULL;
+      for (i = shaped->n_items - 1; i >= 0; i--)
+        state->items = g_list_prepend (state->items, pango_item_copy (shaped->items[i].item));
+    }
+  else
+    {
+      state->items = pango_itemize_with_base_dir (layout->context,
+                                                  base_dir,
+                                                  layout->text,
+                                                  start - layout->text,
+                                                  end - start,
+                                                  itemize_attrs,
+                                                  itemize_attrs ? iter : NULL);
+
+      apply_attributes_to_items (state->items, shape_attrs);
+
+      get_items_log_attrs (layout->text,
+                           start - layout->text,
+                           delimiter_index + delim_len,
+                           state->items,
+                           default_break,
+                           layout->log_attrs + start_offset,
+                           layout->n_chars + 1 - start_offset);
+
+      if (layout->retain_shaping)
+        {
+          shaped = shaped_paragraph_new (layout,
+                                         start - layout->text,
+                                         delimiter_index + delim_len,
+                                         start_offset,
+                                         base_dir,
+                                         state->items);
+
+          if (!layout->shaped_paragraphs)
+            layout->shaped_paragraphs = g_ptr_array_new_with_free_func (shaped_paragraph_free);
+          g_ptr_array_insert (layout->shaped_paragraphs, pos, shaped);
+
+          next_attr = shaped->end_attr;
+        }
+    }
+
+  state->shaped = shaped;
+  state->base_dir = base_dir;
+  state->line_of_par = 1;
+  state->start_offset = start_offset;
+  state->line_start_offset = start_offset;
+  state->line_start_index = start - layout->text;
+
+  state->glyphs = NULL;
+  state->log_widths = NULL;
+  state->log_widths_sums = NULL;
+  state->need_hyphen = NULL;
+  state->scratch = NULL;
+  state->scratch_size = 0;
+
+  /* for deterministic bug hunting's sake set everything! */
+  state->line_width = -1;
+  state->remaining_width = -1;
+  state->log_widths_offset = 0;
+
+  state->hyphen_width = -1;
+
+  state->line_ends = NULL;
+  state->line_end = 0;
+  if (layout->line_breaking == PANGO_LINE_BREAKING_OPTIMAL &&
+      layout->width >= 0 &&
+      layout->ellipsize == PANGO_ELLIPSIZE_NONE &&
+      state->items)
+    {
+      /* The items get shaped before they are broken into lines */
+      if (!state->shaped)
+        state->shaped = unretained = shaped_paragraph_new (layout,
+                                                           start - layout->text,
+                                                           delimiter_index + delim_len,
+                                                           start_offset,
+                                                           base_dir,
+                                                           state->items);
+
+      state->line_ends = find_optimal_breaks (layout, state);
+    }
+
+  if (state->items)
+    {
+      while (state->items)
+        process_line (layout, state);
+    }
+  else
+    {
+      PangoLayoutLine *empty_line;
+
+      empty_line = pango_layout_line_new (layout);
+      empty_line->start_index = state->line_start_index;
+      empty_line->is_paragraph_start = TRUE;
+      line_set_resolved_dir (empty_line, base_dir);
+      ((PangoLayoutLinePrivate *)empty_line)->base_dir = base_dir;
+
+      add_line (empty_line, state);
+    }
+
+  if (cache)
+    {
+      paragraph_cache_insert (cache, &key, layout, start_offset,
+                              layout->line_count - line_count);
+      g_free (key.attrs);
+    }
+
+  if (shaped)
+    layout->log_attrs[start_offset + shaped->n_chars] = next_attr;
+
+  if (unretained)
+    shaped_paragraph_free (unretained);
+
+  g_free (state->line_ends);
+  state->line_ends = NULL;
+  state->shaped = NULL;
+
+  g_free (state->scratch);
+  state->scratch = NULL;
+}
+
+#pragma GCC diagnostic pop
+
+static void
+ensure_log_attrs (PangoLayout *layout,
+                  int          n_attrs)
+{
+  if (layout->n_log_attrs >= n_attrs)
+    return;
+
+  layout->n_log_attrs = MAX (n_attrs, MIN (2 * layout->n_log_attrs, layout->n_chars + 1));
+  layout->log_attrs = g_renew (PangoLogAttr, layout->log_attrs, layout->n_log_attrs);
+}
+
+static gboolean
+pango_layout_is_lazy (PangoLayout *layout)
+{
+  /* Without a width, the alignment of lines depends on the
+   * width of the widest line, and with a positive height,
+   * lines depend on all the lines before them
+   */
+  return layout->lazy && layout->width >= 0 && layout->height < 0;
+}
+
+/* Parallel break analysis
+ *
+ * The default break analysis of a paragraph only depends on its
+ * text, so for parallel layouts it is done for all paragraphs up
+ * front, on a pool of threads. Itemization, tailoring, line breaking
+ * and shaping then happen paragraph by paragraph on the calling
+ * thread, as usual, since fonts and font maps must not be used from
+ * several threads at once.
+ */
+
+/* Don't bother other threads with less text than this */
+#define PARALLEL_BREAK_MIN_CHUNK 4096
+
+typedef struct {
+  int start;		/* byte index of the paragraph */
+  int length;		/* in bytes, including the delimiter */
+  int start_offset;
+  int n_chars;		/* including the delimiter */
+  PangoLogAttr end_attr;	/* the paragraph's own entry for its end */
+} ParagraphBreaks;
+
+typedef struct {
+  GMutex mutex;
+  GCond cond;
+  int pending;
+} BreakJob;
+
+typedef struct {
+  BreakJob *job;
+  const char *text;
+  PangoLogAttr *log_attrs;
+  ParagraphBreaks *paragraphs;
+  int n_paragraphs;
+  gboolean last;
+} BreakChunk;
+
+static void
+break_chunk (BreakChunk *chunk)
+{
+  int i;
+
+  for (i = 0; i < chunk->n_paragraphs; i++)
+    {
+      ParagraphBreaks *para = &chunk->paragraphs[i];
+      PangoLogAttr *attrs = chunk->log_attrs + para->start_offset;
+
+      if (i + 1 == chunk->n_paragraphs && !chunk->last)
+        {
+          PangoLogAttr *tmp;
+
+          /* The entry at the end is the first one of the next
+           * chunk, which another thread is writing to
+           */
+          tmp = g_new (PangoLogAttr, para->n_chars + 1);
+          pango_default_break (chunk->text + para->start, para->length,
+                               NULL, tmp, para->n_chars + 1);
+          memcpy (attrs, tmp, para->n_chars * sizeof (PangoLogAttr));
+          para->end_attr = tmp[para->n_chars];
+          g_free (tmp);
+        }
+      else
+        {
+          pango_default_break (chunk->text + para->start, para->length,
+                               NULL, attrs, para->n_chars + 1);
+          para->end_attr = attrs[para->n_chars];
+        }
+    }
+}
+
+static void
+break_chunk_func (gpointer data,
+                  gpointer user_data G_GNUC_UNUSED)
+{
+  BreakChunk *chunk = data;
+  BreakJob *job = chunk->job;
+
+  break_chunk (chunk);
+
+  g_mutex_lock (&job->mutex);
+  job->pending--;
+  if (job->pending == 0)
+    g_cond_signal (&job->cond);
+  g_mutex_unlock (&job->mutex);
+}
+
+static GThreadPool *
+get_break_pool (void)
+{
+  static GThreadPool *pool = NULL;
+
+  if (g_once_init_enter (&pool))
+    {
+      GThreadPool *new_pool;
+
+      new_pool = g_thread_pool_new (break_chunk_func, NULL,
+                                    g_get_num_processors (), FALSE, NULL);
+      g_once_init_leave (&pool, new_pool);
+    }
+
+  return pool;
+}
+
+/* Finds the paragraphs of @layout and fills layout->log_attrs
+ * with their default break analysis, in parallel. Returns %NULL
+ * if there is only one paragraph.
+ */
+static ParagraphBreaks *
+pango_layout_break_paragraphs (PangoLayout *layout,
+                               int         *n_paragraphs)
+{
+  GArray *paragraphs;
+  GArray *chunks;
+  const char *start;
+  int start_offset;
+  int chunk_size;
+  BreakJob job;
+  guint i, first;
+
+  paragraphs = g_array_new (FALSE, FALSE, sizeof (ParagraphBreaks));
+
+  start = layout->text;
+  start_offset = 0;
+  while (TRUE)
+    {
+      ParagraphBreaks para;
+      int delimiter_index, next_para_index;
+
+      find_paragraph (layout, start, &delimiter_index, &next_para_index);
+
+      para.start = start - layout->text;
+      para.length = next_para_index;
+      para.start_offset = start_offset;
+      para.n_chars = pango_utf8_strlen (start, next_para_index);
+      g_array_append_val (paragraphs, para);
+
+      if (start + delimiter_index == layout->text + layout->length)
+        break;
+
+      start += next_para_index;
+      start_offset += para.n_chars;
+    }
+
+  *n_paragraphs = paragraphs->len;
+
+  if (paragraphs->len < 2)
+    {
+      g_array_free (paragraphs, TRUE);
+      return NULL;
+    }
+
+  /* Cut the paragraphs into one chunk of text per thread */
+  chunk_size = MAX (layout->n_chars / g_get_num_processors (), PARALLEL_BREAK_MIN_CHUNK);
+
+  chunks = g_array_new (FALSE, FALSE, sizeof (BreakChunk));
+  for (i = 0, first = 0; i < paragraphs->len; i++)
+    {
+      ParagraphBreaks *para = &g_array_index (paragraphs, ParagraphBreaks, i);
+      ParagraphBreaks *first_para = &g_array_index (paragraphs, ParagraphBreaks, first);
+
+      if (i + 1 == paragraphs->len ||
+          para->start_offset + para->n_chars - first_para->start_offset >= chunk_size)
+        {
+          BreakChunk chunk;
+
+          chunk.job = &job;
+          chunk.text = layout->text;
+          chunk.log_attrs = layout->log_attrs;
+          chunk.paragraphs = first_para;
+          chunk.n_paragraphs = i + 1 - first;
+          chunk.last = i + 1 == paragraphs->len;
+          g_array_append_val (chunks, chunk);
+
+          first = i + 1;
+        }
+    }
+
+  g_mutex_init (&job.mutex);
+  g_cond_init (&job.cond);
+  job.pending = chunks->len - 1;
+
+  /* The first chunk is done on this thread */
+  for (i = 1; i < chunks->len; i++)
+    g_thread_pool_push (get_break_pool (), &g_array_index (chunks, BreakChunk, i), NULL);
+
+  break_chunk (&g_array_index (chunks, BreakChunk, 0));
+
+  g_mutex_lock (&job.mutex);
+  while (job.pending > 0)
+    g_cond_wait (&job.cond, &job.mutex);
+  g_mutex_unlock (&job.mutex);
+
+  g_mutex_clear (&job.mutex);
+  g_cond_clear (&job.cond);
+  g_array_free (chunks, TRUE);
+
+  return (ParagraphBreaks *) g_array_free (paragraphs, FALSE);
+}
+
+static void
+pango_layout_check_lines (PangoLayout *layout)
+{
+  pango_layout_check_n_lines (layout, G_MAXINT);
+}
+
+/* Makes sure that the first @n_lines lines of @layout (or all
+ * its lines, if there are fewer) are available. Unless @layout
+ * is lazy, this always lays out the whole text. Lazy layouts are
+ * laid out a paragraph at a time, and stop once they have enough
+ * lines; layout->lines_incomplete is set in that case.
+ */
+static void
+pango_layout_check_n_lines (PangoLayout *layout,
+                            int          n_lines)
+{
+  const char *start;
+  gboolean done = FALSE;
+  gboolean lazy;
+  int start_offset;
+  LayoutAttrs attrs;
+  PangoAttrList *itemize_attrs;
+  PangoAttrList *shape_attrs;
+  PangoAttrIterator iter;
+  PangoDirection prev_base_dir = PANGO_DIRECTION_NEUTRAL, base_dir = PANGO_DIRECTION_NEUTRAL;
+  ParaBreakState state;
+  GSList *lines;
+  ParagraphBreaks *paragraphs = NULL;
+  int n_paragraphs = 0;
+  int paragraph = 0;
+
+  check_context_changed (layout);
+
+  if (G_LIKELY (layout->lines) &&
+      (!layout->lines_incomplete || layout->line_count >= (guint) n_lines))
+    return;
+
+  lazy = pango_layout_is_lazy (layout);
+
+  if (!layout->lines)
+    {
+      g_assert (!layout->log_attrs || layout->shaped_paragraphs);
+
+      /* For simplicity, we make sure at this point that layout->text
+       * is non-NULL even if it is zero length
+       */
+      if (G_UNLIKELY (!layout->text))
+        pango_layout_set_text (layout, NULL, 0);
+
+      start_offset = 0;
+      start = layout->text;
+
+      /* Find the first strong direction of the text */
+      if (layout->auto_dir)
+        prev_base_dir = get_initial_base_dir (layout);
+    }
+  else
+    {
+      /* Continue where we stopped */
+      start_offset = layout->lines_end_offset;
+      start = layout->text + layout->lines_end_index;
+      prev_base_dir = layout->lines_end_dir;
+    }
+
+  if (!layout->auto_dir)
+    base_dir = pango_context_get_base_dir (layout->context);
+
+  if (!lazy)
+    ensure_log_attrs (layout, layout->n_chars + 1);
+
+  if (layout->parallel && !lazy && !layout->lines &&
+      !layout->shaped_paragraphs &&
+      !layout->single_paragraph && layout->height < 0)
+    paragraphs = pango_layout_break_paragraphs (layout, &n_paragraphs);
+
+  layout_attrs_init (layout, &attrs);
+  shape_attrs = view_or_null (&attrs.shape);
+  itemize_attrs = view_or_null (&attrs.itemize);
+
+  if (itemize_attrs)
+    _pango_attr_list_get_iterator (itemize_attrs, &iter);
+
+  /* these are only used if layout->height >= 0 */
+  state.remaining_height = layout->height;
+  state.line_height = -1;
+  if (layout->height >= 0)
+    {
+      PangoRectangle logical;
+      pango_layout_get_empty_extents_at_index (layout, 0, &logical);
+      state.line_height = logical.height;
+    }
+
+  /* Collect the new lines separately */
+  lines = layout->lines;
+  layout->lines = NULL;
+
+  do
+    {
+      int delim_len;
+      const char *end;
+      int delimiter_index, next_para_index;
+      int n_chars;
+      PangoLogAttr next_attr;
+
+      find_paragraph (layout, start, &delimiter_index, &next_para_index);
+
+      if (layout->auto_dir)
+	{
+	  base_dir = pango_find_base_dir (start, delimiter_index);
+
+	  /* Propagate the base direction for neutral paragraphs */
+	  if (base_dir == PANGO_DIRECTION_NEUTRAL)
+	    base_dir = prev_base_dir;
+	  else
+	    prev_base_dir = base_dir;
+	}
+
+      end = start + delimiter_index;
+
+      delim_len = next_para_index - delimiter_index;
+
+      if (end == (layout->text + layout->length))
+	done = TRUE;
+
+      n_chars = pango_utf8_strlen (start, (end - start) + delim_len);
+
+      if (lazy)
+        ensure_log_attrs (layout, start_offset + n_chars + 1);
+
+      if (paragraphs)
+        {
+          g_assert (paragraph < n_paragraphs);
+          g_assert (paragraphs[paragraph].start == start - layout->text);
+
+          /* Tailor and break the paragraph with its own entry for the
+           * boundary, and put back the one of the next paragraph after,
+           * as if the paragraphs were analyzed one after the other
+           */
+          next_attr = layout->log_attrs[start_offset + n_chars];
+          layout->log_attrs[start_offset + n_chars] = paragraphs[paragraph].end_attr;
+          paragraph++;
+        }
+
+      process_paragraph (layout, &state,
+                         start, delimiter_index, delim_len,
+                         start_offset, base_dir,
+                         itemize_attrs, &iter, shape_attrs,
+                         paragraphs == NULL);
+
+      if (paragraphs && !done)
+        layout->log_attrs[start_offset + n_chars] = next_attr;
+
+      if (layout->height >= 0 && state.remaining_height < state.line_height)
+	done = TRUE;
+
+      if (!done)
+	start_offset += n_chars;
+
+      start = end + delim_len;
+    }
+  while (!done && !(lazy && layout->line_count >= (guint) n_lines));
+
+  layout->lines_incomplete = !done;
+  if (!done)
+    {
+      layout->lines_end_index = start - layout->text;
+      layout->lines_end_offset = start_offset;
+      layout->lines_end_dir = base_dir;
+    }
+
+  /* Append the new lines */
+  if (lines)
     {
-      PangoItem *item = l->data;
-      pango_item_apply_attrs (item, &iter);
+      layout->lines_tail->next = g_slist_reverse (layout->lines);
+      layout->lines = lines;
     }
+  else
+    layout->lines = g_slist_reverse (layout->lines);
 
-  _pango_attr_iterator_destroy (&iter);
+  apply_attributes_to_runs (layout, layout->lines_tail ? layout->lines_tail->next : layout->lines,
+                            view_or_null (&attrs.runs));
+
+  layout->lines_tail = g_slist_last (layout->lines_tail ? layout->lines_tail : layout->lines);
+
+  if (itemize_attrs)
+    _pango_attr_iterator_destroy (&iter);
+
+  layout_attrs_clear (&attrs);
+
+  g_free (paragraphs);
 }
 
 static void
-apply_attributes_to_runs (PangoLayout   *layout,
-                          PangoAttrList *attrs)
-{
-  GSList *ll;
+shift_attribute (PangoAttribute *attr,
+                 int             pos,
+                 int             remove,
+                 int             add)
+{
+  /* Same adjustment as pango_attr_list_update() */
+  if (attr->start_index >= pos &&
+      attr->start_index < pos + remove)
+    attr->start_index = pos + add;
+  else if (attr->start_index >= pos + remove)
+    attr->start_index += add - remove;
+
+  if (attr->end_index >= pos &&
+      attr->end_index < pos + remove)
+    attr->end_index = pos;
+  else if (attr->end_index >= pos + remove)
+    {
+      if (G_MAXUINT - attr->end_index < add - remove)
+        attr->end_index = G_MAXUINT;
+      else
+        attr->end_index += add - remove;
+    }
+}
 
-  if (!attrs)
-    return;
+static void
+shift_lines (GSList *lines,
+             int     pos,
+             int     remove,
+             int     add)
+{
+  GSList *l, *rl, *al;
 
-  for (ll = layout->lines; ll; ll = ll->next)
+  for (l = lines; l; l = l->next)
     {
-      PangoLayoutLine *line = ll->data;
-      GSList *old_runs = g_slist_reverse (line->runs);
-      GSList *rl;
+      PangoLayoutLine *line = l->data;
 
-      line->runs = NULL;
-      for (rl = old_runs; rl; rl = rl->next)
-        {
-          PangoGlyphItem *glyph_item = rl->data;
-          GSList *new_runs;
+      line->start_index += add - remove;
 
-          new_runs = pango_glyph_item_apply_attrs (glyph_item,
-                                                   layout->text,
-                                                   attrs);
+      for (rl = line->runs; rl; rl = rl->next)
+        {
+          PangoLayoutRun *run = rl->data;
 
-          line->runs = g_slist_concat (new_runs, line->runs);
+          run->item->offset += add - remove;
+          for (al = run->item->analysis.extra_attrs; al; al = al->next)
+            shift_attribute (al->data, pos, remove, add);
         }
-
-      g_slist_free (old_runs);
     }
 }
 
-#pragma GCC diagnostic push
-#pragma GCC diagnostic ignored "-Wdeprecated-declarations"
+static PangoDirection
+get_line_base_dir (PangoLayout *layout,
+                   GSList      *node)
+{
+  if (node)
+    return ((PangoLayoutLinePrivate *)node->data)->base_dir;
+  else
+    return get_initial_base_dir (layout);
+}
 
-static void
-pango_layout_check_lines (PangoLayout *layout)
+/* Updates the lines of @layout after the @remove bytes at @pos
+ * of @old_text have been replaced by @add bytes, redoing only the
+ * paragraphs that were touched. Lines of the paragraphs before
+ * and after the change are kept and, if needed, moved to their
+ * new position.
+ *
+ * Returns %FALSE if the lines could not be updated that way;
+ * they are left untouched in that case.
+ */
+static gboolean
+pango_layout_update_paragraphs (PangoLayout *layout,
+                                const char  *old_text,
+                                int          old_n_chars,
+                                int          pos,
+                                int          remove,
+                                int          add)
 {
-  const char *start;
-  gboolean done = FALSE;
-  int start_offset;
-  PangoAttrList *attrs;
+  GSList *l;
+  GSList *prefix_tail;  /* last kept line before the change */
+  GSList *dirty;        /* first line to redo */
+  GSList *suffix;       /* first kept line after the change */
+  GSList *old_prev;
+  GSList *old_lines;
+  GSList *new_lines;
+  PangoLogAttr *old_log_attrs;
+  LayoutAttrs attrs;
   PangoAttrList *itemize_attrs;
   PangoAttrList *shape_attrs;
   PangoAttrIterator iter;
   PangoDirection prev_base_dir = PANGO_DIRECTION_NEUTRAL, base_dir = PANGO_DIRECTION_NEUTRAL;
   ParaBreakState state;
+  const char *start;
+  int start_offset;
+  gboolean done = FALSE;
 
-  check_context_changed (layout);
-
-  if (G_LIKELY (layout->lines))
-    return;
-
-  g_assert (!layout->log_attrs);
-
-  /* For simplicity, we make sure at this point that layout->text
-   * is non-NULL even if it is zero length
+  /* With a height limit, the lines of a paragraph depend on
+   * everything that comes before it
    */
-  if (G_UNLIKELY (!layout->text))
-    pango_layout_set_text (layout, NULL, 0);
+  if (layout->single_paragraph || layout->height >= 0)
+    return FALSE;
 
-  attrs = pango_layout_get_effective_attributes (layout);
-  if (attrs)
+  if (layout->auto_dir)
     {
-      shape_attrs = pango_attr_list_filter (attrs, affects_break_or_shape, NULL);
-      itemize_attrs = pango_attr_list_filter (attrs, affects_itemization, NULL);
+      PangoDirection old_dir;
 
-      if (itemize_attrs)
-        _pango_attr_list_get_iterator (itemize_attrs, &iter);
+      old_dir = pango_find_base_dir (old_text, layout->length - add + remove);
+      if (old_dir == PANGO_DIRECTION_NEUTRAL)
+        old_dir = pango_context_get_base_dir (layout->context);
+
+      if (old_dir != get_initial_base_dir (layout))
+        return FALSE;
     }
-  else
+
+  /* Find the paragraph containing @pos. If the change is right
+   * after a \r, it may turn it into a \r\n separator, so start
+   * with the paragraph before in that case.
+   */
+  prefix_tail = NULL;
+  dirty = layout->lines;
+  for (l = layout->lines; l; l = l->next)
     {
-      shape_attrs = NULL;
-      itemize_attrs = NULL;
+      PangoLayoutLine *line = l->data;
+
+      if (line->is_paragraph_start)
+        {
+          if (line->start_index > pos ||
+              (line->start_index == pos && pos > 0 && old_text[pos - 1] == '\r'))
+            break;
+
+          dirty = l;
+        }
     }
 
-  layout->log_attrs = g_new (PangoLogAttr, layout->n_chars + 1);
+  for (l = layout->lines; l != dirty; l = l->next)
+    prefix_tail = l;
 
-  start_offset = 0;
-  start = layout->text;
+  start = layout->text + ((PangoLayoutLine *)dirty->data)->start_index;
+  start_offset = pango_utf8_strlen (layout->text, start - layout->text);
+
+  layout_attrs_init (layout, &attrs);
+  shape_attrs = view_or_null (&attrs.shape);
+  itemize_attrs = view_or_null (&attrs.itemize);
+
+  if (itemize_attrs)
+    _pango_attr_list_get_iterator (itemize_attrs, &iter);
 
-  /* Find the first strong direction of the text */
   if (layout->auto_dir)
-    {
-      prev_base_dir = pango_find_base_dir (layout->text, layout->length);
-      if (prev_base_dir == PANGO_DIRECTION_NEUTRAL)
-	prev_base_dir = pango_context_get_base_dir (layout->context);
-    }
+    prev_base_dir = get_line_base_dir (layout, prefix_tail);
   else
     base_dir = pango_context_get_base_dir (layout->context);
 
-  /* these are only used if layout->height >= 0 */
+  /* Collect the new lines separately */
+  old_lines = layout->lines;
+  layout->lines = NULL;
+  layout->line_count = 0;
+
+  old_log_attrs = layout->log_attrs;
+  layout->log_attrs = g_new (PangoLogAttr, layout->n_chars + 1);
+  layout->n_log_attrs = layout->n_chars + 1;
+  memcpy (layout->log_attrs, old_log_attrs, start_offset * sizeof (PangoLogAttr));
+
   state.remaining_height = layout->height;
   state.line_height = -1;
-  if (layout->height >= 0)
-    {
-      PangoRectangle logical;
-      pango_layout_get_empty_extents_at_index (layout, 0, &logical);
-      state.line_height = logical.height;
-    }
+
+  suffix = NULL;
+  old_prev = prefix_tail;
+  l = dirty;
 
   do
     {
@@ -4325,120 +6863,137 @@ pango_layout_check_lines (PangoLayout *layout)
       const char *end;
       int delimiter_index, next_para_index;
 
-      if (layout->single_paragraph)
-	{
-	  delimiter_index = layout->length;
-	  next_para_index = layout->length;
-	}
-      else
-	{
-	  pango_find_paragraph_boundary (start,
-					 (layout->text + layout->length) - start,
-					 &delimiter_index,
-					 &next_para_index);
-	}
-
-      g_assert (next_para_index >= delimiter_index);
+      find_paragraph (layout, start, &delimiter_index, &next_para_index);
 
       if (layout->auto_dir)
-	{
-	  base_dir = pango_find_base_dir (start, delimiter_index);
+        {
+          base_dir = pango_find_base_dir (start, delimiter_index);
 
-	  /* Propagate the base direction for neutral paragraphs */
-	  if (base_dir == PANGO_DIRECTION_NEUTRAL)
-	    base_dir = prev_base_dir;
-	  else
-	    prev_base_dir = base_dir;
-	}
+          /* Propagate the base direction for neutral paragraphs */
+          if (base_dir == PANGO_DIRECTION_NEUTRAL)
+            base_dir = prev_base_dir;
+          else
+            prev_base_dir = base_dir;
+        }
 
       end = start + delimiter_index;
-
       delim_len = next_para_index - delimiter_index;
 
       if (end == (layout->text + layout->length))
-	done = TRUE;
+        done = TRUE;
 
-      g_assert (end <= (layout->text + layout->length));
-      g_assert (start <= (layout->text + layout->length));
-      g_assert (delim_len < 4);	/* PS is 3 bytes */
-      g_assert (delim_len >= 0);
+      process_paragraph (layout, &state,
+                         start, delimiter_index, delim_len,
+                         start_offset, base_dir,
+                         itemize_attrs, &iter, shape_attrs,
+                         TRUE);
 
-      state.attrs = itemize_attrs;
-      state.items = pango_itemize_with_base_dir (layout->context,
-						 base_dir,
-						 layout->text,
-						 start - layout->text,
-						 end - start,
-						 itemize_attrs,
-                                                 itemize_attrs ? &iter : NULL);
+      if (!done)
+        {
+          int next = (end + delim_len) - layout->text;
 
-      apply_attributes_to_items (state.items, shape_attrs);
+          start_offset += pango_utf8_strlen (start, (end - start) + delim_len);
 
-      get_items_log_attrs (layout->text,
-                           start - layout->text,
-                           delimiter_index + delim_len,
-                           state.items,
-			   layout->log_attrs + start_offset,
-                           layout->n_chars + 1 - start_offset);
+          /* Past the change, we can stop as soon as we are back at
+           * the start of an old paragraph that resolves to the same
+           * base direction as before
+           */
+          if (next >= pos + add)
+            {
+              int old_next = next - add + remove;
+
+              while (l && ((PangoLayoutLine *)l->data)->start_index < old_next)
+                {
+                  old_prev = l;
+                  l = l->next;
+                }
+
+              if (l &&
+                  ((PangoLayoutLine *)l->data)->start_index == old_next &&
+                  ((PangoLayoutLine *)l->data)->is_paragraph_start &&
+                  (!layout->auto_dir || base_dir == get_line_base_dir (layout, old_prev)))
+                {
+                  suffix = l;
+                  done = TRUE;
+                }
+            }
+        }
 
-      state.base_dir = base_dir;
-      state.line_of_par = 1;
-      state.start_offset = start_offset;
-      state.line_start_offset = start_offset;
-      state.line_start_index = start - layout->text;
+      start = end + delim_len;
+    }
+  while (!done);
 
-      state.glyphs = NULL;
-      state.log_widths = NULL;
-      state.need_hyphen = NULL;
+  new_lines = g_slist_reverse (layout->lines);
+  layout->lines = old_lines;
 
-      /* for deterministic bug hunting's sake set everything! */
-      state.line_width = -1;
-      state.remaining_width = -1;
-      state.log_widths_offset = 0;
+  apply_attributes_to_runs (layout, new_lines, view_or_null (&attrs.runs));
 
-      state.hyphen_width = -1;
+  if (itemize_attrs)
+    _pango_attr_iterator_destroy (&iter);
 
-      if (state.items)
-	{
-	  while (state.items)
-	    process_line (layout, &state);
-	}
-      else
-	{
-	  PangoLayoutLine *empty_line;
+  layout_attrs_clear (&attrs);
 
-	  empty_line = pango_layout_line_new (layout);
-	  empty_line->start_index = state.line_start_index;
-	  empty_line->is_paragraph_start = TRUE;
-	  line_set_resolved_dir (empty_line, base_dir);
+  /* Cut the old list into the kept prefix, the dropped lines
+   * and the kept suffix
+   */
+  if (prefix_tail)
+    prefix_tail->next = NULL;
+  else
+    layout->lines = NULL;
 
-	  add_line (empty_line, &state);
-	}
+  if (suffix == dirty)
+    dirty = NULL;
+  else if (suffix)
+    old_prev->next = NULL;
 
-      if (layout->height >= 0 && state.remaining_height < state.line_height)
-	done = TRUE;
+  for (l = dirty; l; l = l->next)
+    {
+      PangoLayoutLine *line = l->data;
 
-      if (!done)
-	start_offset += pango_utf8_strlen (start, (end - start) + delim_len);
+      line->layout = NULL;
+      pango_layout_line_unref (line);
+    }
+  g_slist_free (dirty);
 
-      start = end + delim_len;
+  if (suffix)
+    {
+      int old_offset = start_offset - layout->n_chars + old_n_chars;
+
+      shift_lines (suffix, pos, remove, add);
+
+      /* Copied last, so that the entry at the paragraph boundary
+       * is the one computed for the following paragraph, as in
+       * pango_layout_check_lines()
+       */
+      memcpy (layout->log_attrs + start_offset,
+              old_log_attrs + old_offset,
+              (old_n_chars + 1 - old_offset) * sizeof (PangoLogAttr));
     }
-  while (!done);
 
-  apply_attributes_to_runs (layout, attrs);
-  layout->lines = g_slist_reverse (layout->lines);
+  g_free (old_log_attrs);
 
-  if (itemize_attrs)
+  layout->lines = g_slist_concat (layout->lines, g_slist_concat (new_lines, suffix));
+  layout->line_count = g_slist_length (layout->lines);
+  layout->lines_tail = g_slist_last (layout->lines);
+
+  clear_line_table (layout);
+
+  layout->is_wrapped = FALSE;
+  layout->is_ellipsized = FALSE;
+  for (l = layout->lines; l; l = l->next)
     {
-      pango_attr_list_unref (itemize_attrs);
-      _pango_attr_iterator_destroy (&iter);
+      PangoLayoutLinePrivate *private = l->data;
+
+      layout->is_wrapped |= private->wrapped;
+      layout->is_ellipsized |= private->ellipsized;
     }
 
-  pango_attr_list_unref (shape_attrs);
-  pango_attr_list_unref (attrs);
-}
+  layout->unknown_glyphs_count = -1;
+  layout->logical_rect_cached = FALSE;
+  layout->ink_rect_cached = FALSE;
 
-#pragma GCC diagnostic pop
+  return TRUE;
+}
 
 /**
  * pango_layout_line_ref:
@@ -5268,6 +7823,9 @@ pango_layout_line_new (PangoLayout *layout)
   private->line.runs = NULL;
   private->line.length = 0;
   private->cache_status = NOT_CACHED;
+  private->base_dir = PANGO_DIRECTION_NEUTRAL;
+  private->wrapped = FALSE;
+  private->ellipsized = FALSE;
 
   /* Note that we leave start_index, resolved_dir, and is_paragraph_start
    *  uninitialized */
@@ -5909,6 +8467,9 @@ pango_layout_line_postprocess (PangoLayoutLine *line,
 
   DEBUG ("after justification", line, state);
 
+  ((PangoLayoutLinePrivate *)line)->wrapped = wrapped;
+  ((PangoLayoutLinePrivate *)line)->ellipsized = ellipsized;
+
   line->layout->is_wrapped |= wrapped;
   line->layout->is_ellipsized |= ellipsized;
 }
@@ -6043,7 +8604,7 @@ static inline void
 offset_y (PangoLayoutIter *iter,
 	  int             *y)
 {
-  *y += iter->line_extents[iter->line_index].baseline;
+  *y += iter->line_extents.baseline;
 }
 
 /* Sets up the iter for the start of a new cluster. cluster_start_index
@@ -6101,7 +8662,7 @@ static void
 update_run (PangoLayoutIter *iter,
 	    int              run_start_index)
 {
-  const Extents *line_ext = &iter->line_extents[iter->line_index];
+  const Extents *line_ext = &iter->line_extents;
 
   /* Note that in iter_new() the iter->run_width
    * is garbage but we don't use it since we're on the first run of
@@ -6174,13 +8735,7 @@ pango_layout_iter_copy (PangoLayoutIter *iter)
   new->run = iter->run;
   new->index = iter->index;
 
-  new->line_extents = NULL;
-  if (iter->line_extents != NULL)
-    {
-      new->line_extents = g_memdup (iter->line_extents,
-                                    iter->layout->line_count * sizeof (Extents));
-
-    }
+  new->line_extents = iter->line_extents;
   new->line_index = iter->line_index;
 
   new->run_x = iter->run_x;
@@ -6228,9 +8783,133 @@ pango_layout_get_iter (PangoLayout *layout)
   return iter;
 }
 
+/**
+ * pango_layout_get_iter_at_line:
+ * @layout: a #PangoLayout
+ * @line: the index of a line, which must be between 0 and
+ *        <literal>pango_layout_get_line_count(layout) - 1</literal>, inclusive.
+ *
+ * Returns an iterator to iterate over the visual extents of the
+ * layout, starting at the given line.
+ *
+ * The lines before @line are not measured, so this is a cheap
+ * way to iterate over a few lines of a large layout.
+ *
+ * Return value: (nullable): the new #PangoLayoutIter that should be
+ *               freed using pango_layout_iter_free(), or %NULL if
+ *               the index is out of range.
+ *
+ * Since: 1.50
+ **/
+PangoLayoutIter *
+pango_layout_get_iter_at_line (PangoLayout *layout,
+                               int          line)
+{
+  PangoLayoutIter *iter;
+
+  g_return_val_if_fail (PANGO_IS_LAYOUT (layout), NULL);
+
+  if (line < 0)
+    return NULL;
+
+  pango_layout_check_n_lines (layout, line + 1);
+
+  if ((guint) line >= layout->line_count)
+    return NULL;
+
+  iter = g_slice_new (PangoLayoutIter);
+
+  _pango_layout_get_iter_at_line (layout, line, iter);
+
+  return iter;
+}
+
+/**
+ * pango_layout_get_iter_at_y:
+ * @layout: a #PangoLayout
+ * @y: a Y position, in layout coordinates
+ *
+ * Returns an iterator to iterate over the visual extents of the
+ * layout, starting at the line that @y is in.
+ *
+ * If @y is above or below the lines of the layout, or between
+ * two lines, the iterator starts at the nearest line, as for
+ * pango_layout_xy_to_index().
+ *
+ * Return value: the new #PangoLayoutIter that should be freed
+ *               using pango_layout_iter_free().
+ *
+ * Since: 1.50
+ **/
+PangoLayoutIter *
+pango_layout_get_iter_at_y (PangoLayout *layout,
+                            int          y)
+{
+  PangoLayoutIter *iter;
+  gboolean outside;
+
+  g_return_val_if_fail (PANGO_IS_LAYOUT (layout), NULL);
+
+  iter = g_slice_new (PangoLayoutIter);
+
+  _pango_layout_get_iter_at_line (layout, find_line_by_y (layout, y, &outside), iter);
+
+  return iter;
+}
+
+/* Returns the first line whose logical or ink extents reach
+ * down to @y, or the nearest line if there is none
+ */
+int
+_pango_layout_get_first_line_at_y (PangoLayout *layout,
+                                   int          y)
+{
+  const Extents *extents;
+  GSList **links;
+  gboolean outside;
+  int line;
+
+  line = find_line_by_y (layout, y, &outside);
+
+  extents = get_line_table_extents (layout);
+  links = get_line_table (layout);
+
+  /* The ink of the lines above may reach down further */
+  while (line > 0)
+    {
+      PangoRectangle ink_rect;
+
+      get_line_extents_layout_coords (layout, LINE_TABLE_LINE (links, line - 1),
+                                      layout->width,
+                                      extents[line - 1].logical_rect.y,
+                                      NULL, &ink_rect, NULL);
+
+      if (ink_rect.y + ink_rect.height <= y &&
+          extents[line - 1].logical_rect.y + extents[line - 1].logical_rect.height <= y)
+        break;
+
+      line--;
+    }
+
+  return line;
+}
+
 void
 _pango_layout_get_iter (PangoLayout    *layout,
                         PangoLayoutIter*iter)
+{
+  g_return_if_fail (PANGO_IS_LAYOUT (layout));
+
+  pango_layout_check_n_lines (layout, 1);
+
+  _pango_layout_get_iter_at_line (layout, 0, iter);
+}
+
+/* @line must have been laid out */
+void
+_pango_layout_get_iter_at_line (PangoLayout     *layout,
+                                int              line,
+                                PangoLayoutIter *iter)
 {
   int run_start_index;
 
@@ -6238,9 +8917,13 @@ _pango_layout_get_iter (PangoLayout    *layout,
 
   iter->layout = g_object_ref (layout);
 
-  pango_layout_check_lines (layout);
+  pango_layout_check_n_lines (layout, line + 1);
+  g_assert ((guint) line < layout->line_count);
 
-  iter->line_list_link = layout->lines;
+  if (line == 0)
+    iter->line_list_link = layout->lines;
+  else
+    iter->line_list_link = get_line_table (layout)[line];
   iter->line = iter->line_list_link->data;
   pango_layout_line_ref (iter->line);
 
@@ -6255,27 +8938,28 @@ _pango_layout_get_iter (PangoLayout    *layout,
   else
     iter->run = NULL;
 
-  iter->line_extents = NULL;
-
   if (layout->width == -1)
     {
       PangoRectangle logical_rect;
 
+      /* Without a width, the lines are aligned in the widest line */
       pango_layout_get_extents_internal (layout,
                                          NULL,
                                          &logical_rect,
-                                         &iter->line_extents);
+                                         NULL);
       iter->layout_width = logical_rect.width;
     }
   else
-    {
-      pango_layout_get_extents_internal (layout,
-                                         NULL,
-                                         NULL,
-                                         &iter->line_extents);
-      iter->layout_width = layout->width;
-    }
-  iter->line_index = 0;
+    iter->layout_width = layout->width;
+
+  /* Lines further down are measured when the iterator gets there */
+  if (line == 0)
+    get_line_extents_below (layout, iter->line, iter->layout_width,
+                            NULL, &iter->line_extents);
+  else
+    iter->line_extents = get_line_table_extents (layout)[line];
+
+  iter->line_index = line;
 
   update_run (iter, run_start_index);
 }
@@ -6286,7 +8970,6 @@ _pango_layout_iter_destroy (PangoLayoutIter *iter)
   if (iter == NULL)
     return;
 
-  g_free (iter->line_extents);
   pango_layout_line_unref (iter->line);
   g_object_unref (iter->layout);
 }
@@ -6448,7 +9131,8 @@ pango_layout_iter_at_last_line (PangoLayoutIter *iter)
   if (ITER_IS_INVALID (iter))
     return FALSE;
 
-  return iter->line_index == iter->layout->line_count - 1;
+  return iter->line_index == iter->layout->line_count - 1 &&
+         !iter->layout->lines_incomplete;
 }
 
 /**
@@ -6484,6 +9168,11 @@ line_is_terminated (PangoLayoutIter *iter)
       if (next_line->is_paragraph_start)
 	return TRUE;
     }
+  else if (iter->layout->lines_incomplete)
+    {
+      /* Lazy layouts stop at paragraph ends */
+      return TRUE;
+    }
 
   return FALSE;
 }
@@ -6677,6 +9366,27 @@ pango_layout_iter_next_run (PangoLayoutIter *iter)
   return TRUE;
 }
 
+/* Makes sure that the line after the current one, if any,
+ * has been laid out. Only lazy layouts have lines that are
+ * not laid out yet.
+ */
+static gboolean
+iter_extend (PangoLayoutIter *iter)
+{
+  PangoLayout *layout = iter->layout;
+
+  if (layout->lines_incomplete)
+    {
+      pango_layout_check_n_lines (layout, iter->line_index + 2);
+
+      /* the layout may have been cleared if its context changed */
+      if (iter->line->layout == NULL)
+        return FALSE;
+    }
+
+  return TRUE;
+}
+
 /**
  * pango_layout_iter_next_line:
  * @iter: a #PangoLayoutIter
@@ -6690,10 +9400,15 @@ gboolean
 pango_layout_iter_next_line (PangoLayoutIter *iter)
 {
   GSList *next_link;
+  Extents prev;
 
   if (ITER_IS_INVALID (iter))
     return FALSE;
 
+  if ((guint) iter->line_index + 1 >= iter->layout->line_count &&
+      !iter_extend (iter))
+    return FALSE;
+
   next_link = iter->line_list_link->next;
 
   if (next_link == NULL)
@@ -6716,6 +9431,10 @@ pango_layout_iter_next_line (PangoLayoutIter *iter)
 
   iter->line_index ++;
 
+  prev = iter->line_extents;
+  get_line_extents_below (iter->layout, iter->line, iter->layout_width,
+                          &prev, &iter->line_extents);
+
   update_run (iter, iter->line->start_index);
 
   return TRUE;
@@ -6902,7 +9621,7 @@ pango_layout_iter_get_line_extents (PangoLayoutIter *iter,
   if (ITER_IS_INVALID (iter))
     return;
 
-  ext = &iter->line_extents[iter->line_index];
+  ext = &iter->line_extents;
 
   if (ink_rect)
     {
@@ -6947,7 +9666,7 @@ pango_layout_iter_get_line_yrange (PangoLayoutIter *iter,
   if (ITER_IS_INVALID (iter))
     return;
 
-  ext = &iter->line_extents[iter->line_index];
+  ext = &iter->line_extents;
 
   half_spacing = iter->layout->spacing / 2;
 
@@ -6968,7 +9687,7 @@ pango_layout_iter_get_line_yrange (PangoLayoutIter *iter,
   if (y1)
     {
       /* No spacing below the last line */
-      if (iter->line_index == iter->layout->line_count - 1)
+      if (pango_layout_iter_at_last_line (iter))
 	*y1 = ext->logical_rect.y + ext->logical_rect.height;
       else
 	*y1 = ext->logical_rect.y + ext->logical_rect.height + half_spacing;
@@ -6990,7 +9709,7 @@ pango_layout_iter_get_baseline (PangoLayoutIter *iter)
   if (ITER_IS_INVALID (iter))
     return 0;
 
-  return iter->line_extents[iter->line_index].baseline;
+  return iter->line_extents.baseline;
 }
 
 /**
@@ -74,6 +74,25 @@ typedef enum {
   PANGO_WRAP_WORD_CHAR
 } PangoWrapMode;
 
+/**
+ * PangoLineBreaking:
+ * @PANGO_LINE_BREAKING_GREEDY: put as much text on each line as fits,
+ *   one line after the other.
+ * @PANGO_LINE_BREAKING_OPTIMAL: choose the breaks for a whole paragraph
+ *   at once, so that its lines are filled as evenly as possible, with
+ *   as few hyphenated lines as possible.
+ *
+ * A #PangoLineBreaking describes how a #PangoLayout chooses where
+ * to break the lines of a paragraph, among the positions that the
+ * #PangoWrapMode allows.
+ *
+ * Since: 1.50
+ */
+typedef enum {
+  PANGO_LINE_BREAKING_GREEDY,
+  PANGO_LINE_BREAKING_OPTIMAL
+} PangoLineBreaking;
+
 /**
  * PangoEllipsizeMode:
  * @PANGO_ELLIPSIZE_NONE: No ellipsization
@@ -154,6 +173,18 @@ PANGO_AVAILABLE_IN_ALL
 void           pango_layout_set_text       (PangoLayout    *layout,
 					    const char     *text,
 					    int             length);
+PANGO_AVAILABLE_IN_1_50
+void           pango_layout_replace_text   (PangoLayout    *layout,
+                                            int             start,
+                                            int             old_length,
+                                            const char     *text,
+                                            int             length);
+PANGO_AVAILABLE_IN_1_50
+void           pango_layout_insert_text    (PangoLayout    *layout,
+                                            int             start,
+                                            const char     *text,
+                                            int             length,
+                                            PangoAttrList  *attrs);
 PANGO_AVAILABLE_IN_ALL
 const char    *pango_layout_get_text       (PangoLayout    *layout);
 
@@ -196,6 +227,11 @@ PANGO_AVAILABLE_IN_ALL
 PangoWrapMode  pango_layout_get_wrap             (PangoLayout                *layout);
 PANGO_AVAILABLE_IN_1_16
 gboolean       pango_layout_is_wrapped           (PangoLayout                *layout);
+PANGO_AVAILABLE_IN_1_50
+void           pango_layout_set_line_breaking    (PangoLayout                *layout,
+                                                  PangoLineBreaking           line_breaking);
+PANGO_AVAILABLE_IN_1_50
+PangoLineBreaking pango_layout_get_line_breaking (PangoLayout                *layout);
 PANGO_AVAILABLE_IN_ALL
 void           pango_layout_set_indent           (PangoLayout                *layout,
 						  int                         indent);
@@ -239,6 +275,17 @@ void           pango_layout_set_single_paragraph_mode (PangoLayout
 PANGO_AVAILABLE_IN_ALL
 gboolean       pango_layout_get_single_paragraph_mode (PangoLayout                *layout);
 
+PANGO_AVAILABLE_IN_1_50
+void           pango_layout_set_lazy             (PangoLayout                *layout,
+                                                  gboolean                    lazy);
+PANGO_AVAILABLE_IN_1_50
+gboolean       pango_layout_get_lazy             (PangoLayout                *layout);
+PANGO_AVAILABLE_IN_1_50
+void           pango_layout_set_parallel         (PangoLayout                *layout,
+                                                  gboolean                    parallel);
+PANGO_AVAILABLE_IN_1_50
+gboolean       pango_layout_get_parallel         (PangoLayout                *layout);
+
 PANGO_AVAILABLE_IN_1_6
 void               pango_layout_set_ellipsize (PangoLayout        *layout,
 					       PangoEllipsizeMode  ellipsize);
@@ -315,6 +362,8 @@ void     pango_layout_get_pixel_size       (PangoLayout    *layout,
 					    int            *height);
 PANGO_AVAILABLE_IN_1_22
 int      pango_layout_get_baseline         (PangoLayout    *layout);
+PANGO_AVAILABLE_IN_1_50
+int      pango_layout_get_estimated_height (PangoLayout    *layout);
 
 PANGO_AVAILABLE_IN_ALL
 int              pango_layout_get_line_count       (PangoLayout    *layout);
@@ -378,6 +427,12 @@ GType            pango_layout_iter_get_type (void) G_GNUC_CONST;
 
 PANGO_AVAILABLE_IN_ALL
 PangoLayoutIter *pango_layout_get_iter  (PangoLayout     *layout);
+PANGO_AVAILABLE_IN_1_50
+PangoLayoutIter *pango_layout_get_iter_at_line (PangoLayout *layout,
+                                                int          line);
+PANGO_AVAILABLE_IN_1_50
+PangoLayoutIter *pango_layout_get_iter_at_y    (PangoLayout *layout,
+                                                int          y);
 PANGO_AVAILABLE_IN_1_20
 PangoLayoutIter *pango_layout_iter_copy (PangoLayoutIter *iter);
 PANGO_AVAILABLE_IN_ALL
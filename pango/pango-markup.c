@@ -25,7 +25,9 @@
 #include <errno.h>
 
 #include "pango-attributes.h"
+#include "pango-break.h"
 #include "pango-font.h"
+#include "pango-font-private.h"
 #include "pango-enum-types.h"
 #include "pango-impl-utils.h"
 #include "pango-utils-internal.h"
@@ -247,6 +249,12 @@ struct _MarkupData
   GSList *to_apply;
   gunichar accel_marker;
   gunichar accel_char;
+
+  /* For streaming parsers */
+  PangoMarkupParagraphFunc paragraph_func;
+  gpointer paragraph_data;
+  GDestroyNotify paragraph_notify;
+  gsize scanned; /* Bytes of text known to hold no complete separator */
 };
 
 typedef struct _OpenTag OpenTag;
@@ -444,34 +452,30 @@ markup_data_open_tag (MarkupData   *md)
   return ot;
 }
 
-static void
-markup_data_close_tag (MarkupData *md)
+/* Prepends the attributes of @ot, running from its start to
+ * @end_index, to @to_apply. With @copy, the attributes of @ot
+ * are copied, otherwise they are moved.
+ */
+static GSList *
+open_tag_collect_attrs (OpenTag  *ot,
+                        gsize     end_index,
+                        gboolean  copy,
+                        GSList   *to_apply)
 {
-  OpenTag *ot;
   GSList *tmp_list;
 
-  if (md->attr_list == NULL)
-    return;
-
-  /* pop the stack */
-  ot = md->tag_stack->data;
-  md->tag_stack = g_slist_delete_link (md->tag_stack,
-				       md->tag_stack);
-
-  /* Adjust end indexes, and push each attr onto the front of the
-   * to_apply list. This means that outermost tags are on the front of
-   * that list; if we apply the list in order, then the innermost
-   * tags will "win" which is correct.
-   */
   tmp_list = ot->attrs;
   while (tmp_list != NULL)
     {
       PangoAttribute *a = tmp_list->data;
 
+      if (copy)
+        a = pango_attribute_copy (a);
+
       a->start_index = ot->start_index;
-      a->end_index = md->index;
+      a->end_index = end_index;
 
-      md->to_apply = g_slist_prepend (md->to_apply, a);
+      to_apply = g_slist_prepend (to_apply, a);
 
       tmp_list = g_slist_next (tmp_list);
     }
@@ -502,15 +506,161 @@ markup_data_close_tag (MarkupData *md)
 	}
 
       a->start_index = ot->start_index;
-      a->end_index = md->index;
+      a->end_index = end_index;
 
-      md->to_apply = g_slist_prepend (md->to_apply, a);
+      to_apply = g_slist_prepend (to_apply, a);
     }
 
+  return to_apply;
+}
+
+static void
+markup_data_close_tag (MarkupData *md)
+{
+  OpenTag *ot;
+
+  if (md->attr_list == NULL)
+    return;
+
+  /* pop the stack */
+  ot = md->tag_stack->data;
+  md->tag_stack = g_slist_delete_link (md->tag_stack,
+				       md->tag_stack);
+
+  /* Adjust end indexes, and push each attr onto the front of the
+   * to_apply list. This means that outermost tags are on the front of
+   * that list; if we apply the list in order, then the innermost
+   * tags will "win" which is correct.
+   */
+  md->to_apply = open_tag_collect_attrs (ot, md->index, FALSE, md->to_apply);
+
   g_slist_free (ot->attrs);
   g_slice_free (OpenTag, ot);
 }
 
+static gboolean
+attr_starts_before (PangoAttribute *attr,
+                    gpointer        data)
+{
+  return attr->start_index < *(gsize *)data;
+}
+
+/* Passes the first @end bytes of text, which must end with a
+ * paragraph separator, and their attributes to the paragraph
+ * function, and drops them. Attributes that run past @end,
+ * including those of tags that are still open, are split and
+ * continue at the start of the remaining text.
+ */
+static void
+markup_data_emit_paragraph (MarkupData *md,
+                            gsize       end)
+{
+  PangoAttrList *attrs = NULL;
+  GSList *para = NULL;
+  GSList *rest = NULL;
+  GSList *tmp_list;
+
+  if (md->attr_list)
+    {
+      /* Accelerator underlines */
+      attrs = pango_attr_list_filter (md->attr_list, attr_starts_before, &end);
+      pango_attr_list_update (md->attr_list, 0, end, 0);
+    }
+
+  if (!attrs)
+    attrs = pango_attr_list_new ();
+
+  /* Tags that are still open close later than the closed ones,
+   * so they go in front. The stack has the innermost tag first.
+   */
+  for (tmp_list = md->tag_stack; tmp_list; tmp_list = tmp_list->next)
+    {
+      OpenTag *ot = tmp_list->data;
+
+      if (ot->start_index < end)
+        {
+          para = open_tag_collect_attrs (ot, end, TRUE, para);
+          ot->start_index = 0;
+        }
+      else
+        ot->start_index -= end;
+    }
+
+  para = g_slist_reverse (para);
+
+  for (tmp_list = md->to_apply; tmp_list; tmp_list = tmp_list->next)
+    {
+      PangoAttribute *a = tmp_list->data;
+
+      if (a->start_index >= end)
+        {
+          a->start_index -= end;
+          a->end_index -= end;
+          rest = g_slist_prepend (rest, a);
+        }
+      else if (a->end_index > end)
+        {
+          PangoAttribute *b = pango_attribute_copy (a);
+
+          b->end_index = end;
+          para = g_slist_prepend (para, b);
+
+          a->start_index = 0;
+          a->end_index -= end;
+          rest = g_slist_prepend (rest, a);
+        }
+      else
+        para = g_slist_prepend (para, a);
+    }
+
+  g_slist_free (md->to_apply);
+  md->to_apply = g_slist_reverse (rest);
+
+  /* Same order as in pango_markup_parser_finish() */
+  para = g_slist_reverse (para);
+  for (tmp_list = para; tmp_list; tmp_list = tmp_list->next)
+    pango_attr_list_insert (attrs, tmp_list->data);
+  g_slist_free (para);
+
+  md->paragraph_func (md->text->str, end, attrs, md->paragraph_data);
+
+  pango_attr_list_unref (attrs);
+
+  g_string_erase (md->text, 0, end);
+  md->index -= end;
+  md->scanned = 0;
+}
+
+/* Emits all paragraphs whose separator has been seen in full */
+static void
+markup_data_emit_paragraphs (MarkupData *md)
+{
+  while (md->scanned < md->text->len)
+    {
+      const char *start = md->text->str + md->scanned;
+      int length = md->text->len - md->scanned;
+      int delimiter_index, next_para_index;
+
+      pango_find_paragraph_boundary (start, length,
+                                     &delimiter_index, &next_para_index);
+
+      if (delimiter_index == length)
+        {
+          md->scanned = md->text->len;
+          break;
+        }
+
+      /* A \r at the end may still become a \r\n */
+      if (next_para_index == length && start[delimiter_index] == '\r')
+        {
+          md->scanned += delimiter_index;
+          break;
+        }
+
+      markup_data_emit_paragraph (md, md->scanned + next_para_index);
+    }
+}
+
 static void
 start_element_handler  (GMarkupParseContext *context,
 			const gchar         *element_name,
@@ -723,6 +873,9 @@ text_handler           (GMarkupParseContext *context G_GNUC_UNUSED,
 	  pango_attr_list_change (md->attr_list, attr);
 	}
     }
+
+  if (md->paragraph_func)
+    markup_data_emit_paragraphs (md);
 }
 
 static gboolean
@@ -731,6 +884,11 @@ xml_isspace (char c)
   return c == ' ' || c == '\t' || c == '\n' || c == '\r';
 }
 
+static gboolean fast_parse_markup (const char     *markup,
+                                   int             length,
+                                   PangoAttrList **attr_list,
+                                   char          **text);
+
 static const GMarkupParser pango_markup_parser = {
   start_element_handler,
   end_element_handler,
@@ -747,19 +905,20 @@ destroy_markup_data (MarkupData *md)
   if (md->text)
       g_string_free (md->text, TRUE);
 
+  if (md->paragraph_notify)
+    md->paragraph_notify (md->paragraph_data);
+
   if (md->attr_list)
     pango_attr_list_unref (md->attr_list);
 
   g_slice_free (MarkupData, md);
 }
 
-static GMarkupParseContext *
-pango_markup_parser_new_internal (char       accel_marker,
-				  GError   **error,
-				  gboolean   want_attr_list)
+static MarkupData *
+markup_data_new (gunichar accel_marker,
+                 gboolean want_attr_list)
 {
   MarkupData *md;
-  GMarkupParseContext *context;
 
   md = g_slice_new (MarkupData);
 
@@ -781,6 +940,70 @@ pango_markup_parser_new_internal (char       accel_marker,
   md->tag_stack = NULL;
   md->to_apply = NULL;
 
+  md->paragraph_func = NULL;
+  md->paragraph_data = NULL;
+  md->paragraph_notify = NULL;
+  md->scanned = 0;
+
+  return md;
+}
+
+/* Applies the attributes of the closed tags, and moves the
+ * results out of @md
+ */
+static void
+markup_data_get_results (MarkupData     *md,
+                         PangoAttrList **attr_list,
+                         char          **text,
+                         gunichar       *accel_char)
+{
+  GSList *tmp_list;
+
+  if (md->attr_list)
+    {
+      /* The apply list has the most-recently-closed tags first;
+       * we want to apply the least-recently-closed tag last.
+       */
+      tmp_list = md->to_apply;
+      while (tmp_list != NULL)
+	{
+	  PangoAttribute *attr = tmp_list->data;
+
+	  /* Innermost tags before outermost */
+	  pango_attr_list_insert (md->attr_list, attr);
+
+	  tmp_list = g_slist_next (tmp_list);
+	}
+      g_slist_free (md->to_apply);
+      md->to_apply = NULL;
+    }
+
+  if (attr_list)
+    {
+      *attr_list = md->attr_list;
+      md->attr_list = NULL;
+    }
+
+  if (text)
+    {
+      *text = g_string_free (md->text, FALSE);
+      md->text = NULL;
+    }
+
+  if (accel_char)
+    *accel_char = md->accel_char;
+}
+
+static GMarkupParseContext *
+pango_markup_parser_new_internal (char       accel_marker,
+				  GError   **error,
+				  gboolean   want_attr_list)
+{
+  MarkupData *md;
+  GMarkupParseContext *context;
+
+  md = markup_data_new (accel_marker, want_attr_list);
+
   context = g_markup_parse_context_new (&pango_markup_parser,
 					0, md,
                                         (GDestroyNotify)destroy_markup_data);
@@ -851,6 +1074,15 @@ pango_parse_markup (const char                 *markup_text,
   while (p != end && xml_isspace (*p))
     ++p;
 
+  if (accel_marker == 0 &&
+      fast_parse_markup (markup_text, length, attr_list, text))
+    {
+      if (accel_char)
+        *accel_char = 0;
+
+      return TRUE;
+    }
+
   context = pango_markup_parser_new_internal (accel_marker,
                                               error,
                                               (attr_list != NULL));
@@ -921,6 +1153,65 @@ pango_markup_parser_new (gunichar               accel_marker)
   return context;
 }
 
+/**
+ * pango_markup_parser_new_streaming:
+ * @accel_marker: character that precedes an accelerator, or 0 for none
+ * @func: function to call with each paragraph
+ * @user_data: data to pass to @func
+ * @notify: (nullable): function to call on @user_data when the
+ *   parser is freed
+ *
+ * Creates a markup parser like pango_markup_parser_new(), which
+ * passes the text and attributes of each paragraph to @func as soon
+ * as its paragraph separator has been parsed, instead of collecting
+ * all of the text and attributes until pango_markup_parser_finish().
+ *
+ * Tags may span paragraphs; their attributes are split at the
+ * paragraph boundaries. Putting the paragraphs back together with
+ * pango_attr_list_splice(), or with pango_layout_insert_text(),
+ * gives the same text and attributes as pango_parse_markup().
+ *
+ * This keeps the memory used while parsing large markup bounded by
+ * the size of a paragraph, and lets the paragraphs be laid out while
+ * the rest of the markup is still being parsed.
+ *
+ * Feed markup to the parser with g_markup_parse_context_parse(),
+ * and call pango_markup_parser_finish() when done, which passes
+ * the last paragraph to @func.
+ *
+ * Return value: (transfer none): a #GMarkupParseContext that should be
+ * destroyed with g_markup_parse_context_free().
+ *
+ * Since: 1.50
+ */
+GMarkupParseContext *
+pango_markup_parser_new_streaming (gunichar                  accel_marker,
+                                   PangoMarkupParagraphFunc  func,
+                                   gpointer                  user_data,
+                                   GDestroyNotify            notify)
+{
+  GError *error = NULL;
+  GMarkupParseContext *context;
+  MarkupData *md;
+
+  g_return_val_if_fail (func != NULL, NULL);
+
+  context = pango_markup_parser_new_internal (accel_marker, &error, TRUE);
+
+  if (context == NULL)
+    {
+      g_critical ("Had error when making markup parser: %s\n", error->message);
+      return NULL;
+    }
+
+  md = g_markup_parse_context_get_user_data (context);
+  md->paragraph_func = func;
+  md->paragraph_data = user_data;
+  md->paragraph_notify = notify;
+
+  return context;
+}
+
 /**
  * pango_markup_parser_finish:
  * @context: A valid parse context that was returned from pango_markup_parser_new()
@@ -934,6 +1225,12 @@ pango_markup_parser_new (gunichar               accel_marker)
  * markup. This function will not free @context, use g_markup_parse_context_free()
  * to do so.
  *
+ * For a parser from pango_markup_parser_new_streaming(), this passes
+ * the last paragraph to the paragraph function, and @attr_list and
+ * @text are set to an empty list and string. Attributes that apply
+ * to no text at the end of the markup, such as those of an empty
+ * span, are dropped.
+ *
  * Return value: %FALSE if @error is set, otherwise %TRUE
  *
  * Since: 1.31.0
@@ -947,7 +1244,6 @@ pango_markup_parser_finish (GMarkupParseContext   *context,
 {
   gboolean ret = FALSE;
   MarkupData *md = g_markup_parse_context_get_user_data (context);
-  GSList *tmp_list;
 
   if (!g_markup_parse_context_parse (context,
                                      "</markup>",
@@ -958,39 +1254,24 @@ pango_markup_parser_finish (GMarkupParseContext   *context,
   if (!g_markup_parse_context_end_parse (context, error))
     goto out;
 
-  if (md->attr_list)
+  if (md->paragraph_func)
     {
-      /* The apply list has the most-recently-closed tags first;
-       * we want to apply the least-recently-closed tag last.
-       */
-      tmp_list = md->to_apply;
-      while (tmp_list != NULL)
-	{
-	  PangoAttribute *attr = tmp_list->data;
-
-	  /* Innermost tags before outermost */
-	  pango_attr_list_insert (md->attr_list, attr);
+      /* All tags are closed now, the rest is the last paragraph */
+      if (md->text->len > 0)
+        markup_data_emit_paragraph (md, md->text->len);
 
-	  tmp_list = g_slist_next (tmp_list);
-	}
-      g_slist_free (md->to_apply);
+      /* What is left applies to no text, like an empty span at the end */
+      g_slist_free_full (md->to_apply, (GDestroyNotify) pango_attribute_destroy);
       md->to_apply = NULL;
-    }
 
-  if (attr_list)
-    {
-      *attr_list = md->attr_list;
-      md->attr_list = NULL;
+      if (md->attr_list)
+        {
+          pango_attr_list_unref (md->attr_list);
+          md->attr_list = pango_attr_list_new ();
+        }
     }
 
-  if (text)
-    {
-      *text = g_string_free (md->text, FALSE);
-      md->text = NULL;
-    }
-
-  if (accel_char)
-    *accel_char = md->accel_char;
+  markup_data_get_results (md, attr_list, text, accel_char);
 
   g_assert (md->tag_stack == NULL);
   ret = TRUE;
@@ -1316,6 +1597,65 @@ span_parse_flags (const char  *attr_name,
   return TRUE;
 }
 
+/* Markup tends to repeat the same few fonts, so these
+ * are shared as long as the interned cache has room
+ */
+static void
+span_add_font_desc (OpenTag    *tag,
+		    const char *desc)
+{
+  const PangoFontDescription *interned;
+  PangoFontDescription *parsed = NULL;
+
+  interned = _pango_font_description_lookup_interned (desc);
+  if (!interned)
+    interned = parsed = pango_font_description_from_string (desc);
+
+  add_attribute (tag, pango_attr_font_desc_new (interned));
+  if (tag)
+    open_tag_set_absolute_font_size (tag, pango_font_description_get_size (interned));
+
+  pango_font_description_free (parsed);
+}
+
+static gboolean
+span_parse_size (OpenTag    *tag,
+		 const char *size)
+{
+  if (g_ascii_isdigit (*size))
+    {
+      const char *end;
+      gint n;
+
+      if ((end = size, !_pango_scan_int (&end, &n)) || *end != '\0' || n < 0)
+	return FALSE;
+
+      add_attribute (tag, pango_attr_size_new (n));
+      if (tag)
+	open_tag_set_absolute_font_size (tag, n);
+    }
+  else if (strcmp (size, "smaller") == 0)
+    {
+      if (tag)
+	{
+	  tag->scale_level_delta -= 1;
+	  tag->scale_level -= 1;
+	}
+    }
+  else if (strcmp (size, "larger") == 0)
+    {
+      if (tag)
+	{
+	  tag->scale_level_delta += 1;
+	  tag->scale_level += 1;
+	}
+    }
+  else if (!parse_absolute_size (tag, size))
+    return FALSE;
+
+  return TRUE;
+}
+
 static gboolean
 span_parse_func     (MarkupData            *md G_GNUC_UNUSED,
 		     OpenTag               *tag,
@@ -1463,18 +1803,7 @@ span_parse_func     (MarkupData            *md G_GNUC_UNUSED,
 
   /* Parse desc first, then modify it with other font-related attributes. */
   if (G_UNLIKELY (desc))
-    {
-      PangoFontDescription *parsed;
-
-      parsed = pango_font_description_from_string (desc);
-      if (parsed)
-	{
-	  add_attribute (tag, pango_attr_font_desc_new (parsed));
-	  if (tag)
-	    open_tag_set_absolute_font_size (tag, pango_font_description_get_size (parsed));
-	  pango_font_description_free (parsed);
-	}
-    }
+    span_add_font_desc (tag, desc);
 
   if (G_UNLIKELY (family))
     {
@@ -1483,54 +1812,24 @@ span_parse_func     (MarkupData            *md G_GNUC_UNUSED,
 
   if (G_UNLIKELY (size))
     {
-      if (g_ascii_isdigit (*size))
-	{
-	  const char *end;
-	  gint n;
-
-	  if ((end = size, !_pango_scan_int (&end, &n)) || *end != '\0' || n < 0)
-	    {
-	      g_set_error (error,
-			   G_MARKUP_ERROR,
-			   G_MARKUP_ERROR_INVALID_CONTENT,
-			   _("Value of 'size' attribute on <span> tag on line %d "
-			     "could not be parsed; should be an integer no more than %d,"
-			     " or a string such as 'small', not '%s'"),
-			   line_number, INT_MAX, size);
-	      goto error;
-	    }
-
-	  add_attribute (tag, pango_attr_size_new (n));
-	  if (tag)
-	    open_tag_set_absolute_font_size (tag, n);
-	}
-      else if (strcmp (size, "smaller") == 0)
+      if (!span_parse_size (tag, size))
 	{
-	  if (tag)
-	    {
-	      tag->scale_level_delta -= 1;
-	      tag->scale_level -= 1;
-	    }
-	}
-      else if (strcmp (size, "larger") == 0)
-	{
-	  if (tag)
-	    {
-	      tag->scale_level_delta += 1;
-	      tag->scale_level += 1;
-	    }
-	}
-      else if (parse_absolute_size (tag, size))
-	; /* nothing */
-      else
-	{
-	  g_set_error (error,
-		       G_MARKUP_ERROR,
-		       G_MARKUP_ERROR_INVALID_CONTENT,
-		       _("Value of 'size' attribute on <span> tag on line %d "
-			 "could not be parsed; should be an integer, or a "
-			 "string such as 'small', not '%s'"),
-		       line_number, size);
+	  if (g_ascii_isdigit (*size))
+	    g_set_error (error,
+			 G_MARKUP_ERROR,
+			 G_MARKUP_ERROR_INVALID_CONTENT,
+			 _("Value of 'size' attribute on <span> tag on line %d "
+			   "could not be parsed; should be an integer no more than %d,"
+			   " or a string such as 'small', not '%s'"),
+			 line_number, INT_MAX, size);
+	  else
+	    g_set_error (error,
+			 G_MARKUP_ERROR,
+			 G_MARKUP_ERROR_INVALID_CONTENT,
+			 _("Value of 'size' attribute on <span> tag on line %d "
+			   "could not be parsed; should be an integer, or a "
+			   "string such as 'small', not '%s'"),
+			 line_number, size);
 	  goto error;
 	}
     }
@@ -1965,3 +2264,460 @@ u_parse_func        (MarkupData            *md G_GNUC_UNUSED,
 
   return TRUE;
 }
+
+/* Fast path for pango_parse_markup()
+ *
+ * Most markup is generated, well-formed, and only uses the simple
+ * tags and a few attributes of <span>. For that subset, we tokenize
+ * the markup directly instead of going through GMarkup, and look up
+ * tags and attributes in small tables. On anything else, we give up,
+ * and the markup goes through the full parser, which also produces
+ * the error messages.
+ */
+
+#define FAST_MAX_DEPTH 64
+
+typedef enum {
+  FAST_SPAN_FONT,
+  FAST_SPAN_FAMILY,
+  FAST_SPAN_SIZE,
+  FAST_SPAN_STYLE,
+  FAST_SPAN_WEIGHT,
+  FAST_SPAN_FOREGROUND,
+  FAST_SPAN_BACKGROUND,
+  FAST_SPAN_UNDERLINE,
+  N_FAST_SPAN_ATTRS
+} FastSpanAttr;
+
+#define ENTRY(name, value) { name, sizeof (name) - 1, value }
+
+static const struct {
+  const char *name;
+  gsize len;
+  FastSpanAttr attr;
+} fast_span_attrs[] = {
+  ENTRY ("font", FAST_SPAN_FONT),
+  ENTRY ("font_desc", FAST_SPAN_FONT),
+  ENTRY ("face", FAST_SPAN_FAMILY),
+  ENTRY ("font_family", FAST_SPAN_FAMILY),
+  ENTRY ("size", FAST_SPAN_SIZE),
+  ENTRY ("font_size", FAST_SPAN_SIZE),
+  ENTRY ("style", FAST_SPAN_STYLE),
+  ENTRY ("font_style", FAST_SPAN_STYLE),
+  ENTRY ("weight", FAST_SPAN_WEIGHT),
+  ENTRY ("font_weight", FAST_SPAN_WEIGHT),
+  ENTRY ("foreground", FAST_SPAN_FOREGROUND),
+  ENTRY ("fgcolor", FAST_SPAN_FOREGROUND),
+  ENTRY ("color", FAST_SPAN_FOREGROUND),
+  ENTRY ("background", FAST_SPAN_BACKGROUND),
+  ENTRY ("bgcolor", FAST_SPAN_BACKGROUND),
+  ENTRY ("underline", FAST_SPAN_UNDERLINE),
+};
+
+static const struct {
+  const char *name;
+  gsize len;
+  char c;
+} fast_entities[] = {
+  ENTRY ("&amp;", '&'),
+  ENTRY ("&lt;", '<'),
+  ENTRY ("&gt;", '>'),
+  ENTRY ("&quot;", '"'),
+  ENTRY ("&apos;", '\''),
+};
+
+#undef ENTRY
+
+/* The nicks of PangoUnderline, to avoid the GEnumClass lookup */
+static const struct {
+  const char *nick;
+  PangoUnderline value;
+} fast_underlines[] = {
+  { "none", PANGO_UNDERLINE_NONE },
+  { "single", PANGO_UNDERLINE_SINGLE },
+  { "double", PANGO_UNDERLINE_DOUBLE },
+  { "low", PANGO_UNDERLINE_LOW },
+  { "error", PANGO_UNDERLINE_ERROR },
+  { "single-line", PANGO_UNDERLINE_SINGLE_LINE },
+  { "double-line", PANGO_UNDERLINE_DOUBLE_LINE },
+  { "error-line", PANGO_UNDERLINE_ERROR_LINE },
+};
+
+static inline gboolean
+fast_is_name_char (char c)
+{
+  return (c >= 'a' && c <= 'z') || c == '_';
+}
+
+static TagParseFunc
+fast_lookup_tag (const char *name,
+                 gsize       len)
+{
+  switch (len)
+    {
+    case 1:
+      switch (name[0])
+        {
+        case 'b': return b_parse_func;
+        case 'i': return i_parse_func;
+        case 's': return s_parse_func;
+        case 'u': return u_parse_func;
+        default: break;
+        }
+      break;
+    case 2:
+      if (memcmp (name, "tt", 2) == 0)
+        return tt_parse_func;
+      break;
+    case 3:
+      if (memcmp (name, "big", 3) == 0)
+        return big_parse_func;
+      if (memcmp (name, "sub", 3) == 0)
+        return sub_parse_func;
+      if (memcmp (name, "sup", 3) == 0)
+        return sup_parse_func;
+      break;
+    case 4:
+      if (memcmp (name, "span", 4) == 0)
+        return span_parse_func;
+      break;
+    case 5:
+      if (memcmp (name, "small", 5) == 0)
+        return small_parse_func;
+      break;
+    default:
+      break;
+    }
+
+  return NULL;
+}
+
+static int
+fast_lookup_span_attr (const char *name,
+                       gsize       len)
+{
+  guint i;
+
+  for (i = 0; i < G_N_ELEMENTS (fast_span_attrs); i++)
+    {
+      if (fast_span_attrs[i].len == len &&
+          memcmp (fast_span_attrs[i].name, name, len) == 0)
+        return fast_span_attrs[i].attr;
+    }
+
+  return -1;
+}
+
+/* Returns the length of the entity at @p, or 0 */
+static gsize
+fast_parse_entity (const char *p,
+                   const char *end,
+                   char       *c)
+{
+  guint i;
+
+  for (i = 0; i < G_N_ELEMENTS (fast_entities); i++)
+    {
+      if ((gsize) (end - p) >= fast_entities[i].len &&
+          memcmp (fast_entities[i].name, p, fast_entities[i].len) == 0)
+        {
+          *c = fast_entities[i].c;
+          return fast_entities[i].len;
+        }
+    }
+
+  return 0;
+}
+
+/* Does what span_parse_func() does for the attributes we know,
+ * in the same order
+ */
+static gboolean
+fast_span_apply (OpenTag     *tag,
+                 const char **values)
+{
+  const char *v;
+
+  if ((v = values[FAST_SPAN_FONT]))
+    span_add_font_desc (tag, v);
+
+  if ((v = values[FAST_SPAN_FAMILY]))
+    add_attribute (tag, pango_attr_family_new (v));
+
+  if ((v = values[FAST_SPAN_SIZE]))
+    {
+      if (!span_parse_size (tag, v))
+        return FALSE;
+    }
+
+  if ((v = values[FAST_SPAN_STYLE]))
+    {
+      PangoStyle style;
+
+      if (!pango_parse_style (v, &style, FALSE))
+        return FALSE;
+
+      add_attribute (tag, pango_attr_style_new (style));
+    }
+
+  if ((v = values[FAST_SPAN_WEIGHT]))
+    {
+      PangoWeight weight;
+
+      if (!pango_parse_weight (v, &weight, FALSE))
+        return FALSE;
+
+      add_attribute (tag, pango_attr_weight_new (weight));
+    }
+
+  if ((v = values[FAST_SPAN_FOREGROUND]))
+    {
+      PangoColor color;
+      guint16 alpha;
+
+      if (!pango_color_parse_with_alpha (&color, &alpha, v))
+        return FALSE;
+
+      add_attribute (tag, pango_attr_foreground_new (color.red, color.green, color.blue));
+      if (alpha != 0xffff)
+        add_attribute (tag, pango_attr_foreground_alpha_new (alpha));
+    }
+
+  if ((v = values[FAST_SPAN_BACKGROUND]))
+    {
+      PangoColor color;
+      guint16 alpha;
+
+      if (!pango_color_parse_with_alpha (&color, &alpha, v))
+        return FALSE;
+
+      add_attribute (tag, pango_attr_background_new (color.red, color.green, color.blue));
+      if (alpha != 0xffff)
+        add_attribute (tag, pango_attr_background_alpha_new (alpha));
+    }
+
+  if ((v = values[FAST_SPAN_UNDERLINE]))
+    {
+      guint i;
+
+      for (i = 0; i < G_N_ELEMENTS (fast_underlines); i++)
+        {
+          if (strcmp (fast_underlines[i].nick, v) == 0)
+            break;
+        }
+
+      if (i == G_N_ELEMENTS (fast_underlines))
+        return FALSE;
+
+      add_attribute (tag, pango_attr_underline_new (fast_underlines[i].value));
+    }
+
+  return TRUE;
+}
+
+/* Parses @markup if it only uses the subset described above.
+ * Returns %FALSE without touching @attr_list and @text if it
+ * finds anything else.
+ */
+static gboolean
+fast_parse_markup (const char     *markup,
+                   int             length,
+                   PangoAttrList **attr_list,
+                   char          **text)
+{
+  static const gchar *no_attrs[] = { NULL };
+  const char *p = markup;
+  const char *end = markup + length;
+  TagParseFunc stack[FAST_MAX_DEPTH];
+  int depth = 0;
+  MarkupData *md;
+  gboolean ret = FALSE;
+
+  if (!g_utf8_validate (markup, length, NULL))
+    return FALSE;
+
+  md = markup_data_new (0, attr_list != NULL);
+
+  /* The <markup> element that the full parser wraps around it all */
+  markup_data_open_tag (md);
+
+  while (p < end)
+    {
+      const char *q;
+      TagParseFunc parse_func;
+      const char *values[N_FAST_SPAN_ATTRS] = { NULL, };
+      char buf[512];
+      gsize buf_len = 0;
+      gboolean self_close = FALSE;
+      OpenTag *ot;
+
+      for (q = p; q < end && *q != '<' && *q != '&' && *q != '\r'; q++)
+        ;
+
+      if (q > p)
+        {
+          g_string_append_len (md->text, p, q - p);
+          md->index += q - p;
+          p = q;
+          continue;
+        }
+
+      /* GMarkup turns \r\n and \r into \n */
+      if (*p == '\r')
+        {
+          g_string_append_c (md->text, '\n');
+          md->index++;
+          p++;
+          if (p < end && *p == '\n')
+            p++;
+          continue;
+        }
+
+      if (*p == '&')
+        {
+          char c;
+          gsize len = fast_parse_entity (p, end, &c);
+
+          if (len == 0)
+            goto out;
+
+          g_string_append_c (md->text, c);
+          md->index++;
+          p += len;
+          continue;
+        }
+
+      p++;
+
+      if (p < end && *p == '/')
+        {
+          p++;
+          for (q = p; q < end && fast_is_name_char (*q); q++)
+            ;
+
+          if (q == end || *q != '>' || depth == 0 ||
+              fast_lookup_tag (p, q - p) != stack[depth - 1])
+            goto out;
+
+          markup_data_close_tag (md);
+          depth--;
+          p = q + 1;
+          continue;
+        }
+
+      for (q = p; q < end && fast_is_name_char (*q); q++)
+        ;
+
+      parse_func = fast_lookup_tag (p, q - p);
+      if (parse_func == NULL || depth == FAST_MAX_DEPTH)
+        goto out;
+
+      p = q;
+
+      /* Attributes, each name="value" or name='value' */
+      while (TRUE)
+        {
+          const char *name;
+          char quote;
+          int attr;
+
+          if (p == end)
+            goto out;
+
+          if (*p == '>')
+            {
+              self_close = FALSE;
+              p++;
+              break;
+            }
+
+          if (*p == '/')
+            {
+              if (p + 1 == end || p[1] != '>')
+                goto out;
+
+              self_close = TRUE;
+              p += 2;
+              break;
+            }
+
+          if (!xml_isspace (*p))
+            goto out;
+
+          while (p < end && xml_isspace (*p))
+            p++;
+
+          if (p == end)
+            goto out;
+
+          if (*p == '>' || *p == '/')
+            continue;
+
+          if (parse_func != span_parse_func)
+            goto out;
+
+          name = p;
+          for (q = p; q < end && fast_is_name_char (*q); q++)
+            ;
+
+          attr = fast_lookup_span_attr (name, q - name);
+          if (attr < 0 || values[attr] != NULL)
+            goto out;
+
+          p = q;
+          if (end - p < 2 || p[0] != '=' || (p[1] != '"' && p[1] != '\''))
+            goto out;
+
+          quote = p[1];
+          p += 2;
+
+          /* Leave entities and whitespace normalization to GMarkup */
+          for (q = p; q < end && *q != quote; q++)
+            {
+              if (*q == '&' || *q == '<' || *q == '\t' || *q == '\n' || *q == '\r')
+                goto out;
+            }
+
+          if (q == end || buf_len + (q - p) + 1 > sizeof (buf))
+            goto out;
+
+          memcpy (buf + buf_len, p, q - p);
+          buf[buf_len + (q - p)] = '\0';
+          values[attr] = buf + buf_len;
+          buf_len += (q - p) + 1;
+
+          p = q + 1;
+        }
+
+      ot = markup_data_open_tag (md);
+
+      if (parse_func == span_parse_func)
+        {
+          if (!fast_span_apply (ot, values))
+            goto out;
+        }
+      else
+        parse_func (md, ot, no_attrs, no_attrs, NULL, NULL);
+
+      stack[depth++] = parse_func;
+
+      if (self_close)
+        {
+          markup_data_close_tag (md);
+          depth--;
+        }
+    }
+
+  if (depth != 0)
+    goto out;
+
+  markup_data_close_tag (md);
+  markup_data_get_results (md, attr_list, text, NULL);
+
+  ret = TRUE;
+
+ out:
+  destroy_markup_data (md);
+
+  return ret;
+}
@@ -21,6 +21,7 @@
 
 #include "config.h"
 #include <stdlib.h>
+#include <string.h>
 
 #include "pango-renderer.h"
 #include "pango-impl-utils.h"
@@ -61,8 +62,13 @@ struct _PangoRendererPrivate
   guint16 alpha[N_RENDER_PARTS];
 
   PangoLayoutLine *line;
+  PangoLayout *layout;	/* Overrides line->layout when set */
   LineState *line_state;
   PangoOverline overline;
+
+  /* See pango_renderer_set_clip_rect() */
+  PangoRectangle clip_rect;
+  gboolean clip_set;
 };
 
 static void pango_renderer_finalize                     (GObject          *gobject);
@@ -111,6 +117,14 @@ to_device (PangoMatrix *matrix,
     }
 }
 
+static gboolean
+rects_intersect (const PangoRectangle *a,
+		 const PangoRectangle *b)
+{
+  return a->x < b->x + b->width && b->x < a->x + a->width &&
+	 a->y < b->y + b->height && b->y < a->y + a->height;
+}
+
 G_DEFINE_ABSTRACT_TYPE_WITH_CODE (PangoRenderer, pango_renderer, G_TYPE_OBJECT,
                                   G_ADD_PRIVATE (PangoRenderer))
 
@@ -157,6 +171,10 @@ pango_renderer_finalize (GObject *gobject)
  *
  * Draws @layout with the specified #PangoRenderer.
  *
+ * If a clip rectangle has been set with pango_renderer_set_clip_rect(),
+ * only the lines whose extents intersect it are drawn, and of those,
+ * only the runs whose ink extents intersect it.
+ *
  * Since: 1.8
  **/
 void
@@ -165,11 +183,15 @@ pango_renderer_draw_layout (PangoRenderer    *renderer,
 			    int               x,
 			    int               y)
 {
+  PangoRendererPrivate *priv;
   PangoLayoutIter iter;
+  PangoRectangle clip;
 
   g_return_if_fail (PANGO_IS_RENDERER (renderer));
   g_return_if_fail (PANGO_IS_LAYOUT (layout));
 
+  priv = renderer->priv;
+
   /* We only change the matrix if the renderer isn't already
    * active.
    */
@@ -182,17 +204,47 @@ pango_renderer_draw_layout (PangoRenderer    *renderer,
 
   pango_renderer_activate (renderer);
 
-  _pango_layout_get_iter (layout, &iter);
+  if (priv->clip_set)
+    {
+      /* The clip rectangle in layout coordinates */
+      clip = priv->clip_rect;
+      clip.x -= x;
+      clip.y -= y;
+
+      _pango_layout_get_iter_at_line (layout,
+				      _pango_layout_get_first_line_at_y (layout, clip.y),
+				      &iter);
+    }
+  else
+    _pango_layout_get_iter (layout, &iter);
 
   do
     {
+      PangoRectangle   ink_rect;
       PangoRectangle   logical_rect;
       PangoLayoutLine *line;
       int              baseline;
 
       line = pango_layout_iter_get_line_readonly (&iter);
 
-      pango_layout_iter_get_line_extents (&iter, NULL, &logical_rect);
+      pango_layout_iter_get_line_extents (&iter,
+					  priv->clip_set ? &ink_rect : NULL,
+					  &logical_rect);
+
+      if (priv->clip_set)
+	{
+	  /* Lines below the clip are not expected to reach
+	   * back up into it, so stop at the first one
+	   */
+	  if (logical_rect.y >= clip.y + clip.height &&
+	      ink_rect.y >= clip.y + clip.height)
+	    break;
+
+	  if (!rects_intersect (&ink_rect, &clip) &&
+	      !rects_intersect (&logical_rect, &clip))
+	    continue;
+	}
+
       baseline = pango_layout_iter_get_baseline (&iter);
 
       pango_renderer_draw_layout_line (renderer,
@@ -558,6 +610,9 @@ draw_shaped_glyphs (PangoRenderer    *renderer,
  *
  * Draws @line with the specified #PangoRenderer.
  *
+ * If a clip rectangle has been set with pango_renderer_set_clip_rect(),
+ * the glyphs of runs whose ink extents do not intersect it are not drawn.
+ *
  * Since: 1.8
  **/
 void
@@ -605,6 +660,7 @@ pango_renderer_draw_layout_line (PangoRenderer    *renderer,
       PangoAttrShape *shape_attr;
       PangoRectangle ink_rect, *ink = NULL;
       PangoRectangle logical_rect, *logical = NULL;
+      gboolean visible = TRUE;
 
       if (run->item->analysis.flags & PANGO_ANALYSIS_FLAG_CENTERED_BASELINE)
 	logical = &logical_rect;
@@ -655,6 +711,25 @@ pango_renderer_draw_layout_line (PangoRenderer    *renderer,
 	  rise += adjustment;
 	}
 
+      if (G_UNLIKELY (renderer->priv->clip_set))
+	{
+	  PangoRectangle run_ink;
+
+	  if (ink)
+	    run_ink = *ink;
+	  else
+	    pango_glyph_string_extents (run->glyphs, run->item->analysis.font,
+					&run_ink, NULL);
+
+	  run_ink.x += x + x_off;
+	  run_ink.y += y - rise;
+
+	  /* Backgrounds and decorations are cheap to draw, and
+	   * decorations span runs, so only the glyphs are skipped
+	   */
+	  visible = rects_intersect (&run_ink, &renderer->priv->clip_rect);
+	}
+
 
       if (renderer->priv->color_set[PANGO_RENDER_PART_BACKGROUND])
 	{
@@ -672,7 +747,11 @@ pango_renderer_draw_layout_line (PangoRenderer    *renderer,
 					 overall_rect.height);
 	}
 
-      if (shape_attr)
+      if (!visible)
+	{
+	  /* Outside of the clip rectangle */
+	}
+      else if (shape_attr)
 	{
 	  draw_shaped_glyphs (renderer, run->glyphs, shape_attr, x + x_off, y - rise);
 	}
@@ -1567,6 +1646,60 @@ pango_renderer_get_matrix (PangoRenderer *renderer)
   return renderer->matrix;
 }
 
+/**
+ * pango_renderer_set_clip_rect:
+ * @renderer: a #PangoRenderer
+ * @clip_rect: (allow-none): a rectangle in user space coordinates
+ *   in Pango units, or %NULL to unset any existing clip rectangle.
+ *
+ * Sets a rectangle that limits what pango_renderer_draw_layout()
+ * and pango_renderer_draw_layout_line() draw. Lines of the layout,
+ * and the glyphs of runs, whose extents do not intersect it are
+ * skipped, without being measured if possible.
+ *
+ * The rectangle is in the same coordinates as the position
+ * passed to pango_renderer_draw_layout(). It is not applied to
+ * what is drawn, so renderers should still clip to it, or
+ * to a larger area, to avoid drawing outside of it.
+ *
+ * Since: 1.50
+ **/
+void
+pango_renderer_set_clip_rect (PangoRenderer        *renderer,
+			      const PangoRectangle *clip_rect)
+{
+  g_return_if_fail (PANGO_IS_RENDERER_FAST (renderer));
+
+  if (clip_rect)
+    {
+      renderer->priv->clip_rect = *clip_rect;
+      renderer->priv->clip_set = TRUE;
+    }
+  else
+    renderer->priv->clip_set = FALSE;
+}
+
+/**
+ * pango_renderer_get_clip_rect:
+ * @renderer: a #PangoRenderer
+ *
+ * Gets the clip rectangle that limits what is drawn by
+ * pango_renderer_draw_layout(). See pango_renderer_set_clip_rect().
+ *
+ * Return value: (nullable): the clip rectangle, or %NULL if no clip
+ *  rectangle has been set. The returned rectangle is owned by Pango
+ *  and must not be modified or freed.
+ *
+ * Since: 1.50
+ **/
+const PangoRectangle *
+pango_renderer_get_clip_rect (PangoRenderer *renderer)
+{
+  g_return_val_if_fail (PANGO_IS_RENDERER (renderer), NULL);
+
+  return renderer->priv->clip_set ? &renderer->priv->clip_rect : NULL;
+}
+
 /**
  * pango_renderer_get_layout:
  * @renderer: a #PangoRenderer
@@ -1586,6 +1719,9 @@ pango_renderer_get_matrix (PangoRenderer *renderer)
 PangoLayout *
 pango_renderer_get_layout (PangoRenderer *renderer)
 {
+  if (G_UNLIKELY (renderer->priv->layout != NULL))
+    return renderer->priv->layout;
+
   if (G_UNLIKELY (renderer->priv->line == NULL))
     return NULL;
 
@@ -1613,3 +1749,575 @@ pango_renderer_get_layout_line (PangoRenderer     *renderer)
 {
   return renderer->priv->line;
 }
+
+/* Display lists
+ *
+ * A display list is recorded by drawing a layout with a renderer
+ * that keeps what it is asked to draw, in user space and relative
+ * to the layout. Replaying it calls the same vfuncs on another
+ * renderer, without going through the lines and runs again.
+ */
+
+typedef enum
+{
+  DISPLAY_OP_GLYPHS,
+  DISPLAY_OP_RECTANGLE,
+  DISPLAY_OP_ERROR_UNDERLINE,
+  DISPLAY_OP_SHAPE
+} DisplayOpType;
+
+typedef struct _DisplayOp DisplayOp;
+
+struct _DisplayOp
+{
+  DisplayOpType type;
+
+  /* The color the op is drawn in */
+  PangoRenderPart part;
+  gboolean color_set;
+  PangoColor color;
+  guint16 alpha;
+
+  /* The ink extents, used for clipping. Rectangles
+   * and error underlines are drawn at these.
+   */
+  PangoRectangle bounds;
+
+  /* Origin of glyphs and shapes */
+  int x, y;
+
+  union {
+    struct {
+      PangoFont *font;
+      PangoGlyphString *glyphs;
+      int width;
+    } glyphs;
+    struct {
+      PangoAttrShape *attr;
+      PangoLayoutLine *line;
+    } shape;
+  } u;
+};
+
+/**
+ * PangoDisplayList:
+ *
+ * A #PangoDisplayList is an immutable recording of what
+ * pango_renderer_draw_layout() draws for a layout: the glyphs,
+ * with the runs of each font and color joined where possible,
+ * and the rectangles, error underlines and shapes, along with
+ * the colors that they are drawn in.
+ *
+ * It can be drawn many times with pango_renderer_draw_display_list()
+ * or pango_cairo_show_display_list(), which is much cheaper than
+ * drawing the layout again, for text that doesn't change.
+ *
+ * A display list doesn't follow changes to the layout that it
+ * was recorded from. Compare pango_display_list_get_serial() to
+ * pango_layout_get_serial() to find out whether it is out of date.
+ *
+ * Since: 1.50
+ */
+struct _PangoDisplayList
+{
+  guint ref_count;
+  guint serial;
+  PangoMatrix *matrix;
+  PangoLayout *layout; /* Only kept for shapes */
+  DisplayOp *ops;
+  guint n_ops;
+};
+
+typedef struct _PangoRecordingRenderer PangoRecordingRenderer;
+typedef struct _PangoRecordingRendererClass PangoRecordingRendererClass;
+
+struct _PangoRecordingRenderer
+{
+  PangoRenderer parent_instance;
+
+  GArray *ops;
+  PangoLayout *layout;
+};
+
+struct _PangoRecordingRendererClass
+{
+  PangoRendererClass parent_class;
+};
+
+GType pango_recording_renderer_get_type (void);
+
+G_DEFINE_TYPE (PangoRecordingRenderer, pango_recording_renderer, PANGO_TYPE_RENDERER)
+
+static void
+display_op_clear (DisplayOp *op)
+{
+  switch (op->type)
+    {
+    case DISPLAY_OP_GLYPHS:
+      g_object_unref (op->u.glyphs.font);
+      pango_glyph_string_free (op->u.glyphs.glyphs);
+      break;
+    case DISPLAY_OP_SHAPE:
+      pango_attribute_destroy ((PangoAttribute *) op->u.shape.attr);
+      if (op->u.shape.line)
+	pango_layout_line_unref (op->u.shape.line);
+      break;
+    case DISPLAY_OP_RECTANGLE:
+    case DISPLAY_OP_ERROR_UNDERLINE:
+    default:
+      break;
+    }
+}
+
+static void
+record_color (PangoRenderer   *renderer,
+	      PangoRenderPart  part,
+	      DisplayOp       *op)
+{
+  PangoColor *color = pango_renderer_get_color (renderer, part);
+
+  op->part = part;
+  op->color_set = color != NULL;
+  if (color)
+    op->color = *color;
+  op->alpha = pango_renderer_get_alpha (renderer, part);
+}
+
+static gboolean
+same_color (const DisplayOp *a,
+	    const DisplayOp *b)
+{
+  return a->part == b->part &&
+	 a->color_set == b->color_set &&
+	 (!a->color_set ||
+	  (a->color.red == b->color.red &&
+	   a->color.green == b->color.green &&
+	   a->color.blue == b->color.blue)) &&
+	 a->alpha == b->alpha;
+}
+
+static void
+union_rects (PangoRectangle       *dest,
+	     const PangoRectangle *src)
+{
+  int x2, y2;
+
+  if (src->width <= 0 || src->height <= 0)
+    return;
+
+  if (dest->width <= 0 || dest->height <= 0)
+    {
+      *dest = *src;
+      return;
+    }
+
+  x2 = MAX (dest->x + dest->width, src->x + src->width);
+  y2 = MAX (dest->y + dest->height, src->y + src->height);
+  dest->x = MIN (dest->x, src->x);
+  dest->y = MIN (dest->y, src->y);
+  dest->width = x2 - dest->x;
+  dest->height = y2 - dest->y;
+}
+
+static void
+pango_recording_renderer_draw_glyphs (PangoRenderer    *renderer,
+				      PangoFont        *font,
+				      PangoGlyphString *glyphs,
+				      int               x,
+				      int               y)
+{
+  GArray *ops = ((PangoRecordingRenderer *) renderer)->ops;
+  DisplayOp op = { 0, };
+  PangoRectangle ink;
+
+  if (glyphs->num_glyphs == 0)
+    return;
+
+  op.type = DISPLAY_OP_GLYPHS;
+  record_color (renderer, PANGO_RENDER_PART_FOREGROUND, &op);
+
+  pango_glyph_string_extents (glyphs, font, &ink, NULL);
+  ink.x += x;
+  ink.y += y;
+
+  /* Join runs in the same font and color on the same baseline,
+   * by widening the last glyph of the previous run to reach
+   * the start of this one.
+   */
+  if (ops->len > 0)
+    {
+      DisplayOp *last = &g_array_index (ops, DisplayOp, ops->len - 1);
+
+      if (last->type == DISPLAY_OP_GLYPHS &&
+	  last->u.glyphs.font == font &&
+	  last->y == y &&
+	  x >= last->x + last->u.glyphs.width &&
+	  same_color (last, &op))
+	{
+	  PangoGlyphString *dest = last->u.glyphs.glyphs;
+	  int n = dest->num_glyphs;
+	  int end = last->x + last->u.glyphs.width;
+
+	  dest->glyphs[n - 1].geometry.width += x - end;
+
+	  pango_glyph_string_set_size (dest, n + glyphs->num_glyphs);
+	  memcpy (dest->glyphs + n, glyphs->glyphs,
+		  glyphs->num_glyphs * sizeof (PangoGlyphInfo));
+	  memcpy (dest->log_clusters + n, glyphs->log_clusters,
+		  glyphs->num_glyphs * sizeof (int));
+
+	  last->u.glyphs.width = x - last->x + pango_glyph_string_get_width (glyphs);
+	  union_rects (&last->bounds, &ink);
+	  return;
+	}
+    }
+
+  op.bounds = ink;
+  op.x = x;
+  op.y = y;
+  op.u.glyphs.font = g_object_ref (font);
+  op.u.glyphs.glyphs = pango_glyph_string_copy (glyphs);
+  op.u.glyphs.width = pango_glyph_string_get_width (glyphs);
+
+  g_array_append_val (ops, op);
+}
+
+static void
+pango_recording_renderer_draw_rectangle (PangoRenderer   *renderer,
+					 PangoRenderPart  part,
+					 int              x,
+					 int              y,
+					 int              width,
+					 int              height)
+{
+  GArray *ops = ((PangoRecordingRenderer *) renderer)->ops;
+  DisplayOp op = { 0, };
+
+  op.type = DISPLAY_OP_RECTANGLE;
+  record_color (renderer, part, &op);
+  op.bounds.x = x;
+  op.bounds.y = y;
+  op.bounds.width = width;
+  op.bounds.height = height;
+
+  g_array_append_val (ops, op);
+}
+
+static void
+pango_recording_renderer_draw_error_underline (PangoRenderer *renderer,
+					       int            x,
+					       int            y,
+					       int            width,
+					       int            height)
+{
+  GArray *ops = ((PangoRecordingRenderer *) renderer)->ops;
+  DisplayOp op = { 0, };
+
+  op.type = DISPLAY_OP_ERROR_UNDERLINE;
+  record_color (renderer, PANGO_RENDER_PART_UNDERLINE, &op);
+  op.bounds.x = x;
+  op.bounds.y = y;
+  op.bounds.width = width;
+  op.bounds.height = height;
+
+  g_array_append_val (ops, op);
+}
+
+static void
+pango_recording_renderer_draw_shape (PangoRenderer  *renderer,
+				     PangoAttrShape *attr,
+				     int             x,
+				     int             y)
+{
+  GArray *ops = ((PangoRecordingRenderer *) renderer)->ops;
+  DisplayOp op = { 0, };
+
+  op.type = DISPLAY_OP_SHAPE;
+  record_color (renderer, PANGO_RENDER_PART_FOREGROUND, &op);
+  op.bounds = attr->ink_rect;
+  op.bounds.x += x;
+  op.bounds.y += y;
+  op.x = x;
+  op.y = y;
+  op.u.shape.attr = (PangoAttrShape *) pango_attribute_copy ((PangoAttribute *) attr);
+  op.u.shape.line = pango_layout_line_ref (pango_renderer_get_layout_line (renderer));
+
+  /* Shape renderers find their data through the context of the
+   * layout. The lines forget their layout when it is laid out
+   * again or freed, so the layout itself is kept.
+   */
+  if (!((PangoRecordingRenderer *) renderer)->layout)
+    ((PangoRecordingRenderer *) renderer)->layout = g_object_ref (pango_renderer_get_layout (renderer));
+
+  g_array_append_val (ops, op);
+}
+
+static void
+pango_recording_renderer_init (PangoRecordingRenderer *renderer)
+{
+  renderer->ops = g_array_new (FALSE, FALSE, sizeof (DisplayOp));
+}
+
+static void
+pango_recording_renderer_finalize (GObject *object)
+{
+  PangoRecordingRenderer *renderer = (PangoRecordingRenderer *) object;
+
+  if (renderer->ops)
+    {
+      guint i;
+
+      for (i = 0; i < renderer->ops->len; i++)
+	display_op_clear (&g_array_index (renderer->ops, DisplayOp, i));
+      g_array_free (renderer->ops, TRUE);
+    }
+
+  g_clear_object (&renderer->layout);
+
+  G_OBJECT_CLASS (pango_recording_renderer_parent_class)->finalize (object);
+}
+
+static void
+pango_recording_renderer_class_init (PangoRecordingRendererClass *klass)
+{
+  GObjectClass *object_class = G_OBJECT_CLASS (klass);
+  PangoRendererClass *renderer_class = PANGO_RENDERER_CLASS (klass);
+
+  object_class->finalize = pango_recording_renderer_finalize;
+
+  renderer_class->draw_glyphs = pango_recording_renderer_draw_glyphs;
+  renderer_class->draw_rectangle = pango_recording_renderer_draw_rectangle;
+  renderer_class->draw_error_underline = pango_recording_renderer_draw_error_underline;
+  renderer_class->draw_shape = pango_recording_renderer_draw_shape;
+}
+
+G_DEFINE_BOXED_TYPE (PangoDisplayList, pango_display_list,
+                     pango_display_list_ref,
+                     pango_display_list_unref);
+
+/**
+ * pango_display_list_new:
+ * @layout: a #PangoLayout
+ *
+ * Records what pango_renderer_draw_layout() draws for @layout
+ * at the origin, into a new display list.
+ *
+ * The colors are those of the attributes of @layout, as the
+ * default implementation of the prepare_run vfunc of
+ * #PangoRenderer sets them. The text that glyphs belong to
+ * is not recorded, so it can't be embedded in the output of
+ * renderers that support it, like PDF output in cairo.
+ *
+ * If @layout contains shapes, the display list keeps a reference
+ * to it, since shape renderers find their data through the
+ * context of the layout, see pango_renderer_get_layout().
+ *
+ * Return value: (transfer full): a new #PangoDisplayList, free
+ *   with pango_display_list_unref()
+ *
+ * Since: 1.50
+ */
+PangoDisplayList *
+pango_display_list_new (PangoLayout *layout)
+{
+  PangoRecordingRenderer *recorder;
+  PangoDisplayList *list;
+
+  g_return_val_if_fail (PANGO_IS_LAYOUT (layout), NULL);
+
+  list = g_slice_new (PangoDisplayList);
+  list->ref_count = 1;
+  list->serial = pango_layout_get_serial (layout);
+  list->matrix = pango_matrix_copy (pango_context_get_matrix (pango_layout_get_context (layout)));
+
+  recorder = g_object_new (pango_recording_renderer_get_type (), NULL);
+  pango_renderer_draw_layout ((PangoRenderer *) recorder, layout, 0, 0);
+
+  list->n_ops = recorder->ops->len;
+  list->ops = (DisplayOp *) g_array_free (recorder->ops, FALSE);
+  recorder->ops = NULL;
+  list->layout = recorder->layout;
+  recorder->layout = NULL;
+
+  g_object_unref (recorder);
+
+  return list;
+}
+
+/**
+ * pango_display_list_ref:
+ * @list: (nullable): a #PangoDisplayList, may be %NULL
+ *
+ * Increase the reference count of @list by one.
+ *
+ * Return value: @list
+ *
+ * Since: 1.50
+ */
+PangoDisplayList *
+pango_display_list_ref (PangoDisplayList *list)
+{
+  if (list == NULL)
+    return NULL;
+
+  g_atomic_int_inc ((int *) &list->ref_count);
+
+  return list;
+}
+
+/**
+ * pango_display_list_unref:
+ * @list: (nullable): a #PangoDisplayList, may be %NULL
+ *
+ * Decrease the reference count of @list by one. If the
+ * result is zero, free @list and everything it holds.
+ *
+ * Since: 1.50
+ */
+void
+pango_display_list_unref (PangoDisplayList *list)
+{
+  guint i;
+
+  if (list == NULL)
+    return;
+
+  g_return_if_fail (list->ref_count > 0);
+
+  if (!g_atomic_int_dec_and_test ((int *) &list->ref_count))
+    return;
+
+  for (i = 0; i < list->n_ops; i++)
+    display_op_clear (&list->ops[i]);
+  g_free (list->ops);
+
+  pango_matrix_free (list->matrix);
+  g_clear_object (&list->layout);
+  g_slice_free (PangoDisplayList, list);
+}
+
+/**
+ * pango_display_list_get_serial:
+ * @list: a #PangoDisplayList
+ *
+ * Returns the serial number that the layout that @list was
+ * recorded from had at the time, see pango_layout_get_serial().
+ *
+ * If the serial of the layout is different now, the layout
+ * has changed, and @list should be recorded again.
+ *
+ * Return value: the serial number of the layout when it was
+ *   recorded
+ *
+ * Since: 1.50
+ */
+guint
+pango_display_list_get_serial (PangoDisplayList *list)
+{
+  g_return_val_if_fail (list != NULL, 0);
+
+  return list->serial;
+}
+
+/**
+ * pango_renderer_draw_display_list:
+ * @renderer: a #PangoRenderer
+ * @list: a #PangoDisplayList
+ * @x: X position of the left edge of the layout, in user space
+ *   coordinates in Pango units.
+ * @y: Y position of the top edge of the layout, in user space
+ *   coordinates in Pango units.
+ *
+ * Draws what was recorded in @list with the specified #PangoRenderer,
+ * like pango_renderer_draw_layout() would draw the layout that @list
+ * was recorded from. The colors of the parts of @renderer are set
+ * to the recorded ones for each thing that is drawn.
+ *
+ * If a clip rectangle has been set with pango_renderer_set_clip_rect(),
+ * only what has ink extents that intersect it is drawn.
+ *
+ * Since: 1.50
+ */
+void
+pango_renderer_draw_display_list (PangoRenderer    *renderer,
+				  PangoDisplayList *list,
+				  int               x,
+				  int               y)
+{
+  PangoRendererPrivate *priv;
+  PangoRendererClass *class;
+  PangoRectangle clip;
+  guint i;
+
+  g_return_if_fail (PANGO_IS_RENDERER (renderer));
+  g_return_if_fail (list != NULL);
+
+  priv = renderer->priv;
+  class = PANGO_RENDERER_GET_CLASS (renderer);
+
+  /* Like pango_renderer_draw_layout() */
+  if (!renderer->active_count)
+    pango_renderer_set_matrix (renderer, list->matrix);
+
+  pango_renderer_activate (renderer);
+
+  if (priv->clip_set)
+    {
+      clip = priv->clip_rect;
+      clip.x -= x;
+      clip.y -= y;
+    }
+
+  for (i = 0; i < list->n_ops; i++)
+    {
+      DisplayOp *op = &list->ops[i];
+
+      if (priv->clip_set && !rects_intersect (&op->bounds, &clip))
+	continue;
+
+      pango_renderer_set_color (renderer, op->part,
+				op->color_set ? &op->color : NULL);
+      pango_renderer_set_alpha (renderer, op->part, op->alpha);
+
+      switch (op->type)
+	{
+	case DISPLAY_OP_GLYPHS:
+	  class->draw_glyphs (renderer,
+			      op->u.glyphs.font, op->u.glyphs.glyphs,
+			      x + op->x, y + op->y);
+	  break;
+
+	case DISPLAY_OP_RECTANGLE:
+	  class->draw_rectangle (renderer, op->part,
+				 x + op->bounds.x, y + op->bounds.y,
+				 op->bounds.width, op->bounds.height);
+	  break;
+
+	case DISPLAY_OP_ERROR_UNDERLINE:
+	  class->draw_error_underline (renderer,
+				       x + op->bounds.x, y + op->bounds.y,
+				       op->bounds.width, op->bounds.height);
+	  break;
+
+	case DISPLAY_OP_SHAPE:
+	  if (class->draw_shape)
+	    {
+	      PangoLayoutLine *line = priv->line;
+	      PangoLayout *layout = priv->layout;
+
+	      priv->line = op->u.shape.line;
+	      priv->layout = list->layout;
+	      class->draw_shape (renderer, op->u.shape.attr,
+				 x + op->x, y + op->y);
+	      priv->line = line;
+	      priv->layout = layout;
+	    }
+	  break;
+
+	default:
+	  g_assert_not_reached ();
+	}
+    }
+
+  pango_renderer_deactivate (renderer);
+}
@@ -276,11 +276,38 @@ void               pango_renderer_set_matrix      (PangoRenderer     *renderer,
 PANGO_AVAILABLE_IN_1_8
 const PangoMatrix *pango_renderer_get_matrix      (PangoRenderer     *renderer);
 
+PANGO_AVAILABLE_IN_1_50
+void                  pango_renderer_set_clip_rect (PangoRenderer        *renderer,
+                                                    const PangoRectangle *clip_rect);
+PANGO_AVAILABLE_IN_1_50
+const PangoRectangle *pango_renderer_get_clip_rect (PangoRenderer        *renderer);
+
 PANGO_AVAILABLE_IN_1_20
 PangoLayout       *pango_renderer_get_layout      (PangoRenderer     *renderer);
 PANGO_AVAILABLE_IN_1_20
 PangoLayoutLine   *pango_renderer_get_layout_line (PangoRenderer     *renderer);
 
+typedef struct _PangoDisplayList PangoDisplayList;
+
+#define PANGO_TYPE_DISPLAY_LIST (pango_display_list_get_type ())
+
+PANGO_AVAILABLE_IN_1_50
+GType             pango_display_list_get_type   (void) G_GNUC_CONST;
+PANGO_AVAILABLE_IN_1_50
+PangoDisplayList *pango_display_list_new        (PangoLayout      *layout);
+PANGO_AVAILABLE_IN_1_50
+PangoDisplayList *pango_display_list_ref        (PangoDisplayList *list);
+PANGO_AVAILABLE_IN_1_50
+void              pango_display_list_unref      (PangoDisplayList *list);
+PANGO_AVAILABLE_IN_1_50
+guint             pango_display_list_get_serial (PangoDisplayList *list);
+
+PANGO_AVAILABLE_IN_1_50
+void pango_renderer_draw_display_list    (PangoRenderer    *renderer,
+                                          PangoDisplayList *list,
+                                          int               x,
+                                          int               y);
+
 G_END_DECLS
 
 #endif /* __PANGO_RENDERER_H_ */
@@ -634,6 +634,11 @@ _pango_cairo_font_private_initialize (PangoCairoFontPrivate      *cf_priv,
   cf_priv->scaled_font = NULL;
   cf_priv->hbi = NULL;
   cf_priv->glyph_extents_cache = NULL;
+  cf_priv->glyph_extents_cache_n_sets = 0;
+  cf_priv->glyph_extents_cache_window_lookups = 0;
+  cf_priv->glyph_extents_cache_window_misses = 0;
+  cf_priv->glyph_extents_cache_hits = 0;
+  cf_priv->glyph_extents_cache_misses = 0;
   cf_priv->metrics_by_lang = NULL;
 }
 
@@ -767,12 +772,18 @@ _pango_cairo_font_private_get_glyph_extents_missing (PangoCairoFontPrivate *cf_p
     }
 }
 
-#define GLYPH_CACHE_NUM_ENTRIES 256 /* should be power of two */
-#define GLYPH_CACHE_MASK (GLYPH_CACHE_NUM_ENTRIES - 1)
-/* An entry in the fixed-size cache for the glyph->extents mapping.
- * The cache is indexed by the lower N bits of the glyph (see
- * GLYPH_CACHE_NUM_ENTRIES).  For scripts with few glyphs,
- * this should provide pretty much instant lookups.
+#define GLYPH_CACHE_WAYS 4
+#define GLYPH_CACHE_INITIAL_SETS 64 /* should be power of two */
+#define GLYPH_CACHE_MAX_SETS 4096
+/* An entry in the cache for the glyph->extents mapping.
+ * The cache is set-associative: a glyph can be in any of the
+ * GLYPH_CACHE_WAYS entries of the set picked by its lower bits,
+ * and the entries of a set are kept in most recently used order.
+ * For scripts with few glyphs, the initial size should provide
+ * pretty much instant lookups. Fonts with large glyph working
+ * sets, as for CJK or Indic text, make the cache grow, see
+ * glyph_extents_cache_maybe_grow(). Unused entries have
+ * PANGO_GLYPH_EMPTY as glyph, which never gets looked up.
  */
 struct _PangoCairoFontGlyphExtentsCacheEntry
 {
@@ -781,6 +792,19 @@ struct _PangoCairoFontGlyphExtentsCacheEntry
   PangoRectangle ink_rect;
 };
 
+static PangoCairoFontGlyphExtentsCacheEntry *
+glyph_extents_cache_new (guint n_sets)
+{
+  PangoCairoFontGlyphExtentsCacheEntry *cache;
+  guint i;
+
+  cache = g_new0 (PangoCairoFontGlyphExtentsCacheEntry, n_sets * GLYPH_CACHE_WAYS);
+  for (i = 0; i < n_sets * GLYPH_CACHE_WAYS; i++)
+    cache[i].glyph = PANGO_GLYPH_EMPTY;
+
+  return cache;
+}
+
 static gboolean
 _pango_cairo_font_private_glyph_extents_cache_init (PangoCairoFontPrivate *cf_priv)
 {
@@ -815,9 +839,8 @@ _pango_cairo_font_private_glyph_extents_cache_init (PangoCairoFontPrivate *cf_pr
 	}
     }
 
-  cf_priv->glyph_extents_cache = g_new0 (PangoCairoFontGlyphExtentsCacheEntry, GLYPH_CACHE_NUM_ENTRIES);
-  /* Make sure all cache entries are invalid initially */
-  cf_priv->glyph_extents_cache[0].glyph = 1; /* glyph 1 cannot happen in bucket 0 */
+  cf_priv->glyph_extents_cache = glyph_extents_cache_new (GLYPH_CACHE_INITIAL_SETS);
+  cf_priv->glyph_extents_cache_n_sets = GLYPH_CACHE_INITIAL_SETS;
 
   return TRUE;
 }
@@ -848,22 +871,127 @@ compute_glyph_extents (PangoCairoFontPrivate  *cf_priv,
   entry->ink_rect.height = pango_units_from_double (extents.height);
 }
 
+/* Every few lookups per entry, doubles the number of sets
+ * if more than a quarter of the recent lookups missed. The
+ * cached entries are kept, in the same order.
+ */
+static void
+glyph_extents_cache_maybe_grow (PangoCairoFontPrivate *cf_priv)
+{
+  PangoCairoFontGlyphExtentsCacheEntry *old_cache;
+  guint old_n_sets, n_sets;
+  guint i, j;
+
+  old_n_sets = cf_priv->glyph_extents_cache_n_sets;
+
+  if (cf_priv->glyph_extents_cache_window_lookups < 4 * old_n_sets * GLYPH_CACHE_WAYS)
+    return;
+
+  if (cf_priv->glyph_extents_cache_window_misses * 4 > cf_priv->glyph_extents_cache_window_lookups &&
+      old_n_sets < GLYPH_CACHE_MAX_SETS)
+    {
+      old_cache = cf_priv->glyph_extents_cache;
+      n_sets = old_n_sets * 2;
+
+      cf_priv->glyph_extents_cache = glyph_extents_cache_new (n_sets);
+      cf_priv->glyph_extents_cache_n_sets = n_sets;
+
+      /* Each old set splits into two new ones */
+      for (i = 0; i < old_n_sets * GLYPH_CACHE_WAYS; i++)
+        {
+          PangoCairoFontGlyphExtentsCacheEntry *set;
+
+          if (old_cache[i].glyph == PANGO_GLYPH_EMPTY)
+            continue;
+
+          set = cf_priv->glyph_extents_cache + (old_cache[i].glyph & (n_sets - 1)) * GLYPH_CACHE_WAYS;
+          for (j = 0; set[j].glyph != PANGO_GLYPH_EMPTY; j++)
+            ;
+          set[j] = old_cache[i];
+        }
+
+      g_free (old_cache);
+    }
+
+  cf_priv->glyph_extents_cache_window_lookups = 0;
+  cf_priv->glyph_extents_cache_window_misses = 0;
+}
+
 static PangoCairoFontGlyphExtentsCacheEntry *
 _pango_cairo_font_private_get_glyph_extents_cache_entry (PangoCairoFontPrivate  *cf_priv,
 							 PangoGlyph              glyph)
 {
-  PangoCairoFontGlyphExtentsCacheEntry *entry;
-  guint idx;
+  PangoCairoFontGlyphExtentsCacheEntry *set;
+  PangoCairoFontGlyphExtentsCacheEntry entry;
+  guint i;
 
-  idx = glyph & GLYPH_CACHE_MASK;
-  entry = cf_priv->glyph_extents_cache + idx;
+  glyph_extents_cache_maybe_grow (cf_priv);
 
-  if (entry->glyph != glyph)
+  set = cf_priv->glyph_extents_cache +
+        (glyph & (cf_priv->glyph_extents_cache_n_sets - 1)) * GLYPH_CACHE_WAYS;
+
+  cf_priv->glyph_extents_cache_window_lookups++;
+
+  if (G_LIKELY (set[0].glyph == glyph))
+    {
+      cf_priv->glyph_extents_cache_hits++;
+      return set;
+    }
+
+  for (i = 1; i < GLYPH_CACHE_WAYS; i++)
+    if (set[i].glyph == glyph)
+      break;
+
+  if (i < GLYPH_CACHE_WAYS)
     {
-      compute_glyph_extents (cf_priv, glyph, entry);
+      cf_priv->glyph_extents_cache_hits++;
+      entry = set[i];
     }
+  else
+    {
+      cf_priv->glyph_extents_cache_misses++;
+      cf_priv->glyph_extents_cache_window_misses++;
+      compute_glyph_extents (cf_priv, glyph, &entry);
+      i = GLYPH_CACHE_WAYS - 1;
+    }
+
+  /* Move to the front, dropping the least recently used entry on a miss */
+  memmove (set + 1, set, i * sizeof (PangoCairoFontGlyphExtentsCacheEntry));
+  set[0] = entry;
+
+  return set;
+}
+
+/**
+ * pango_cairo_font_get_glyph_extents_cache_stats:
+ * @font: a #PangoFont from a #PangoCairoFontMap
+ * @hits: (out) (optional): return location for the number of cache hits
+ * @misses: (out) (optional): return location for the number of cache misses
+ *
+ * Obtains the number of times that glyph extents for @font were
+ * found in its glyph extents cache, and the number of times that
+ * they had to be obtained from cairo, since @font was created.
+ *
+ * This can be used to judge how well the cache works for
+ * the text that is being laid out.
+ *
+ * Since: 1.50
+ */
+void
+pango_cairo_font_get_glyph_extents_cache_stats (PangoCairoFont *font,
+                                                guint          *hits,
+                                                guint          *misses)
+{
+  PangoCairoFontPrivate *cf_priv;
+
+  g_return_if_fail (PANGO_IS_CAIRO_FONT (font));
+
+  cf_priv = PANGO_CAIRO_FONT_PRIVATE (font);
 
-  return entry;
+  if (hits)
+    *hits = cf_priv->glyph_extents_cache_hits;
+  if (misses)
+    *misses = cf_priv->glyph_extents_cache_misses;
 }
 
 void
@@ -86,6 +86,11 @@ struct _PangoCairoFontPrivate
 
   PangoRectangle font_extents;
   PangoCairoFontGlyphExtentsCacheEntry *glyph_extents_cache;
+  guint glyph_extents_cache_n_sets;
+  guint glyph_extents_cache_window_lookups;
+  guint glyph_extents_cache_window_misses;
+  guint glyph_extents_cache_hits;
+  guint glyph_extents_cache_misses;
 
   GSList *metrics_by_lang;
 };
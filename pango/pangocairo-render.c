@@ -155,6 +155,7 @@
 #include "config.h"
 
 #include <math.h>
+#include <string.h>
 
 #include "pango-font-private.h"
 #include "pangocairo-private.h"
@@ -167,6 +168,20 @@ typedef struct _PangoCairoRendererClass PangoCairoRendererClass;
 #define PANGO_IS_CAIRO_RENDERER_CLASS(klass) (G_TYPE_CHECK_CLASS_TYPE ((klass), PANGO_TYPE_CAIRO_RENDERER))
 #define PANGO_CAIRO_RENDERER_GET_CLASS(obj)  (G_TYPE_INSTANCE_GET_CLASS ((obj), PANGO_TYPE_CAIRO_RENDERER, PangoCairoRendererClass))
 
+/* At most this many fonts and colours are batched at once */
+#define MAX_GLYPH_BATCHES 8
+
+typedef struct _GlyphBatch GlyphBatch;
+
+/* Glyphs in one font and colour that have not been shown yet */
+struct _GlyphBatch
+{
+  PangoFont *font;
+  gboolean set_source;		/* Whether to set the colour below */
+  double rgba[4];
+  GArray *glyphs;		/* cairo_glyph_t, kept when empty */
+};
+
 struct _PangoCairoRenderer
 {
   PangoRenderer parent_instance;
@@ -174,8 +189,13 @@ struct _PangoCairoRenderer
   cairo_t *cr;
   gboolean do_path;
   gboolean has_show_text_glyphs;
+  gboolean override_color;	/* Draw everything with the current source */
   double x_offset, y_offset;
 
+  /* Glyphs of runs that are shown together, see queue_glyphs() */
+  GlyphBatch batches[MAX_GLYPH_BATCHES];
+  int n_batches;
+
   /* house-keeping options */
   gboolean is_cached_renderer;
   gboolean cr_had_current_point;
@@ -188,16 +208,20 @@ struct _PangoCairoRendererClass
 
 G_DEFINE_TYPE (PangoCairoRenderer, pango_cairo_renderer, PANGO_TYPE_RENDERER)
 
-static void
-set_color (PangoCairoRenderer *crenderer,
-	   PangoRenderPart     part)
+/* Gets the colour that @part is drawn in. Returns %FALSE if
+ * it is drawn with the current source of the cairo context.
+ */
+static gboolean
+get_color (PangoCairoRenderer *crenderer,
+	   PangoRenderPart     part,
+	   double              rgba[4])
 {
   PangoColor *color = pango_renderer_get_color ((PangoRenderer *) (crenderer), part);
   guint16 a = pango_renderer_get_alpha ((PangoRenderer *) (crenderer), part);
   gdouble red, green, blue, alpha;
 
-  if (!a && !color)
-    return;
+  if (crenderer->override_color || (!a && !color))
+    return FALSE;
 
   if (color)
     {
@@ -224,7 +248,98 @@ set_color (PangoCairoRenderer *crenderer,
   if (a)
     alpha = a / 65535.;
 
-  cairo_set_source_rgba (crenderer->cr, red, green, blue, alpha);
+  rgba[0] = red;
+  rgba[1] = green;
+  rgba[2] = blue;
+  rgba[3] = alpha;
+
+  return TRUE;
+}
+
+static void
+set_color (PangoCairoRenderer *crenderer,
+	   PangoRenderPart     part)
+{
+  double rgba[4];
+
+  if (get_color (crenderer, part, rgba))
+    cairo_set_source_rgba (crenderer->cr, rgba[0], rgba[1], rgba[2], rgba[3]);
+}
+
+/* Glyph batching
+ *
+ * Showing the glyphs of each run with its own cairo_show_glyphs()
+ * is slow for layouts with many short runs, like highlighted code.
+ * So the glyphs of runs are queued in batches of one font and
+ * colour, and each batch is shown with one cairo_show_glyphs().
+ *
+ * Runs of a colour are batched across runs of other colours, which
+ * only changes the order of glyphs that overlap, as glyphs of a
+ * line rarely do. Anything else that is drawn may overlap glyphs,
+ * so all batches are shown before it, and when drawing ends.
+ */
+
+static void
+flush_glyphs (PangoCairoRenderer *crenderer)
+{
+  int i;
+
+  for (i = 0; i < crenderer->n_batches; i++)
+    {
+      GlyphBatch *batch = &crenderer->batches[i];
+
+      cairo_save (crenderer->cr);
+
+      if (batch->set_source)
+	cairo_set_source_rgba (crenderer->cr,
+			       batch->rgba[0], batch->rgba[1],
+			       batch->rgba[2], batch->rgba[3]);
+
+      if (_pango_cairo_font_install (batch->font, crenderer->cr))
+	cairo_show_glyphs (crenderer->cr,
+			   &g_array_index (batch->glyphs, cairo_glyph_t, 0),
+			   batch->glyphs->len);
+
+      cairo_restore (crenderer->cr);
+
+      g_clear_object (&batch->font);
+      g_array_set_size (batch->glyphs, 0);
+    }
+
+  crenderer->n_batches = 0;
+}
+
+/* Returns the batch for glyphs in @font and the foreground colour */
+static GlyphBatch *
+get_glyph_batch (PangoCairoRenderer *crenderer,
+		 PangoFont          *font)
+{
+  GlyphBatch *batch;
+  gboolean set_source;
+  double rgba[4] = { 0., 0., 0., 0. };
+  int i;
+
+  set_source = get_color (crenderer, PANGO_RENDER_PART_FOREGROUND, rgba);
+
+  for (i = 0; i < crenderer->n_batches; i++)
+    {
+      batch = &crenderer->batches[i];
+
+      if (batch->font == font &&
+	  batch->set_source == set_source &&
+	  memcmp (batch->rgba, rgba, sizeof (rgba)) == 0)
+	return batch;
+    }
+
+  if (crenderer->n_batches == MAX_GLYPH_BATCHES)
+    flush_glyphs (crenderer);
+
+  batch = &crenderer->batches[crenderer->n_batches++];
+  batch->font = g_object_ref (font);
+  batch->set_source = set_source;
+  memcpy (batch->rgba, rgba, sizeof (rgba));
+
+  return batch;
 }
 
 /* note: modifies crenderer->cr without doing cairo_save/restore() */
@@ -534,6 +649,73 @@ done:
 
 #define STACK_ARRAY_LENGTH(T) (STACK_BUFFER_SIZE / sizeof(T))
 
+/* Queues @glyphs to be shown together with the glyphs of other runs
+ * in the same font and colour. Returns %FALSE if @font can't be used
+ * for showing glyphs, which pango_cairo_renderer_show_text_glyphs()
+ * handles.
+ */
+static gboolean
+queue_glyphs (PangoCairoRenderer *crenderer,
+	      PangoFont          *font,
+	      PangoGlyphString   *glyphs,
+	      double              base_x,
+	      double              base_y)
+{
+  cairo_scaled_font_t *scaled_font;
+  GlyphBatch *batch;
+  int i;
+  int x_position = 0;
+
+  scaled_font = pango_cairo_font_get_scaled_font ((PangoCairoFont *) font);
+  if (G_UNLIKELY (scaled_font == NULL || cairo_scaled_font_status (scaled_font) != CAIRO_STATUS_SUCCESS))
+    return FALSE;
+
+  batch = get_glyph_batch (crenderer, font);
+
+  for (i = 0; i < glyphs->num_glyphs; i++)
+    {
+      PangoGlyphInfo *gi = &glyphs->glyphs[i];
+
+      if (gi->glyph != PANGO_GLYPH_EMPTY)
+	{
+	  double cx = base_x + (double)(x_position + gi->geometry.x_offset) / PANGO_SCALE;
+	  double cy = gi->geometry.y_offset == 0 ?
+		      base_y :
+		      base_y + (double)(gi->geometry.y_offset) / PANGO_SCALE;
+
+	  if (gi->glyph & PANGO_GLYPH_UNKNOWN_FLAG)
+	    {
+	      if (gi->glyph == (0x20 | PANGO_GLYPH_UNKNOWN_FLAG))
+		; /* no hex boxes for space, please */
+	      else
+		{
+		  /* Keep the glyphs before the box below it */
+		  flush_glyphs (crenderer);
+
+		  cairo_save (crenderer->cr);
+		  set_color (crenderer, PANGO_RENDER_PART_FOREGROUND);
+		  _pango_cairo_renderer_draw_unknown_glyph (crenderer, font, gi, cx, cy);
+		  cairo_restore (crenderer->cr);
+
+		  batch = get_glyph_batch (crenderer, font);
+		}
+	    }
+	  else
+	    {
+	      cairo_glyph_t glyph;
+
+	      glyph.index = gi->glyph;
+	      glyph.x = cx;
+	      glyph.y = cy;
+	      g_array_append_val (batch->glyphs, glyph);
+	    }
+	}
+      x_position += gi->geometry.width;
+    }
+
+  return TRUE;
+}
+
 static void
 pango_cairo_renderer_show_text_glyphs (PangoRenderer        *renderer,
 				       const char           *text,
@@ -555,6 +737,12 @@ pango_cairo_renderer_show_text_glyphs (PangoRenderer        *renderer,
   double base_x = crenderer->x_offset + (double)x / PANGO_SCALE;
   double base_y = crenderer->y_offset + (double)y / PANGO_SCALE;
 
+  if (!crenderer->do_path && !clusters &&
+      queue_glyphs (crenderer, font, glyphs, base_x, base_y))
+    return;
+
+  flush_glyphs (crenderer);
+
   cairo_save (crenderer->cr);
   if (!crenderer->do_path)
     set_color (crenderer, PANGO_RENDER_PART_FOREGROUND);
@@ -739,6 +927,12 @@ pango_cairo_renderer_draw_rectangle (PangoRenderer     *renderer,
 {
   PangoCairoRenderer *crenderer = (PangoCairoRenderer *) (renderer);
 
+  /* A background in the color of the text would hide it */
+  if (crenderer->override_color && part == PANGO_RENDER_PART_BACKGROUND)
+    return;
+
+  flush_glyphs (crenderer);
+
   if (!crenderer->do_path)
     {
       cairo_save (crenderer->cr);
@@ -773,6 +967,8 @@ pango_cairo_renderer_draw_trapezoid (PangoRenderer     *renderer,
   cairo_t *cr;
   double x, y;
 
+  flush_glyphs (crenderer);
+
   cr = crenderer->cr;
 
   cairo_save (cr);
@@ -881,6 +1077,8 @@ pango_cairo_renderer_draw_error_underline (PangoRenderer *renderer,
   PangoCairoRenderer *crenderer = (PangoCairoRenderer *) (renderer);
   cairo_t *cr = crenderer->cr;
 
+  flush_glyphs (crenderer);
+
   if (!crenderer->do_path)
     {
       cairo_save (cr);
@@ -930,6 +1128,8 @@ pango_cairo_renderer_draw_shape (PangoRenderer  *renderer,
   base_x = crenderer->x_offset + (double)x / PANGO_SCALE;
   base_y = crenderer->y_offset + (double)y / PANGO_SCALE;
 
+  flush_glyphs (crenderer);
+
   cairo_save (cr);
   if (!crenderer->do_path)
     set_color (crenderer, PANGO_RENDER_PART_FOREGROUND);
@@ -942,21 +1142,50 @@ pango_cairo_renderer_draw_shape (PangoRenderer  *renderer,
 }
 
 static void
-pango_cairo_renderer_init (PangoCairoRenderer *renderer G_GNUC_UNUSED)
+pango_cairo_renderer_end (PangoRenderer *renderer)
+{
+  flush_glyphs ((PangoCairoRenderer *) renderer);
+}
+
+static void
+pango_cairo_renderer_init (PangoCairoRenderer *renderer)
 {
+  int i;
+
+  for (i = 0; i < MAX_GLYPH_BATCHES; i++)
+    renderer->batches[i].glyphs = g_array_new (FALSE, FALSE, sizeof (cairo_glyph_t));
+}
+
+static void
+pango_cairo_renderer_finalize (GObject *object)
+{
+  PangoCairoRenderer *renderer = (PangoCairoRenderer *) object;
+  int i;
+
+  for (i = 0; i < MAX_GLYPH_BATCHES; i++)
+    {
+      g_clear_object (&renderer->batches[i].font);
+      g_array_free (renderer->batches[i].glyphs, TRUE);
+    }
+
+  G_OBJECT_CLASS (pango_cairo_renderer_parent_class)->finalize (object);
 }
 
 static void
 pango_cairo_renderer_class_init (PangoCairoRendererClass *klass)
 {
+  GObjectClass *object_class = G_OBJECT_CLASS (klass);
   PangoRendererClass *renderer_class = PANGO_RENDERER_CLASS (klass);
 
+  object_class->finalize = pango_cairo_renderer_finalize;
+
   renderer_class->draw_glyphs = pango_cairo_renderer_draw_glyphs;
   renderer_class->draw_glyph_item = pango_cairo_renderer_draw_glyph_item;
   renderer_class->draw_rectangle = pango_cairo_renderer_draw_rectangle;
   renderer_class->draw_trapezoid = pango_cairo_renderer_draw_trapezoid;
   renderer_class->draw_error_underline = pango_cairo_renderer_draw_error_underline;
   renderer_class->draw_shape = pango_cairo_renderer_draw_shape;
+  renderer_class->end = pango_cairo_renderer_end;
 }
 
 static PangoCairoRenderer *cached_renderer = NULL; /* MT-safe */
@@ -993,8 +1222,10 @@ release_renderer (PangoCairoRenderer *renderer)
       renderer->cr = NULL;
       renderer->do_path = FALSE;
       renderer->has_show_text_glyphs = FALSE;
+      renderer->override_color = FALSE;
       renderer->x_offset = 0.;
       renderer->y_offset = 0.;
+      pango_renderer_set_clip_rect ((PangoRenderer *) renderer, NULL);
 
       G_UNLOCK (cached_renderer);
     }
@@ -1022,6 +1253,37 @@ restore_current_point (PangoCairoRenderer *renderer)
     cairo_new_sub_path (renderer->cr);
 }
 
+/* Lets the renderer skip lines and runs that are outside of the clip
+ * of the cairo context. Must be called after save_current_point(),
+ * since what is drawn is placed relative to the current point.
+ */
+static void
+set_clip_rect (PangoCairoRenderer *renderer)
+{
+  PangoRectangle clip;
+  double x1, y1, x2, y2;
+  /* Keep the clip rectangle and the positions around it in range */
+  const double limit = G_MAXINT / PANGO_SCALE / 4;
+
+  cairo_clip_extents (renderer->cr, &x1, &y1, &x2, &y2);
+
+  x1 -= renderer->x_offset;
+  x2 -= renderer->x_offset;
+  y1 -= renderer->y_offset;
+  y2 -= renderer->y_offset;
+
+  /* Unbounded surfaces, like recording surfaces, have no useful clip */
+  if (x1 < -limit || y1 < -limit || x2 > limit || y2 > limit)
+    return;
+
+  /* Leave a unit of room for hinting and antialiasing */
+  clip.x = (int) floor (x1 * PANGO_SCALE) - PANGO_SCALE;
+  clip.y = (int) floor (y1 * PANGO_SCALE) - PANGO_SCALE;
+  clip.width = (int) ceil (x2 * PANGO_SCALE) + PANGO_SCALE - clip.x;
+  clip.height = (int) ceil (y2 * PANGO_SCALE) + PANGO_SCALE - clip.y;
+
+  pango_renderer_set_clip_rect ((PangoRenderer *) renderer, &clip);
+}
 
 /* convenience wrappers using the default renderer */
 
@@ -1118,6 +1380,9 @@ _pango_cairo_do_layout_line (cairo_t          *cr,
   crenderer->do_path = do_path;
   save_current_point (crenderer);
 
+  if (!do_path)
+    set_clip_rect (crenderer);
+
   pango_renderer_draw_layout_line (renderer, line, 0, 0);
 
   restore_current_point (crenderer);
@@ -1137,6 +1402,9 @@ _pango_cairo_do_layout (cairo_t     *cr,
   crenderer->do_path = do_path;
   save_current_point (crenderer);
 
+  if (!do_path)
+    set_clip_rect (crenderer);
+
   pango_renderer_draw_layout (renderer, layout, 0, 0);
 
   restore_current_point (crenderer);
@@ -1144,6 +1412,28 @@ _pango_cairo_do_layout (cairo_t     *cr,
   release_renderer (crenderer);
 }
 
+static void
+_pango_cairo_do_display_list (cairo_t          *cr,
+			      PangoDisplayList *list,
+			      gboolean          override_color)
+{
+  PangoCairoRenderer *crenderer = acquire_renderer ();
+  PangoRenderer *renderer = (PangoRenderer *) crenderer;
+
+  crenderer->cr = cr;
+  crenderer->do_path = FALSE;
+  crenderer->override_color = override_color;
+  save_current_point (crenderer);
+
+  set_clip_rect (crenderer);
+
+  pango_renderer_draw_display_list (renderer, list, 0, 0);
+
+  restore_current_point (crenderer);
+
+  release_renderer (crenderer);
+}
+
 static void
 _pango_cairo_do_error_underline (cairo_t *cr,
 				 double   x,
@@ -1256,6 +1546,9 @@ pango_cairo_show_layout_line (cairo_t          *cr,
  * The top-left corner of the #PangoLayout will be drawn
  * at the current point of the cairo context.
  *
+ * Lines and runs that are outside of the clip extents of
+ * @cr are skipped.
+ *
  * Since: 1.10
  **/
 void
@@ -1268,6 +1561,34 @@ pango_cairo_show_layout (cairo_t     *cr,
   _pango_cairo_do_layout (cr, layout, FALSE);
 }
 
+/**
+ * pango_cairo_show_display_list:
+ * @cr: a Cairo context
+ * @list: a #PangoDisplayList
+ * @override_color: whether to draw everything with the current
+ *   source of @cr, instead of the recorded colors. Backgrounds
+ *   are not drawn then.
+ *
+ * Draws what was recorded in @list in the specified cairo context,
+ * like pango_cairo_show_layout() draws the layout that @list was
+ * recorded from. The top-left corner of the layout will be drawn
+ * at the current point of the cairo context.
+ *
+ * What is outside of the clip extents of @cr is skipped.
+ *
+ * Since: 1.50
+ **/
+void
+pango_cairo_show_display_list (cairo_t          *cr,
+			       PangoDisplayList *list,
+			       gboolean          override_color)
+{
+  g_return_if_fail (cr != NULL);
+  g_return_if_fail (list != NULL);
+
+  _pango_cairo_do_display_list (cr, list, override_color);
+}
+
 /**
  * pango_cairo_show_error_underline:
  * @cr: a Cairo context
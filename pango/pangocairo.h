@@ -127,6 +127,10 @@ GType         pango_cairo_font_get_type               (void) G_GNUC_CONST;
 
 PANGO_AVAILABLE_IN_1_18
 cairo_scaled_font_t *pango_cairo_font_get_scaled_font (PangoCairoFont *font);
+PANGO_AVAILABLE_IN_1_50
+void                 pango_cairo_font_get_glyph_extents_cache_stats (PangoCairoFont *font,
+                                                                     guint          *hits,
+                                                                     guint          *misses);
 
 /* Update a Pango context for the current state of a cairo context
  */
@@ -182,6 +186,10 @@ void pango_cairo_show_layout_line  (cairo_t          *cr,
 PANGO_AVAILABLE_IN_1_10
 void pango_cairo_show_layout       (cairo_t          *cr,
 				    PangoLayout      *layout);
+PANGO_AVAILABLE_IN_1_50
+void pango_cairo_show_display_list (cairo_t          *cr,
+				    PangoDisplayList *list,
+				    gboolean          override_color);
 
 PANGO_AVAILABLE_IN_1_14
 void pango_cairo_show_error_underline (cairo_t       *cr,
@@ -741,6 +741,18 @@ pango_fc_font_key_get_variations (const PangoFcFontKey *key)
  * PangoFcPatterns
  */
 
+/* Maps codepoints to the index of the first font that covers them,
+ * in three levels: planes of 256 pages of 256 entries. Entries are
+ * the font index + 1, COVERAGE_INDEX_NONE if no font covers the
+ * codepoint, or 0 if it has not been looked up yet.
+ */
+#define COVERAGE_INDEX_N_PLANES 17
+#define COVERAGE_INDEX_NONE G_MAXUINT16
+
+typedef struct {
+  guint16 **planes[COVERAGE_INDEX_N_PLANES];
+} PangoFcCoverageIndex;
+
 struct _PangoFcPatterns {
   guint ref_count;
 
@@ -749,6 +761,8 @@ struct _PangoFcPatterns {
   FcPattern *pattern;
   FcPattern *match;
   FcFontSet *fontset;
+
+  PangoFcCoverageIndex *coverage_index;
 };
 
 static PangoFcPatterns *
@@ -811,6 +825,23 @@ pango_fc_patterns_unref (PangoFcPatterns *pats)
   if (pats->fontset)
     FcFontSetDestroy (pats->fontset);
 
+  if (pats->coverage_index)
+    {
+      int i, j;
+
+      for (i = 0; i < COVERAGE_INDEX_N_PLANES; i++)
+        {
+          if (!pats->coverage_index->planes[i])
+            continue;
+
+          for (j = 0; j < 256; j++)
+            g_free (pats->coverage_index->planes[i][j]);
+          g_free (pats->coverage_index->planes[i]);
+        }
+
+      g_slice_free (PangoFcCoverageIndex, pats->coverage_index);
+    }
+
   g_slice_free (PangoFcPatterns, pats);
 }
 
@@ -910,6 +941,61 @@ pango_fc_patterns_get_font_pattern (PangoFcPatterns *pats, int i, gboolean *prep
     return NULL;
 }
 
+/* Returns the index of the first font in @pats whose charset
+ * contains @wc, or -1 if there is none. The result is remembered,
+ * so this is only expensive the first time a codepoint is looked
+ * up for a list of patterns, regardless of how many fontsets use it.
+ */
+static int
+pango_fc_patterns_find_font (PangoFcPatterns *pats,
+                             gunichar         wc)
+{
+  guint16 ***plane;
+  guint16 **page;
+  guint16 *entry;
+  int i;
+
+  if (G_UNLIKELY (wc >= COVERAGE_INDEX_N_PLANES << 16))
+    return -1;
+
+  if (G_UNLIKELY (!pats->coverage_index))
+    pats->coverage_index = g_slice_new0 (PangoFcCoverageIndex);
+
+  plane = &pats->coverage_index->planes[wc >> 16];
+  if (G_UNLIKELY (!*plane))
+    *plane = g_new0 (guint16 *, 256);
+
+  page = &(*plane)[(wc >> 8) & 0xff];
+  if (G_UNLIKELY (!*page))
+    *page = g_new0 (guint16, 256);
+
+  entry = &(*page)[wc & 0xff];
+
+  if (G_LIKELY (*entry != 0))
+    return *entry == COVERAGE_INDEX_NONE ? -1 : *entry - 1;
+
+  *entry = COVERAGE_INDEX_NONE;
+
+  for (i = 0; i < COVERAGE_INDEX_NONE - 1; i++)
+    {
+      FcPattern *font_pattern;
+      FcCharSet *charset;
+      gboolean prepare;
+
+      font_pattern = pango_fc_patterns_get_font_pattern (pats, i, &prepare);
+      if (!font_pattern)
+        break;
+
+      if (FcPatternGetCharSet (font_pattern, FC_CHARSET, 0, &charset) == FcResultMatch &&
+          FcCharSetHasChar (charset, wc))
+        {
+          *entry = i + 1;
+          break;
+        }
+    }
+
+  return *entry == COVERAGE_INDEX_NONE ? -1 : *entry - 1;
+}
 
 /*
  * PangoFcFontset
@@ -1081,6 +1167,18 @@ pango_fc_fontset_get_font (PangoFontset  *fontset,
   int result = -1;
   unsigned int i;
 
+  /* The coverage of our fonts comes from the charsets of the
+   * patterns, so the index shared by all fontsets with the same
+   * patterns tells us which font to use. If no font covers @wc,
+   * we use the first one, like the loop below does.
+   */
+  result = pango_fc_patterns_find_font (fcfontset->patterns, wc);
+  font = pango_fc_fontset_get_font_at (fcfontset, MAX (result, 0));
+  if (G_LIKELY (font))
+    return g_object_ref (font);
+
+  /* Some font failed to load, look at the ones we have */
+  result = -1;
   for (i = 0;
        pango_fc_fontset_get_font_at (fcfontset, i);
        i++)
@@ -31,25 +31,57 @@
 
 #include <glib.h>
 
-/* cache a single hb_buffer_t */
-static hb_buffer_t *cached_buffer = NULL; /* MT-safe */
-G_LOCK_DEFINE_STATIC (cached_buffer);
+/* Keep one hb_buffer_t per thread, so that concurrent shaping
+ * neither contends on a lock nor falls back to creating and
+ * destroying a buffer for every item.
+ */
+typedef struct
+{
+  hb_buffer_t *buffer;
+  gboolean in_use;
+} ThreadBuffer;
+
+/* Enough for typical runs, so that steady-state shaping
+ * does not need to grow the buffer
+ */
+#define THREAD_BUFFER_PREALLOCATED_LENGTH 256
+
+static void
+thread_buffer_free (gpointer data)
+{
+  ThreadBuffer *thread_buffer = data;
+
+  hb_buffer_destroy (thread_buffer->buffer);
+  g_slice_free (ThreadBuffer, thread_buffer);
+}
+
+static GPrivate thread_buffer_key = G_PRIVATE_INIT (thread_buffer_free);
 
 static hb_buffer_t *
 acquire_buffer (gboolean *free_buffer)
 {
+  ThreadBuffer *thread_buffer;
   hb_buffer_t *buffer;
 
-  if (G_LIKELY (G_TRYLOCK (cached_buffer)))
+  thread_buffer = g_private_get (&thread_buffer_key);
+  if (G_UNLIKELY (!thread_buffer))
     {
-      if (G_UNLIKELY (!cached_buffer))
-	cached_buffer = hb_buffer_create ();
+      thread_buffer = g_slice_new (ThreadBuffer);
+      thread_buffer->buffer = hb_buffer_create ();
+      thread_buffer->in_use = FALSE;
+      hb_buffer_pre_allocate (thread_buffer->buffer, THREAD_BUFFER_PREALLOCATED_LENGTH);
+      g_private_set (&thread_buffer_key, thread_buffer);
+    }
 
-      buffer = cached_buffer;
+  if (G_LIKELY (!thread_buffer->in_use))
+    {
+      thread_buffer->in_use = TRUE;
+      buffer = thread_buffer->buffer;
       *free_buffer = FALSE;
     }
   else
     {
+      /* Reentrant shaping from within a font callback */
       buffer = hb_buffer_create ();
       *free_buffer = TRUE;
     }
@@ -62,8 +94,11 @@ release_buffer (hb_buffer_t *buffer, gboolean free_buffer)
 {
   if (G_LIKELY (!free_buffer))
     {
+      ThreadBuffer *thread_buffer = g_private_get (&thread_buffer_key);
+
+      /* hb_buffer_reset() keeps the allocated storage */
       hb_buffer_reset (buffer);
-      G_UNLOCK (cached_buffer);
+      thread_buffer->in_use = FALSE;
     }
   else
     hb_buffer_destroy (buffer);
@@ -267,32 +302,118 @@ pango_hb_font_get_glyph_extents (hb_font_t          *font,
   return hb_font_get_glyph_extents (context->parent, glyph, extents);
 }
 
-static hb_font_t *
-pango_font_get_hb_font_for_context (PangoFont           *font,
-                                    PangoHbShapeContext *context)
+static hb_font_funcs_t *
+get_font_funcs (void)
 {
-  hb_font_t *hb_font;
   static hb_font_funcs_t *funcs;
 
-  hb_font = pango_font_get_hb_font (font);
+  if (g_once_init_enter (&funcs))
+    {
+      hb_font_funcs_t *f = hb_font_funcs_create ();
+
+      hb_font_funcs_set_nominal_glyph_func (f, pango_hb_font_get_nominal_glyph, NULL, NULL);
+      hb_font_funcs_set_glyph_h_advance_func (f, pango_hb_font_get_glyph_h_advance, NULL, NULL);
+      hb_font_funcs_set_glyph_v_advance_func (f, pango_hb_font_get_glyph_v_advance, NULL, NULL);
+      hb_font_funcs_set_glyph_extents_func (f, pango_hb_font_get_glyph_extents, NULL, NULL);
+
+      hb_font_funcs_make_immutable (f);
+
+      g_once_init_leave (&funcs, f);
+    }
+
+  return funcs;
+}
+
+/* The wrapper fonts only depend on the font and the show flags,
+ * so we keep one immutable wrapper per combination of show flags
+ * around for the lifetime of the font, instead of creating a
+ * sub-font for every shaping call.
+ */
+#define N_SHOW_FLAG_COMBINATIONS ((PANGO_SHOW_SPACES | PANGO_SHOW_LINE_BREAKS | PANGO_SHOW_IGNORABLES) + 1)
+
+typedef struct
+{
+  hb_font_t *fonts[N_SHOW_FLAG_COMBINATIONS];
+} PangoHbFontCache;
+
+static void
+hb_font_cache_free (gpointer data)
+{
+  PangoHbFontCache *cache = data;
+  int i;
+
+  for (i = 0; i < N_SHOW_FLAG_COMBINATIONS; i++)
+    hb_font_destroy (cache->fonts[i]);
 
-  if (G_UNLIKELY (!funcs))
+  g_free (cache);
+}
+
+G_LOCK_DEFINE_STATIC (hb_font_cache);
+
+static PangoHbFontCache *
+get_hb_font_cache (PangoFont *font)
+{
+  static GQuark cache_quark;
+  PangoHbFontCache *cache;
+
+  if (G_UNLIKELY (!cache_quark))
+    cache_quark = g_quark_from_static_string ("pango-hb-shape-fonts");
+
+  cache = g_object_get_qdata (G_OBJECT (font), cache_quark);
+  if (G_UNLIKELY (!cache))
     {
-      funcs = hb_font_funcs_create ();
+      G_LOCK (hb_font_cache);
 
-      hb_font_funcs_set_nominal_glyph_func (funcs, pango_hb_font_get_nominal_glyph, NULL, NULL);
-      hb_font_funcs_set_glyph_h_advance_func (funcs, pango_hb_font_get_glyph_h_advance, NULL, NULL);
-      hb_font_funcs_set_glyph_v_advance_func (funcs, pango_hb_font_get_glyph_v_advance, NULL, NULL);
-      hb_font_funcs_set_glyph_extents_func (funcs, pango_hb_font_get_glyph_extents, NULL, NULL);
+      cache = g_object_get_qdata (G_OBJECT (font), cache_quark);
+      if (!cache)
+        {
+          cache = g_new0 (PangoHbFontCache, 1);
+          g_object_set_qdata_full (G_OBJECT (font), cache_quark, cache, hb_font_cache_free);
+        }
 
-      hb_font_funcs_make_immutable (funcs);
+      G_UNLOCK (hb_font_cache);
     }
 
+  return cache;
+}
+
+static void
+context_free (gpointer data)
+{
+  g_slice_free (PangoHbShapeContext, data);
+}
+
+static hb_font_t *
+pango_font_get_hb_font_for_flags (PangoFont      *font,
+                                  PangoShowFlags  show_flags)
+{
+  PangoHbFontCache *cache;
+  PangoHbShapeContext *context;
+  hb_font_t *hb_font;
+
+  show_flags &= N_SHOW_FLAG_COMBINATIONS - 1;
+
+  cache = get_hb_font_cache (font);
+
+  hb_font = g_atomic_pointer_get (&cache->fonts[show_flags]);
+  if (G_LIKELY (hb_font))
+    return hb_font;
+
+  context = g_slice_new (PangoHbShapeContext);
   context->font = font;
-  context->parent = hb_font;
+  context->parent = pango_font_get_hb_font (font);
+  context->show_flags = show_flags;
 
-  hb_font = hb_font_create_sub_font (hb_font);
-  hb_font_set_funcs (hb_font, funcs, context, NULL);
+  hb_font = hb_font_create_sub_font (context->parent);
+  hb_font_set_funcs (hb_font, get_font_funcs (), context, context_free);
+  hb_font_make_immutable (hb_font);
+
+  if (!g_atomic_pointer_compare_and_exchange (&cache->fonts[show_flags], NULL, hb_font))
+    {
+      /* Another thread beat us to it */
+      hb_font_destroy (hb_font);
+      hb_font = g_atomic_pointer_get (&cache->fonts[show_flags]);
+    }
 
   return hb_font;
 }
@@ -323,7 +444,7 @@ pango_hb_shape (PangoFont           *font,
                 const char          *paragraph_text,
                 unsigned int         paragraph_length)
 {
-  PangoHbShapeContext context = { 0, };
+  PangoShowFlags show_flags;
   hb_buffer_flags_t hb_buffer_flags;
   hb_font_t *hb_font;
   hb_buffer_t *hb_buffer;
@@ -341,8 +462,8 @@ pango_hb_shape (PangoFont           *font,
   g_return_if_fail (font != NULL);
   g_return_if_fail (analysis != NULL);
 
-  context.show_flags = find_show_flags (analysis);
-  hb_font = pango_font_get_hb_font_for_context (font, &context);
+  show_flags = find_show_flags (analysis);
+  hb_font = pango_font_get_hb_font_for_flags (font, show_flags);
   hb_buffer = acquire_buffer (&free_buffer);
 
   hb_direction = PANGO_GRAVITY_IS_VERTICAL (analysis->gravity) ? HB_DIRECTION_TTB : HB_DIRECTION_LTR;
@@ -353,7 +474,7 @@ pango_hb_shape (PangoFont           *font,
 
   hb_buffer_flags = HB_BUFFER_FLAG_BOT | HB_BUFFER_FLAG_EOT;
 
-  if (context.show_flags & PANGO_SHOW_IGNORABLES)
+  if (show_flags & PANGO_SHOW_IGNORABLES)
     hb_buffer_flags |= HB_BUFFER_FLAG_PRESERVE_DEFAULT_IGNORABLES;
 
   /* setup buffer */
@@ -427,5 +548,4 @@ pango_hb_shape (PangoFont           *font,
       }
 
   release_buffer (hb_buffer, free_buffer);
-  hb_font_destroy (hb_font);
 }
@@ -50,6 +50,7 @@
 typedef struct _PangoFT2Font      PangoFT2Font;
 typedef struct _PangoFT2GlyphInfo PangoFT2GlyphInfo;
 typedef struct _PangoFT2Renderer  PangoFT2Renderer;
+typedef struct _PangoFT2RenderedGlyph PangoFT2RenderedGlyph;
 
 struct _PangoFT2Font
 {
@@ -63,14 +64,22 @@ struct _PangoFT2Font
   GSList *metrics_by_lang;
 
   GHashTable *glyph_info;
-  GDestroyNotify glyph_cache_destroy;
 };
 
 struct _PangoFT2GlyphInfo
 {
   PangoRectangle logical_rect;
   PangoRectangle ink_rect;
-  void *cached_glyph;
+  PangoFT2RenderedGlyph *cached_glyph;
+  GList cache_link;
+};
+
+struct _PangoFT2RenderedGlyph
+{
+  int ref_count;
+  FT_Bitmap bitmap;
+  int bitmap_left;
+  int bitmap_top;
 };
 
 #define PANGO_TYPE_FT2_FONT              (pango_ft2_font_get_type ())
@@ -86,13 +95,14 @@ FT_Library     _pango_ft2_font_map_get_library    (PangoFontMap      *fontmap);
 void _pango_ft2_font_map_default_substitute (PangoFcFontMap *fcfontmap,
 					     FcPattern      *pattern);
 
-void *_pango_ft2_font_get_cache_glyph_data    (PangoFont      *font,
-					       int             glyph_index);
-void  _pango_ft2_font_set_cache_glyph_data    (PangoFont      *font,
-					       int             glyph_index,
-					       void           *cached_glyph);
-void  _pango_ft2_font_set_glyph_cache_destroy (PangoFont      *font,
-					       GDestroyNotify  destroy_notify);
+PangoFT2RenderedGlyph *_pango_ft2_font_get_cache_glyph_data (PangoFont             *font,
+							    int                    glyph_index);
+void                   _pango_ft2_font_set_cache_glyph_data (PangoFont             *font,
+							    int                    glyph_index,
+							    PangoFT2RenderedGlyph *cached_glyph);
+
+PangoFT2RenderedGlyph *_pango_ft2_rendered_glyph_ref   (PangoFT2RenderedGlyph *rendered);
+void                   _pango_ft2_rendered_glyph_unref (PangoFT2RenderedGlyph *rendered);
 
 #define PANGO_TYPE_FT2_RENDERER            (pango_ft2_renderer_get_type())
 #define PANGO_FT2_RENDERER(object)         (G_TYPE_CHECK_INSTANCE_CAST ((object), PANGO_TYPE_FT2_RENDERER, PangoFT2Renderer))
@@ -97,16 +97,20 @@ pango_ft2_renderer_set_bitmap (PangoFT2Renderer *renderer,
   renderer->bitmap = bitmap;
 }
 
-typedef struct
+PangoFT2RenderedGlyph *
+_pango_ft2_rendered_glyph_ref (PangoFT2RenderedGlyph *rendered)
 {
-  FT_Bitmap bitmap;
-  int bitmap_left;
-  int bitmap_top;
-} PangoFT2RenderedGlyph;
+  g_atomic_int_inc (&rendered->ref_count);
 
-static void
-pango_ft2_free_rendered_glyph (PangoFT2RenderedGlyph *rendered)
+  return rendered;
+}
+
+void
+_pango_ft2_rendered_glyph_unref (PangoFT2RenderedGlyph *rendered)
 {
+  if (!g_atomic_int_dec_and_test (&rendered->ref_count))
+    return;
+
   g_free (rendered->bitmap.buffer);
   g_slice_free (PangoFT2RenderedGlyph, rendered);
 }
@@ -126,6 +130,7 @@ pango_ft2_font_render_box_glyph (int      width,
 
   box = g_slice_new (PangoFT2RenderedGlyph);
 
+  box->ref_count = 1;
   box->bitmap_left = 0;
   box->bitmap_top = top;
 
@@ -230,6 +235,7 @@ pango_ft2_font_render_glyph (PangoFont *font,
       PangoFT2Font *ft2font = (PangoFT2Font *) font;
 
       rendered = g_slice_new (PangoFT2RenderedGlyph);
+      rendered->ref_count = 1;
 
       /* Draw glyph */
       FT_Load_Glyph (face, glyph_index, ft2font->load_flags);
@@ -269,7 +275,6 @@ pango_ft2_renderer_draw_glyph (PangoRenderer *renderer,
 {
   FT_Bitmap *bitmap = PANGO_FT2_RENDERER (renderer)->bitmap;
   PangoFT2RenderedGlyph *rendered_glyph;
-  gboolean add_glyph_to_cache;
   guchar *src, *dest;
 
   int x_start, x_limit;
@@ -293,14 +298,16 @@ pango_ft2_renderer_draw_glyph (PangoRenderer *renderer,
 	glyph = PANGO_GLYPH_UNKNOWN_FLAG;
     }
 
+  /* The glyph cache is shared by all fonts and may evict this
+   * glyph at any time, so we hold a reference while drawing it.
+   */
   rendered_glyph = _pango_ft2_font_get_cache_glyph_data (font, glyph);
-  add_glyph_to_cache = FALSE;
   if (rendered_glyph == NULL)
     {
       rendered_glyph = pango_ft2_font_render_glyph (font, glyph);
       if (rendered_glyph == NULL)
         return;
-      add_glyph_to_cache = TRUE;
+      _pango_ft2_font_set_cache_glyph_data (font, glyph, rendered_glyph);
     }
 
   x_start = MAX (0, - (ixoff + rendered_glyph->bitmap_left));
@@ -379,13 +386,7 @@ pango_ft2_renderer_draw_glyph (PangoRenderer *renderer,
       break;
     }
 
-  if (add_glyph_to_cache)
-    {
-      _pango_ft2_font_set_glyph_cache_destroy (font,
-					       (GDestroyNotify) pango_ft2_free_rendered_glyph);
-      _pango_ft2_font_set_cache_glyph_data (font,
-					    glyph, rendered_glyph);
-    }
+  _pango_ft2_rendered_glyph_unref (rendered_glyph);
 }
 
 typedef struct {
@@ -67,6 +67,20 @@ static void     pango_ft2_font_get_glyph_extents (PangoFont      *font,
 static FT_Face  pango_ft2_font_real_lock_face    (PangoFcFont    *font);
 static void     pango_ft2_font_real_unlock_face  (PangoFcFont    *font);
 
+/* Rendered glyphs of all fonts share one cache, with a limit on
+ * the memory used by the bitmaps. Glyphs are evicted in least
+ * recently used order; the extents in PangoFT2GlyphInfo stay.
+ */
+#define GLYPH_CACHE_DEFAULT_MAX_SIZE (16 * 1024 * 1024)
+
+G_LOCK_DEFINE_STATIC (glyph_cache);
+static GQueue glyph_cache_lru = G_QUEUE_INIT;  /* MT-safe, protected by glyph_cache lock */
+static gsize glyph_cache_size = 0;
+static gsize glyph_cache_max_size = GLYPH_CACHE_DEFAULT_MAX_SIZE;
+static guint glyph_cache_hits = 0;
+static guint glyph_cache_misses = 0;
+static guint glyph_cache_evictions = 0;
+
 
 PangoFT2Font *
 _pango_ft2_font_new (PangoFT2FontMap *ft2fontmap,
@@ -440,16 +454,59 @@ pango_ft2_font_real_unlock_face (PangoFcFont *font G_GNUC_UNUSED)
 {
 }
 
+static gsize
+rendered_glyph_size (PangoFT2RenderedGlyph *rendered)
+{
+  return sizeof (PangoFT2RenderedGlyph) +
+         (gsize) rendered->bitmap.rows * ABS (rendered->bitmap.pitch);
+}
+
+/* Must be called with the glyph_cache lock held.
+ * Returns the cache's reference to the glyph, to be
+ * released after releasing the lock.
+ */
+static PangoFT2RenderedGlyph *
+glyph_cache_remove (PangoFT2GlyphInfo *info)
+{
+  PangoFT2RenderedGlyph *rendered = info->cached_glyph;
+
+  g_queue_unlink (&glyph_cache_lru, &info->cache_link);
+  glyph_cache_size -= rendered_glyph_size (rendered);
+  info->cached_glyph = NULL;
+
+  return rendered;
+}
+
+/* Must be called with the glyph_cache lock held.
+ * Returns the glyphs that were dropped from the cache,
+ * to be unreffed after releasing the lock.
+ */
+static GSList *
+glyph_cache_trim (gsize max_size)
+{
+  GSList *evicted = NULL;
+
+  while (glyph_cache_size > max_size)
+    {
+      PangoFT2GlyphInfo *info = glyph_cache_lru.tail->data;
+
+      evicted = g_slist_prepend (evicted, glyph_cache_remove (info));
+      glyph_cache_evictions++;
+    }
+
+  return evicted;
+}
+
 static gboolean
 pango_ft2_free_glyph_info_callback (gpointer key G_GNUC_UNUSED,
 				    gpointer value,
 				    gpointer data)
 {
-  PangoFT2Font *font = PANGO_FT2_FONT (data);
   PangoFT2GlyphInfo *info = value;
+  GSList **cached = data;
 
-  if (font->glyph_cache_destroy && info->cached_glyph)
-    (*font->glyph_cache_destroy) (info->cached_glyph);
+  if (info->cached_glyph)
+    *cached = g_slist_prepend (*cached, glyph_cache_remove (info));
 
   g_slice_free (PangoFT2GlyphInfo, info);
   return TRUE;
@@ -459,6 +516,7 @@ static void
 pango_ft2_font_finalize (GObject *object)
 {
   PangoFT2Font *ft2font = (PangoFT2Font *)object;
+  GSList *cached = NULL;
 
   if (ft2font->face)
     {
@@ -466,8 +524,12 @@ pango_ft2_font_finalize (GObject *object)
       ft2font->face = NULL;
     }
 
+  G_LOCK (glyph_cache);
   g_hash_table_foreach_remove (ft2font->glyph_info,
-			       pango_ft2_free_glyph_info_callback, object);
+			       pango_ft2_free_glyph_info_callback, &cached);
+  G_UNLOCK (glyph_cache);
+
+  g_slist_free_full (cached, (GDestroyNotify) _pango_ft2_rendered_glyph_unref);
   g_hash_table_destroy (ft2font->glyph_info);
 
   G_OBJECT_CLASS (pango_ft2_font_parent_class)->finalize (object);
@@ -516,46 +578,164 @@ pango_ft2_get_unknown_glyph (PangoFont *font)
     return PANGO_GLYPH_EMPTY;
 }
 
-void *
+/* Returns a new reference to the cached rendering of the glyph,
+ * or %NULL if it is not in the cache.
+ */
+PangoFT2RenderedGlyph *
 _pango_ft2_font_get_cache_glyph_data (PangoFont *font,
 				     int        glyph_index)
 {
   PangoFT2GlyphInfo *info;
+  PangoFT2RenderedGlyph *rendered = NULL;
 
   if (!PANGO_FT2_IS_FONT (font))
     return NULL;
 
   info = pango_ft2_font_get_glyph_info (font, glyph_index, FALSE);
 
-  if (info == NULL)
-    return NULL;
+  G_LOCK (glyph_cache);
+
+  if (info && info->cached_glyph)
+    {
+      rendered = _pango_ft2_rendered_glyph_ref (info->cached_glyph);
 
-  return info->cached_glyph;
+      g_queue_unlink (&glyph_cache_lru, &info->cache_link);
+      g_queue_push_head_link (&glyph_cache_lru, &info->cache_link);
+
+      glyph_cache_hits++;
+    }
+  else
+    glyph_cache_misses++;
+
+  G_UNLOCK (glyph_cache);
+
+  return rendered;
 }
 
+/* Adds a reference to @cached_glyph to the cache, unless
+ * it does not fit into the cache at all.
+ */
 void
-_pango_ft2_font_set_cache_glyph_data (PangoFont     *font,
-				     int            glyph_index,
-				     void          *cached_glyph)
+_pango_ft2_font_set_cache_glyph_data (PangoFont             *font,
+				     int                    glyph_index,
+				     PangoFT2RenderedGlyph *cached_glyph)
 {
   PangoFT2GlyphInfo *info;
+  PangoFT2RenderedGlyph *old = NULL;
+  GSList *evicted = NULL;
+  gsize size;
 
   if (!PANGO_FT2_IS_FONT (font))
     return;
 
   info = pango_ft2_font_get_glyph_info (font, glyph_index, TRUE);
+  size = rendered_glyph_size (cached_glyph);
 
-  info->cached_glyph = cached_glyph;
+  G_LOCK (glyph_cache);
 
-  /* TODO: Implement limiting of the number of cached glyphs */
+  if (info->cached_glyph)
+    old = glyph_cache_remove (info);
+
+  if (size <= glyph_cache_max_size)
+    {
+      info->cached_glyph = _pango_ft2_rendered_glyph_ref (cached_glyph);
+      info->cache_link.data = info;
+      g_queue_push_head_link (&glyph_cache_lru, &info->cache_link);
+      glyph_cache_size += size;
+
+      evicted = glyph_cache_trim (glyph_cache_max_size);
+    }
+
+  G_UNLOCK (glyph_cache);
+
+  if (old)
+    _pango_ft2_rendered_glyph_unref (old);
+  g_slist_free_full (evicted, (GDestroyNotify) _pango_ft2_rendered_glyph_unref);
 }
 
+/**
+ * pango_ft2_glyph_cache_set_max_size:
+ * @max_size: the maximum number of bytes to use for rendered glyphs
+ *
+ * Sets the amount of memory that the FreeType backend may use
+ * to keep rendered glyph bitmaps around between calls to
+ * pango_ft2_render() and friends.
+ *
+ * The cache is shared by all fonts. When it is full, the least
+ * recently drawn glyphs are dropped. Setting the size to 0
+ * disables the cache and drops all rendered glyphs.
+ *
+ * The default is 16 megabytes.
+ *
+ * Since: 1.50
+ */
 void
-_pango_ft2_font_set_glyph_cache_destroy (PangoFont      *font,
-					 GDestroyNotify  destroy_notify)
+pango_ft2_glyph_cache_set_max_size (gsize max_size)
 {
-  if (!PANGO_FT2_IS_FONT (font))
-    return;
+  GSList *evicted;
+
+  G_LOCK (glyph_cache);
+
+  glyph_cache_max_size = max_size;
+  evicted = glyph_cache_trim (max_size);
+
+  G_UNLOCK (glyph_cache);
+
+  g_slist_free_full (evicted, (GDestroyNotify) _pango_ft2_rendered_glyph_unref);
+}
 
-  PANGO_FT2_FONT (font)->glyph_cache_destroy = destroy_notify;
+/**
+ * pango_ft2_glyph_cache_get_max_size:
+ *
+ * Returns the amount of memory that the FreeType backend may
+ * use for rendered glyphs. See pango_ft2_glyph_cache_set_max_size().
+ *
+ * Returns: the maximum size of the glyph cache, in bytes
+ *
+ * Since: 1.50
+ */
+gsize
+pango_ft2_glyph_cache_get_max_size (void)
+{
+  gsize max_size;
+
+  G_LOCK (glyph_cache);
+  max_size = glyph_cache_max_size;
+  G_UNLOCK (glyph_cache);
+
+  return max_size;
+}
+
+/**
+ * pango_ft2_glyph_cache_get_stats:
+ * @hits: (out) (optional): return location for the number of cache hits
+ * @misses: (out) (optional): return location for the number of cache misses
+ * @evictions: (out) (optional): return location for the number of
+ *   glyphs that were dropped to stay within the maximum size
+ * @size: (out) (optional): return location for the number of bytes
+ *   currently used by the cache
+ *
+ * Obtains statistics about the cache of rendered glyphs of
+ * the FreeType backend, since the start of the process.
+ *
+ * Since: 1.50
+ */
+void
+pango_ft2_glyph_cache_get_stats (guint *hits,
+                                 guint *misses,
+                                 guint *evictions,
+                                 gsize *size)
+{
+  G_LOCK (glyph_cache);
+
+  if (hits)
+    *hits = glyph_cache_hits;
+  if (misses)
+    *misses = glyph_cache_misses;
+  if (evictions)
+    *evictions = glyph_cache_evictions;
+  if (size)
+    *size = glyph_cache_size;
+
+  G_UNLOCK (glyph_cache);
 }
@@ -107,6 +107,16 @@ void pango_ft2_render_layout_subpixel      (FT_Bitmap        *bitmap,
 					    int               x,
 					    int               y);
 
+PANGO_AVAILABLE_IN_1_50
+void  pango_ft2_glyph_cache_set_max_size (gsize  max_size);
+PANGO_AVAILABLE_IN_1_50
+gsize pango_ft2_glyph_cache_get_max_size (void);
+PANGO_AVAILABLE_IN_1_50
+void  pango_ft2_glyph_cache_get_stats    (guint *hits,
+                                          guint *misses,
+                                          guint *evictions,
+                                          gsize *size);
+
 PANGO_AVAILABLE_IN_ALL
 GType pango_ft2_font_map_get_type (void) G_GNUC_CONST;
 
@@ -158,6 +158,471 @@ fallback_shape (const char          *text,
     pango_glyph_string_reverse_range (glyphs, 0, glyphs->num_glyphs);
 }
 
+/* Shape cache
+ *
+ * Shaping the same short runs (labels, numbers, column headers)
+ * over and over is the single largest cost of laying out text,
+ * so we keep a bounded LRU cache of shaping results in front of
+ * HarfBuzz. The key covers everything that influences the output
+ * of pango_hb_shape(): the font, the item text together with the
+ * context that HarfBuzz looks at, the relevant analysis fields,
+ * the shaping-related extra attributes and the shape flags.
+ *
+ * The results for a font are kept in a table attached to the font,
+ * and go away with it. Entries don't hold references on fonts: fonts
+ * may belong to a per-thread fontmap and must be finalized in their
+ * own thread. Only the LRU list is shared between all fonts. The
+ * serial of the fontmap is part of the key, so that results from
+ * before a change of the fontmap are not used anymore.
+ */
+
+#define SHAPE_CACHE_DEFAULT_SIZE 1024
+
+/* Don't bother caching long items, they are unlikely to repeat */
+#define SHAPE_CACHE_MAX_ITEM_LENGTH 1024
+
+/* This matches HB_BUFFER_CONTEXT_LENGTH, the number of characters
+ * before and after the item that hb_buffer_add_utf8() records
+ */
+#define SHAPE_CACHE_CONTEXT_LENGTH 5
+
+typedef struct _ShapeCacheEntry ShapeCacheEntry;
+
+struct _ShapeCacheEntry
+{
+  GList link;
+  GHashTable *table;    /* the table of the font, owning the entry */
+  guint hash;
+  gsize key_length;
+  guchar *key;
+  PangoGlyphString *glyphs;
+};
+
+typedef struct
+{
+  guchar *data;
+  gsize length;
+  gsize allocated;
+  guchar static_data[256];
+} ShapeCacheKey;
+
+typedef struct
+{
+  PangoLanguage *language;
+  guint serial;
+  int script;
+  int pre_length;
+  int item_length;
+  int post_length;
+  int n_attrs;
+  guint8 level;
+  guint8 gravity;
+  guint8 analysis_flags;
+  guint8 shape_flags;
+} ShapeCacheKeyHeader;
+
+G_LOCK_DEFINE_STATIC (shape_cache);
+static GQueue shape_cache_lru = G_QUEUE_INIT;   /* MT-safe, protected by shape_cache lock */
+static int shape_cache_max_size = SHAPE_CACHE_DEFAULT_SIZE;
+static guint shape_cache_hits = 0;
+static guint shape_cache_misses = 0;
+
+static void
+shape_cache_key_init (ShapeCacheKey *key)
+{
+  key->data = key->static_data;
+  key->length = 0;
+  key->allocated = sizeof (key->static_data);
+}
+
+static void
+shape_cache_key_clear (ShapeCacheKey *key)
+{
+  if (key->data != key->static_data)
+    g_free (key->data);
+}
+
+static void
+shape_cache_key_append (ShapeCacheKey *key,
+                        gconstpointer  data,
+                        gsize          length)
+{
+  if (key->length + length > key->allocated)
+    {
+      gsize allocated = MAX (2 * key->allocated, key->length + length);
+
+      if (key->data == key->static_data)
+        {
+          key->data = g_malloc (allocated);
+          memcpy (key->data, key->static_data, key->length);
+        }
+      else
+        key->data = g_realloc (key->data, allocated);
+
+      key->allocated = allocated;
+    }
+
+  memcpy (key->data + key->length, data, length);
+  key->length += length;
+}
+
+static int
+shape_cache_clamp_index (guint index,
+                         int   item_offset,
+                         int   item_length)
+{
+  if (index <= (guint) item_offset)
+    return 0;
+  if (index - item_offset >= (guint) item_length)
+    return item_length;
+  return index - item_offset;
+}
+
+/* Serializes everything besides the font that pango_hb_shape()
+ * and the post-processing in pango_shape_with_flags() depend on.
+ *
+ * Extra attributes are only relevant for shaping if they are
+ * font features, letter spacing (which turns off ligatures) or
+ * show flags, and only the part of their range that overlaps
+ * the item matters.
+ */
+static void
+shape_cache_key_build (ShapeCacheKey       *key,
+                       guint                serial,
+                       const char          *item_text,
+                       int                  item_length,
+                       const char          *paragraph_text,
+                       int                  paragraph_length,
+                       const PangoAnalysis *analysis,
+                       PangoShapeFlags      flags)
+{
+  ShapeCacheKeyHeader header;
+  const char *start, *end;
+  const char *paragraph_end = paragraph_text + paragraph_length;
+  int item_offset = item_text - paragraph_text;
+  GSList *l;
+  int i;
+
+  start = item_text;
+  for (i = 0; i < SHAPE_CACHE_CONTEXT_LENGTH && start > paragraph_text; i++)
+    start = g_utf8_find_prev_char (paragraph_text, start);
+  if (start == NULL)
+    start = paragraph_text;
+
+  end = item_text + item_length;
+  for (i = 0; i < SHAPE_CACHE_CONTEXT_LENGTH && end < paragraph_end; i++)
+    end = MIN (g_utf8_next_char (end), paragraph_end);
+
+  memset (&header, 0, sizeof (header));
+  header.language = analysis->language;
+  header.serial = serial;
+  header.script = analysis->script;
+  header.pre_length = item_text - start;
+  header.item_length = item_length;
+  header.post_length = end - (item_text + item_length);
+  header.n_attrs = g_slist_length (analysis->extra_attrs);
+  header.level = analysis->level;
+  header.gravity = analysis->gravity;
+  header.analysis_flags = analysis->flags;
+  header.shape_flags = flags;
+
+  shape_cache_key_append (key, &header, sizeof (header));
+  shape_cache_key_append (key, start, end - start);
+
+  for (l = analysis->extra_attrs; l; l = l->next)
+    {
+      PangoAttribute *attr = l->data;
+      int values[4];
+
+      switch ((int) attr->klass->type)
+        {
+        case PANGO_ATTR_FONT_FEATURES:
+        case PANGO_ATTR_LETTER_SPACING:
+        case PANGO_ATTR_SHOW:
+          break;
+        default:
+          continue;
+        }
+
+      values[0] = attr->klass->type;
+      if (attr->start_index == PANGO_ATTR_INDEX_FROM_TEXT_BEGINNING &&
+          attr->end_index == PANGO_ATTR_INDEX_TO_TEXT_END)
+        {
+          /* Global features take a different path in HarfBuzz */
+          values[1] = -1;
+          values[2] = -1;
+        }
+      else
+        {
+          values[1] = shape_cache_clamp_index (attr->start_index, item_offset, item_length);
+          values[2] = shape_cache_clamp_index (attr->end_index, item_offset, item_length);
+        }
+      values[3] = attr->klass->type == PANGO_ATTR_SHOW ? ((PangoAttrInt *)attr)->value : 0;
+
+      shape_cache_key_append (key, values, sizeof (values));
+
+      if (attr->klass->type == PANGO_ATTR_FONT_FEATURES)
+        {
+          const char *features = ((PangoAttrFontFeatures *)attr)->features;
+
+          shape_cache_key_append (key, features, strlen (features) + 1);
+        }
+    }
+}
+
+static guint
+shape_cache_key_hash (ShapeCacheKey *key)
+{
+  guint32 h = 5381;
+  gsize i;
+
+  for (i = 0; i < key->length; i++)
+    h = (h << 5) + h + key->data[i];
+
+  return h;
+}
+
+static guint
+shape_cache_entry_hash (gconstpointer data)
+{
+  const ShapeCacheEntry *entry = data;
+
+  return entry->hash;
+}
+
+static gboolean
+shape_cache_entry_equal (gconstpointer a,
+                         gconstpointer b)
+{
+  const ShapeCacheEntry *entry_a = a;
+  const ShapeCacheEntry *entry_b = b;
+
+  return entry_a->key_length == entry_b->key_length &&
+         memcmp (entry_a->key, entry_b->key, entry_a->key_length) == 0;
+}
+
+static void
+shape_cache_entry_free (ShapeCacheEntry *entry)
+{
+  g_free (entry->key);
+  pango_glyph_string_free (entry->glyphs);
+  g_slice_free (ShapeCacheEntry, entry);
+}
+
+static void
+copy_glyphs (PangoGlyphString       *dest,
+             const PangoGlyphString *src)
+{
+  pango_glyph_string_set_size (dest, src->num_glyphs);
+  memcpy (dest->glyphs, src->glyphs, src->num_glyphs * sizeof (PangoGlyphInfo));
+  memcpy (dest->log_clusters, src->log_clusters, src->num_glyphs * sizeof (int));
+}
+
+/* Must be called with the shape_cache lock held */
+static void
+shape_cache_trim (int max_size)
+{
+  while (shape_cache_lru.length > (guint) max_size)
+    {
+      GList *link = g_queue_pop_tail_link (&shape_cache_lru);
+      ShapeCacheEntry *entry = link->data;
+
+      g_hash_table_remove (entry->table, entry);
+      shape_cache_entry_free (entry);
+    }
+}
+
+/* Called when the font is finalized */
+static void
+shape_cache_table_free (GHashTable *table)
+{
+  GHashTableIter iter;
+  ShapeCacheEntry *entry;
+
+  G_LOCK (shape_cache);
+
+  g_hash_table_iter_init (&iter, table);
+  while (g_hash_table_iter_next (&iter, (gpointer *) &entry, NULL))
+    {
+      g_queue_unlink (&shape_cache_lru, &entry->link);
+      shape_cache_entry_free (entry);
+    }
+
+  G_UNLOCK (shape_cache);
+
+  g_hash_table_destroy (table);
+}
+
+static GQuark
+shape_cache_quark (void)
+{
+  static GQuark quark = 0;
+
+  if (G_UNLIKELY (quark == 0))
+    quark = g_quark_from_static_string ("pango-shape-cache");
+
+  return quark;
+}
+
+static gboolean
+shape_cache_lookup (PangoFont        *font,
+                    ShapeCacheKey    *key,
+                    guint             hash,
+                    PangoGlyphString *glyphs)
+{
+  ShapeCacheEntry lookup;
+  ShapeCacheEntry *entry;
+  GHashTable *table;
+
+  lookup.hash = hash;
+  lookup.key = key->data;
+  lookup.key_length = key->length;
+
+  G_LOCK (shape_cache);
+
+  table = g_object_get_qdata (G_OBJECT (font), shape_cache_quark ());
+  entry = table ? g_hash_table_lookup (table, &lookup) : NULL;
+  if (entry)
+    {
+      g_queue_unlink (&shape_cache_lru, &entry->link);
+      g_queue_push_head_link (&shape_cache_lru, &entry->link);
+      copy_glyphs (glyphs, entry->glyphs);
+      shape_cache_hits++;
+    }
+  else
+    shape_cache_misses++;
+
+  G_UNLOCK (shape_cache);
+
+  return entry != NULL;
+}
+
+static void
+shape_cache_insert (PangoFont        *font,
+                    ShapeCacheKey    *key,
+                    guint             hash,
+                    PangoGlyphString *glyphs)
+{
+  ShapeCacheEntry *entry;
+  GHashTable *table;
+
+  entry = g_slice_new (ShapeCacheEntry);
+  entry->link.data = entry;
+  entry->link.prev = NULL;
+  entry->link.next = NULL;
+  entry->hash = hash;
+  entry->key_length = key->length;
+  entry->key = g_malloc (key->length);
+  memcpy (entry->key, key->data, key->length);
+  entry->glyphs = pango_glyph_string_copy (glyphs);
+
+  G_LOCK (shape_cache);
+
+  table = g_object_get_qdata (G_OBJECT (font), shape_cache_quark ());
+  if (G_UNLIKELY (!table))
+    {
+      /* Only ever set with the lock held, so this can't replace
+       * (and free) a table under our feet
+       */
+      table = g_hash_table_new (shape_cache_entry_hash, shape_cache_entry_equal);
+      g_object_set_qdata_full (G_OBJECT (font), shape_cache_quark (),
+                               table, (GDestroyNotify) shape_cache_table_free);
+    }
+
+  if (shape_cache_max_size > 0 && !g_hash_table_contains (table, entry))
+    {
+      entry->table = table;
+      g_hash_table_add (table, entry);
+      g_queue_push_head_link (&shape_cache_lru, &entry->link);
+      entry = NULL;
+
+      shape_cache_trim (shape_cache_max_size);
+    }
+
+  G_UNLOCK (shape_cache);
+
+  if (entry)
+    shape_cache_entry_free (entry);
+}
+
+/**
+ * pango_shape_cache_set_size:
+ * @size: the maximum number of shaping results to keep
+ *
+ * Sets the maximum number of shaping results that Pango keeps
+ * around to avoid shaping identical runs of text repeatedly.
+ *
+ * Results are keyed by the font, the text of the item and its
+ * surrounding context, the #PangoAnalysis and the shape flags,
+ * and are evicted in least-recently-used order. Cached results
+ * do not keep their font alive, they are dropped when the font
+ * is freed.
+ *
+ * Setting the size to 0 disables the cache and drops all
+ * cached results.
+ *
+ * Since: 1.50
+ */
+void
+pango_shape_cache_set_size (int size)
+{
+  g_return_if_fail (size >= 0);
+
+  G_LOCK (shape_cache);
+
+  g_atomic_int_set (&shape_cache_max_size, size);
+  shape_cache_trim (size);
+
+  G_UNLOCK (shape_cache);
+}
+
+/**
+ * pango_shape_cache_get_size:
+ *
+ * Returns the maximum number of shaping results that Pango
+ * keeps around. See pango_shape_cache_set_size().
+ *
+ * Returns: the maximum size of the shape cache
+ *
+ * Since: 1.50
+ */
+int
+pango_shape_cache_get_size (void)
+{
+  int size;
+
+  G_LOCK (shape_cache);
+  size = shape_cache_max_size;
+  G_UNLOCK (shape_cache);
+
+  return size;
+}
+
+/**
+ * pango_shape_cache_get_stats:
+ * @hits: (out) (optional): return location for the number of cache hits
+ * @misses: (out) (optional): return location for the number of cache misses
+ *
+ * Obtains the number of times that shaping results were found
+ * in the shape cache, and the number of times that they had to
+ * be computed, since the start of the process.
+ *
+ * Since: 1.50
+ */
+void
+pango_shape_cache_get_stats (guint *hits,
+                             guint *misses)
+{
+  G_LOCK (shape_cache);
+
+  if (hits)
+    *hits = shape_cache_hits;
+  if (misses)
+    *misses = shape_cache_misses;
+
+  G_UNLOCK (shape_cache);
+}
+
 /**
  * pango_shape_with_flags:
  * @item_text: valid UTF-8 text to shape
@@ -198,6 +663,9 @@ pango_shape_with_flags (const gchar         *item_text,
 {
   int i;
   int last_cluster;
+  ShapeCacheKey key;
+  guint hash = 0;
+  gboolean use_cache = FALSE;
 
   glyphs->num_glyphs = 0;
 
@@ -215,6 +683,29 @@ pango_shape_with_flags (const gchar         *item_text,
   g_return_if_fail (paragraph_text <= item_text);
   g_return_if_fail (paragraph_text + paragraph_length >= item_text + item_length);
 
+  if (analysis->font &&
+      item_length <= SHAPE_CACHE_MAX_ITEM_LENGTH &&
+      g_atomic_int_get (&shape_cache_max_size) > 0)
+    {
+      PangoFontMap *fontmap = pango_font_get_font_map (analysis->font);
+
+      shape_cache_key_init (&key);
+      shape_cache_key_build (&key,
+                             fontmap ? pango_font_map_get_serial (fontmap) : 0,
+                             item_text, item_length,
+                             paragraph_text, paragraph_length,
+                             analysis, flags);
+      hash = shape_cache_key_hash (&key);
+
+      if (shape_cache_lookup (analysis->font, &key, hash, glyphs))
+        {
+          shape_cache_key_clear (&key);
+          return;
+        }
+
+      use_cache = TRUE;
+    }
+
   if (analysis->font)
     {
       pango_hb_shape (analysis->font,
@@ -258,6 +749,12 @@ pango_shape_with_flags (const gchar         *item_text,
 
   if (G_UNLIKELY (!glyphs->num_glyphs))
     {
+      if (use_cache)
+        {
+          shape_cache_key_clear (&key);
+          use_cache = FALSE;
+        }
+
       fallback_shape (item_text, item_length, analysis, glyphs);
       if (G_UNLIKELY (!glyphs->num_glyphs))
         return;
@@ -307,4 +804,10 @@ pango_shape_with_flags (const gchar         *item_text,
           glyphs->glyphs[i].geometry.y_offset = PANGO_UNITS_ROUND (glyphs->glyphs[i].geometry.y_offset);
         }
     }
+
+  if (use_cache)
+    {
+      shape_cache_insert (analysis->font, &key, hash, glyphs);
+      shape_cache_key_clear (&key);
+    }
 }
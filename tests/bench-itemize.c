@@ -0,0 +1,105 @@
+/* Pango
+ * bench-itemize.c: Benchmark for pango_itemize()
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.	 See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#include "config.h"
+#include <stdlib.h>
+#include <string.h>
+#include <glib.h>
+#include <pango/pangocairo.h>
+
+/* Measures how many characters per second pango_itemize() gets
+ * through for Latin, CJK and emoji-heavy text. Most of the time
+ * goes into looking up the font for each character, so this
+ * mostly measures the per-fontset font cache.
+ *
+ * Usage: bench-itemize [N_ITERS]
+ */
+
+static const char *latin =
+  "The quick brown fox jumps over the lazy dog. "
+  "Pack my box with five dozen liquor jugs! 0123456789 ";
+
+static const char *cjk =
+  "我能吞下玻璃而不伤身体。"
+  "私はガラスを食べられます。それは私を傷つけません。"
+  "나는 유리를 먹을 수 있어요. 그래도 아프지 않아요. ";
+
+static const char *emoji =
+  "Party time 🎉🎈 with friends 👩‍👩‍👧‍👦 and food 🍕🍔🌮, "
+  "weather ☀️🌧️❄️ flags 🇩🇪🇫🇷🇯🇵 ";
+
+static int num_iters = 2000;
+
+static void
+run (PangoContext *context,
+     const char   *name,
+     const char   *sample)
+{
+  GString *str;
+  gint64 start, end;
+  int i;
+  long n_chars;
+
+  /* Build a paragraph of a few kB */
+  str = g_string_new ("");
+  while (str->len < 4096)
+    g_string_append (str, sample);
+
+  n_chars = g_utf8_strlen (str->str, str->len);
+
+  /* Warm up fonts and caches */
+  g_list_free_full (pango_itemize (context, str->str, 0, str->len, NULL, NULL),
+                    (GDestroyNotify)pango_item_free);
+
+  start = g_get_monotonic_time ();
+
+  for (i = 0; i < num_iters; i++)
+    g_list_free_full (pango_itemize (context, str->str, 0, str->len, NULL, NULL),
+                      (GDestroyNotify)pango_item_free);
+
+  end = g_get_monotonic_time ();
+
+  g_print ("%-6s %.1f Mchars/sec\n", name,
+           (double) n_chars * num_iters / MAX (end - start, 1));
+
+  g_string_free (str, TRUE);
+}
+
+int
+main (int argc, char *argv[])
+{
+  PangoContext *context;
+  PangoFontDescription *desc;
+
+  if (argc > 1)
+    num_iters = atoi (argv[1]);
+
+  context = pango_font_map_create_context (pango_cairo_font_map_get_default ());
+  desc = pango_font_description_from_string ("Sans 12");
+  pango_context_set_font_description (context, desc);
+  pango_font_description_free (desc);
+
+  run (context, "latin", latin);
+  run (context, "cjk", cjk);
+  run (context, "emoji", emoji);
+
+  g_object_unref (context);
+
+  return 0;
+}
@@ -0,0 +1,193 @@
+/* Pango
+ * bench-layout-attrs.c: Benchmark for laying out attributed text
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.	 See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#include "config.h"
+#include <stdlib.h>
+#include <string.h>
+#include <glib.h>
+#include <pango/pangocairo.h>
+
+/* Measures how many times per second a layout with many
+ * attributes (mixed scripts and languages, like
+ * utils/test-mixed.markup, with styled words) gets laid out
+ * again, and how many attributes get copied for each layout.
+ *
+ * The copies are counted with a custom attribute type that is
+ * set on every word. It is not used for itemization or shaping,
+ * so it should only be copied into the runs it ends up on.
+ *
+ * Usage: bench-layout-attrs [N_ITERS]
+ */
+
+static const char *markup =
+  "<span lang=\"zh-cn\">你好，<b>这是</b>中文<i>竖排</i>测试。</span> "
+  "<span lang=\"en\">Roses are <span foreground=\"red\">Red</span>, "
+  "Grass is <span foreground=\"green\" underline=\"single\">Green</span>. "
+  "<tt>2006</tt></span> "
+  "<span lang=\"fa\">Arabic is <b>گل‌ها</b> قرمزند، چمن سبز. ۲۰۰۶</span> "
+  "<span lang=\"ja\">「<span size=\"larger\">ノート</span>を買った。」</span> ";
+
+static int num_iters = 500;
+
+static PangoAttrType counted_type;
+static guint n_copies;
+
+static PangoAttribute *counted_attr_new (void);
+
+static PangoAttribute *
+counted_attr_copy (const PangoAttribute *attr)
+{
+  n_copies++;
+
+  return counted_attr_new ();
+}
+
+static void
+counted_attr_destroy (PangoAttribute *attr)
+{
+  g_slice_free (PangoAttribute, attr);
+}
+
+static gboolean
+counted_attr_equal (const PangoAttribute *attr1,
+                    const PangoAttribute *attr2)
+{
+  return TRUE;
+}
+
+static PangoAttribute *
+counted_attr_new (void)
+{
+  static PangoAttrClass klass = {
+    0,
+    counted_attr_copy,
+    counted_attr_destroy,
+    counted_attr_equal
+  };
+  PangoAttribute *attr;
+
+  klass.type = counted_type;
+
+  attr = g_slice_new (PangoAttribute);
+  pango_attribute_init (attr, &klass);
+
+  return attr;
+}
+
+static PangoLayout *
+create_layout (PangoContext *context)
+{
+  PangoLayout *layout;
+  PangoAttrList *attrs;
+  GString *str;
+  char *text;
+  guint i, start;
+
+  str = g_string_new ("");
+  for (i = 0; i < 20; i++)
+    g_string_append (str, markup);
+
+  layout = pango_layout_new (context);
+  pango_layout_set_markup (layout, str->str, -1);
+  pango_layout_set_width (layout, 400 * PANGO_SCALE);
+
+  /* Mark every word with a counted attribute */
+  attrs = pango_attr_list_copy (pango_layout_get_attributes (layout));
+  text = g_strdup (pango_layout_get_text (layout));
+
+  for (i = 0, start = 0; ; i++)
+    {
+      if (text[i] == ' ' || text[i] == '\0')
+        {
+          if (i > start)
+            {
+              PangoAttribute *attr = counted_attr_new ();
+
+              attr->start_index = start;
+              attr->end_index = i;
+              pango_attr_list_insert (attrs, attr);
+            }
+
+          start = i + 1;
+        }
+
+      if (text[i] == '\0')
+        break;
+    }
+
+  pango_layout_set_attributes (layout, attrs);
+  pango_attr_list_unref (attrs);
+
+  g_free (text);
+  g_string_free (str, TRUE);
+
+  return layout;
+}
+
+int
+main (int argc, char *argv[])
+{
+  PangoContext *context;
+  PangoLayout *layout;
+  gint64 start, end;
+  int i, n_runs;
+  PangoLayoutIter *iter;
+
+  if (argc > 1)
+    num_iters = atoi (argv[1]);
+
+  counted_type = pango_attr_type_register ("bench-counted");
+
+  context = pango_font_map_create_context (pango_cairo_font_map_get_default ());
+  layout = create_layout (context);
+
+  /* Warm up fonts and caches */
+  pango_layout_get_line_count (layout);
+
+  n_runs = 0;
+  iter = pango_layout_get_iter (layout);
+  do
+    {
+      if (pango_layout_iter_get_run_readonly (iter))
+        n_runs++;
+    }
+  while (pango_layout_iter_next_run (iter));
+  pango_layout_iter_free (iter);
+
+  n_copies = 0;
+  start = g_get_monotonic_time ();
+
+  for (i = 0; i < num_iters; i++)
+    {
+      pango_layout_context_changed (layout);
+      pango_layout_get_line_count (layout);
+    }
+
+  end = g_get_monotonic_time ();
+
+  g_print ("%.0f layouts/sec\n",
+           (double) num_iters * G_USEC_PER_SEC / MAX (end - start, 1));
+  g_print ("%.1f attribute copies per layout (%d runs)\n",
+           (double) n_copies / MAX (num_iters, 1), n_runs);
+
+  g_object_unref (layout);
+  g_object_unref (context);
+
+  return 0;
+}
@@ -0,0 +1,148 @@
+/* Pango
+ * bench-line-breaking.c: Benchmark for greedy and optimal line breaking
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.	 See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#include "config.h"
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include <glib.h>
+#include <pango/pangocairo.h>
+
+/* Measures how many times per second utils/test-long-paragraph.txt
+ * gets laid out with greedy and with optimal line breaking, and
+ * how even the resulting lines are. The raggedness is the root
+ * mean square of how much room the lines other than the last one
+ * of each paragraph leave, in points.
+ *
+ * Both are measured at a few widths, rewrapping the same layout,
+ * so the shaping is mostly reused and line breaking dominates.
+ *
+ * Usage: bench-line-breaking [N_ITERS]
+ */
+
+static int num_iters = 50;
+
+static double
+get_raggedness (PangoLayout *layout)
+{
+  PangoLayoutIter *iter;
+  PangoLayoutLine *line;
+  double sum = 0;
+  int n = 0;
+  int width;
+
+  width = pango_layout_get_width (layout);
+
+  iter = pango_layout_get_iter (layout);
+  line = pango_layout_iter_get_line_readonly (iter);
+  while (pango_layout_iter_next_line (iter))
+    {
+      PangoLayoutLine *next = pango_layout_iter_get_line_readonly (iter);
+
+      /* Last lines of paragraphs are not filled */
+      if (!next->is_paragraph_start)
+        {
+          PangoRectangle logical;
+          double slack;
+
+          pango_layout_line_get_extents (line, NULL, &logical);
+          slack = (double) MAX (width - logical.width, 0) / PANGO_SCALE;
+          sum += slack * slack;
+          n++;
+        }
+
+      line = next;
+    }
+  pango_layout_iter_free (iter);
+
+  return n > 0 ? sqrt (sum / n) : 0;
+}
+
+static void
+run (PangoLayout       *layout,
+     PangoLineBreaking  line_breaking,
+     const char        *name)
+{
+  int widths[] = { 200, 300, 450 };
+  gint64 start, end;
+  double raggedness = 0;
+  int lines = 0;
+  int i, j;
+
+  pango_layout_set_line_breaking (layout, line_breaking);
+
+  /* Warm up fonts and caches */
+  pango_layout_set_width (layout, 100 * PANGO_SCALE);
+  pango_layout_get_line_count (layout);
+
+  start = g_get_monotonic_time ();
+
+  for (i = 0; i < num_iters; i++)
+    for (j = 0; j < G_N_ELEMENTS (widths); j++)
+      {
+        pango_layout_set_width (layout, widths[j] * PANGO_SCALE);
+        pango_layout_get_line_count (layout);
+      }
+
+  end = g_get_monotonic_time ();
+
+  for (j = 0; j < G_N_ELEMENTS (widths); j++)
+    {
+      pango_layout_set_width (layout, widths[j] * PANGO_SCALE);
+      lines += pango_layout_get_line_count (layout);
+      raggedness += get_raggedness (layout);
+    }
+
+  g_print ("%-8s %.0f layouts/sec, %d lines, raggedness %.1f\n",
+           name,
+           (double) num_iters * G_N_ELEMENTS (widths) * G_USEC_PER_SEC / MAX (end - start, 1),
+           lines, raggedness / G_N_ELEMENTS (widths));
+}
+
+int
+main (int argc, char *argv[])
+{
+  PangoContext *context;
+  PangoLayout *layout;
+  char *path, *text;
+  GError *error = NULL;
+
+  g_test_init (&argc, &argv, NULL);
+
+  if (argc > 1)
+    num_iters = atoi (argv[1]);
+
+  path = g_test_build_filename (G_TEST_DIST, "..", "utils", "test-long-paragraph.txt", NULL);
+  g_file_get_contents (path, &text, NULL, &error);
+  g_assert_no_error (error);
+  g_free (path);
+
+  context = pango_font_map_create_context (pango_cairo_font_map_get_default ());
+  layout = pango_layout_new (context);
+  pango_layout_set_text (layout, text, -1);
+
+  run (layout, PANGO_LINE_BREAKING_GREEDY, "greedy");
+  run (layout, PANGO_LINE_BREAKING_OPTIMAL, "optimal");
+
+  g_object_unref (layout);
+  g_object_unref (context);
+  g_free (text);
+
+  return 0;
+}
@@ -0,0 +1,187 @@
+/* Pango
+ * bench-markup.c: Benchmark for markup parsing
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.	 See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#include "config.h"
+#include <stdlib.h>
+#include <string.h>
+#include <glib.h>
+#include <pango/pango.h>
+
+/* Compares how many MB/s of markup pango_parse_markup() gets
+ * through with how many a parser from pango_markup_parser_new(),
+ * which always goes through GMarkup, gets through. The inputs are
+ * the valid markups in tests/markups/ and a large generated one.
+ *
+ * Usage: bench-markup [N_ITERS]
+ */
+
+static int num_iters = 20;
+
+static void
+parse_fast (const char *markup,
+            gsize       length)
+{
+  PangoAttrList *attrs;
+  char *text;
+
+  if (!pango_parse_markup (markup, length, 0, &attrs, &text, NULL, NULL))
+    g_error ("Failed to parse markup");
+
+  pango_attr_list_unref (attrs);
+  g_free (text);
+}
+
+static void
+parse_gmarkup (const char *markup,
+               gsize       length)
+{
+  GMarkupParseContext *context;
+  PangoAttrList *attrs;
+  char *text;
+
+  context = pango_markup_parser_new (0);
+  if (!g_markup_parse_context_parse (context, markup, length, NULL) ||
+      !pango_markup_parser_finish (context, &attrs, &text, NULL, NULL))
+    g_error ("Failed to parse markup");
+
+  g_markup_parse_context_free (context);
+  pango_attr_list_unref (attrs);
+  g_free (text);
+}
+
+static double
+measure (void      (* parse) (const char *, gsize),
+         GPtrArray *inputs)
+{
+  gint64 start, end;
+  gsize total = 0;
+  int i;
+  guint j;
+
+  for (j = 0; j < inputs->len; j++)
+    total += strlen (g_ptr_array_index (inputs, j));
+
+  start = g_get_monotonic_time ();
+
+  for (i = 0; i < num_iters; i++)
+    for (j = 0; j < inputs->len; j++)
+      {
+        const char *markup = g_ptr_array_index (inputs, j);
+
+        parse (markup, strlen (markup));
+      }
+
+  end = g_get_monotonic_time ();
+
+  return (double) total * num_iters / MAX (end - start, 1);
+}
+
+static void
+run (const char *name,
+     GPtrArray  *inputs)
+{
+  double fast, gmarkup;
+
+  /* Warm up */
+  measure (parse_fast, inputs);
+
+  fast = measure (parse_fast, inputs);
+  gmarkup = measure (parse_gmarkup, inputs);
+
+  g_print ("%-10s pango_parse_markup %.1f MB/s, GMarkup %.1f MB/s (%.2fx)\n",
+           name, fast, gmarkup, fast / gmarkup);
+}
+
+/* Looks like the output of a log exporter */
+static char *
+generate_markup (gsize size)
+{
+  static const char *levels[] = {
+    "<span foreground=\"#808080\">debug</span>",
+    "<span foreground=\"#0000ff\" weight=\"bold\">info</span>",
+    "<span foreground=\"#ff8000\" background=\"#ffffe0\">warning</span>",
+    "<span color=\"red\" weight=\"heavy\" underline=\"single\">error</span>",
+  };
+  GString *str;
+  guint i;
+
+  str = g_string_new ("");
+
+  for (i = 0; str->len < size; i++)
+    g_string_append_printf (str,
+                            "<span font=\"Monospace 9\">%02u:%02u:%02u.%03u</span> %s "
+                            "<b>module-%u</b>: request <i>%u</i> took <span size=\"smaller\">%u ms</span> "
+                            "&lt;ok&gt; <tt>0x%08x</tt>\n",
+                            (i / 3600000) % 24, (i / 60000) % 60, (i / 1000) % 60, i % 1000,
+                            levels[i % G_N_ELEMENTS (levels)],
+                            i % 17, i, i % 250, i * 2654435761u);
+
+  return g_string_free (str, FALSE);
+}
+
+int
+main (int argc, char *argv[])
+{
+  GPtrArray *inputs;
+  GDir *dir;
+  const char *name;
+  char *path;
+  GError *error = NULL;
+
+  g_test_init (&argc, &argv, NULL);
+
+  if (argc > 1)
+    num_iters = atoi (argv[1]);
+
+  inputs = g_ptr_array_new_with_free_func (g_free);
+
+  path = g_test_build_filename (G_TEST_DIST, "markups", NULL);
+  dir = g_dir_open (path, 0, &error);
+  g_assert_no_error (error);
+
+  while ((name = g_dir_read_name (dir)) != NULL)
+    {
+      char *filename, *contents;
+
+      if (!g_str_has_prefix (name, "valid-") || !g_str_has_suffix (name, ".markup"))
+        continue;
+
+      filename = g_build_filename (path, name, NULL);
+      g_file_get_contents (filename, &contents, NULL, &error);
+      g_assert_no_error (error);
+      g_ptr_array_add (inputs, contents);
+      g_free (filename);
+    }
+
+  g_dir_close (dir);
+  g_free (path);
+
+  /* The small files are too quick to measure one at a time */
+  num_iters *= 1000;
+  run ("markups", inputs);
+  num_iters /= 1000;
+
+  g_ptr_array_set_size (inputs, 0);
+  g_ptr_array_add (inputs, generate_markup (4 * 1024 * 1024));
+  run ("generated", inputs);
+
+  g_ptr_array_unref (inputs);
+
+  return 0;
+}
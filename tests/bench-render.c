@@ -0,0 +1,146 @@
+/* Pango
+ * bench-render.c: Benchmark for rendering layouts with cairo
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.	 See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#include "config.h"
+#include <stdlib.h>
+#include <glib.h>
+#include <pango/pangocairo.h>
+
+/* Measures how many times per second pango_cairo_show_layout()
+ * draws a page of text into an image surface, once with every
+ * word in its own colour, like highlighted code, and once with
+ * the same text without attributes. With many short runs, most
+ * of the time goes into the calls into cairo for each run.
+ *
+ * Usage: bench-render [N_ITERS]
+ */
+
+static const char *words[] = {
+  "static", "void", "int", "return", "if", "else", "while", "for",
+  "layout", "iter", "line", "run", "glyphs", "width", "0", "1",
+  "(", ")", "{", "}", ";", "=", "+", "->",
+};
+
+static const char *colors[] = {
+  "#a020f0", "#2e8b57", "#0000ff", "#a52a2a", "#008b8b", "#000000",
+};
+
+static int num_iters = 200;
+
+static void
+run (PangoLayout *layout,
+     const char  *name)
+{
+  cairo_surface_t *surface;
+  cairo_t *cr;
+  PangoLayoutIter *iter;
+  gint64 start, end;
+  int i, n_runs;
+
+  surface = cairo_image_surface_create (CAIRO_FORMAT_ARGB32, 800, 1200);
+  cr = cairo_create (surface);
+
+  n_runs = 0;
+  iter = pango_layout_get_iter (layout);
+  do
+    {
+      if (pango_layout_iter_get_run_readonly (iter))
+        n_runs++;
+    }
+  while (pango_layout_iter_next_run (iter));
+  pango_layout_iter_free (iter);
+
+  /* Warm up fonts and caches */
+  cairo_move_to (cr, 0, 0);
+  pango_cairo_show_layout (cr, layout);
+
+  start = g_get_monotonic_time ();
+
+  for (i = 0; i < num_iters; i++)
+    {
+      cairo_move_to (cr, 0, 0);
+      pango_cairo_show_layout (cr, layout);
+    }
+
+  cairo_surface_flush (surface);
+  end = g_get_monotonic_time ();
+
+  g_print ("%-8s %5d runs, %.0f frames/sec\n", name, n_runs,
+           (double) num_iters * G_USEC_PER_SEC / MAX (end - start, 1));
+
+  cairo_destroy (cr);
+  cairo_surface_destroy (surface);
+}
+
+int
+main (int argc, char *argv[])
+{
+  PangoFontMap *fontmap;
+  PangoContext *context;
+  PangoLayout *layout;
+  GString *markup, *text;
+  int i;
+
+  if (argc > 1)
+    num_iters = atoi (argv[1]);
+
+  /* About 60 lines of 60 columns */
+  markup = g_string_new ("");
+  text = g_string_new ("");
+  for (i = 0; text->len < 60 * 60; i++)
+    {
+      const char *word = words[(i * 7) % G_N_ELEMENTS (words)];
+      char *escaped = g_markup_escape_text (word, -1);
+
+      g_string_append_printf (markup, "<span foreground=\"%s\">%s</span>",
+                              colors[i % G_N_ELEMENTS (colors)], escaped);
+      g_string_append (text, word);
+      g_free (escaped);
+
+      if (i % 12 == 11)
+        {
+          g_string_append_c (markup, '\n');
+          g_string_append_c (text, '\n');
+        }
+      else
+        {
+          g_string_append_c (markup, ' ');
+          g_string_append_c (text, ' ');
+        }
+    }
+
+  fontmap = pango_cairo_font_map_get_default ();
+  context = pango_font_map_create_context (fontmap);
+
+  layout = pango_layout_new (context);
+  pango_layout_set_markup (layout, markup->str, -1);
+  run (layout, "colored");
+  g_object_unref (layout);
+
+  layout = pango_layout_new (context);
+  pango_layout_set_text (layout, text->str, -1);
+  run (layout, "plain");
+  g_object_unref (layout);
+
+  g_object_unref (context);
+  g_string_free (markup, TRUE);
+  g_string_free (text, TRUE);
+
+  return 0;
+}
@@ -0,0 +1,130 @@
+/* Pango
+ * bench-shape-threads.c: Benchmark for shaping from multiple threads
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.	 See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#include "config.h"
+#include <stdlib.h>
+#include <string.h>
+#include <glib.h>
+#include <pango/pangocairo.h>
+
+/* Measures the number of items shaped per second from 1 and
+ * from N threads. The shape cache is turned off, so that every
+ * item really goes through HarfBuzz and the shaping buffers.
+ *
+ * Usage: bench-shape-threads [N_THREADS [N_ITERS]]
+ */
+
+static const char *text =
+  "Hamburgerfonts 0123456789\n"
+  "วิวิวิวิวิวิ\n"
+  "بهداد\n"
+  "Label, Value, Total, Column header\n";
+
+static int num_threads = 8;
+static int num_iters = 2000;
+
+static GList *items;
+
+static GMutex mutex;
+
+static gpointer
+thread_func (gpointer data)
+{
+  PangoGlyphString *glyphs;
+  int i;
+  GList *l;
+
+  glyphs = pango_glyph_string_new ();
+
+  /* Wait for the start signal */
+  g_mutex_lock (&mutex);
+  g_mutex_unlock (&mutex);
+
+  for (i = 0; i < num_iters; i++)
+    for (l = items; l; l = l->next)
+      {
+        PangoItem *item = l->data;
+
+        pango_shape_full (text + item->offset, item->length,
+                          text, strlen (text),
+                          &item->analysis, glyphs);
+      }
+
+  pango_glyph_string_free (glyphs);
+
+  return NULL;
+}
+
+static double
+run (int n_threads)
+{
+  GPtrArray *threads;
+  gint64 start, end;
+  int i;
+
+  threads = g_ptr_array_new ();
+
+  g_mutex_lock (&mutex);
+
+  for (i = 0; i < n_threads; i++)
+    g_ptr_array_add (threads, g_thread_new ("shape", thread_func, NULL));
+
+  start = g_get_monotonic_time ();
+  g_mutex_unlock (&mutex);
+
+  for (i = 0; i < n_threads; i++)
+    g_thread_join (g_ptr_array_index (threads, i));
+
+  end = g_get_monotonic_time ();
+
+  g_ptr_array_unref (threads);
+
+  return (double) n_threads * num_iters * g_list_length (items) * G_USEC_PER_SEC / MAX (end - start, 1);
+}
+
+int
+main (int argc, char *argv[])
+{
+  PangoContext *context;
+  double single, multi;
+
+  if (argc > 1)
+    num_threads = atoi (argv[1]);
+  if (argc > 2)
+    num_iters = atoi (argv[2]);
+
+  pango_shape_cache_set_size (0);
+
+  context = pango_font_map_create_context (pango_cairo_font_map_get_default ());
+  items = pango_itemize (context, text, 0, strlen (text), NULL, NULL);
+
+  /* Warm up fonts and per-font HarfBuzz data */
+  run (1);
+
+  single = run (1);
+  multi = run (num_threads);
+
+  g_print ("1 thread:   %.0f items/sec\n", single);
+  g_print ("%d threads: %.0f items/sec (%.2fx)\n", num_threads, multi, multi / single);
+
+  g_list_free_full (items, (GDestroyNotify)pango_item_free);
+  g_object_unref (context);
+
+  return 0;
+}
@@ -0,0 +1,102 @@
+/* Pango
+ * bench-wrap.c: Benchmark for wrapping text into narrow columns
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.	 See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#include "config.h"
+#include <stdlib.h>
+#include <string.h>
+#include <glib.h>
+#include <pango/pangocairo.h>
+
+/* Measures how many lines per second get made when laying out
+ * long paragraphs into columns of a few widths. In narrow columns,
+ * nearly every item has to be broken, so this mostly measures
+ * process_item() finding the breaks.
+ *
+ * Usage: bench-wrap [N_ITERS]
+ */
+
+static const char *sample =
+  "The quick brown fox jumps over the lazy dog. "
+  "Pack my box with five dozen liquor jugs! "
+  "Sphinx of black quartz, judge my vow. "
+  "Incomprehensibilities notwithstanding, 0123456789 ";
+
+static int num_iters = 200;
+
+static void
+run (PangoLayout *layout,
+     int          width)
+{
+  gint64 start, end;
+  int i, n_lines = 0;
+
+  pango_layout_set_width (layout, width * PANGO_SCALE);
+
+  /* Warm up fonts and caches */
+  pango_layout_get_line_count (layout);
+
+  start = g_get_monotonic_time ();
+
+  for (i = 0; i < num_iters; i++)
+    {
+      pango_layout_context_changed (layout);
+      n_lines = pango_layout_get_line_count (layout);
+    }
+
+  end = g_get_monotonic_time ();
+
+  g_print ("%4d pt: %5d lines, %.0f lines/sec\n", width, n_lines,
+           (double) n_lines * num_iters * G_USEC_PER_SEC / MAX (end - start, 1));
+}
+
+int
+main (int argc, char *argv[])
+{
+  PangoContext *context;
+  PangoLayout *layout;
+  GString *str;
+  int i;
+
+  if (argc > 1)
+    num_iters = atoi (argv[1]);
+
+  /* A few paragraphs of a few kB */
+  str = g_string_new ("");
+  for (i = 0; i < 4; i++)
+    {
+      while (str->len < (i + 1) * 4096)
+        g_string_append (str, sample);
+      g_string_append_c (str, '\n');
+    }
+
+  context = pango_font_map_create_context (pango_cairo_font_map_get_default ());
+  layout = pango_layout_new (context);
+  pango_layout_set_text (layout, str->str, -1);
+
+  run (layout, 40);
+  run (layout, 80);
+  run (layout, 160);
+  run (layout, 400);
+
+  g_object_unref (layout);
+  g_object_unref (context);
+  g_string_free (str, TRUE);
+
+  return 0;
+}
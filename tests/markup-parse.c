@@ -128,6 +128,75 @@ test_parse (gconstpointer d)
   g_free (expected_file);
 }
 
+static void
+parse_with_gmarkup (const char     *markup,
+                    PangoAttrList **attrs,
+                    char          **text)
+{
+  GMarkupParseContext *context;
+  GError *error = NULL;
+
+  context = pango_markup_parser_new (0);
+  g_markup_parse_context_parse (context, markup, -1, &error);
+  g_assert_no_error (error);
+  pango_markup_parser_finish (context, attrs, text, NULL, &error);
+  g_assert_no_error (error);
+  g_markup_parse_context_free (context);
+}
+
+/* Test that the fast path of pango_parse_markup()
+ * gives the same results as going through GMarkup
+ */
+static void
+test_fast_path (void)
+{
+  const char *markups[] = {
+    "plain text",
+    "<b>bold</b> <i>it<u>al</u>ic</i>",
+    "<span font=\"Sans Italic 12\" weight=\"bold\" color=\"#ff0000\">a</span>",
+    "<span size=\"larger\"><span size=\"x-small\">x</span> y</span>",
+    "<span foreground=\"red\" background=\"#00ff0080\" underline=\"double\">z</span>",
+    "<sub>1</sub><sup>2</sup><small>3</small><big>4</big><tt>5</tt><s>6</s>",
+    "a &amp; b &lt;c&gt; &quot;d&quot; &apos;e&apos;",
+    "line\r\nbreaks\rhere",
+    "<span face='Serif' style='italic' font_size='12000'>f</span>",
+    "<b/><span\n  weight='300'\t>g</span>",
+    /* These need the full parser */
+    "<span font-weight=\"bold\">h</span>",
+    "&#x41;",
+    "<span lang=\"de\" weight=\"bold\">i</span>",
+    "<span foreground=\"a&amp;b\">j</span>",
+  };
+  int i;
+
+  for (i = 0; i < G_N_ELEMENTS (markups); i++)
+    {
+      PangoAttrList *attrs, *expected_attrs;
+      char *text, *expected_text;
+      GString *str, *expected;
+      GError *error = NULL;
+
+      pango_parse_markup (markups[i], -1, 0, &attrs, &text, NULL, &error);
+      g_assert_no_error (error);
+
+      parse_with_gmarkup (markups[i], &expected_attrs, &expected_text);
+
+      str = g_string_new (text);
+      print_attr_list (attrs, str);
+      expected = g_string_new (expected_text);
+      print_attr_list (expected_attrs, expected);
+
+      g_assert_cmpstr (str->str, ==, expected->str);
+
+      g_string_free (str, TRUE);
+      g_string_free (expected, TRUE);
+      pango_attr_list_unref (attrs);
+      pango_attr_list_unref (expected_attrs);
+      g_free (text);
+      g_free (expected_text);
+    }
+}
+
 int
 main (int argc, char *argv[])
 {
@@ -169,5 +238,7 @@ main (int argc, char *argv[])
     }
   g_dir_close (dir);
 
+  g_test_add_func ("/markup/fast-path", test_fast_path);
+
   return g_test_run ();
 }
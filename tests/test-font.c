@@ -116,6 +116,108 @@ test_variation (void)
   pango_font_description_free (desc2);
 }
 
+static void
+test_interned (void)
+{
+  const PangoFontDescription *desc1, *desc2, *desc3;
+  PangoFontDescription *copy;
+  PangoAttribute *attr;
+
+  desc1 = pango_font_description_from_string_interned ("Cantarell Bold 14");
+  desc2 = pango_font_description_from_string_interned ("Cantarell Bold 14");
+  g_assert_true (desc1 == desc2);
+
+  /* Different strings for the same font share the result */
+  desc2 = pango_font_description_from_string_interned ("  Cantarell,  bold 14");
+  g_assert_true (desc1 == desc2);
+
+  desc3 = pango_font_description_from_string_interned ("Cantarell 14");
+  g_assert_true (desc1 != desc3);
+  g_assert_false (pango_font_description_equal (desc1, desc3));
+
+  copy = pango_font_description_copy (desc1);
+  g_assert_true (pango_font_description_equal (copy, desc1));
+  g_assert_cmpuint (pango_font_description_hash (copy), ==, pango_font_description_hash (desc1));
+
+  /* The copy is a normal font description */
+  pango_font_description_set_weight (copy, PANGO_WEIGHT_NORMAL);
+  g_assert_true (pango_font_description_equal (copy, desc3));
+  g_assert_cmpint (pango_font_description_get_weight (desc1), ==, PANGO_WEIGHT_BOLD);
+  pango_font_description_free (copy);
+
+  /* Attributes get a description of their own */
+  attr = pango_attr_font_desc_new (desc1);
+  g_assert_true (((PangoAttrFontDesc *)attr)->desc != desc1);
+  g_assert_true (pango_font_description_equal (((PangoAttrFontDesc *)attr)->desc, desc1));
+  pango_attribute_destroy (attr);
+
+  /* Freeing does nothing */
+  pango_font_description_free ((PangoFontDescription *) desc1);
+  g_assert_cmpstr (pango_font_description_get_family (desc1), ==, "Cantarell");
+
+  /* The family name is given back as spelled */
+  desc2 = pango_font_description_from_string_interned ("cantarell Bold 14");
+  g_assert_true (desc1 != desc2);
+  g_assert_cmpstr (pango_font_description_get_family (desc2), ==, "cantarell");
+  g_assert_true (pango_font_description_equal (desc1, desc2));
+  g_assert_cmpuint (pango_font_description_hash (desc1), ==, pango_font_description_hash (desc2));
+}
+
+static PangoFontDescription *
+get_markup_font_desc (const char     *markup,
+                      PangoAttrList **attrs)
+{
+  PangoAttrIterator *iter;
+  PangoAttribute *attr;
+
+  g_assert_true (pango_parse_markup (markup, -1, 0, attrs, NULL, NULL, NULL));
+
+  iter = pango_attr_list_get_iterator (*attrs);
+  attr = pango_attr_iterator_get (iter, PANGO_ATTR_FONT_DESC);
+  g_assert_nonnull (attr);
+  pango_attr_iterator_destroy (iter);
+
+  return ((PangoAttrFontDesc *)attr)->desc;
+}
+
+/* Test that modifying a font attribute from markup
+ * doesn't affect other parses of the same markup
+ */
+static void
+test_interned_markup (void)
+{
+  PangoAttrList *attrs1, *attrs2;
+  PangoFontDescription *desc;
+
+  desc = get_markup_font_desc ("<span font='Cantarell Italic 11'>a</span>", &attrs1);
+  pango_font_description_set_family_static (desc, "Serif");
+  pango_font_description_set_size (desc, 20 * PANGO_SCALE);
+  pango_font_description_set_weight (desc, PANGO_WEIGHT_BOLD);
+
+  desc = get_markup_font_desc ("<span font='Cantarell Italic 11'>b</span>", &attrs2);
+  g_assert_cmpstr (pango_font_description_get_family (desc), ==, "Cantarell");
+  g_assert_cmpint (pango_font_description_get_size (desc), ==, 11 * PANGO_SCALE);
+  g_assert_cmpint (pango_font_description_get_style (desc), ==, PANGO_STYLE_ITALIC);
+  g_assert_cmpint (pango_font_description_get_weight (desc), ==, PANGO_WEIGHT_NORMAL);
+
+  /* The shared description is unchanged, hash included */
+  g_assert_true (pango_font_description_equal (desc, pango_font_description_from_string_interned ("Cantarell Italic 11")));
+  g_assert_cmpuint (pango_font_description_hash (desc), ==,
+                    pango_font_description_hash (pango_font_description_from_string_interned ("Cantarell Italic 11")));
+
+  pango_attr_list_unref (attrs1);
+  pango_attr_list_unref (attrs2);
+
+  /* Earlier parses don't change the spelling of the family */
+  desc = get_markup_font_desc ("<span font='Cantarell Italic 12'>a</span>", &attrs1);
+  g_assert_cmpstr (pango_font_description_get_family (desc), ==, "Cantarell");
+  desc = get_markup_font_desc ("<span font='cantarell Italic 12'>b</span>", &attrs2);
+  g_assert_cmpstr (pango_font_description_get_family (desc), ==, "cantarell");
+
+  pango_attr_list_unref (attrs1);
+  pango_attr_list_unref (attrs2);
+}
+
 static void
 test_metrics (void)
 {
@@ -314,6 +416,109 @@ test_roundtrip_emoji (void)
   g_object_unref (context);
 }
 
+typedef struct {
+  gunichar wc;
+  int n_fonts;
+  PangoFont *first;
+  PangoFont *font;
+} CoverageScan;
+
+static gboolean
+scan_font (PangoFontset *fontset,
+           PangoFont    *font,
+           gpointer      user_data)
+{
+  CoverageScan *scan = user_data;
+
+  if (!scan->first)
+    scan->first = g_object_ref (font);
+
+  if (pango_font_has_char (font, scan->wc))
+    {
+      scan->font = g_object_ref (font);
+      return TRUE;
+    }
+
+  scan->n_fonts++;
+  return FALSE;
+}
+
+/* Test that the font a fontset picks for a character is the
+ * first one covering it, as found by looking at every font in
+ * turn, whether it is the first font, a fallback or none
+ */
+static void
+test_fontset_coverage (void)
+{
+  PangoFontMap *fontmap;
+  PangoContext *context;
+  PangoFontDescription *desc;
+  PangoFontset *fontset;
+  gunichar chars[] = {
+    'a', 0x5d0, 0x627, 0xe01, 0x4e00, 0x1f600, 0xfdd0
+  };
+  gboolean seen_first = FALSE, seen_fallback = FALSE, seen_none = FALSE;
+  int i, j;
+
+#ifdef HAVE_CARBON
+  /* We probably don't have the right fonts */
+  g_test_skip ("Skipping font-dependent tests on OS X");
+  return;
+#endif
+
+  fontmap = pango_cairo_font_map_get_default ();
+  context = pango_font_map_create_context (fontmap);
+
+  desc = pango_font_description_from_string ("Cantarell 11");
+  fontset = pango_font_map_load_fontset (fontmap, context, desc,
+                                         pango_language_from_string ("en-us"));
+
+  for (i = 0; i < G_N_ELEMENTS (chars); i++)
+    {
+      CoverageScan scan = { chars[i], 0, NULL, NULL };
+      PangoFont *expected;
+
+      pango_fontset_foreach (fontset, scan_font, &scan);
+
+      if (scan.font)
+        {
+          expected = scan.font;
+          if (scan.n_fonts == 0)
+            seen_first = TRUE;
+          else
+            seen_fallback = TRUE;
+        }
+      else
+        {
+          /* Nothing covers it, the first font is used */
+          expected = scan.first;
+          seen_none = TRUE;
+        }
+
+      /* The second lookup is answered from the index */
+      for (j = 0; j < 2; j++)
+        {
+          PangoFont *font;
+
+          font = pango_fontset_get_font (fontset, chars[i]);
+          g_assert_true (font == expected);
+          g_object_unref (font);
+        }
+
+      g_clear_object (&scan.font);
+      g_clear_object (&scan.first);
+    }
+
+  g_assert_true (seen_first);
+  g_assert_true (seen_none);
+  if (!seen_fallback)
+    g_test_skip ("No fallback fonts");
+
+  g_object_unref (fontset);
+  pango_font_description_free (desc);
+  g_object_unref (context);
+}
+
 int
 main (int argc, char *argv[])
 {
@@ -328,10 +533,13 @@ main (int argc, char *argv[])
   g_test_add_func ("/pango/fontdescription/parse", test_parse);
   g_test_add_func ("/pango/fontdescription/roundtrip", test_roundtrip);
   g_test_add_func ("/pango/fontdescription/variation", test_variation);
+  g_test_add_func ("/pango/fontdescription/interned", test_interned);
+  g_test_add_func ("/pango/fontdescription/interned-markup", test_interned_markup);
   g_test_add_func ("/pango/font/extents", test_extents);
   g_test_add_func ("/pango/font/enumerate", test_enumerate);
   g_test_add_func ("/pango/font/roundtrip/plain", test_roundtrip_plain);
   g_test_add_func ("/pango/font/roundtrip/emoji", test_roundtrip_emoji);
+  g_test_add_func ("/pango/fontset/coverage", test_fontset_coverage);
 
   return g_test_run ();
 }
@@ -0,0 +1,130 @@
+/* Pango
+ * test-ft2-render.c: Test cases for rendering with the FreeType backend
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.	 See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#include "config.h"
+#include <string.h>
+#include <glib.h>
+#include <pango/pangoft2.h>
+
+static void
+render (PangoFontMap *fontmap,
+        const char   *font,
+        guchar      **out_buffer)
+{
+  PangoContext *context;
+  PangoLayout *layout;
+  PangoFontDescription *desc;
+  FT_Bitmap bitmap;
+
+  context = pango_font_map_create_context (fontmap);
+  layout = pango_layout_new (context);
+  desc = pango_font_description_from_string (font);
+  pango_layout_set_font_description (layout, desc);
+  pango_font_description_free (desc);
+  pango_layout_set_text (layout, "The quick brown fox jumps over the lazy dog", -1);
+
+  bitmap.width = 400;
+  bitmap.rows = 50;
+  bitmap.pitch = bitmap.width;
+  bitmap.num_grays = 256;
+  bitmap.pixel_mode = FT_PIXEL_MODE_GRAY;
+  bitmap.buffer = g_malloc0 (bitmap.rows * bitmap.pitch);
+
+  pango_ft2_render_layout (&bitmap, layout, 0, 0);
+
+  *out_buffer = bitmap.buffer;
+
+  g_object_unref (layout);
+  g_object_unref (context);
+}
+
+static void
+test_glyph_cache (void)
+{
+  PangoFontMap *fontmap;
+  guchar *uncached, *cached, *evicting;
+  guint hits, hits2, evictions, evictions2;
+  gsize size;
+  int i;
+
+  fontmap = pango_ft2_font_map_new ();
+
+  pango_ft2_glyph_cache_set_max_size (0);
+  pango_ft2_glyph_cache_get_stats (NULL, NULL, NULL, &size);
+  g_assert_cmpuint (size, ==, 0);
+
+  render (fontmap, "Sans 12", &uncached);
+  pango_ft2_glyph_cache_get_stats (NULL, NULL, NULL, &size);
+  g_assert_cmpuint (size, ==, 0);
+
+  /* Drawing the same text twice hits the cache */
+  pango_ft2_glyph_cache_set_max_size (1024 * 1024);
+  g_free (uncached);
+  render (fontmap, "Sans 12", &uncached);
+  pango_ft2_glyph_cache_get_stats (&hits, NULL, NULL, &size);
+  g_assert_cmpuint (size, >, 0);
+
+  render (fontmap, "Sans 12", &cached);
+  pango_ft2_glyph_cache_get_stats (&hits2, NULL, NULL, NULL);
+  g_assert_cmpuint (hits2, >, hits);
+  g_assert_true (memcmp (cached, uncached, 400 * 50) == 0);
+  g_free (cached);
+
+  /* Many sizes with a small budget evict, but stay within it */
+  pango_ft2_glyph_cache_set_max_size (16 * 1024);
+  pango_ft2_glyph_cache_get_stats (NULL, NULL, &evictions, NULL);
+
+  for (i = 8; i < 40; i++)
+    {
+      char *font = g_strdup_printf ("Sans %d", i);
+
+      render (fontmap, font, &evicting);
+      g_free (evicting);
+      g_free (font);
+
+      pango_ft2_glyph_cache_get_stats (NULL, NULL, NULL, &size);
+      g_assert_cmpuint (size, <=, 16 * 1024);
+    }
+
+  pango_ft2_glyph_cache_get_stats (NULL, NULL, &evictions2, NULL);
+  g_assert_cmpuint (evictions2, >, evictions);
+
+  /* Evicted glyphs render the same */
+  render (fontmap, "Sans 12", &cached);
+  g_assert_true (memcmp (cached, uncached, 400 * 50) == 0);
+  g_free (cached);
+
+  g_free (uncached);
+
+  pango_ft2_glyph_cache_set_max_size (0);
+  pango_ft2_glyph_cache_get_stats (NULL, NULL, NULL, &size);
+  g_assert_cmpuint (size, ==, 0);
+
+  g_object_unref (fontmap);
+}
+
+int
+main (int argc, char *argv[])
+{
+  g_test_init (&argc, &argv, NULL);
+
+  g_test_add_func ("/ft2/glyph-cache", test_glyph_cache);
+
+  return g_test_run ();
+}
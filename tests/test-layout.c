@@ -223,11 +223,15 @@ parse_params (const gchar        *str,
   g_strfreev (strings);
 }
 
+/* Lays out the markup in @filename, repeated @repeat times
+ * as separate paragraphs, and dumps the result into @string
+ */
 static void
-test_file (const gchar *filename, GString *string)
+test_file (const gchar *filename, GString *string, gboolean parallel, int repeat)
 {
   gchar *contents;
   gchar *markup;
+  GString *repeated;
   gsize  length;
   GError *error = NULL;
   PangoLayout *layout;
@@ -237,6 +241,7 @@ test_file (const gchar *filename, GString *string)
   PangoEllipsizeMode ellipsize = PANGO_ELLIPSIZE_NONE;
   PangoWrapMode wrap = PANGO_WRAP_WORD;
   PangoFontDescription *desc;
+  int i;
 
   if (context == NULL)
     context = pango_font_map_create_context (pango_cairo_font_map_get_default ());
@@ -257,13 +262,23 @@ test_file (const gchar *filename, GString *string)
   pango_layout_set_font_description (layout, desc);
   pango_font_description_free (desc);
 
-  pango_layout_set_markup (layout, markup, length);
+  repeated = g_string_sized_new (repeat * (length + 1));
+  for (i = 0; i < repeat; i++)
+    {
+      if (i > 0)
+        g_string_append_c (repeated, '\n');
+      g_string_append_len (repeated, markup, length);
+    }
+
+  pango_layout_set_markup (layout, repeated->str, repeated->len);
+  g_string_free (repeated, TRUE);
   g_free (contents);
 
   if (width != 0)
     pango_layout_set_width (layout, width * PANGO_SCALE);
   pango_layout_set_ellipsize (layout, ellipsize);
   pango_layout_set_wrap (layout, wrap);
+  pango_layout_set_parallel (layout, parallel);
 
   g_string_append (string, pango_layout_get_text (layout));
   g_string_append (string, "\n--- parameters\n\n");
@@ -306,6 +321,7 @@ test_layout (gconstpointer d)
   GError *error = NULL;
   GString *dump;
   gchar *diff;
+  int parallel;
 
   const char *old_locale = setlocale (LC_ALL, NULL);
   setlocale (LC_ALL, "en_US.utf8");
@@ -322,33 +338,87 @@ test_layout (gconstpointer d)
 
   expected_file = get_expected_filename (filename);
 
-  dump = g_string_sized_new (0);
+  /* Parallel layout must give the same results */
+  for (parallel = 0; parallel < 2; parallel++)
+    {
+      dump = g_string_sized_new (0);
 
-  test_file (filename, dump);
+      test_file (filename, dump, parallel, 1);
 
-  diff = diff_with_file (expected_file, dump->str, dump->len, &error);
-  g_assert_no_error (error);
+      diff = diff_with_file (expected_file, dump->str, dump->len, &error);
+      g_assert_no_error (error);
+
+      if (diff && diff[0])
+        {
+          char **lines = g_strsplit (diff, "\n", -1);
+          const char *line;
+          int i = 0;
+
+          g_test_message ("Contents don't match expected contents%s",
+                          parallel ? " with parallel layout" : "");
+
+          for (line = lines[0]; line != NULL; line = lines[++i])
+            g_test_message ("%s", line);
+
+          g_test_fail ();
+          g_strfreev (lines);
+        }
+
+      g_free (diff);
+      g_string_free (dump, TRUE);
+    }
 
   setlocale (LC_ALL, old_locale);
 
-  if (diff && diff[0])
-    {
-      char **lines = g_strsplit (diff, "\n", -1);
-      const char *line;
-      int i = 0;
+  g_free (expected_file);
+}
 
-      g_test_message ("Contents don't match expected contents");
+/* The texts of the layouts are too short to be cut into several
+ * chunks for break analysis, so repeat each of them until there
+ * is enough text for more than one chunk on 2 or more processors,
+ * and compare parallel layout with layout on one thread
+ */
+#define PARALLEL_TEXT_LENGTH (64 * 1024)
 
-      for (line = lines[0]; line != NULL; line = lines[++i])
-        g_test_message ("%s", line);
+static void
+test_layout_parallel (gconstpointer d)
+{
+  const gchar *filename = d;
+  GString *dump, *parallel_dump;
+  gchar *contents;
+  int repeat;
 
-      g_test_fail ();
-      g_strfreev (lines);
+  const char *old_locale = setlocale (LC_ALL, NULL);
+  setlocale (LC_ALL, "en_US.utf8");
+  if (strstr (setlocale (LC_ALL, NULL), "en_US") == NULL)
+    {
+      char *msg = g_strdup_printf ("Locale en_US.UTF-8 not available, skipping layout %s", filename);
+      g_test_skip (msg);
+      g_free (msg);
+      return;
     }
 
-  g_free (diff);
+  if (g_get_num_processors () < 2)
+    g_test_message ("Only one processor, breaking will not be parallel");
+
+  g_file_get_contents (filename, &contents, NULL, NULL);
+  g_assert_nonnull (contents);
+  repeat = PARALLEL_TEXT_LENGTH / strlen (contents) + 1;
+  g_free (contents);
+
+  dump = g_string_sized_new (0);
+  parallel_dump = g_string_sized_new (0);
+
+  test_file (filename, dump, FALSE, repeat);
+  test_file (filename, parallel_dump, TRUE, repeat);
+
+  g_assert_cmpuint (parallel_dump->len, ==, dump->len);
+  g_assert_true (strcmp (parallel_dump->str, dump->str) == 0);
+
   g_string_free (dump, TRUE);
-  g_free (expected_file);
+  g_string_free (parallel_dump, TRUE);
+
+  setlocale (LC_ALL, old_locale);
 }
 
 int
@@ -367,7 +437,7 @@ main (int argc, char *argv[])
       setlocale (LC_ALL, "en_US.utf8");
 
       string = g_string_sized_new (0);
-      test_file (argv[1], string);
+      test_file (argv[1], string, FALSE, 1);
       g_test_message ("%s", string->str);
 
       return 0;
@@ -388,6 +458,11 @@ main (int argc, char *argv[])
       g_test_add_data_func_full (path, g_test_build_filename (G_TEST_DIST, "layouts", name, NULL),
                                  test_layout, g_free);
       g_free (path);
+
+      path = g_strdup_printf ("/layout/parallel/%s", name);
+      g_test_add_data_func_full (path, g_test_build_filename (G_TEST_DIST, "layouts", name, NULL),
+                                 test_layout_parallel, g_free);
+      g_free (path);
     }
   g_dir_close (dir);
 
@@ -238,6 +238,106 @@ test_list_change (void)
   pango_attr_list_unref (list);
 }
 
+static void
+test_list_out_of_order (void)
+{
+  PangoAttrList *list;
+  PangoAttribute *attr;
+  PangoAttrIterator *iter;
+  GSList *attrs;
+  int i;
+
+  list = pango_attr_list_new ();
+
+  attr = pango_attr_size_new (10);
+  attr->start_index = 30;
+  attr->end_index = 40;
+  pango_attr_list_insert (list, attr);
+  attr = pango_attr_size_new (20);
+  attr->start_index = 10;
+  attr->end_index = 20;
+  pango_attr_list_insert (list, attr);
+  attr = pango_attr_size_new (30);
+  attr->start_index = 10;
+  attr->end_index = 30;
+  pango_attr_list_insert_before (list, attr);
+  attr = pango_attr_size_new (40);
+  attr->start_index = 10;
+  attr->end_index = 40;
+  pango_attr_list_insert (list, attr);
+  attr = pango_attr_size_new (50);
+  attr->start_index = 10;
+  attr->end_index = 50;
+  pango_attr_list_insert_before (list, attr);
+
+  assert_attr_list (list, "[10,50]size=50\n"
+                          "[10,30]size=30\n"
+                          "[10,20]size=20\n"
+                          "[10,40]size=40\n"
+                          "[30,40]size=10\n");
+  pango_attr_list_unref (list);
+
+  /* A list large enough to skip blocks of attributes in change() */
+  list = pango_attr_list_new ();
+
+  for (i = 99; i >= 0; i--)
+    {
+      attr = pango_attr_size_new (i);
+      attr->start_index = i * 10;
+      attr->end_index = i * 10 + 5;
+      pango_attr_list_insert (list, attr);
+    }
+
+  attr = pango_attr_weight_new (PANGO_WEIGHT_BOLD);
+  attr->start_index = 0;
+  attr->end_index = 1000;
+  pango_attr_list_insert (list, attr);
+
+  attr = pango_attr_size_new (50);
+  attr->start_index = 503;
+  attr->end_index = 512;
+  pango_attr_list_change (list, attr);
+
+  attr = pango_attr_size_new (7);
+  attr->start_index = 700;
+  attr->end_index = 703;
+  pango_attr_list_change (list, attr);
+
+  attrs = pango_attr_list_get_attributes (list);
+  g_assert_cmpint (g_slist_length (attrs), ==, 102);
+  g_slist_free_full (attrs, (GDestroyNotify) pango_attribute_destroy);
+
+  iter = pango_attr_list_get_iterator (list);
+  do
+    {
+      int start, end;
+
+      pango_attr_iterator_range (iter, &start, &end);
+      attr = pango_attr_iterator_get (iter, PANGO_ATTR_SIZE);
+
+      if (start == 500)
+        {
+          g_assert_nonnull (attr);
+          g_assert_cmpint (((PangoAttrInt *) attr)->value, ==, 50);
+          g_assert_cmpint (attr->start_index, ==, 500);
+          g_assert_cmpint (attr->end_index, ==, 512);
+        }
+      else if (start == 700)
+        {
+          g_assert_nonnull (attr);
+          g_assert_cmpint (((PangoAttrInt *) attr)->value, ==, 7);
+          g_assert_cmpint (end, ==, 703);
+        }
+
+      if (start < 1000)
+        g_assert_nonnull (pango_attr_iterator_get (iter, PANGO_ATTR_WEIGHT));
+    }
+  while (pango_attr_iterator_next (iter));
+  pango_attr_iterator_destroy (iter);
+
+  pango_attr_list_unref (list);
+}
+
 static void
 test_list_splice (void)
 {
@@ -389,6 +489,69 @@ test_list_filter (void)
   pango_attr_list_unref (out);
 }
 
+static void
+test_list_builder (void)
+{
+  PangoAttrListBuilder *builder;
+  PangoAttrList *list, *copy, *out;
+  PangoAttribute *attr;
+  PangoAttrIterator *iter;
+  int i;
+
+  builder = pango_attr_list_builder_new ();
+
+  /* Adjacent ranges with the same value become one attribute */
+  for (i = 0; i < 10; i++)
+    pango_attr_list_builder_add_color (builder, PANGO_ATTR_FOREGROUND,
+                                       0, 0, i < 5 ? 0xffff : 0,
+                                       i, i + 1);
+
+  pango_attr_list_builder_add_int (builder, PANGO_ATTR_WEIGHT, PANGO_WEIGHT_BOLD, 3, 6);
+  pango_attr_list_builder_add_int (builder, PANGO_ATTR_UNDERLINE, PANGO_UNDERLINE_SINGLE, 0, 2);
+  attr = pango_attr_size_new (10);
+  attr->start_index = 2;
+  attr->end_index = 4;
+  pango_attr_list_builder_add (builder, attr);
+
+  list = pango_attr_list_builder_finish (builder);
+
+  assert_attr_list (list, "[0,5]foreground=#00000000ffff\n"
+                          "[0,2]underline=1\n"
+                          "[2,4]size=10\n"
+                          "[3,6]weight=700\n"
+                          "[5,10]foreground=#000000000000\n");
+
+  iter = pango_attr_list_get_iterator (list);
+  pango_attr_iterator_next (iter);
+  pango_attr_iterator_next (iter);
+  attr = pango_attr_iterator_get (iter, PANGO_ATTR_WEIGHT);
+  g_assert_nonnull (attr);
+  g_assert_cmpint (((PangoAttrInt *)attr)->value, ==, PANGO_WEIGHT_BOLD);
+  pango_attr_iterator_destroy (iter);
+
+  copy = pango_attr_list_copy (list);
+  g_assert_true (pango_attr_list_equal (list, copy));
+
+  /* Filtered attributes outlive the list they came from */
+  out = pango_attr_list_filter (list, just_weight, NULL);
+  pango_attr_list_unref (list);
+  assert_attr_list (out, "[3,6]weight=700\n");
+
+  pango_attr_list_change (copy, pango_attr_weight_new (PANGO_WEIGHT_LIGHT));
+  assert_attr_list (copy, "[0,5]foreground=#00000000ffff\n"
+                          "[0,2]underline=1\n"
+                          "[0,-1]weight=300\n"
+                          "[2,4]size=10\n"
+                          "[5,10]foreground=#000000000000\n");
+
+  pango_attr_list_unref (out);
+  pango_attr_list_unref (copy);
+
+  builder = pango_attr_list_builder_new ();
+  pango_attr_list_builder_add_int (builder, PANGO_ATTR_STYLE, PANGO_STYLE_ITALIC, 0, 1);
+  pango_attr_list_builder_free (builder);
+}
+
 static void
 test_iter (void)
 {
@@ -748,6 +911,115 @@ test_list_equal (void)
   }
 }
 
+static PangoAttrList *
+create_large_list (void)
+{
+  PangoAttrList *list;
+  PangoAttribute *attr;
+  int i;
+
+  list = pango_attr_list_new ();
+
+  /* Out of order, with a few long attributes in between */
+  for (i = 0; i < 1000; i++)
+    {
+      int start = (i * 37) % 1000 * 10;
+
+      attr = pango_attr_size_new (i);
+      attr->start_index = start;
+      attr->end_index = start + (i % 50 == 0 ? 3000 : 5 + i % 20);
+      pango_attr_list_insert (list, attr);
+    }
+
+  return list;
+}
+
+static void
+test_list_range (void)
+{
+  PangoAttrList *list;
+  guint ranges[][2] = { { 0, 1 }, { 0, 10000 }, { 995, 1005 }, { 5000, 5001 },
+                        { 7777, 8100 }, { 9990, 20000 }, { 20000, 30000 } };
+  int i;
+
+  list = create_large_list ();
+
+  for (i = 0; i < G_N_ELEMENTS (ranges); i++)
+    {
+      guint start = ranges[i][0], end = ranges[i][1];
+      GSList *all, *in_range, *l, *r;
+
+      all = pango_attr_list_get_attributes (list);
+      in_range = pango_attr_list_get_attributes_in_range (list, start, end);
+
+      /* Same as checking every attribute, in the same order */
+      r = in_range;
+      for (l = all; l; l = l->next)
+        {
+          PangoAttribute *attr = l->data;
+
+          if (attr->start_index < end && attr->end_index > start)
+            {
+              g_assert_nonnull (r);
+              g_assert_true (pango_attribute_equal (attr, r->data));
+              g_assert_cmpuint (attr->start_index, ==, ((PangoAttribute *) r->data)->start_index);
+              g_assert_cmpuint (attr->end_index, ==, ((PangoAttribute *) r->data)->end_index);
+              r = r->next;
+            }
+        }
+      g_assert_null (r);
+
+      g_slist_free_full (all, (GDestroyNotify) pango_attribute_destroy);
+      g_slist_free_full (in_range, (GDestroyNotify) pango_attribute_destroy);
+    }
+
+  g_assert_null (pango_attr_list_get_attributes_in_range (list, 10, 10));
+
+  pango_attr_list_unref (list);
+}
+
+static gpointer
+read_list (gpointer data)
+{
+  PangoAttrList *list = data;
+  PangoAttrIterator *iter;
+  GSList *attrs;
+  int n = 0;
+
+  iter = pango_attr_list_get_iterator (list);
+  do
+    n++;
+  while (pango_attr_iterator_next (iter));
+  pango_attr_iterator_destroy (iter);
+
+  attrs = pango_attr_list_get_attributes_in_range (list, 1000, 2000);
+  g_slist_free_full (attrs, (GDestroyNotify) pango_attribute_destroy);
+
+  return GINT_TO_POINTER (n);
+}
+
+/* Test that a list that was built out of order
+ * can be read from several threads at once
+ */
+static void
+test_list_threads (void)
+{
+  PangoAttrList *list;
+  GThread *threads[8];
+  int i, n;
+
+  list = create_large_list ();
+
+  for (i = 0; i < G_N_ELEMENTS (threads); i++)
+    threads[i] = g_thread_new ("read", read_list, list);
+
+  n = GPOINTER_TO_INT (g_thread_join (threads[0]));
+  for (i = 1; i < G_N_ELEMENTS (threads); i++)
+    g_assert_cmpint (GPOINTER_TO_INT (g_thread_join (threads[i])), ==, n);
+
+  pango_attr_list_unref (list);
+}
+
 static void
 test_insert (void)
 {
@@ -1041,12 +1313,16 @@ main (int argc, char *argv[])
   g_test_add_func ("/attributes/equal", test_attributes_equal);
   g_test_add_func ("/attributes/list/basic", test_list);
   g_test_add_func ("/attributes/list/change", test_list_change);
+  g_test_add_func ("/attributes/list/out-of-order", test_list_out_of_order);
+  g_test_add_func ("/attributes/list/builder", test_list_builder);
   g_test_add_func ("/attributes/list/splice", test_list_splice);
   g_test_add_func ("/attributes/list/splice2", test_list_splice2);
   g_test_add_func ("/attributes/list/filter", test_list_filter);
   g_test_add_func ("/attributes/list/update", test_list_update);
   g_test_add_func ("/attributes/list/update2", test_list_update2);
   g_test_add_func ("/attributes/list/equal", test_list_equal);
+  g_test_add_func ("/attributes/list/range", test_list_range);
+  g_test_add_func ("/attributes/list/threads", test_list_threads);
   g_test_add_func ("/attributes/list/insert", test_insert);
   g_test_add_func ("/attributes/list/merge", test_merge);
   g_test_add_func ("/attributes/list/merge2", test_merge2);
@@ -21,6 +21,7 @@
 
 #include "config.h"
 #include <glib.h>
+#include <string.h>
 #include <pango/pangocairo.h>
 
 /* test that we don't crash in shape_tab when the layout
@@ -101,6 +102,1501 @@ test_language_emoji_crash (void)
   g_assert (scripts == NULL || num > 0);
 }
 
+static void
+test_shape_cache (void)
+{
+  PangoContext *context;
+  GList *items;
+  PangoItem *item;
+  PangoGlyphString *glyphs1, *glyphs2;
+  const char *text = "Hello, cached world";
+  guint hits, misses;
+  guint hits2, misses2;
+  int i;
+
+  context = pango_font_map_create_context (pango_cairo_font_map_get_default ());
+  items = pango_itemize (context, text, 0, strlen (text), NULL, NULL);
+  g_assert_nonnull (items);
+  item = items->data;
+
+  glyphs1 = pango_glyph_string_new ();
+  glyphs2 = pango_glyph_string_new ();
+
+  pango_shape_cache_set_size (16);
+
+  pango_shape_full (text + item->offset, item->length, text, strlen (text), &item->analysis, glyphs1);
+  pango_shape_cache_get_stats (&hits, &misses);
+
+  pango_shape_full (text + item->offset, item->length, text, strlen (text), &item->analysis, glyphs2);
+  pango_shape_cache_get_stats (&hits2, &misses2);
+
+  g_assert_cmpuint (hits2, ==, hits + 1);
+  g_assert_cmpuint (misses2, ==, misses);
+
+  g_assert_cmpint (glyphs1->num_glyphs, ==, glyphs2->num_glyphs);
+  for (i = 0; i < glyphs1->num_glyphs; i++)
+    {
+      g_assert_cmpuint (glyphs1->glyphs[i].glyph, ==, glyphs2->glyphs[i].glyph);
+      g_assert_cmpint (glyphs1->glyphs[i].geometry.width, ==, glyphs2->glyphs[i].geometry.width);
+      g_assert_cmpint (glyphs1->log_clusters[i], ==, glyphs2->log_clusters[i]);
+    }
+
+  /* A disabled cache neither hits nor misses */
+  pango_shape_cache_set_size (0);
+  pango_shape_full (text + item->offset, item->length, text, strlen (text), &item->analysis, glyphs2);
+  pango_shape_cache_get_stats (&hits, &misses);
+  g_assert_cmpuint (hits, ==, hits2);
+  g_assert_cmpuint (misses, ==, misses2);
+
+  pango_shape_cache_set_size (1024);
+
+  pango_glyph_string_free (glyphs1);
+  pango_glyph_string_free (glyphs2);
+  g_list_free_full (items, (GDestroyNotify)pango_item_free);
+  g_object_unref (context);
+}
+
+/* Test that cached shaping results don't keep their font alive */
+static void
+test_shape_cache_font_lifetime (void)
+{
+  PangoFontMap *fontmap;
+  PangoContext *context;
+  GList *items;
+  PangoItem *item;
+  PangoGlyphString *glyphs;
+  PangoFont *font;
+  const char *text = "Short lived font";
+
+  fontmap = pango_cairo_font_map_new ();
+  context = pango_font_map_create_context (fontmap);
+  items = pango_itemize (context, text, 0, strlen (text), NULL, NULL);
+  item = items->data;
+
+  glyphs = pango_glyph_string_new ();
+  pango_shape_full (text + item->offset, item->length, text, strlen (text), &item->analysis, glyphs);
+  pango_glyph_string_free (glyphs);
+
+  font = item->analysis.font;
+  g_object_add_weak_pointer (G_OBJECT (font), (gpointer *) &font);
+
+  g_list_free_full (items, (GDestroyNotify)pango_item_free);
+  g_object_unref (context);
+  g_object_unref (fontmap);
+
+  g_assert_null (font);
+}
+
+static void
+shape_with_attrs (PangoContext     *context,
+                  const char       *text,
+                  PangoAttrList    *attrs,
+                  PangoGlyphString *glyphs)
+{
+  GList *items;
+  PangoItem *item;
+
+  items = pango_itemize (context, text, 0, strlen (text), attrs, NULL);
+  g_assert_nonnull (items);
+  item = items->data;
+
+  pango_shape_full (text + item->offset, item->length, text, strlen (text), &item->analysis, glyphs);
+
+  g_list_free_full (items, (GDestroyNotify)pango_item_free);
+}
+
+static PangoFont *
+get_first_font (PangoContext *context,
+                const char   *text)
+{
+  GList *items;
+  PangoFont *font;
+
+  items = pango_itemize (context, text, 0, strlen (text), NULL, NULL);
+  g_assert_nonnull (items);
+  font = g_object_ref (((PangoItem *) items->data)->analysis.font);
+
+  g_list_free_full (items, (GDestroyNotify)pango_item_free);
+
+  return font;
+}
+
+/* Test that shaping with and without show flags, which use
+ * different wrappers around the HarfBuzz font of the font,
+ * leaves that font alone, and that the results don't get
+ * mixed up when shaping alternates between them
+ */
+static void
+test_shape_show_flags (void)
+{
+  PangoContext *context;
+  PangoAttrList *attrs;
+  PangoGlyphString *plain, *shown, *glyphs;
+  PangoFont *font;
+  hb_font_t *hb_font;
+  const char *text = "a b c";
+  int i, j;
+
+  pango_shape_cache_set_size (0);
+
+  context = pango_font_map_create_context (pango_cairo_font_map_get_default ());
+  attrs = pango_attr_list_new ();
+  pango_attr_list_insert (attrs, pango_attr_show_new (PANGO_SHOW_SPACES));
+
+  plain = pango_glyph_string_new ();
+  shown = pango_glyph_string_new ();
+  glyphs = pango_glyph_string_new ();
+
+  font = get_first_font (context, text);
+  hb_font = pango_font_get_hb_font (font);
+  g_assert_nonnull (hb_font);
+
+  shape_with_attrs (context, text, NULL, plain);
+  shape_with_attrs (context, text, attrs, shown);
+
+  g_assert_cmpint (plain->num_glyphs, ==, shown->num_glyphs);
+  g_assert_false (plain->glyphs[1].glyph & PANGO_GLYPH_UNKNOWN_FLAG);
+  g_assert_true (shown->glyphs[1].glyph & PANGO_GLYPH_UNKNOWN_FLAG);
+
+  for (i = 0; i < 4; i++)
+    {
+      PangoGlyphString *expected = i % 2 ? shown : plain;
+
+      shape_with_attrs (context, text, i % 2 ? attrs : NULL, glyphs);
+
+      g_assert_cmpint (glyphs->num_glyphs, ==, expected->num_glyphs);
+      for (j = 0; j < glyphs->num_glyphs; j++)
+        g_assert_cmpuint (glyphs->glyphs[j].glyph, ==, expected->glyphs[j].glyph);
+
+      /* The wrappers are made on top of the font's own
+       * HarfBuzz font, which stays the same and immutable
+       */
+      g_assert_true (pango_font_get_hb_font (font) == hb_font);
+      g_assert_true (hb_font_is_immutable (hb_font));
+    }
+
+  g_object_unref (font);
+  pango_glyph_string_free (plain);
+  pango_glyph_string_free (shown);
+  pango_glyph_string_free (glyphs);
+  pango_attr_list_unref (attrs);
+  g_object_unref (context);
+
+  pango_shape_cache_set_size (1024);
+}
+
+static void
+assert_layouts_equal (PangoLayout *layout,
+                      PangoLayout *expected)
+{
+  const PangoLogAttr *attrs, *expected_attrs;
+  int n_attrs, n_expected_attrs;
+  int width, height, expected_width, expected_height;
+  int i;
+
+  g_assert_cmpstr (pango_layout_get_text (layout), ==, pango_layout_get_text (expected));
+  g_assert_cmpint (pango_layout_get_line_count (layout), ==, pango_layout_get_line_count (expected));
+
+  for (i = 0; i < pango_layout_get_line_count (layout); i++)
+    {
+      PangoLayoutLine *line = pango_layout_get_line_readonly (layout, i);
+      PangoLayoutLine *expected_line = pango_layout_get_line_readonly (expected, i);
+
+      g_assert_cmpint (line->start_index, ==, expected_line->start_index);
+      g_assert_cmpint (line->length, ==, expected_line->length);
+      g_assert_cmpint (line->is_paragraph_start, ==, expected_line->is_paragraph_start);
+      g_assert_cmpint (line->resolved_dir, ==, expected_line->resolved_dir);
+      g_assert_cmpint (g_slist_length (line->runs), ==, g_slist_length (expected_line->runs));
+    }
+
+  attrs = pango_layout_get_log_attrs_readonly (layout, &n_attrs);
+  expected_attrs = pango_layout_get_log_attrs_readonly (expected, &n_expected_attrs);
+  g_assert_cmpint (n_attrs, ==, n_expected_attrs);
+  g_assert_true (memcmp (attrs, expected_attrs, n_attrs * sizeof (PangoLogAttr)) == 0);
+
+  pango_layout_get_size (layout, &width, &height);
+  pango_layout_get_size (expected, &expected_width, &expected_height);
+  g_assert_cmpint (width, ==, expected_width);
+  g_assert_cmpint (height, ==, expected_height);
+}
+
+/* Returns the lines of the first @n_before and the last @n_after
+ * paragraphs of @layout, in order
+ */
+static GPtrArray *
+get_kept_lines (PangoLayout *layout,
+                int          n_before,
+                int          n_after)
+{
+  GPtrArray *lines;
+  GSList *l;
+  int n_paragraphs, para;
+
+  n_paragraphs = 0;
+  for (l = pango_layout_get_lines_readonly (layout); l; l = l->next)
+    {
+      PangoLayoutLine *line = l->data;
+
+      if (line->is_paragraph_start)
+        n_paragraphs++;
+    }
+
+  lines = g_ptr_array_new_with_free_func ((GDestroyNotify) pango_layout_line_unref);
+
+  para = -1;
+  for (l = pango_layout_get_lines_readonly (layout); l; l = l->next)
+    {
+      PangoLayoutLine *line = l->data;
+
+      if (line->is_paragraph_start)
+        para++;
+
+      if (para < n_before || para >= n_paragraphs - n_after)
+        g_ptr_array_add (lines, pango_layout_line_ref (line));
+    }
+
+  return lines;
+}
+
+/* Test that editing a laid out layout gives the same result
+ * as laying out the new text, and keeps the lines of the
+ * paragraphs before and after the change
+ */
+static void
+test_layout_replace_text (void)
+{
+  struct {
+    const char *text;
+    int start;
+    int old_length;
+    const char *insert;
+    int kept_before;
+    int kept_after;
+  } tests[] = {
+    { "one two\nthree four\nfive six", 12, 0, "and a half ", 1, 1 },
+    { "one two\nthree four\nfive six", 7, 1, "", 0, 1 },
+    { "one two\nthree four\nfive six", 3, 1, "\n", 0, 2 },
+    { "one two\nthree four\nfive six", 0, 0, "zero\n", 0, 3 },
+    { "one two\nthree four\nfive six", 27, 0, " seven\n", 2, 0 },
+    { "one two\nthree four\nfive six", 8, 0, "new paragraph\n", 1, 2 },
+    { "one two\rthree four\nfive six", 8, 0, "\n", 0, 2 },
+    { "one two\nthree four\nfive six", 0, 27, "all gone", 0, 0 },
+    /* The inserted paragraph changes the direction of the next one */
+    { "abc\n123\nghi", 4, 0, "\xd7\xa9\xd7\x9c\xd7\x95\xd7\x9d ", 1, 0 },
+    /* The base direction of the layout changes */
+    { "\xd7\xa9\xd7\x9c\xd7\x95\xd7\x9d\n123\nabc", 0, 8, "xyz", 0, 0 },
+  };
+  PangoContext *context;
+  int i;
+
+  context = pango_font_map_create_context (pango_cairo_font_map_get_default ());
+
+  for (i = 0; i < G_N_ELEMENTS (tests); i++)
+    {
+      PangoLayout *layout, *expected;
+      PangoAttrList *attrs;
+      GPtrArray *before, *after;
+      GString *str;
+      guint j;
+
+      layout = pango_layout_new (context);
+      pango_layout_set_width (layout, 60 * PANGO_SCALE);
+      pango_layout_set_text (layout, tests[i].text, -1);
+
+      attrs = pango_attr_list_new ();
+      pango_attr_list_insert (attrs, pango_attr_weight_new (PANGO_WEIGHT_BOLD));
+      pango_layout_set_attributes (layout, attrs);
+      pango_attr_list_unref (attrs);
+
+      /* lay it out first */
+      pango_layout_get_line_count (layout);
+
+      before = get_kept_lines (layout, tests[i].kept_before, tests[i].kept_after);
+
+      pango_layout_replace_text (layout, tests[i].start, tests[i].old_length, tests[i].insert, -1);
+
+      after = get_kept_lines (layout, tests[i].kept_before, tests[i].kept_after);
+
+      g_assert_cmpuint (after->len, ==, before->len);
+      for (j = 0; j < before->len; j++)
+        {
+          PangoLayoutLine *line = g_ptr_array_index (after, j);
+
+          g_assert_true (line == g_ptr_array_index (before, j));
+          g_assert_true (line->layout == layout);
+        }
+
+      g_ptr_array_unref (before);
+      g_ptr_array_unref (after);
+
+      str = g_string_new (tests[i].text);
+      g_string_erase (str, tests[i].start, tests[i].old_length);
+      g_string_insert (str, tests[i].start, tests[i].insert);
+
+      expected = pango_layout_new (context);
+      pango_layout_set_width (expected, 60 * PANGO_SCALE);
+      pango_layout_set_text (expected, str->str, -1);
+      pango_layout_set_attributes (expected, pango_layout_get_attributes (layout));
+
+      assert_layouts_equal (layout, expected);
+
+      g_string_free (str, TRUE);
+      g_object_unref (expected);
+      g_object_unref (layout);
+    }
+
+  g_object_unref (context);
+}
+
+static void
+insert_paragraph (const char    *text,
+                  int            length,
+                  PangoAttrList *attrs,
+                  gpointer       user_data)
+{
+  PangoLayout *layout = user_data;
+  const char *end;
+
+  /* Only complete paragraphs, except maybe for the last one */
+  end = pango_layout_get_text (layout);
+  end += strlen (end);
+  g_assert_true (end == pango_layout_get_text (layout) || end[-1] == '\n');
+
+  pango_layout_insert_text (layout, strlen (pango_layout_get_text (layout)),
+                            text, length, attrs);
+
+  /* Lay out as we go */
+  pango_layout_get_line_count (layout);
+}
+
+/* Test that streaming markup into a layout gives
+ * the same result as setting all of the markup
+ */
+static void
+test_markup_streaming (void)
+{
+  const char *markup =
+    "<b>one</b> two\n"
+    "<span foreground=\"red\">three\nfour <i>five\n\nsix</i></span>\n"
+    "<span size=\"larger\">seven <u>eight</u>\nnine</span> ten";
+  PangoContext *context;
+  PangoLayout *layout, *expected;
+  GMarkupParseContext *parser;
+  PangoAttrList *attrs;
+  char *text;
+  GError *error = NULL;
+  int chunk;
+
+  context = pango_font_map_create_context (pango_cairo_font_map_get_default ());
+
+  expected = pango_layout_new (context);
+  pango_layout_set_width (expected, 60 * PANGO_SCALE);
+  pango_layout_set_markup (expected, markup, -1);
+
+  for (chunk = 1; chunk < 20; chunk += 6)
+    {
+      int pos;
+
+      layout = pango_layout_new (context);
+      pango_layout_set_width (layout, 60 * PANGO_SCALE);
+      pango_layout_get_line_count (layout);
+
+      parser = pango_markup_parser_new_streaming (0, insert_paragraph,
+                                                  g_object_ref (layout),
+                                                  g_object_unref);
+
+      for (pos = 0; pos < strlen (markup); pos += chunk)
+        {
+          g_markup_parse_context_parse (parser, markup + pos,
+                                        MIN (chunk, strlen (markup) - pos),
+                                        &error);
+          g_assert_no_error (error);
+        }
+
+      pango_markup_parser_finish (parser, &attrs, &text, NULL, &error);
+      g_assert_no_error (error);
+      g_assert_cmpstr (text, ==, "");
+      g_assert_true (pango_attr_list_get_attributes (attrs) == NULL);
+      g_markup_parse_context_free (parser);
+
+      assert_layouts_equal (layout, expected);
+      g_assert_true (pango_attr_list_equal (pango_layout_get_attributes (layout),
+                                            pango_layout_get_attributes (expected)));
+
+      pango_attr_list_unref (attrs);
+      g_free (text);
+      g_object_unref (layout);
+    }
+
+  g_object_unref (expected);
+  g_object_unref (context);
+}
+
+/* Test that attributes that apply to no text at the end
+ * of streamed markup are not returned
+ */
+static void
+test_markup_streaming_empty_end (void)
+{
+  const char *markups[] = {
+    "<b>one</b><span foreground=\"red\"></span>",
+    "one\n<i></i>",
+    "<u>one\n</u>",
+    "<span size=\"larger\"></span>",
+  };
+  PangoContext *context;
+  int i;
+
+  context = pango_font_map_create_context (pango_cairo_font_map_get_default ());
+
+  for (i = 0; i < G_N_ELEMENTS (markups); i++)
+    {
+      PangoLayout *layout;
+      GMarkupParseContext *parser;
+      PangoAttrList *attrs;
+      char *text;
+      GError *error = NULL;
+
+      layout = pango_layout_new (context);
+
+      parser = pango_markup_parser_new_streaming (0, insert_paragraph,
+                                                  g_object_ref (layout),
+                                                  g_object_unref);
+
+      g_markup_parse_context_parse (parser, markups[i], -1, &error);
+      g_assert_no_error (error);
+
+      pango_markup_parser_finish (parser, &attrs, &text, NULL, &error);
+      g_assert_no_error (error);
+      g_assert_cmpstr (text, ==, "");
+      g_assert_true (pango_attr_list_get_attributes (attrs) == NULL);
+      g_markup_parse_context_free (parser);
+
+      pango_attr_list_unref (attrs);
+      g_free (text);
+      g_object_unref (layout);
+    }
+
+  g_object_unref (context);
+}
+
+/* Test that lazy layouts produce the same lines as
+ * layouts that are laid out at once
+ */
+static void
+test_layout_lazy (void)
+{
+  PangoContext *context;
+  PangoLayout *layout, *expected;
+  PangoLayoutIter *iter, *expected_iter;
+  GString *str;
+  int i, index, trailing, expected_index, expected_trailing;
+  int height;
+
+  context = pango_font_map_create_context (pango_cairo_font_map_get_default ());
+
+  str = g_string_new ("");
+  for (i = 0; i < 200; i++)
+    g_string_append_printf (str, "Paragraph %d has some words that will wrap.\n", i);
+
+  layout = pango_layout_new (context);
+  pango_layout_set_lazy (layout, TRUE);
+  pango_layout_set_width (layout, 100 * PANGO_SCALE);
+  pango_layout_set_text (layout, str->str, -1);
+
+  expected = pango_layout_new (context);
+  pango_layout_set_width (expected, 100 * PANGO_SCALE);
+  pango_layout_set_text (expected, str->str, -1);
+
+  g_assert_true (pango_layout_get_lazy (layout));
+  g_assert_nonnull (pango_layout_get_line_readonly (layout, 3));
+  g_assert_cmpint (pango_layout_get_estimated_height (layout), >, 0);
+
+  pango_layout_xy_to_index (layout, 0, 50 * PANGO_SCALE, &index, &trailing);
+  pango_layout_xy_to_index (expected, 0, 50 * PANGO_SCALE, &expected_index, &expected_trailing);
+  g_assert_cmpint (index, ==, expected_index);
+  g_assert_cmpint (trailing, ==, expected_trailing);
+
+  iter = pango_layout_get_iter (layout);
+  expected_iter = pango_layout_get_iter (expected);
+  do
+    {
+      PangoRectangle logical, expected_logical;
+
+      g_assert_cmpint (pango_layout_iter_get_index (iter), ==, pango_layout_iter_get_index (expected_iter));
+      g_assert_cmpint (pango_layout_iter_get_baseline (iter), ==, pango_layout_iter_get_baseline (expected_iter));
+
+      pango_layout_iter_get_line_extents (iter, NULL, &logical);
+      pango_layout_iter_get_line_extents (expected_iter, NULL, &expected_logical);
+      g_assert_cmpint (logical.y, ==, expected_logical.y);
+      g_assert_cmpint (logical.height, ==, expected_logical.height);
+
+      g_assert_cmpint (pango_layout_iter_at_last_line (iter), ==, pango_layout_iter_at_last_line (expected_iter));
+    }
+  while (pango_layout_iter_next_line (iter) && pango_layout_iter_next_line (expected_iter));
+
+  g_assert_false (pango_layout_iter_next_line (expected_iter));
+  pango_layout_iter_free (iter);
+  pango_layout_iter_free (expected_iter);
+
+  pango_layout_get_size (expected, NULL, &height);
+  g_assert_cmpint (pango_layout_get_estimated_height (layout), ==, height);
+  g_assert_cmpint (pango_layout_get_line_count (layout), ==, pango_layout_get_line_count (expected));
+
+  g_string_free (str, TRUE);
+  g_object_unref (expected);
+  g_object_unref (layout);
+  g_object_unref (context);
+}
+
+/* Compares line lookups of @layout, which go through its line
+ * table, with walking the lines with an iterator
+ */
+static void
+check_line_lookups (PangoLayout *layout)
+{
+  PangoLayoutIter *iter;
+  PangoRectangle logical, pos;
+  int i, line, x_pos, index, trailing, expected_index, expected_trailing;
+  int y0, y1;
+
+  /* Lazy layouts get laid out as the lookups go */
+  iter = pango_layout_get_iter (layout);
+  i = 0;
+  do
+    {
+      PangoLayoutLine *l = pango_layout_iter_get_line_readonly (iter);
+
+      g_assert_true (pango_layout_get_line_readonly (layout, i) == l);
+
+      pango_layout_iter_get_line_extents (iter, NULL, &logical);
+      pango_layout_iter_get_line_yrange (iter, &y0, &y1);
+
+      pango_layout_index_to_pos (layout, l->start_index, &pos);
+      g_assert_cmpint (pos.y, ==, logical.y);
+      g_assert_cmpint (pos.height, ==, logical.height);
+
+      pango_layout_line_x_to_index (l, 10 * PANGO_SCALE - logical.x,
+                                    &expected_index, &expected_trailing);
+
+      pango_layout_xy_to_index (layout, 10 * PANGO_SCALE, y0, &index, &trailing);
+      g_assert_cmpint (index, ==, expected_index);
+      g_assert_cmpint (trailing, ==, expected_trailing);
+
+      pango_layout_xy_to_index (layout, 10 * PANGO_SCALE, y1 - 1, &index, &trailing);
+      g_assert_cmpint (index, ==, expected_index);
+      g_assert_cmpint (trailing, ==, expected_trailing);
+
+      pango_layout_index_to_line_x (layout, l->start_index, FALSE, &line, &x_pos);
+      g_assert_cmpint (line, ==, i);
+
+      i++;
+    }
+  while (pango_layout_iter_next_line (iter));
+  pango_layout_iter_free (iter);
+
+  g_assert_cmpint (i, ==, pango_layout_get_line_count (layout));
+  g_assert_null (pango_layout_get_line_readonly (layout, i));
+
+  /* Off the top and the bottom */
+  g_assert_false (pango_layout_xy_to_index (layout, 0, -1, &index, &trailing));
+  g_assert_cmpint (index, ==, 0);
+  g_assert_false (pango_layout_xy_to_index (layout, 0, y1, &index, &trailing));
+}
+
+/* Test that finding lines by number, index and position
+ * agrees with walking the lines, also after the lines change
+ */
+static void
+test_layout_line_table (void)
+{
+  PangoContext *context;
+  PangoLayout *layout;
+  GString *str;
+  int i;
+
+  context = pango_font_map_create_context (pango_cairo_font_map_get_default ());
+
+  str = g_string_new ("");
+  for (i = 0; i < 50; i++)
+    g_string_append_printf (str, "Paragraph %d has some words that will wrap.\n%s", i,
+                            i % 7 == 0 ? "\n" : "");
+
+  layout = pango_layout_new (context);
+  pango_layout_set_width (layout, 100 * PANGO_SCALE);
+  pango_layout_set_spacing (layout, 3 * PANGO_SCALE + 1);
+  pango_layout_set_text (layout, str->str, -1);
+
+  check_line_lookups (layout);
+
+  pango_layout_insert_text (layout, 20, "A few more words to wrap\n", -1, NULL);
+  check_line_lookups (layout);
+
+  pango_layout_set_width (layout, -1);
+  pango_layout_set_alignment (layout, PANGO_ALIGN_CENTER);
+  check_line_lookups (layout);
+
+  pango_layout_set_width (layout, 100 * PANGO_SCALE);
+  pango_layout_set_lazy (layout, TRUE);
+  check_line_lookups (layout);
+
+  g_string_free (str, TRUE);
+  g_object_unref (layout);
+  g_object_unref (context);
+}
+
+/* Test that iterators that start in the middle of a layout
+ * agree with iterators that start at the top
+ */
+static void
+test_layout_iter_at_line (void)
+{
+  PangoContext *context;
+  PangoLayout *layout;
+  PangoLayoutIter *iter, *iter2;
+  GString *str;
+  int i, n;
+
+  context = pango_font_map_create_context (pango_cairo_font_map_get_default ());
+
+  str = g_string_new ("");
+  for (i = 0; i < 20; i++)
+    g_string_append_printf (str, "Paragraph %d has some words that will wrap.\n", i);
+
+  layout = pango_layout_new (context);
+  pango_layout_set_width (layout, 100 * PANGO_SCALE);
+  pango_layout_set_spacing (layout, 2 * PANGO_SCALE);
+  pango_layout_set_text (layout, str->str, -1);
+
+  n = pango_layout_get_line_count (layout);
+  g_assert_null (pango_layout_get_iter_at_line (layout, n));
+
+  iter = pango_layout_get_iter (layout);
+  i = 0;
+  do
+    {
+      PangoRectangle logical, logical2;
+      int y0, y1;
+
+      pango_layout_iter_get_line_extents (iter, NULL, &logical);
+      pango_layout_iter_get_line_yrange (iter, &y0, &y1);
+
+      iter2 = pango_layout_get_iter_at_line (layout, i);
+      pango_layout_iter_get_line_extents (iter2, NULL, &logical2);
+      g_assert_cmpint (logical2.y, ==, logical.y);
+      g_assert_cmpint (logical2.height, ==, logical.height);
+      g_assert_cmpint (pango_layout_iter_get_baseline (iter2), ==, pango_layout_iter_get_baseline (iter));
+      g_assert_cmpint (pango_layout_iter_get_index (iter2), ==, pango_layout_iter_get_index (iter));
+
+      /* Moving on measures the next line like the other iterator */
+      if (pango_layout_iter_next_line (iter2))
+        {
+          PangoLayoutIter *next = pango_layout_iter_copy (iter);
+
+          g_assert_true (pango_layout_iter_next_line (next));
+          g_assert_cmpint (pango_layout_iter_get_baseline (iter2), ==, pango_layout_iter_get_baseline (next));
+          pango_layout_iter_free (next);
+        }
+      pango_layout_iter_free (iter2);
+
+      iter2 = pango_layout_get_iter_at_y (layout, (y0 + y1) / 2);
+      g_assert_cmpint (pango_layout_iter_get_baseline (iter2), ==, pango_layout_iter_get_baseline (iter));
+      pango_layout_iter_free (iter2);
+
+      i++;
+    }
+  while (pango_layout_iter_next_line (iter));
+  pango_layout_iter_free (iter);
+
+  g_assert_cmpint (i, ==, n);
+
+  g_string_free (str, TRUE);
+  g_object_unref (layout);
+  g_object_unref (context);
+}
+
+/* Test that parallel layout of a long text gives the
+ * same result as laying it out on one thread
+ */
+static void
+test_layout_parallel (void)
+{
+  PangoContext *context;
+  PangoLayout *layout, *expected;
+  GString *str;
+  int i;
+
+  context = pango_font_map_create_context (pango_cairo_font_map_get_default ());
+
+  str = g_string_new ("");
+  for (i = 0; i < 2000; i++)
+    g_string_append_printf (str, "Paragraph %d: some text, \xd7\xa9\xd7\x9c\xd7\x95\xd7\x9d and more text.%s",
+                            i, i % 7 == 0 ? "\r\n" : "\n");
+
+  layout = pango_layout_new (context);
+  pango_layout_set_parallel (layout, TRUE);
+  pango_layout_set_width (layout, 150 * PANGO_SCALE);
+  pango_layout_set_text (layout, str->str, -1);
+
+  expected = pango_layout_new (context);
+  pango_layout_set_width (expected, 150 * PANGO_SCALE);
+  pango_layout_set_text (expected, str->str, -1);
+
+  g_assert_true (pango_layout_get_parallel (layout));
+  assert_layouts_equal (layout, expected);
+
+  g_string_free (str, TRUE);
+  g_object_unref (expected);
+  g_object_unref (layout);
+  g_object_unref (context);
+}
+
+/* Test that layouts that get their lines from the paragraph
+ * cache come out the same as layouts that don't
+ */
+static void
+test_layout_paragraph_cache (void)
+{
+  const char *markup =
+    "Some <b>bold</b> text that is long enough to wrap\n"
+    "\xd7\xa9\xd7\x9c\xd7\x95\xd7\x9d \xd7\xa2\xd7\x95\xd7\x9c\xd7\x9d and some text\n"
+    "Some text that is long enough to wrap\n"
+    "Some text that is long enough to wrap\n";
+  PangoContext *context, *cached_context;
+  PangoLayout *layout, *expected;
+  guint hits, misses, hits2, misses2;
+  int i;
+
+  context = pango_font_map_create_context (pango_cairo_font_map_get_default ());
+  cached_context = pango_font_map_create_context (pango_cairo_font_map_get_default ());
+  pango_context_set_paragraph_cache_size (cached_context, 16);
+  g_assert_cmpuint (pango_context_get_paragraph_cache_size (cached_context), ==, 16);
+
+  for (i = 0; i < 3; i++)
+    {
+      layout = pango_layout_new (cached_context);
+      pango_layout_set_width (layout, 100 * PANGO_SCALE);
+      pango_layout_set_ellipsize (layout, i == 2 ? PANGO_ELLIPSIZE_END : PANGO_ELLIPSIZE_NONE);
+      pango_layout_set_markup (layout, markup, -1);
+
+      expected = pango_layout_new (context);
+      pango_layout_set_width (expected, 100 * PANGO_SCALE);
+      pango_layout_set_ellipsize (expected, i == 2 ? PANGO_ELLIPSIZE_END : PANGO_ELLIPSIZE_NONE);
+      pango_layout_set_markup (expected, markup, -1);
+
+      assert_layouts_equal (layout, expected);
+
+      pango_context_get_paragraph_cache_stats (cached_context, &hits, &misses);
+      if (i == 0)
+        {
+          /* The fourth paragraph is the same as the third one */
+          g_assert_cmpuint (hits, ==, 1);
+          g_assert_cmpuint (misses, ==, 4);
+        }
+      else if (i == 1)
+        {
+          g_assert_cmpuint (hits, ==, 6);
+          g_assert_cmpuint (misses, ==, 4);
+        }
+
+      g_object_unref (expected);
+      g_object_unref (layout);
+    }
+
+  /* Changing the context drops the cached paragraphs */
+  pango_context_get_paragraph_cache_stats (cached_context, &hits, &misses);
+  pango_context_set_base_dir (cached_context, PANGO_DIRECTION_RTL);
+  pango_context_set_base_dir (context, PANGO_DIRECTION_RTL);
+
+  layout = pango_layout_new (cached_context);
+  pango_layout_set_auto_dir (layout, FALSE);
+  pango_layout_set_markup (layout, markup, -1);
+
+  expected = pango_layout_new (context);
+  pango_layout_set_auto_dir (expected, FALSE);
+  pango_layout_set_markup (expected, markup, -1);
+
+  assert_layouts_equal (layout, expected);
+
+  pango_context_get_paragraph_cache_stats (cached_context, &hits2, &misses2);
+  g_assert_cmpuint (hits2 - hits, ==, 1);
+  g_assert_cmpuint (misses2 - misses, ==, 4);
+
+  g_object_unref (expected);
+  g_object_unref (layout);
+
+  pango_context_set_paragraph_cache_size (cached_context, 0);
+  g_object_unref (cached_context);
+  g_object_unref (context);
+}
+
+/* Test that rewrapping a layout, which reuses the shaping
+ * of its paragraphs, gives the same result as a new layout
+ */
+static void
+test_layout_rewrap (void)
+{
+  const char *markup =
+    "Some <b>bold</b> text that is long enough to wrap\n"
+    "\xd7\xa9\xd7\x9c\xd7\x95\xd7\x9d \xd7\xa2\xd7\x95\xd7\x9c\xd7\x9d and some text\n"
+    "Tabs\tin\tbetween <span letter_spacing=\"1024\">spaced out</span>\n"
+    "\n"
+    "Averyveryverylongwordthatdoesnotfitintoaline";
+  int widths[] = { 100, 60, 200, 30, -1, 60, 100 };
+  PangoContext *context;
+  PangoLayout *layout;
+  int i, j;
+
+  context = pango_font_map_create_context (pango_cairo_font_map_get_default ());
+
+  for (i = 0; i < 2; i++)
+    {
+      layout = pango_layout_new (context);
+      pango_layout_set_wrap (layout, i == 0 ? PANGO_WRAP_WORD : PANGO_WRAP_WORD_CHAR);
+      pango_layout_set_markup (layout, markup, -1);
+
+      for (j = 0; j < G_N_ELEMENTS (widths); j++)
+        {
+          PangoLayout *expected;
+          int width = widths[j] < 0 ? -1 : widths[j] * PANGO_SCALE;
+
+          pango_layout_set_width (layout, width);
+
+          expected = pango_layout_new (context);
+          pango_layout_set_wrap (expected, i == 0 ? PANGO_WRAP_WORD : PANGO_WRAP_WORD_CHAR);
+          pango_layout_set_markup (expected, markup, -1);
+          pango_layout_set_width (expected, width);
+
+          assert_layouts_equal (layout, expected);
+
+          g_object_unref (expected);
+        }
+
+      /* Editing the text drops the retained shaping */
+      pango_layout_replace_text (layout, 0, 4, "More", -1);
+      pango_layout_set_width (layout, 80 * PANGO_SCALE);
+      g_assert_cmpint (pango_layout_get_line_count (layout), >, 1);
+      pango_layout_set_width (layout, 40 * PANGO_SCALE);
+      g_assert_cmpint (pango_layout_get_line_count (layout), >, 1);
+
+      g_object_unref (layout);
+    }
+
+  g_object_unref (context);
+}
+
+/* Test that optimal line breaking makes lines that cover the
+ * text and fit, also when rewrapping, and breaks words with
+ * PANGO_WRAP_WORD_CHAR only when they don't fit otherwise
+ */
+static void
+test_layout_optimal_breaks (void)
+{
+  const char *texts[] = {
+    "Far out in the uncharted backwaters of the unfashionable end of the "
+    "western spiral arm of the Galaxy lies a small unregarded yellow sun. "
+    "Orbiting this at a distance of roughly ninety-two million miles is an "
+    "utterly insignificant little blue green planet.\n"
+    "Whose ape-descended life forms are so amazingly primitive that they "
+    "still think digital watches are a pretty neat idea.",
+    "Some \xd7\xa9\xd7\x9c\xd7\x95\xd7\x9d words and a hyphen\xc2\xadated "
+    "Averyveryverylongwordthatdoesnotfitintoaline and more words after it",
+  };
+  int widths[] = { 150, 80, 300 };
+  PangoContext *context;
+  int i, j, k;
+
+  context = pango_font_map_create_context (pango_cairo_font_map_get_default ());
+
+  for (i = 0; i < G_N_ELEMENTS (texts); i++)
+    for (j = 0; j < 4; j++)
+      {
+        PangoLayout *layout;
+
+        layout = pango_layout_new (context);
+        pango_layout_set_text (layout, texts[i], -1);
+        pango_layout_set_justify (layout, j % 2);
+        pango_layout_set_wrap (layout, j < 2 ? PANGO_WRAP_WORD_CHAR : PANGO_WRAP_WORD);
+        pango_layout_set_line_breaking (layout, PANGO_LINE_BREAKING_OPTIMAL);
+        g_assert_cmpint (pango_layout_get_line_breaking (layout), ==, PANGO_LINE_BREAKING_OPTIMAL);
+
+        for (k = 0; k < G_N_ELEMENTS (widths); k++)
+          {
+            int index = 0;
+            int n;
+
+            pango_layout_set_width (layout, widths[k] * PANGO_SCALE);
+            g_assert_cmpint (pango_layout_get_line_count (layout), >, 1);
+
+            for (n = 0; n < pango_layout_get_line_count (layout); n++)
+              {
+                PangoLayoutLine *line = pango_layout_get_line_readonly (layout, n);
+                const char *text = pango_layout_get_text (layout);
+                PangoRectangle logical;
+
+                /* Skip the paragraph delimiter */
+                if (line->start_index > index && text[index] == '\n')
+                  index++;
+                g_assert_cmpint (line->start_index, ==, index);
+                index += line->length;
+
+                /* Only the long word does not fit without char breaks */
+                pango_layout_line_get_extents (line, NULL, &logical);
+                if (j < 2 || !strstr (text + line->start_index, "Avery") ||
+                    strstr (text + line->start_index, "Avery") >= text + index)
+                  g_assert_cmpint (logical.width, <=, widths[k] * PANGO_SCALE);
+              }
+
+            g_assert_cmpint (index, ==, strlen (texts[i]));
+          }
+
+        g_object_unref (layout);
+      }
+
+  g_object_unref (context);
+}
+
+/* Sums up the squares of the room left on lines that are not
+ * the last of their paragraph, and counts the lines that end
+ * in a hyphen
+ */
+static void
+get_breaking_stats (PangoLayout *layout,
+                    double      *raggedness,
+                    int         *n_hyphens)
+{
+  const char *text = pango_layout_get_text (layout);
+  int width = pango_layout_get_width (layout);
+  GSList *l;
+
+  *raggedness = 0;
+  *n_hyphens = 0;
+
+  for (l = pango_layout_get_lines_readonly (layout); l; l = l->next)
+    {
+      PangoLayoutLine *line = l->data;
+      PangoLayoutLine *next = l->next ? l->next->data : NULL;
+      PangoRectangle logical;
+      const char *end = text + line->start_index + line->length;
+
+      if (!next || next->is_paragraph_start)
+        continue;
+
+      pango_layout_line_get_extents (line, NULL, &logical);
+      *raggedness += (double) (width - logical.width) * (width - logical.width);
+
+      if (line->length >= 2 && strncmp (end - 2, "\xc2\xad", 2) == 0)
+        (*n_hyphens)++;
+    }
+}
+
+/* Test that optimal line breaking does better than greedy line
+ * breaking for paragraphs where greedy breaking either leaves a
+ * nearly empty line or hyphenates a word needlessly
+ */
+static void
+test_layout_optimal_breaks_better (void)
+{
+  struct {
+    const char *text;
+    int columns;
+    int greedy_hyphens;
+  } tests[] = {
+    /* Greedy: "aaa bb" "cc" "ddddd", optimal: "aaa" "bb cc" "ddddd" */
+    { "aaa bb cc ddddd", 6, 0 },
+    /* Greedy: "aaaaaaaa aaaaaaaa aaaaaaaaa b-" "bbbb ccccccccccccccc" "dddddddddd",
+     * optimal: "aaaaaaaa aaaaaaaa aaaaaaaaa" "bbbbb ccccccccccccccc" "dddddddddd"
+     */
+    { "aaaaaaaa aaaaaaaa aaaaaaaaa b\xc2\xad""bbbb ccccccccccccccc dddddddddd", 30, 1 },
+  };
+  PangoContext *context;
+  PangoFontDescription *desc;
+  int i;
+
+  context = pango_font_map_create_context (pango_cairo_font_map_get_default ());
+  desc = pango_font_description_from_string ("Monospace 10");
+
+  for (i = 0; i < G_N_ELEMENTS (tests); i++)
+    {
+      PangoLayout *greedy, *optimal;
+      PangoRectangle logical;
+      double greedy_raggedness, optimal_raggedness;
+      int greedy_hyphens, optimal_hyphens;
+      int char_width;
+
+      greedy = pango_layout_new (context);
+      pango_layout_set_font_description (greedy, desc);
+
+      /* Make room for a number of characters, and half of one more */
+      pango_layout_set_text (greedy, "0000000000", -1);
+      pango_layout_get_extents (greedy, NULL, &logical);
+      char_width = logical.width / 10;
+
+      pango_layout_set_text (greedy, tests[i].text, -1);
+      pango_layout_set_width (greedy, tests[i].columns * char_width + char_width / 2);
+
+      optimal = pango_layout_copy (greedy);
+      pango_layout_set_line_breaking (optimal, PANGO_LINE_BREAKING_OPTIMAL);
+
+      get_breaking_stats (greedy, &greedy_raggedness, &greedy_hyphens);
+      get_breaking_stats (optimal, &optimal_raggedness, &optimal_hyphens);
+
+      g_assert_cmpint (pango_layout_get_line_count (greedy), ==, 3);
+      g_assert_cmpint (pango_layout_get_line_count (optimal), ==, 3);
+      g_assert_cmpint (pango_layout_get_line_readonly (optimal, 0)->length, <,
+                       pango_layout_get_line_readonly (greedy, 0)->length);
+
+      g_assert_cmpfloat (optimal_raggedness, <, greedy_raggedness);
+      g_assert_cmpint (greedy_hyphens, ==, tests[i].greedy_hyphens);
+      g_assert_cmpint (optimal_hyphens, ==, 0);
+
+      g_object_unref (greedy);
+      g_object_unref (optimal);
+    }
+
+  pango_font_description_free (desc);
+  g_object_unref (context);
+}
+
+/* A renderer that only counts how often it is asked to draw glyphs */
+typedef struct
+{
+  PangoRenderer parent_instance;
+  int n_draw_glyphs;
+} CountingRenderer;
+
+typedef struct
+{
+  PangoRendererClass parent_class;
+} CountingRendererClass;
+
+GType counting_renderer_get_type (void);
+
+G_DEFINE_TYPE (CountingRenderer, counting_renderer, PANGO_TYPE_RENDERER)
+
+static void
+counting_renderer_draw_glyphs (PangoRenderer    *renderer,
+                               PangoFont        *font,
+                               PangoGlyphString *glyphs,
+                               int               x,
+                               int               y)
+{
+  ((CountingRenderer *) renderer)->n_draw_glyphs++;
+}
+
+static void
+counting_renderer_init (CountingRenderer *renderer)
+{
+}
+
+static void
+counting_renderer_class_init (CountingRendererClass *klass)
+{
+  PANGO_RENDERER_CLASS (klass)->draw_glyphs = counting_renderer_draw_glyphs;
+}
+
+static PangoLayout *
+create_clip_test_layout (PangoContext *context)
+{
+  PangoLayout *layout;
+  GString *str;
+  int i;
+
+  str = g_string_new ("");
+  for (i = 0; i < 30; i++)
+    g_string_append_printf (str,
+                            "Line %d is <span foreground=\"red\">red</span> and "
+                            "<span foreground=\"blue\">blue</span> and goes on\n", i);
+
+  layout = pango_layout_new (context);
+  pango_layout_set_markup (layout, str->str, -1);
+  g_string_free (str, TRUE);
+
+  return layout;
+}
+
+static int
+count_runs (PangoLayout *layout,
+            int          first,
+            int          last)
+{
+  int i, n = 0;
+
+  for (i = MAX (first, 0); i <= last && i < pango_layout_get_line_count (layout); i++)
+    n += g_slist_length (pango_layout_get_line_readonly (layout, i)->runs);
+
+  return n;
+}
+
+/* Test that clipped drawing draws the runs in the clip
+ * rectangle, and not many more
+ */
+static void
+test_renderer_clip (void)
+{
+  PangoContext *context;
+  PangoLayout *layout;
+  CountingRenderer *renderer;
+  PangoLayoutIter *iter;
+  PangoRectangle logical, clip;
+  int x = 30 * PANGO_SCALE, y = -40 * PANGO_SCALE;
+  int n_all, n_lines, top, bottom;
+
+  context = pango_font_map_create_context (pango_cairo_font_map_get_default ());
+  layout = create_clip_test_layout (context);
+  renderer = g_object_new (counting_renderer_get_type (), NULL);
+
+  n_lines = pango_layout_get_line_count (layout);
+
+  pango_renderer_draw_layout (PANGO_RENDERER (renderer), layout, x, y);
+  n_all = renderer->n_draw_glyphs;
+  g_assert_cmpint (n_all, ==, count_runs (layout, 0, n_lines));
+
+  /* Lines 10 to 12 */
+  iter = pango_layout_get_iter_at_line (layout, 10);
+  pango_layout_iter_get_line_extents (iter, NULL, &logical);
+  top = logical.y;
+  pango_layout_iter_free (iter);
+
+  iter = pango_layout_get_iter_at_line (layout, 12);
+  pango_layout_iter_get_line_extents (iter, NULL, &logical);
+  bottom = logical.y + logical.height;
+  pango_layout_iter_free (iter);
+
+  pango_layout_get_extents (layout, NULL, &logical);
+  clip.x = x;
+  clip.y = y + top + PANGO_SCALE;
+  clip.width = logical.width;
+  clip.height = bottom - top - 2 * PANGO_SCALE;
+
+  renderer->n_draw_glyphs = 0;
+  pango_renderer_set_clip_rect (PANGO_RENDERER (renderer), &clip);
+  g_assert_nonnull (pango_renderer_get_clip_rect (PANGO_RENDERER (renderer)));
+  pango_renderer_draw_layout (PANGO_RENDERER (renderer), layout, x, y);
+  g_assert_cmpint (renderer->n_draw_glyphs, >=, count_runs (layout, 10, 12));
+  g_assert_cmpint (renderer->n_draw_glyphs, <=, count_runs (layout, 9, 13));
+
+  /* Only the start of the lines */
+  clip.x = x;
+  clip.y = y;
+  clip.width = 5 * PANGO_SCALE;
+  clip.height = logical.height;
+
+  renderer->n_draw_glyphs = 0;
+  pango_renderer_set_clip_rect (PANGO_RENDERER (renderer), &clip);
+  pango_renderer_draw_layout (PANGO_RENDERER (renderer), layout, x, y);
+  g_assert_cmpint (renderer->n_draw_glyphs, >=, n_lines - 1);
+  g_assert_cmpint (renderer->n_draw_glyphs, <, n_all / 2);
+
+  /* Nothing is clipped once the clip rectangle is unset */
+  renderer->n_draw_glyphs = 0;
+  pango_renderer_set_clip_rect (PANGO_RENDERER (renderer), NULL);
+  g_assert_null (pango_renderer_get_clip_rect (PANGO_RENDERER (renderer)));
+  pango_renderer_draw_layout (PANGO_RENDERER (renderer), layout, x, y);
+  g_assert_cmpint (renderer->n_draw_glyphs, ==, n_all);
+
+  g_object_unref (renderer);
+  g_object_unref (layout);
+  g_object_unref (context);
+}
+
+/* Test that pango_cairo_show_layout() draws the same inside
+ * of the clip of the cairo context as without a clip
+ */
+static void
+test_cairo_clip (void)
+{
+  cairo_surface_t *surface, *clipped_surface;
+  cairo_t *cr;
+  PangoContext *context;
+  PangoLayout *layout;
+  unsigned char *data, *clipped_data;
+  int stride, row, col;
+  int clip_x = 20, clip_y = 100, clip_width = 60, clip_height = 50;
+
+  surface = cairo_image_surface_create (CAIRO_FORMAT_ARGB32, 200, 300);
+  clipped_surface = cairo_image_surface_create (CAIRO_FORMAT_ARGB32, 200, 300);
+
+  cr = cairo_create (surface);
+  context = pango_cairo_create_context (cr);
+  layout = create_clip_test_layout (context);
+
+  cairo_move_to (cr, 3, -20);
+  pango_cairo_show_layout (cr, layout);
+  cairo_destroy (cr);
+
+  cr = cairo_create (clipped_surface);
+  cairo_rectangle (cr, clip_x, clip_y, clip_width, clip_height);
+  cairo_clip (cr);
+  cairo_move_to (cr, 3, -20);
+  pango_cairo_show_layout (cr, layout);
+  cairo_destroy (cr);
+
+  cairo_surface_flush (surface);
+  cairo_surface_flush (clipped_surface);
+
+  data = cairo_image_surface_get_data (surface);
+  clipped_data = cairo_image_surface_get_data (clipped_surface);
+  stride = cairo_image_surface_get_stride (surface);
+  g_assert_cmpint (stride, ==, cairo_image_surface_get_stride (clipped_surface));
+
+  for (row = clip_y; row < clip_y + clip_height; row++)
+    for (col = clip_x; col < clip_x + clip_width; col++)
+      g_assert_cmpuint (((guint32 *) (data + row * stride))[col], ==,
+                        ((guint32 *) (clipped_data + row * stride))[col]);
+
+  g_object_unref (layout);
+  g_object_unref (context);
+  cairo_surface_destroy (surface);
+  cairo_surface_destroy (clipped_surface);
+}
+
+/* Test that display lists draw the glyphs of the layout,
+ * and tell when the layout changed
+ */
+static void
+test_renderer_display_list (void)
+{
+  PangoContext *context;
+  PangoLayout *layout;
+  CountingRenderer *renderer;
+  PangoDisplayList *list;
+  PangoLayoutIter *iter;
+  PangoRectangle logical, clip;
+  int n_all, n_lines;
+
+  context = pango_font_map_create_context (pango_cairo_font_map_get_default ());
+  layout = create_clip_test_layout (context);
+  renderer = g_object_new (counting_renderer_get_type (), NULL);
+
+  n_lines = pango_layout_get_line_count (layout);
+
+  list = pango_display_list_new (layout);
+  g_assert_cmpuint (pango_display_list_get_serial (list), ==, pango_layout_get_serial (layout));
+
+  pango_renderer_draw_display_list (PANGO_RENDERER (renderer), list, 0, 0);
+  n_all = renderer->n_draw_glyphs;
+  g_assert_cmpint (n_all, >=, n_lines);
+  g_assert_cmpint (n_all, <=, count_runs (layout, 0, n_lines));
+
+  /* Only line 10 */
+  iter = pango_layout_get_iter_at_line (layout, 10);
+  pango_layout_iter_get_line_extents (iter, NULL, &logical);
+  pango_layout_iter_free (iter);
+
+  clip.x = 0;
+  clip.y = logical.y + logical.height / 2;
+  clip.width = logical.width;
+  clip.height = PANGO_SCALE;
+
+  renderer->n_draw_glyphs = 0;
+  pango_renderer_set_clip_rect (PANGO_RENDERER (renderer), &clip);
+  pango_renderer_draw_display_list (PANGO_RENDERER (renderer), list, 0, 0);
+  g_assert_cmpint (renderer->n_draw_glyphs, >=, 1);
+  g_assert_cmpint (renderer->n_draw_glyphs, <=, count_runs (layout, 9, 11));
+
+  /* The clip rectangle is relative to where the list is drawn */
+  renderer->n_draw_glyphs = 0;
+  pango_renderer_draw_display_list (PANGO_RENDERER (renderer), list, 0, 100 * logical.height);
+  g_assert_cmpint (renderer->n_draw_glyphs, ==, 0);
+
+  pango_layout_set_text (layout, "Changed", -1);
+  g_assert_cmpuint (pango_display_list_get_serial (list), !=, pango_layout_get_serial (layout));
+
+  pango_display_list_unref (list);
+  g_object_unref (renderer);
+  g_object_unref (layout);
+  g_object_unref (context);
+}
+
+/* Test that showing a display list draws the same
+ * as showing the layout it was recorded from
+ */
+static void
+test_cairo_display_list (void)
+{
+  cairo_surface_t *surface, *list_surface;
+  cairo_t *cr;
+  PangoContext *context;
+  PangoLayout *layout;
+  PangoDisplayList *list;
+  unsigned char *data, *list_data;
+  int stride, row, col;
+  gboolean drawn = FALSE;
+
+  surface = cairo_image_surface_create (CAIRO_FORMAT_ARGB32, 200, 300);
+  list_surface = cairo_image_surface_create (CAIRO_FORMAT_ARGB32, 200, 300);
+
+  cr = cairo_create (surface);
+  context = pango_cairo_create_context (cr);
+  layout = create_clip_test_layout (context);
+  list = pango_display_list_new (layout);
+
+  cairo_move_to (cr, 3, -20);
+  pango_cairo_show_layout (cr, layout);
+  cairo_destroy (cr);
+
+  cr = cairo_create (list_surface);
+  cairo_move_to (cr, 3, -20);
+  pango_cairo_show_display_list (cr, list, FALSE);
+  cairo_destroy (cr);
+
+  cairo_surface_flush (surface);
+  cairo_surface_flush (list_surface);
+
+  data = cairo_image_surface_get_data (surface);
+  list_data = cairo_image_surface_get_data (list_surface);
+  stride = cairo_image_surface_get_stride (surface);
+
+  for (row = 0; row < 300; row++)
+    g_assert_true (memcmp (data + row * stride, list_data + row * stride, 200 * 4) == 0);
+
+  /* With the colors overridden, nothing is red */
+  cr = cairo_create (list_surface);
+  cairo_set_operator (cr, CAIRO_OPERATOR_CLEAR);
+  cairo_paint (cr);
+  cairo_set_operator (cr, CAIRO_OPERATOR_OVER);
+  cairo_set_source_rgb (cr, 0, 1, 0);
+  cairo_move_to (cr, 3, -20);
+  pango_cairo_show_display_list (cr, list, TRUE);
+  cairo_destroy (cr);
+
+  cairo_surface_flush (list_surface);
+
+  for (row = 0; row < 300; row++)
+    for (col = 0; col < 200; col++)
+      {
+        guint32 pixel = ((guint32 *) (list_data + row * stride))[col];
+
+        g_assert_cmpuint ((pixel >> 16) & 0xff, ==, 0);
+        g_assert_cmpuint (pixel & 0xff, ==, 0);
+        if (pixel != 0)
+          drawn = TRUE;
+      }
+  g_assert_true (drawn);
+
+  pango_display_list_unref (list);
+  g_object_unref (layout);
+  g_object_unref (context);
+  cairo_surface_destroy (surface);
+  cairo_surface_destroy (list_surface);
+}
+
+static void
+count_shapes (cairo_t        *cr,
+              PangoAttrShape *attr,
+              gboolean        do_path,
+              gpointer        data)
+{
+  (*(int *) data)++;
+}
+
+/* Test that display lists still draw shapes after
+ * the layout was changed or freed
+ */
+static void
+test_cairo_display_list_shapes (void)
+{
+  cairo_surface_t *surface;
+  cairo_t *cr;
+  PangoContext *context;
+  PangoLayout *layout;
+  PangoDisplayList *list;
+  PangoAttrList *attrs;
+  PangoAttribute *attr;
+  PangoRectangle rect = { 0, -10 * PANGO_SCALE, 10 * PANGO_SCALE, 10 * PANGO_SCALE };
+  int n_shapes = 0;
+
+  surface = cairo_image_surface_create (CAIRO_FORMAT_ARGB32, 100, 100);
+  cr = cairo_create (surface);
+  context = pango_cairo_create_context (cr);
+  pango_cairo_context_set_shape_renderer (context, count_shapes, &n_shapes, NULL);
+
+  layout = pango_layout_new (context);
+  pango_layout_set_text (layout, "a\xef\xbf\xbcb", -1);
+  attrs = pango_attr_list_new ();
+  attr = pango_attr_shape_new (&rect, &rect);
+  attr->start_index = 1;
+  attr->end_index = 4;
+  pango_attr_list_insert (attrs, attr);
+  pango_layout_set_attributes (layout, attrs);
+  pango_attr_list_unref (attrs);
+
+  list = pango_display_list_new (layout);
+
+  cairo_move_to (cr, 10, 50);
+  pango_cairo_show_display_list (cr, list, FALSE);
+  g_assert_cmpint (n_shapes, ==, 1);
+
+  pango_layout_set_text (layout, "Changed", -1);
+  pango_layout_get_line_count (layout);
+  g_assert_cmpuint (pango_display_list_get_serial (list), !=, pango_layout_get_serial (layout));
+
+  cairo_move_to (cr, 10, 50);
+  pango_cairo_show_display_list (cr, list, FALSE);
+  g_assert_cmpint (n_shapes, ==, 2);
+
+  g_object_unref (layout);
+
+  cairo_move_to (cr, 10, 50);
+  pango_cairo_show_display_list (cr, list, FALSE);
+  g_assert_cmpint (n_shapes, ==, 3);
+
+  pango_display_list_unref (list);
+  g_object_unref (context);
+  cairo_destroy (cr);
+  cairo_surface_destroy (surface);
+}
+
+/* Test that glyph extents come out the same from the
+ * glyph extents cache, also after it had to grow
+ */
+static void
+test_glyph_extents_cache (void)
+{
+  PangoContext *context;
+  PangoFontDescription *desc;
+  PangoFont *font;
+  PangoRectangle *ink, *logical;
+  PangoRectangle ink2, logical2;
+  guint hits, misses, hits2, misses2;
+  int n_glyphs = 3000;
+  int i;
+
+  context = pango_font_map_create_context (pango_cairo_font_map_get_default ());
+  desc = pango_font_description_from_string ("Sans 12");
+  font = pango_context_load_font (context, desc);
+
+  ink = g_new (PangoRectangle, n_glyphs);
+  logical = g_new (PangoRectangle, n_glyphs);
+
+  for (i = 0; i < n_glyphs; i++)
+    pango_font_get_glyph_extents (font, i, &ink[i], &logical[i]);
+
+  pango_cairo_font_get_glyph_extents_cache_stats (PANGO_CAIRO_FONT (font), &hits, &misses);
+  g_assert_cmpuint (misses, >=, n_glyphs);
+
+  /* Access glyphs in a working set larger than the initial cache */
+  for (i = 0; i < 4 * n_glyphs; i++)
+    {
+      int glyph = (i * 7) % 1000;
+
+      pango_font_get_glyph_extents (font, glyph, &ink2, &logical2);
+      g_assert_true (memcmp (&ink2, &ink[glyph], sizeof (PangoRectangle)) == 0);
+      g_assert_true (memcmp (&logical2, &logical[glyph], sizeof (PangoRectangle)) == 0);
+    }
+
+  pango_cairo_font_get_glyph_extents_cache_stats (PANGO_CAIRO_FONT (font), &hits2, &misses2);
+  g_assert_cmpuint (hits2 + misses2, ==, hits + misses + 4 * n_glyphs);
+  g_assert_cmpuint (hits2 - hits, >, misses2 - misses);
+
+  g_free (ink);
+  g_free (logical);
+  g_object_unref (font);
+  pango_font_description_free (desc);
+  g_object_unref (context);
+}
+
 int
 main (int argc, char *argv[])
 {
@@ -111,6 +1607,26 @@ main (int argc, char *argv[])
   g_test_add_func ("/layout/itemize-utf8", test_itemize_utf8);
   g_test_add_func ("/layout/short-string-crash", test_short_string_crash);
   g_test_add_func ("/language/emoji-crash", test_language_emoji_crash);
+  g_test_add_func ("/layout/replace-text", test_layout_replace_text);
+  g_test_add_func ("/layout/markup-streaming", test_markup_streaming);
+  g_test_add_func ("/layout/markup-streaming/empty-end", test_markup_streaming_empty_end);
+  g_test_add_func ("/layout/lazy", test_layout_lazy);
+  g_test_add_func ("/layout/parallel", test_layout_parallel);
+  g_test_add_func ("/layout/paragraph-cache", test_layout_paragraph_cache);
+  g_test_add_func ("/layout/rewrap", test_layout_rewrap);
+  g_test_add_func ("/layout/optimal-breaks", test_layout_optimal_breaks);
+  g_test_add_func ("/layout/optimal-breaks/better", test_layout_optimal_breaks_better);
+  g_test_add_func ("/layout/line-table", test_layout_line_table);
+  g_test_add_func ("/layout/iter-at-line", test_layout_iter_at_line);
+  g_test_add_func ("/shape/cache", test_shape_cache);
+  g_test_add_func ("/shape/cache/font-lifetime", test_shape_cache_font_lifetime);
+  g_test_add_func ("/shape/show-flags", test_shape_show_flags);
+  g_test_add_func ("/cairo/glyph-extents-cache", test_glyph_extents_cache);
+  g_test_add_func ("/renderer/clip", test_renderer_clip);
+  g_test_add_func ("/cairo/clip", test_cairo_clip);
+  g_test_add_func ("/renderer/display-list", test_renderer_display_list);
+  g_test_add_func ("/cairo/display-list", test_cairo_display_list);
+  g_test_add_func ("/cairo/display-list-shapes", test_cairo_display_list_shapes);
 
   return g_test_run ();
 }